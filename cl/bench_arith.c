@@ -29,7 +29,10 @@ struct bench_arith {
     uint32_t type_size;
     uint32_t type_width;
 
+    struct u_bench_params bench_params;
+
     struct cl cl;
+    struct u_result result;
 
     uint32_t global_work_size;
     uint64_t target_ops;
@@ -150,6 +153,7 @@ bench_arith_init(struct bench_arith *test)
     };
     cl_init(cl, &params);
     cl_log("device: %s", cl->dev->name);
+    cl_init_result(cl, &test->result, "bench_arith");
 
     if (!strncmp(test->type_name, "half", 4) && !cl->dev->half_fp_config)
         cl_die("fp16 is not supported");
@@ -167,6 +171,7 @@ bench_arith_cleanup(struct bench_arith *test)
     cl_destroy_pipeline(cl, test->pipeline);
     cl_destroy_buffer(cl, test->buf);
 
+    u_result_cleanup(&test->result);
     cl_cleanup(cl);
 }
 
@@ -174,11 +179,13 @@ static void
 bench_arith_dispatch(struct bench_arith *test)
 {
     struct cl *cl = &test->cl;
-    const uint32_t loops = 4;
 
     cl_set_pipeline_arg(cl, test->pipeline, 0, &test->buf->mem, sizeof(test->buf->mem));
 
-    for (uint32_t i = 0; i < loops; i++) {
+    struct u_bench bench;
+    struct u_bench_stats stats;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
         cl_event ev;
 
         cl_enqueue_pipeline(cl, test->pipeline, test->global_work_size, 0, 0, 0, 0, 0, &ev);
@@ -191,10 +198,20 @@ bench_arith_dispatch(struct bench_arith *test)
         cl_get_event_profiling_info(cl, ev, CL_PROFILING_COMMAND_END, &end_ns, sizeof(end_ns));
         cl_destroy_event(cl, ev);
 
-        const uint32_t dur_us = (end_ns - start_ns) / 1000;
-        const float gops = (float)test->target_ops / (end_ns - start_ns);
-        cl_log("iter %d took %.3f ms: %.1f GOPS", i, (float)dur_us / 1000.0f, gops);
+        u_bench_add(&bench, end_ns - start_ns);
     }
+    u_bench_finish(&bench, &stats);
+
+    char str[128];
+    const float gops = (float)test->target_ops / stats.median;
+    cl_log("%.1f GOPS (%s)", gops, u_bench_stats_to_str(&stats, str, sizeof(str)));
+
+    struct u_result *res = &test->result;
+    u_result_set_param(res, "type", "%s", test->type_name);
+    u_result_set_param(res, "global_work_size", "%u", test->global_work_size);
+    u_result_set_param(res, "ops", "%" PRIu64, test->target_ops);
+    u_result_add(res, "throughput", gops, "GOPS");
+    u_result_add_bench_stats(res, "time", &stats);
 }
 
 int
@@ -202,6 +219,12 @@ main(int argc, char **argv)
 {
     struct bench_arith test = {
         .type_name = NULL,
+        .bench_params = {
+            .warmup = 1,
+            .min_repeat = 4,
+            .max_repeat = 20,
+            .max_cv = 0.02f,
+        },
     };
 
     if (argc != 2)
@@ -17,8 +17,10 @@ kernel void memcpy32(global uint *dst, global uint *src)       \n\
 struct bench_copy {
     size_t size;
     bool verify;
+    struct u_bench_params bench_params;
 
     struct cl cl;
+    struct u_result result;
 
     struct cl_buffer *src;
     struct cl_buffer *dst;
@@ -75,6 +77,7 @@ bench_copy_init(struct bench_copy *test)
     };
     cl_init(cl, &params);
     cl_log("device: %s", cl->dev->name);
+    cl_init_result(cl, &test->result, "bench_copy");
 
     bench_copy_init_size(test);
     bench_copy_init_buffers(test);
@@ -92,22 +95,46 @@ bench_copy_cleanup(struct bench_copy *test)
     cl_destroy_buffer(cl, test->dst);
     cl_destroy_buffer(cl, test->src);
 
+    u_result_cleanup(&test->result);
     cl_cleanup(cl);
 }
 
+static void
+bench_copy_report(struct bench_copy *test,
+                  const char *op,
+                  size_t size,
+                  const struct u_bench_stats *stats)
+{
+    char str[128];
+    const float gbps = (float)size / stats->median / 1.024f / 1.024f / 1.024f;
+    cl_log("%s %zu MiBs: %.1f GiB/s (%s)", op, size / 1024 / 1024, gbps,
+           u_bench_stats_to_str(stats, str, sizeof(str)));
+
+    struct u_result *res = &test->result;
+    u_result_clear_params(res);
+    u_result_set_param(res, "op", "%s", op);
+    u_result_set_param(res, "size", "%zu", size);
+    u_result_set_param(res, "skip_scale", "%d", SKIP_SCALE);
+    u_result_add(res, "throughput", gbps, "GiB/s");
+    u_result_add_bench_stats(res, "time", stats);
+}
+
 static void
 bench_copy_dispatch(struct bench_copy *test)
 {
     struct cl *cl = &test->cl;
     const size_t copy_size = test->size / SKIP_SCALE;
     const size_t count = copy_size / sizeof(cl_uint);
-    const uint32_t loops = 4;
 
     cl_set_pipeline_arg(cl, test->pipeline, 0, &test->dst->mem, sizeof(test->dst->mem));
     cl_set_pipeline_arg(cl, test->pipeline, 1, &test->src->mem, sizeof(test->src->mem));
 
     cl_log("skip scale %d", SKIP_SCALE);
-    for (uint32_t i = 0; i < loops; i++) {
+
+    struct u_bench bench;
+    struct u_bench_stats stats;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
         cl_event ev;
 
         cl_enqueue_pipeline(cl, test->pipeline, count, 0, 0, 0, 0, 0, &ev);
@@ -118,13 +145,12 @@ bench_copy_dispatch(struct bench_copy *test)
         cl_get_event_profiling_info(cl, ev, CL_PROFILING_COMMAND_START, &start_ns,
                                     sizeof(start_ns));
         cl_get_event_profiling_info(cl, ev, CL_PROFILING_COMMAND_END, &end_ns, sizeof(end_ns));
-        const uint32_t dur_us = (end_ns - start_ns) / 1000;
-        const float gbps = (float)copy_size / (end_ns - start_ns) / 1.024f / 1.024f / 1.024f;
-        cl_log("copying %zu MiBs took %.3f ms: %.1f GiB/s", copy_size / 1024 / 1024,
-               (float)dur_us / 1000.0f, gbps);
+        u_bench_add(&bench, end_ns - start_ns);
 
         cl_destroy_event(cl, ev);
     }
+    u_bench_finish(&bench, &stats);
+    bench_copy_report(test, "copying", copy_size, &stats);
 
     if (test->verify) {
         const cl_uint *src = cl_map_buffer(cl, test->src, CL_MAP_READ);
@@ -145,13 +171,18 @@ bench_copy_dispatch(struct bench_copy *test)
         memset(src, 0x7f, size);
         memcpy(dst, src, size);
 
-        const uint64_t start_ns = u_now();
-        memcpy(dst, src, size);
-        const uint64_t end_ns = u_now();
-        const uint64_t dur_us = (end_ns - start_ns) / 1000;
-        const float gbps = (float)size / (end_ns - start_ns) / 1.024f / 1.024f / 1.024f;
-        cl_log("cpu baseline: memcpy %zu MiBs took %.3f ms: %.1f GiB/s", size / 1024 / 1024,
-               (float)dur_us / 1000.0f, gbps);
+        u_bench_init(&bench, &test->bench_params);
+        while (u_bench_next(&bench)) {
+            const uint64_t start_ns = u_now();
+            memcpy(dst, src, size);
+            const uint64_t end_ns = u_now();
+            u_bench_add(&bench, end_ns - start_ns);
+        }
+        u_bench_finish(&bench, &stats);
+        bench_copy_report(test, "cpu baseline: memcpy", size, &stats);
+
+        free(src);
+        free(dst);
     }
 }
 
@@ -161,6 +192,12 @@ main(void)
     struct bench_copy test = {
         .size = 0,
         .verify = false,
+        .bench_params = {
+            .warmup = 1,
+            .min_repeat = 4,
+            .max_repeat = 20,
+            .max_cv = 0.02f,
+        },
     };
 
     bench_copy_init(&test);
@@ -18,8 +18,10 @@ struct bench_fill {
     size_t size;
     cl_uint val;
     bool verify;
+    struct u_bench_params bench_params;
 
     struct cl cl;
+    struct u_result result;
 
     struct cl_buffer *buf;
     struct cl_pipeline *pipeline;
@@ -70,6 +72,7 @@ bench_fill_init(struct bench_fill *test)
     };
     cl_init(cl, &params);
     cl_log("device: %s", cl->dev->name);
+    cl_init_result(cl, &test->result, "bench_fill");
 
     bench_fill_init_size(test);
     bench_fill_init_buffer(test);
@@ -85,22 +88,46 @@ bench_fill_cleanup(struct bench_fill *test)
     cl_destroy_pipeline(cl, test->pipeline);
     cl_destroy_buffer(cl, test->buf);
 
+    u_result_cleanup(&test->result);
     cl_cleanup(cl);
 }
 
+static void
+bench_fill_report(struct bench_fill *test,
+                  const char *op,
+                  size_t size,
+                  const struct u_bench_stats *stats)
+{
+    char str[128];
+    const float gbps = (float)size / stats->median / 1.024f / 1.024f / 1.024f;
+    cl_log("%s %zu MiBs: %.1f GiB/s (%s)", op, size / 1024 / 1024, gbps,
+           u_bench_stats_to_str(stats, str, sizeof(str)));
+
+    struct u_result *res = &test->result;
+    u_result_clear_params(res);
+    u_result_set_param(res, "op", "%s", op);
+    u_result_set_param(res, "size", "%zu", size);
+    u_result_set_param(res, "skip_scale", "%d", SKIP_SCALE);
+    u_result_add(res, "throughput", gbps, "GiB/s");
+    u_result_add_bench_stats(res, "time", stats);
+}
+
 static void
 bench_fill_dispatch(struct bench_fill *test)
 {
     struct cl *cl = &test->cl;
     const size_t fill_size = test->size / SKIP_SCALE;
     const size_t count = fill_size / sizeof(cl_uint);
-    const uint32_t loops = 4;
 
     cl_set_pipeline_arg(cl, test->pipeline, 0, &test->buf->mem, sizeof(test->buf->mem));
     cl_set_pipeline_arg(cl, test->pipeline, 1, &test->val, sizeof(test->val));
 
     cl_log("skip scale %d", SKIP_SCALE);
-    for (uint32_t i = 0; i < loops; i++) {
+
+    struct u_bench bench;
+    struct u_bench_stats stats;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
         cl_event ev;
 
         cl_enqueue_pipeline(cl, test->pipeline, count, 0, 0, 0, 0, 0, &ev);
@@ -111,13 +138,12 @@ bench_fill_dispatch(struct bench_fill *test)
         cl_get_event_profiling_info(cl, ev, CL_PROFILING_COMMAND_START, &start_ns,
                                     sizeof(start_ns));
         cl_get_event_profiling_info(cl, ev, CL_PROFILING_COMMAND_END, &end_ns, sizeof(end_ns));
-        const uint32_t dur_us = (end_ns - start_ns) / 1000;
-        const float gbps = (float)fill_size / (end_ns - start_ns) / 1.024f / 1.024f / 1.024f;
-        cl_log("filling %zu MiBs took %.3f ms: %.1f GiB/s", fill_size / 1024 / 1024,
-               (float)dur_us / 1000.0f, gbps);
+        u_bench_add(&bench, end_ns - start_ns);
 
         cl_destroy_event(cl, ev);
     }
+    u_bench_finish(&bench, &stats);
+    bench_fill_report(test, "filling", fill_size, &stats);
 
     if (test->verify) {
         const cl_uint *ptr = cl_map_buffer(cl, test->buf, CL_MAP_READ);
@@ -134,13 +160,17 @@ bench_fill_dispatch(struct bench_fill *test)
         void *buf = malloc(size);
         memset(buf, 0x7f, size);
 
-        const uint64_t start_ns = u_now();
-        memset(buf, 0x7f, size);
-        const uint64_t end_ns = u_now();
-        const uint64_t dur_us = (end_ns - start_ns) / 1000;
-        const float gbps = (float)size / (end_ns - start_ns) / 1.024f / 1.024f / 1.024f;
-        cl_log("cpu baseline: memset %zu MiBs took %.3f ms: %.1f GiB/s", size / 1024 / 1024,
-               (float)dur_us / 1000.0f, gbps);
+        u_bench_init(&bench, &test->bench_params);
+        while (u_bench_next(&bench)) {
+            const uint64_t start_ns = u_now();
+            memset(buf, 0x7f, size);
+            const uint64_t end_ns = u_now();
+            u_bench_add(&bench, end_ns - start_ns);
+        }
+        u_bench_finish(&bench, &stats);
+        bench_fill_report(test, "cpu baseline: memset", size, &stats);
+
+        free(buf);
     }
 }
 
@@ -151,6 +181,12 @@ main(void)
         .size = 0,
         .val = 0x12345677,
         .verify = false,
+        .bench_params = {
+            .warmup = 1,
+            .min_repeat = 4,
+            .max_repeat = 20,
+            .max_cv = 0.02f,
+        },
     };
 
     bench_fill_init(&test);
@@ -118,13 +118,21 @@ tflite_bhwc_to_tensor_test_dispatch(struct tflite_bhwc_to_tensor_test *test)
     cl_set_pipeline_arg(cl, test->pipeline, 2, &shared[0], sizeof(shared[0]));
     cl_set_pipeline_arg(cl, test->pipeline, 3, &shared[1], sizeof(shared[1]));
 
+    const size_t global_size[3] = { test->width, test->height, 0 };
+    size_t local_size[3] = { 256, 1, 1 };
+    char shape[256];
+    snprintf(shape, sizeof(shape), "tflite_bhwc_to_tensor %dx%dx%d b%d", test->width,
+             test->height, test->channels, test->batches);
+    cl_tune_pipeline(cl, test->pipeline, shape, global_size, local_size);
+
     for (uint32_t i = 0; i < loops; i++) {
         cl_event start_ev;
         cl_event end_ev;
 
         for (uint32_t j = 0; j < dispatches; j++) {
             cl_event *ev = j == 0 ? &start_ev : j == dispatches - 1 ? &end_ev : NULL;
-            cl_enqueue_pipeline(cl, test->pipeline, test->width, test->height, 0, 256, 1, 1, ev);
+            cl_enqueue_pipeline(cl, test->pipeline, global_size[0], global_size[1],
+                                global_size[2], local_size[0], local_size[1], local_size[2], ev);
         }
         if (dispatches == 1)
             end_ev = cl_retain_event(cl, start_ev);
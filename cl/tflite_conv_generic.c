@@ -484,6 +484,9 @@ struct tflite_conv_generic_test {
     cl_int stride_y;
     cl_int dilation_x;
     cl_int dilation_y;
+    float activation_min;
+
+    float tolerance;
 
     size_t buf_size;
     size_t src_offset;
@@ -502,6 +505,24 @@ struct tflite_conv_generic_test {
     struct cl_buffer *weight_buf;
 
     struct cl_pipeline *pipeline;
+
+    cl_half *src_data;
+    cl_half *bias_data;
+    cl_half *weight_data;
+    cl_half *ref_data;
+    uint64_t gpu_ns;
+
+    struct u_result result;
+};
+
+struct tflite_conv_generic_test_ref {
+    const struct tflite_conv_generic_test *test;
+    enum u_simd_level level;
+    cl_ref_row_func row;
+
+    /* per slice pair, tap and src slice, the 4x4 weights of both dst slices interleaved */
+    float *weights;
+    float *biases;
 };
 
 static void
@@ -514,6 +535,7 @@ tflite_conv_generic_test_init(struct tflite_conv_generic_test *test)
     };
     cl_init(cl, &params);
     cl_log("device: %s", cl->dev->name);
+    cl_init_result(cl, &test->result, "tflite_conv_generic");
 
     if (!cl->dev->half_fp_config)
         cl_die("fp16 is not supported");
@@ -530,6 +552,12 @@ tflite_conv_generic_test_init(struct tflite_conv_generic_test *test)
         cl_create_image(cl, CL_MEM_READ_WRITE, CL_RGBA, CL_HALF_FLOAT,
                         CL_MEM_OBJECT_IMAGE1D_BUFFER, src_count, 0, test->src_buf->mem, NULL);
 
+    test->src_data = malloc(test->src_size);
+    if (!test->src_data)
+        cl_die("failed to alloc src data");
+    cl_fill_random_half(test->src_data, src_count * 4, 1.0f);
+    cl_write_buffer(cl, test->src_buf, test->src_data, test->src_size);
+
     const size_t dst_count = test->dst_width * test->dst_height * test->dst_slice_count;
     if (test->dst_size != sizeof(cl_half4) * dst_count)
         cl_die("bad dst size");
@@ -537,18 +565,30 @@ tflite_conv_generic_test_init(struct tflite_conv_generic_test *test)
     test->dst_buf =
         cl_suballoc_buffer(cl, test->buf, CL_MEM_READ_WRITE, test->dst_offset, test->dst_size);
 
+    test->ref_data = malloc(test->dst_size);
+    if (!test->ref_data)
+        cl_die("failed to alloc ref data");
+
     const size_t bias_size = sizeof(cl_half4) * test->dst_slice_count;
-    cl_half4 *biases = calloc(1, bias_size);
-    test->bias_buf =
-        cl_create_buffer(cl, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, bias_size, biases);
-    free(biases);
-
-    const size_t weight_size =
-        sizeof(cl_half4) * test->src_slice_count * 8 * test->kernel_width * test->kernel_height;
-    cl_half4 *weights = calloc(1, weight_size);
-    test->weight_buf =
-        cl_create_buffer(cl, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, weight_size, weights);
-    free(weights);
+    test->bias_data = malloc(bias_size);
+    if (!test->bias_data)
+        cl_die("failed to alloc bias data");
+    cl_fill_random_half(test->bias_data, test->dst_slice_count * 4, 0.5f);
+    test->bias_buf = cl_create_buffer(cl, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, bias_size,
+                                      test->bias_data);
+
+    /* dst slices are processed in pairs */
+    const int tap_count = test->kernel_width * test->kernel_height;
+    const size_t weight_count =
+        DIV_ROUND_UP(test->dst_slice_count, 2) * tap_count * test->src_slice_count * 8;
+    const size_t weight_size = sizeof(cl_half4) * weight_count;
+    test->weight_data = malloc(weight_size);
+    if (!test->weight_data)
+        cl_die("failed to alloc weight data");
+    const float weight_scale = cl_get_ref_weight_scale(tap_count * test->src_slice_count * 4);
+    cl_fill_random_half(test->weight_data, weight_count * 4, weight_scale);
+    test->weight_buf = cl_create_buffer(cl, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                                        weight_size, test->weight_data);
 
     test->pipeline = cl_create_pipeline(cl, tflite_conv_generic_test_cs, "main_function");
 }
@@ -568,6 +608,12 @@ tflite_conv_generic_test_cleanup(struct tflite_conv_generic_test *test)
     cl_destroy_buffer(cl, test->src_buf);
     cl_destroy_buffer(cl, test->buf);
 
+    free(test->src_data);
+    free(test->bias_data);
+    free(test->weight_data);
+    free(test->ref_data);
+
+    u_result_cleanup(&test->result);
     cl_cleanup(cl);
 }
 
@@ -614,17 +660,34 @@ tflite_conv_generic_test_dispatch(struct tflite_conv_generic_test *test)
     cl_set_pipeline_arg(cl, test->pipeline, 6, &shared[2], sizeof(shared[2]));
     cl_set_pipeline_arg(cl, test->pipeline, 7, &shared[3], sizeof(shared[3]));
 
-    const cl_half4 what[] = { 0 };
+    const cl_half4 what = {
+        .x = u_float_to_half(test->activation_min),
+    };
     cl_set_pipeline_arg(cl, test->pipeline, 8, &what, sizeof(what));
 
+    const size_t global_size[3] = {
+        (size_t)DIV_ROUND_UP(test->dst_width, 4),
+        (size_t)DIV_ROUND_UP(test->dst_height, 2),
+        (size_t)DIV_ROUND_UP(test->dst_slice_count, 2),
+    };
+    size_t local_size[3] = { 128, 2, 1 };
+    char shape[256];
+    snprintf(shape, sizeof(shape),
+             "tflite_conv_generic %dx%dx%d-%dx%dx%d k%dx%d s%dx%d d%dx%d",
+             test->src_width, test->src_height, test->src_slice_count, test->dst_width,
+             test->dst_height, test->dst_slice_count, test->kernel_width, test->kernel_height,
+             test->stride_x, test->stride_y, test->dilation_x, test->dilation_y);
+    cl_tune_pipeline(cl, test->pipeline, shape, global_size, local_size);
+
+    test->gpu_ns = UINT64_MAX;
     for (uint32_t i = 0; i < loops; i++) {
         cl_event start_ev;
         cl_event end_ev;
 
         for (uint32_t j = 0; j < dispatches; j++) {
             cl_event *ev = j == 0 ? &start_ev : j == dispatches - 1 ? &end_ev : NULL;
-            cl_enqueue_pipeline(cl, test->pipeline, test->dst_width / 4, test->dst_height / 2, 1,
-                                128, 2, 1, ev);
+            cl_enqueue_pipeline(cl, test->pipeline, global_size[0], global_size[1],
+                                global_size[2], local_size[0], local_size[1], local_size[2], ev);
         }
         if (dispatches == 1)
             end_ev = cl_retain_event(cl, start_ev);
@@ -642,9 +705,319 @@ tflite_conv_generic_test_dispatch(struct tflite_conv_generic_test *test)
 
         const float dur_ms = (float)(end_ns - start_ns) / 1000000;
         cl_log("iter %d took %.3f ms", i, dur_ms);
+
+        const uint64_t dispatch_ns = (end_ns - start_ns) / dispatches;
+        if (test->gpu_ns > dispatch_ns)
+            test->gpu_ns = dispatch_ns;
+    }
+}
+
+/* computes the fp32 sums of one dst row for a pair of dst slices */
+static void
+tflite_conv_generic_test_ref_row(const void *data,
+                                 float *dst,
+                                 const float *const *src_rows,
+                                 const float *weights)
+{
+    const struct tflite_conv_generic_test *test = data;
+    const int row_size = test->src_width * 4;
+    const int tap_size = test->src_slice_count * 32;
+
+    for (int x = 0; x < test->dst_width; x++) {
+        float sums[2][4] = { 0 };
+        for (int ky = 0; ky < test->kernel_height; ky++) {
+            if (!src_rows[ky])
+                continue;
+            for (int kx = 0; kx < test->kernel_width; kx++) {
+                const int src_x = x * test->stride_x + test->padding_x + kx * test->dilation_x;
+                if (src_x < 0 || src_x >= test->src_width)
+                    continue;
+
+                const float *src = src_rows[ky] + src_x * 4;
+                const float *w = weights + (ky * test->kernel_width + kx) * tap_size;
+                for (int s = 0; s < test->src_slice_count; s++) {
+                    for (int i = 0; i < 4; i++) {
+                        for (int c = 0; c < 4; c++) {
+                            sums[0][c] += w[8 * i + c] * src[i];
+                            sums[1][c] += w[8 * i + 4 + c] * src[i];
+                        }
+                    }
+                    src += row_size;
+                    w += 32;
+                }
+            }
+        }
+
+        memcpy(dst + x * 4, sums[0], sizeof(sums[0]));
+        memcpy(dst + (test->dst_width + x) * 4, sums[1], sizeof(sums[1]));
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+static __attribute__((target("sse4.1"))) void
+tflite_conv_generic_test_ref_row_sse41(const void *data,
+                                       float *dst,
+                                       const float *const *src_rows,
+                                       const float *weights)
+{
+    const struct tflite_conv_generic_test *test = data;
+    const int row_size = test->src_width * 4;
+    const int tap_size = test->src_slice_count * 32;
+
+    for (int x = 0; x < test->dst_width; x++) {
+        __m128 sums[2] = { _mm_setzero_ps(), _mm_setzero_ps() };
+        for (int ky = 0; ky < test->kernel_height; ky++) {
+            if (!src_rows[ky])
+                continue;
+            for (int kx = 0; kx < test->kernel_width; kx++) {
+                const int src_x = x * test->stride_x + test->padding_x + kx * test->dilation_x;
+                if (src_x < 0 || src_x >= test->src_width)
+                    continue;
+
+                const float *src = src_rows[ky] + src_x * 4;
+                const float *w = weights + (ky * test->kernel_width + kx) * tap_size;
+                for (int s = 0; s < test->src_slice_count; s++) {
+                    for (int i = 0; i < 4; i++) {
+                        const __m128 val = _mm_set1_ps(src[i]);
+                        sums[0] = _mm_add_ps(sums[0], _mm_mul_ps(_mm_loadu_ps(w + 8 * i), val));
+                        sums[1] =
+                            _mm_add_ps(sums[1], _mm_mul_ps(_mm_loadu_ps(w + 8 * i + 4), val));
+                    }
+                    src += row_size;
+                    w += 32;
+                }
+            }
+        }
+
+        _mm_storeu_ps(dst + x * 4, sums[0]);
+        _mm_storeu_ps(dst + (test->dst_width + x) * 4, sums[1]);
+    }
+}
+
+static __attribute__((target("avx2,fma"))) void
+tflite_conv_generic_test_ref_row_avx2(const void *data,
+                                      float *dst,
+                                      const float *const *src_rows,
+                                      const float *weights)
+{
+    const struct tflite_conv_generic_test *test = data;
+    const int row_size = test->src_width * 4;
+    const int tap_size = test->src_slice_count * 32;
+
+    for (int x = 0; x < test->dst_width; x++) {
+        /* both dst slices in one vector; one chain per src channel to hide the fma latency */
+        __m256 sums[4] = { _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(),
+                           _mm256_setzero_ps() };
+        for (int ky = 0; ky < test->kernel_height; ky++) {
+            if (!src_rows[ky])
+                continue;
+            for (int kx = 0; kx < test->kernel_width; kx++) {
+                const int src_x = x * test->stride_x + test->padding_x + kx * test->dilation_x;
+                if (src_x < 0 || src_x >= test->src_width)
+                    continue;
+
+                const float *src = src_rows[ky] + src_x * 4;
+                const float *w = weights + (ky * test->kernel_width + kx) * tap_size;
+                for (int s = 0; s < test->src_slice_count; s++) {
+                    for (int i = 0; i < 4; i++) {
+                        sums[i] = _mm256_fmadd_ps(_mm256_loadu_ps(w + 8 * i),
+                                                  _mm256_broadcast_ss(src + i), sums[i]);
+                    }
+                    src += row_size;
+                    w += 32;
+                }
+            }
+        }
+
+        const __m256 sum =
+            _mm256_add_ps(_mm256_add_ps(sums[0], sums[1]), _mm256_add_ps(sums[2], sums[3]));
+        _mm_storeu_ps(dst + x * 4, _mm256_castps256_ps128(sum));
+        _mm_storeu_ps(dst + (test->dst_width + x) * 4, _mm256_extractf128_ps(sum, 1));
+    }
+}
+
+#elif defined(__aarch64__)
+
+static void
+tflite_conv_generic_test_ref_row_neon(const void *data,
+                                      float *dst,
+                                      const float *const *src_rows,
+                                      const float *weights)
+{
+    const struct tflite_conv_generic_test *test = data;
+    const int row_size = test->src_width * 4;
+    const int tap_size = test->src_slice_count * 32;
+
+    for (int x = 0; x < test->dst_width; x++) {
+        float32x4_t sums[2] = { vdupq_n_f32(0.0f), vdupq_n_f32(0.0f) };
+        for (int ky = 0; ky < test->kernel_height; ky++) {
+            if (!src_rows[ky])
+                continue;
+            for (int kx = 0; kx < test->kernel_width; kx++) {
+                const int src_x = x * test->stride_x + test->padding_x + kx * test->dilation_x;
+                if (src_x < 0 || src_x >= test->src_width)
+                    continue;
+
+                const float *src = src_rows[ky] + src_x * 4;
+                const float *w = weights + (ky * test->kernel_width + kx) * tap_size;
+                for (int s = 0; s < test->src_slice_count; s++) {
+                    const float32x4_t val = vld1q_f32(src);
+                    sums[0] = vfmaq_laneq_f32(sums[0], vld1q_f32(w + 0), val, 0);
+                    sums[1] = vfmaq_laneq_f32(sums[1], vld1q_f32(w + 4), val, 0);
+                    sums[0] = vfmaq_laneq_f32(sums[0], vld1q_f32(w + 8), val, 1);
+                    sums[1] = vfmaq_laneq_f32(sums[1], vld1q_f32(w + 12), val, 1);
+                    sums[0] = vfmaq_laneq_f32(sums[0], vld1q_f32(w + 16), val, 2);
+                    sums[1] = vfmaq_laneq_f32(sums[1], vld1q_f32(w + 20), val, 2);
+                    sums[0] = vfmaq_laneq_f32(sums[0], vld1q_f32(w + 24), val, 3);
+                    sums[1] = vfmaq_laneq_f32(sums[1], vld1q_f32(w + 28), val, 3);
+                    src += row_size;
+                    w += 32;
+                }
+            }
+        }
+
+        vst1q_f32(dst + x * 4, sums[0]);
+        vst1q_f32(dst + (test->dst_width + x) * 4, sums[1]);
     }
 }
 
+#endif
+
+static const cl_ref_row_func tflite_conv_generic_test_ref_row_funcs[U_SIMD_LEVEL_COUNT] = {
+    [U_SIMD_LEVEL_NONE] = tflite_conv_generic_test_ref_row,
+#if defined(__x86_64__) || defined(__i386__)
+    [U_SIMD_LEVEL_SSE41] = tflite_conv_generic_test_ref_row_sse41,
+    [U_SIMD_LEVEL_AVX2] = tflite_conv_generic_test_ref_row_avx2,
+#elif defined(__aarch64__)
+    [U_SIMD_LEVEL_NEON] = tflite_conv_generic_test_ref_row_neon,
+#endif
+};
+
+static void
+tflite_conv_generic_test_ref_rows(void *data, uint32_t begin, uint32_t end)
+{
+    const struct tflite_conv_generic_test_ref *ref = data;
+    const struct tflite_conv_generic_test *test = ref->test;
+    const int row_size = test->src_width * 4;
+    const int pair_size = test->kernel_width * test->kernel_height * test->src_slice_count * 32;
+
+    float *src_data = malloc(sizeof(float) * row_size * test->src_slice_count *
+                             test->kernel_height);
+    const float **src_rows = malloc(sizeof(*src_rows) * test->kernel_height);
+    float *dst = malloc(sizeof(float) * 2 * test->dst_width * 4);
+    if (!src_data || !src_rows || !dst)
+        cl_die("failed to alloc ref rows");
+
+    for (uint32_t i = begin; i < end; i++) {
+        const int pair = i / test->dst_height;
+        const int y = i % test->dst_height;
+
+        for (int ky = 0; ky < test->kernel_height; ky++) {
+            const int src_y = y * test->stride_y + test->padding_y + ky * test->dilation_y;
+            if (src_y < 0 || src_y >= test->src_height) {
+                src_rows[ky] = NULL;
+                continue;
+            }
+
+            float *row = src_data + row_size * test->src_slice_count * ky;
+            for (int s = 0; s < test->src_slice_count; s++) {
+                const cl_half *src =
+                    test->src_data + ((s * test->src_height + src_y) * test->src_width) * 4;
+                u_convert_half_to_float(row + row_size * s, src, row_size, ref->level);
+            }
+            src_rows[ky] = row;
+        }
+
+        ref->row(test, dst, src_rows, ref->weights + pair_size * pair);
+
+        for (int j = 0; j < 2; j++) {
+            const int s = pair * 2 + j;
+            if (s >= test->dst_slice_count)
+                break;
+
+            float *sums = dst + test->dst_width * 4 * j;
+            for (int x = 0; x < test->dst_width * 4; x++) {
+                const float val = sums[x] + ref->biases[s * 4 + x % 4];
+                sums[x] = val > test->activation_min ? val : test->activation_min;
+            }
+
+            cl_half *row = test->ref_data + ((s * test->dst_height + y) * test->dst_width) * 4;
+            u_convert_float_to_half(row, sums, test->dst_width * 4, ref->level);
+        }
+    }
+
+    free(dst);
+    free(src_rows);
+    free(src_data);
+}
+
+static void
+tflite_conv_generic_test_ref(void *data, enum u_simd_level level, uint32_t thread_count)
+{
+    struct tflite_conv_generic_test *test = data;
+    const int pair_count = DIV_ROUND_UP(test->dst_slice_count, 2);
+    const int tap_count = test->kernel_width * test->kernel_height * test->src_slice_count;
+
+    struct tflite_conv_generic_test_ref ref = {
+        .test = test,
+        .level = level,
+        .row = cl_get_ref_row(tflite_conv_generic_test_ref_row_funcs, level),
+        .weights = malloc(sizeof(float) * pair_count * tap_count * 32),
+        .biases = malloc(sizeof(float) * test->dst_slice_count * 4),
+    };
+    if (!ref.weights || !ref.biases)
+        cl_die("failed to alloc ref weights");
+
+    /* the kernel reads 4 half4 per dst slice; interleave the two dst slices per src channel */
+    for (int i = 0; i < pair_count * tap_count; i++) {
+        const cl_half *src = test->weight_data + 32 * i;
+        float *dst = ref.weights + 32 * i;
+        for (int j = 0; j < 2; j++) {
+            for (int ch = 0; ch < 4; ch++)
+                u_convert_half_to_float(dst + 8 * ch + 4 * j, src + 16 * j + 4 * ch, 4, level);
+        }
+    }
+    u_convert_half_to_float(ref.biases, test->bias_data, test->dst_slice_count * 4, level);
+
+    u_parallel_for(pair_count * test->dst_height, 1, thread_count,
+                   tflite_conv_generic_test_ref_rows, &ref);
+
+    free(ref.biases);
+    free(ref.weights);
+}
+
+/* the kernel reads texel -1 for padding, whose value the spec leaves undefined */
+static bool
+tflite_conv_generic_test_is_padded(const void *data, int x, int y)
+{
+    const struct tflite_conv_generic_test *test = data;
+    const int x_min = x * test->stride_x + test->padding_x;
+    const int x_max = x_min + (test->kernel_width - 1) * test->dilation_x;
+    const int y_min = y * test->stride_y + test->padding_y;
+    const int y_max = y_min + (test->kernel_height - 1) * test->dilation_y;
+
+    return x_min < 0 || x_max >= test->src_width || y_min < 0 || y_max >= test->src_height;
+}
+
+static void
+tflite_conv_generic_test_validate(struct tflite_conv_generic_test *test)
+{
+    const struct cl_ref ref = {
+        .test = test,
+        .run = tflite_conv_generic_test_ref,
+        .skip = tflite_conv_generic_test_is_padded,
+        .width = test->dst_width,
+        .height = test->dst_height,
+        .slice_count = test->dst_slice_count,
+        .ref_data = test->ref_data,
+        .tolerance = test->tolerance,
+        .gpu_ns = test->gpu_ns,
+        .result = &test->result,
+    };
+    cl_validate_ref(&test->cl, &ref, test->dst_buf);
+}
+
 int
 main(void)
 {
@@ -665,6 +1038,9 @@ main(void)
         .stride_y = 1,
         .dilation_x = 1,
         .dilation_y = 1,
+        .activation_min = 0.0f,
+
+        .tolerance = 1.0f / 32.0f,
 
         .buf_size = 14155776,
         .src_offset = 0,
@@ -675,6 +1051,7 @@ main(void)
 
     tflite_conv_generic_test_init(&test);
     tflite_conv_generic_test_dispatch(&test);
+    tflite_conv_generic_test_validate(&test);
     tflite_conv_generic_test_cleanup(&test);
 
     return 0;
@@ -13,12 +13,13 @@ struct tflite_conv_simple_test {
     cl_int width;
     cl_int height;
     cl_int slice_count;
-
     cl_int reduce_width;
     cl_int reduce_height;
     cl_int kernel_width;
     cl_int kernel_height;
 
+    float tolerance;
+
     struct cl cl;
 
     struct cl_buffer *src_buf;
@@ -27,6 +28,21 @@ struct tflite_conv_simple_test {
     struct cl_buffer *weight_buf;
 
     struct cl_pipeline *pipeline;
+
+    cl_half *src_data;
+    cl_half *weight_data;
+    cl_half *ref_data;
+    uint64_t gpu_ns;
+
+    struct u_result result;
+};
+
+struct tflite_conv_simple_test_ref {
+    const struct tflite_conv_simple_test *test;
+    enum u_simd_level level;
+    cl_ref_row_func row;
+
+    float *weights;
 };
 
 static void
@@ -39,10 +55,15 @@ tflite_conv_simple_test_init(struct tflite_conv_simple_test *test)
     };
     cl_init(cl, &params);
     cl_log("device: %s", cl->dev->name);
+    cl_init_result(cl, &test->result, "tflite_conv_simple");
 
     if (!cl->dev->half_fp_config)
         cl_die("fp16 is not supported");
 
+    /* the kernel hardcodes the reduction */
+    if (test->reduce_width != 4 || test->reduce_height != 4)
+        cl_die("bad reduce size");
+
     const size_t src_count = test->width * test->height * test->slice_count;
     const size_t src_size = sizeof(cl_half4) * src_count;
     test->src_buf = cl_create_buffer(cl, CL_MEM_READ_WRITE, src_size, NULL);
@@ -50,15 +71,33 @@ tflite_conv_simple_test_init(struct tflite_conv_simple_test *test)
         cl_create_image(cl, CL_MEM_READ_WRITE, CL_RGBA, CL_HALF_FLOAT,
                         CL_MEM_OBJECT_IMAGE1D_BUFFER, src_count, 0, test->src_buf->mem, NULL);
 
+    test->src_data = malloc(src_size);
+    if (!test->src_data)
+        cl_die("failed to alloc src data");
+    cl_fill_random_half(test->src_data, src_count * 4, 1.0f);
+    cl_write_buffer(cl, test->src_buf, test->src_data, src_size);
+
     const size_t dst_count =
         (test->width / test->reduce_width) * (test->height / test->reduce_height);
     const size_t dst_size = sizeof(cl_half4) * dst_count;
     test->dst_buf = cl_create_buffer(cl, CL_MEM_READ_WRITE, dst_size, NULL);
 
+    test->ref_data = malloc(dst_size);
+    if (!test->ref_data)
+        cl_die("failed to alloc ref data");
+
     const size_t weight_count = test->kernel_width * test->kernel_height * test->slice_count;
     const size_t weight_size = sizeof(cl_half4) * weight_count;
     test->weight_buf = cl_create_buffer(cl, CL_MEM_READ_WRITE, weight_size, NULL);
 
+    test->weight_data = malloc(weight_size);
+    if (!test->weight_data)
+        cl_die("failed to alloc weight data");
+    const float weight_scale =
+        cl_get_ref_weight_scale(weight_count * test->reduce_width * test->reduce_height);
+    cl_fill_random_half(test->weight_data, weight_count * 4, weight_scale);
+    cl_write_buffer(cl, test->weight_buf, test->weight_data, weight_size);
+
     test->pipeline = cl_create_pipeline(cl, tflite_conv_simple_test_cs, "convert");
 }
 
@@ -70,11 +109,15 @@ tflite_conv_simple_test_cleanup(struct tflite_conv_simple_test *test)
     cl_destroy_pipeline(cl, test->pipeline);
 
     cl_destroy_buffer(cl, test->weight_buf);
-
     cl_destroy_buffer(cl, test->dst_buf);
     cl_destroy_image(cl, test->src_img);
     cl_destroy_buffer(cl, test->src_buf);
 
+    free(test->src_data);
+    free(test->weight_data);
+    free(test->ref_data);
+
+    u_result_cleanup(&test->result);
     cl_cleanup(cl);
 }
 
@@ -105,10 +148,23 @@ tflite_conv_simple_test_dispatch(struct tflite_conv_simple_test *test)
     cl_set_pipeline_arg(cl, test->pipeline, 3, &args[0], sizeof(args[0]));
     cl_set_pipeline_arg(cl, test->pipeline, 4, &args[1], sizeof(args[1]));
 
+    const size_t global_size[3] = {
+        (size_t)(test->width / test->reduce_width),
+        (size_t)(test->height / test->reduce_height),
+        repeat,
+    };
+    size_t local_size[3] = { 8, 8, 1 };
+    char shape[256];
+    snprintf(shape, sizeof(shape), "tflite_conv_simple %dx%dx%d r%dx%d k%dx%d", test->width,
+             test->height, test->slice_count, test->reduce_width, test->reduce_height,
+             test->kernel_width, test->kernel_height);
+    cl_tune_pipeline(cl, test->pipeline, shape, global_size, local_size);
+
+    test->gpu_ns = UINT64_MAX;
     for (uint32_t i = 0; i < loops; i++) {
         cl_event ev;
-        cl_enqueue_pipeline(cl, test->pipeline, test->width / test->reduce_width,
-                            test->height / test->reduce_height, repeat, 8, 8, 1, &ev);
+        cl_enqueue_pipeline(cl, test->pipeline, global_size[0], global_size[1], global_size[2],
+                            local_size[0], local_size[1], local_size[2], &ev);
         cl_finish(cl);
 
         cl_ulong start_ns;
@@ -120,7 +176,264 @@ tflite_conv_simple_test_dispatch(struct tflite_conv_simple_test *test)
 
         const float dur_ms = (float)(end_ns - start_ns) / 1000000;
         cl_log("iter %d took %.3f ms", i, dur_ms);
+
+        /* each dispatch computes the convolution repeat times */
+        const uint64_t conv_ns = (end_ns - start_ns) / repeat;
+        if (test->gpu_ns > conv_ns)
+            test->gpu_ns = conv_ns;
+    }
+}
+
+/* computes the fp32 sums of one dst row */
+static void
+tflite_conv_simple_test_ref_row(const void *data,
+                                float *dst,
+                                const float *const *src_spans,
+                                const float *weights)
+{
+    const struct tflite_conv_simple_test *test = data;
+    const int dst_width = test->width / test->reduce_width;
+
+    for (int x = 0; x < dst_width; x++) {
+        float sums[4] = { 0 };
+        const float *w = weights;
+        for (int s = 0; s < test->slice_count; s++) {
+            for (int ky = 0; ky < test->kernel_height; ky++) {
+                for (int kx = 0; kx < test->kernel_width; kx++) {
+                    const int base = test->reduce_width * x + kx;
+                    /* the weight is shared by the whole reduction window */
+                    float window[4] = { 0 };
+                    for (int i = 0; i < test->reduce_height; i++) {
+                        const float *src = src_spans[s] + (test->width * (ky + i) + base) * 4;
+                        for (int j = 0; j < test->reduce_width; j++) {
+                            for (int c = 0; c < 4; c++)
+                                window[c] += src[j * 4 + c];
+                        }
+                    }
+                    for (int c = 0; c < 4; c++)
+                        sums[c] += w[c] * window[c];
+                    w += 4;
+                }
+            }
+        }
+
+        memcpy(dst + x * 4, sums, sizeof(sums));
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+static __attribute__((target("sse4.1"))) void
+tflite_conv_simple_test_ref_row_sse41(const void *data,
+                                      float *dst,
+                                      const float *const *src_spans,
+                                      const float *weights)
+{
+    const struct tflite_conv_simple_test *test = data;
+    const int dst_width = test->width / test->reduce_width;
+
+    for (int x = 0; x < dst_width; x++) {
+        __m128 sum = _mm_setzero_ps();
+        const float *w = weights;
+        for (int s = 0; s < test->slice_count; s++) {
+            for (int ky = 0; ky < test->kernel_height; ky++) {
+                for (int kx = 0; kx < test->kernel_width; kx++) {
+                    const int base = test->reduce_width * x + kx;
+                    /* the weight is shared by the whole reduction window */
+                    __m128 window = _mm_setzero_ps();
+                    for (int i = 0; i < test->reduce_height; i++) {
+                        const float *src = src_spans[s] + (test->width * (ky + i) + base) * 4;
+                        for (int j = 0; j < test->reduce_width; j++)
+                            window = _mm_add_ps(window, _mm_loadu_ps(src + j * 4));
+                    }
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(w), window));
+                    w += 4;
+                }
+            }
+        }
+
+        _mm_storeu_ps(dst + x * 4, sum);
+    }
+}
+
+static __attribute__((target("avx2,fma"))) void
+tflite_conv_simple_test_ref_row_avx2(const void *data,
+                                     float *dst,
+                                     const float *const *src_spans,
+                                     const float *weights)
+{
+    const struct tflite_conv_simple_test *test = data;
+    const int dst_width = test->width / test->reduce_width;
+
+    for (int x = 0; x < dst_width; x++) {
+        __m256 sum = _mm256_setzero_ps();
+        const float *w = weights;
+        for (int s = 0; s < test->slice_count; s++) {
+            for (int ky = 0; ky < test->kernel_height; ky++) {
+                for (int kx = 0; kx < test->kernel_width; kx++) {
+                    const int base = test->reduce_width * x + kx;
+                    /* two src texels per vector; reduce_width is even */
+                    __m256 window = _mm256_setzero_ps();
+                    for (int i = 0; i < test->reduce_height; i++) {
+                        const float *src = src_spans[s] + (test->width * (ky + i) + base) * 4;
+                        for (int j = 0; j < test->reduce_width; j += 2)
+                            window = _mm256_add_ps(window, _mm256_loadu_ps(src + j * 4));
+                    }
+                    sum = _mm256_fmadd_ps(_mm256_broadcast_ps((const __m128 *)w), window, sum);
+                    w += 4;
+                }
+            }
+        }
+
+        _mm_storeu_ps(dst + x * 4, _mm_add_ps(_mm256_castps256_ps128(sum),
+                                              _mm256_extractf128_ps(sum, 1)));
+    }
+}
+
+#elif defined(__aarch64__)
+
+static void
+tflite_conv_simple_test_ref_row_neon(const void *data,
+                                     float *dst,
+                                     const float *const *src_spans,
+                                     const float *weights)
+{
+    const struct tflite_conv_simple_test *test = data;
+    const int dst_width = test->width / test->reduce_width;
+
+    for (int x = 0; x < dst_width; x++) {
+        float32x4_t sum = vdupq_n_f32(0.0f);
+        const float *w = weights;
+        for (int s = 0; s < test->slice_count; s++) {
+            for (int ky = 0; ky < test->kernel_height; ky++) {
+                for (int kx = 0; kx < test->kernel_width; kx++) {
+                    const int base = test->reduce_width * x + kx;
+                    /* the weight is shared by the whole reduction window */
+                    float32x4_t window = vdupq_n_f32(0.0f);
+                    for (int i = 0; i < test->reduce_height; i++) {
+                        const float *src = src_spans[s] + (test->width * (ky + i) + base) * 4;
+                        for (int j = 0; j < test->reduce_width; j++)
+                            window = vaddq_f32(window, vld1q_f32(src + j * 4));
+                    }
+                    sum = vfmaq_f32(sum, vld1q_f32(w), window);
+                    w += 4;
+                }
+            }
+        }
+
+        vst1q_f32(dst + x * 4, sum);
+    }
+}
+
+#endif
+
+static const cl_ref_row_func tflite_conv_simple_test_ref_row_funcs[U_SIMD_LEVEL_COUNT] = {
+    [U_SIMD_LEVEL_NONE] = tflite_conv_simple_test_ref_row,
+#if defined(__x86_64__) || defined(__i386__)
+    [U_SIMD_LEVEL_SSE41] = tflite_conv_simple_test_ref_row_sse41,
+    [U_SIMD_LEVEL_AVX2] = tflite_conv_simple_test_ref_row_avx2,
+#elif defined(__aarch64__)
+    [U_SIMD_LEVEL_NEON] = tflite_conv_simple_test_ref_row_neon,
+#endif
+};
+
+/* texels from the first read of a dst row to past its last read */
+static int
+tflite_conv_simple_test_get_span_size(const struct tflite_conv_simple_test *test)
+{
+    return test->width * (test->kernel_height + test->reduce_height - 1) + test->kernel_width;
+}
+
+static void
+tflite_conv_simple_test_ref_rows(void *data, uint32_t begin, uint32_t end)
+{
+    const struct tflite_conv_simple_test_ref *ref = data;
+    const struct tflite_conv_simple_test *test = ref->test;
+    const int slice_size = test->width * test->height;
+    const int src_count = slice_size * test->slice_count;
+    const int span_size = tflite_conv_simple_test_get_span_size(test);
+    const int dst_width = test->width / test->reduce_width;
+
+    float *span_data = malloc(sizeof(float) * 4 * span_size * test->slice_count);
+    const float **src_spans = malloc(sizeof(*src_spans) * test->slice_count);
+    float *dst = malloc(sizeof(float) * 4 * dst_width);
+    if (!span_data || !src_spans || !dst)
+        cl_die("failed to alloc ref rows");
+
+    for (uint32_t y = begin; y < end; y++) {
+        /* reads are linear; they run into the next rows and slices and past the image */
+        for (int s = 0; s < test->slice_count; s++) {
+            float *span = span_data + 4 * span_size * s;
+            const int offset = slice_size * s + test->width * test->reduce_height * y;
+            const int count = src_count - offset < span_size ? src_count - offset : span_size;
+
+            u_convert_half_to_float(span, test->src_data + 4 * offset, 4 * count, ref->level);
+            memset(span + 4 * count, 0, sizeof(float) * 4 * (span_size - count));
+            src_spans[s] = span;
+        }
+
+        ref->row(test, dst, src_spans, ref->weights);
+
+        u_convert_float_to_half(test->ref_data + 4 * dst_width * y, dst, 4 * dst_width,
+                                ref->level);
     }
+
+    free(dst);
+    free(src_spans);
+    free(span_data);
+}
+
+static void
+tflite_conv_simple_test_ref(void *data, enum u_simd_level level, uint32_t thread_count)
+{
+    struct tflite_conv_simple_test *test = data;
+    const int weight_count = test->kernel_width * test->kernel_height * test->slice_count;
+
+    struct tflite_conv_simple_test_ref ref = {
+        .test = test,
+        .level = level,
+        .row = cl_get_ref_row(tflite_conv_simple_test_ref_row_funcs, level),
+        .weights = malloc(sizeof(float) * 4 * weight_count),
+    };
+    if (!ref.weights)
+        cl_die("failed to alloc ref weights");
+    u_convert_half_to_float(ref.weights, test->weight_data, 4 * weight_count, level);
+
+    u_parallel_for(test->height / test->reduce_height, 1, thread_count,
+                   tflite_conv_simple_test_ref_rows, &ref);
+
+    free(ref.weights);
+}
+
+/* reads past the image are undefined */
+static bool
+tflite_conv_simple_test_is_out_of_range(const void *data, int x, int y)
+{
+    const struct tflite_conv_simple_test *test = data;
+    const int last = test->width * (test->height * (test->slice_count - 1) +
+                                    test->reduce_height * y + test->kernel_height +
+                                    test->reduce_height - 2) +
+                     test->reduce_width * x + test->kernel_width + test->reduce_width - 2;
+
+    return last >= test->width * test->height * test->slice_count;
+}
+
+static void
+tflite_conv_simple_test_validate(struct tflite_conv_simple_test *test)
+{
+    const struct cl_ref ref = {
+        .test = test,
+        .run = tflite_conv_simple_test_ref,
+        .skip = tflite_conv_simple_test_is_out_of_range,
+        .width = test->width / test->reduce_width,
+        .height = test->height / test->reduce_height,
+        .slice_count = 1,
+        .ref_data = test->ref_data,
+        .tolerance = test->tolerance,
+        .gpu_ns = test->gpu_ns,
+        .result = &test->result,
+    };
+    cl_validate_ref(&test->cl, &ref, test->dst_buf);
 }
 
 int
@@ -130,15 +443,17 @@ main(void)
         .width = 512,
         .height = 288,
         .slice_count = 6,
-
         .reduce_width = 4,
         .reduce_height = 4,
         .kernel_width = 4,
         .kernel_height = 4,
+
+        .tolerance = 1.0f / 32.0f,
     };
 
     tflite_conv_simple_test_init(&test);
     tflite_conv_simple_test_dispatch(&test);
+    tflite_conv_simple_test_validate(&test);
     tflite_conv_simple_test_cleanup(&test);
 
     return 0;
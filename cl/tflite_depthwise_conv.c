@@ -83,6 +83,8 @@ struct tflite_depthwise_conv_test {
     cl_int dilation_x;
     cl_int dilation_y;
 
+    float tolerance;
+
     size_t buf_size;
     size_t src_offset;
     size_t src_size;
@@ -100,6 +102,23 @@ struct tflite_depthwise_conv_test {
     struct cl_buffer *weight_buf;
 
     struct cl_pipeline *pipeline;
+
+    cl_half *src_data;
+    cl_half *bias_data;
+    cl_half *weight_data;
+    cl_half *ref_data;
+    uint64_t gpu_ns;
+
+    struct u_result result;
+};
+
+struct tflite_depthwise_conv_test_ref {
+    const struct tflite_depthwise_conv_test *test;
+    enum u_simd_level level;
+    cl_ref_row_func row;
+
+    float *weights;
+    float *biases;
 };
 
 static void
@@ -112,6 +131,7 @@ tflite_depthwise_conv_test_init(struct tflite_depthwise_conv_test *test)
     };
     cl_init(cl, &params);
     cl_log("device: %s", cl->dev->name);
+    cl_init_result(cl, &test->result, "tflite_depthwise_conv");
 
     if (!cl->dev->half_fp_config)
         cl_die("fp16 is not supported");
@@ -128,6 +148,12 @@ tflite_depthwise_conv_test_init(struct tflite_depthwise_conv_test *test)
         cl_create_image(cl, CL_MEM_READ_WRITE, CL_RGBA, CL_HALF_FLOAT,
                         CL_MEM_OBJECT_IMAGE1D_BUFFER, src_count, 0, test->src_buf->mem, NULL);
 
+    test->src_data = malloc(test->src_size);
+    if (!test->src_data)
+        cl_die("failed to alloc src data");
+    cl_fill_random_half(test->src_data, src_count * 4, 1.0f);
+    cl_write_buffer(cl, test->src_buf, test->src_data, test->src_size);
+
     const size_t dst_count = test->dst_width * test->dst_height * test->slice_count;
     if (test->dst_size != sizeof(cl_half4) * dst_count)
         cl_die("bad dst size");
@@ -135,18 +161,27 @@ tflite_depthwise_conv_test_init(struct tflite_depthwise_conv_test *test)
     test->dst_buf =
         cl_suballoc_buffer(cl, test->buf, CL_MEM_READ_WRITE, test->dst_offset, test->dst_size);
 
+    test->ref_data = malloc(test->dst_size);
+    if (!test->ref_data)
+        cl_die("failed to alloc ref data");
+
     const size_t bias_size = sizeof(cl_half4) * test->slice_count;
-    cl_half4 *biases = calloc(1, bias_size);
-    test->bias_buf =
-        cl_create_buffer(cl, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, bias_size, biases);
-    free(biases);
-
-    const size_t weight_size =
-        sizeof(cl_half4) * test->slice_count * test->kernel_width * test->kernel_height;
-    cl_half4 *weights = calloc(1, weight_size);
-    test->weight_buf =
-        cl_create_buffer(cl, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, weight_size, weights);
-    free(weights);
+    test->bias_data = malloc(bias_size);
+    if (!test->bias_data)
+        cl_die("failed to alloc bias data");
+    cl_fill_random_half(test->bias_data, test->slice_count * 4, 0.5f);
+    test->bias_buf = cl_create_buffer(cl, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, bias_size,
+                                      test->bias_data);
+
+    const int tap_count = test->kernel_width * test->kernel_height;
+    const size_t weight_size = sizeof(cl_half4) * test->slice_count * tap_count;
+    test->weight_data = malloc(weight_size);
+    if (!test->weight_data)
+        cl_die("failed to alloc weight data");
+    cl_fill_random_half(test->weight_data, test->slice_count * tap_count * 4,
+                        cl_get_ref_weight_scale(tap_count));
+    test->weight_buf = cl_create_buffer(cl, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                                        weight_size, test->weight_data);
 
     test->pipeline = cl_create_pipeline(cl, tflite_depthwise_conv_test_cs, "main_function");
 }
@@ -166,6 +201,12 @@ tflite_depthwise_conv_test_cleanup(struct tflite_depthwise_conv_test *test)
     cl_destroy_buffer(cl, test->src_buf);
     cl_destroy_buffer(cl, test->buf);
 
+    free(test->src_data);
+    free(test->bias_data);
+    free(test->weight_data);
+    free(test->ref_data);
+
+    u_result_cleanup(&test->result);
     cl_cleanup(cl);
 }
 
@@ -211,14 +252,24 @@ tflite_depthwise_conv_test_dispatch(struct tflite_depthwise_conv_test *test)
     cl_set_pipeline_arg(cl, test->pipeline, 6, &shared[2], sizeof(shared[2]));
     cl_set_pipeline_arg(cl, test->pipeline, 7, &shared[3], sizeof(shared[3]));
 
+    const size_t global_size[3] = { test->dst_width, test->dst_height, test->slice_count };
+    size_t local_size[3] = { 128, 1, 2 };
+    char shape[256];
+    snprintf(shape, sizeof(shape), "tflite_depthwise_conv %dx%d-%dx%dx%d k%dx%d s%dx%d d%dx%d",
+             test->src_width, test->src_height, test->dst_width, test->dst_height,
+             test->slice_count, test->kernel_width, test->kernel_height, test->stride_x,
+             test->stride_y, test->dilation_x, test->dilation_y);
+    cl_tune_pipeline(cl, test->pipeline, shape, global_size, local_size);
+
+    test->gpu_ns = UINT64_MAX;
     for (uint32_t i = 0; i < loops; i++) {
         cl_event start_ev;
         cl_event end_ev;
 
         for (uint32_t j = 0; j < dispatches; j++) {
             cl_event *ev = j == 0 ? &start_ev : j == dispatches - 1 ? &end_ev : NULL;
-            cl_enqueue_pipeline(cl, test->pipeline, test->dst_width, test->dst_height,
-                                test->slice_count, 128, 1, 2, ev);
+            cl_enqueue_pipeline(cl, test->pipeline, global_size[0], global_size[1],
+                                global_size[2], local_size[0], local_size[1], local_size[2], ev);
         }
         if (dispatches == 1)
             end_ev = cl_retain_event(cl, start_ev);
@@ -236,9 +287,256 @@ tflite_depthwise_conv_test_dispatch(struct tflite_depthwise_conv_test *test)
 
         const float dur_ms = (float)(end_ns - start_ns) / 1000000;
         cl_log("iter %d took %.3f ms", i, dur_ms);
+
+        const uint64_t dispatch_ns = (end_ns - start_ns) / dispatches;
+        if (test->gpu_ns > dispatch_ns)
+            test->gpu_ns = dispatch_ns;
+    }
+}
+
+/* computes the fp32 sums of one dst row of one slice */
+static void
+tflite_depthwise_conv_test_ref_row(const void *data,
+                                   float *dst,
+                                   const float *const *src_rows,
+                                   const float *weights)
+{
+    const struct tflite_depthwise_conv_test *test = data;
+    for (int x = 0; x < test->dst_width; x++) {
+        float sums[4] = { 0 };
+        for (int ky = 0; ky < test->kernel_height; ky++) {
+            if (!src_rows[ky])
+                continue;
+            for (int kx = 0; kx < test->kernel_width; kx++) {
+                const int src_x = x * test->stride_x + test->padding_x + kx * test->dilation_x;
+                if (src_x < 0 || src_x >= test->src_width)
+                    continue;
+
+                const float *src = src_rows[ky] + src_x * 4;
+                const float *w = weights + (ky * test->kernel_width + kx) * 4;
+                for (int c = 0; c < 4; c++)
+                    sums[c] += w[c] * src[c];
+            }
+        }
+
+        memcpy(dst + x * 4, sums, sizeof(sums));
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+static __attribute__((target("sse4.1"))) void
+tflite_depthwise_conv_test_ref_row_sse41(const void *data,
+                                         float *dst,
+                                         const float *const *src_rows,
+                                         const float *weights)
+{
+    const struct tflite_depthwise_conv_test *test = data;
+    for (int x = 0; x < test->dst_width; x++) {
+        __m128 sum = _mm_setzero_ps();
+        for (int ky = 0; ky < test->kernel_height; ky++) {
+            if (!src_rows[ky])
+                continue;
+            for (int kx = 0; kx < test->kernel_width; kx++) {
+                const int src_x = x * test->stride_x + test->padding_x + kx * test->dilation_x;
+                if (src_x < 0 || src_x >= test->src_width)
+                    continue;
+
+                const __m128 src = _mm_loadu_ps(src_rows[ky] + src_x * 4);
+                const __m128 w = _mm_loadu_ps(weights + (ky * test->kernel_width + kx) * 4);
+                sum = _mm_add_ps(sum, _mm_mul_ps(w, src));
+            }
+        }
+
+        _mm_storeu_ps(dst + x * 4, sum);
+    }
+}
+
+static __attribute__((target("avx2,fma"))) void
+tflite_depthwise_conv_test_ref_row_avx2(const void *data,
+                                        float *dst,
+                                        const float *const *src_rows,
+                                        const float *weights)
+{
+    const struct tflite_depthwise_conv_test *test = data;
+    /* two dst texels per vector */
+    int x = 0;
+    for (; x + 2 <= test->dst_width; x += 2) {
+        __m256 sum = _mm256_setzero_ps();
+        for (int ky = 0; ky < test->kernel_height; ky++) {
+            if (!src_rows[ky])
+                continue;
+            for (int kx = 0; kx < test->kernel_width; kx++) {
+                const int src_x0 = x * test->stride_x + test->padding_x + kx * test->dilation_x;
+                const int src_x1 = src_x0 + test->stride_x;
+                const bool in_x0 = src_x0 >= 0 && src_x0 < test->src_width;
+                const bool in_x1 = src_x1 >= 0 && src_x1 < test->src_width;
+                if (!in_x0 && !in_x1)
+                    continue;
+
+                const __m128 src0 =
+                    in_x0 ? _mm_loadu_ps(src_rows[ky] + src_x0 * 4) : _mm_setzero_ps();
+                const __m128 src1 =
+                    in_x1 ? _mm_loadu_ps(src_rows[ky] + src_x1 * 4) : _mm_setzero_ps();
+                const float *w = weights + (ky * test->kernel_width + kx) * 4;
+                sum = _mm256_fmadd_ps(_mm256_broadcast_ps((const __m128 *)w),
+                                      _mm256_set_m128(src1, src0), sum);
+            }
+        }
+
+        _mm256_storeu_ps(dst + x * 4, sum);
+    }
+
+    if (x < test->dst_width) {
+        __m128 sum = _mm_setzero_ps();
+        for (int ky = 0; ky < test->kernel_height; ky++) {
+            if (!src_rows[ky])
+                continue;
+            for (int kx = 0; kx < test->kernel_width; kx++) {
+                const int src_x = x * test->stride_x + test->padding_x + kx * test->dilation_x;
+                if (src_x < 0 || src_x >= test->src_width)
+                    continue;
+
+                const __m128 src = _mm_loadu_ps(src_rows[ky] + src_x * 4);
+                const __m128 w = _mm_loadu_ps(weights + (ky * test->kernel_width + kx) * 4);
+                sum = _mm_fmadd_ps(w, src, sum);
+            }
+        }
+
+        _mm_storeu_ps(dst + x * 4, sum);
     }
 }
 
+#elif defined(__aarch64__)
+
+static void
+tflite_depthwise_conv_test_ref_row_neon(const void *data,
+                                        float *dst,
+                                        const float *const *src_rows,
+                                        const float *weights)
+{
+    const struct tflite_depthwise_conv_test *test = data;
+    for (int x = 0; x < test->dst_width; x++) {
+        float32x4_t sum = vdupq_n_f32(0.0f);
+        for (int ky = 0; ky < test->kernel_height; ky++) {
+            if (!src_rows[ky])
+                continue;
+            for (int kx = 0; kx < test->kernel_width; kx++) {
+                const int src_x = x * test->stride_x + test->padding_x + kx * test->dilation_x;
+                if (src_x < 0 || src_x >= test->src_width)
+                    continue;
+
+                const float32x4_t src = vld1q_f32(src_rows[ky] + src_x * 4);
+                const float32x4_t w = vld1q_f32(weights + (ky * test->kernel_width + kx) * 4);
+                sum = vfmaq_f32(sum, w, src);
+            }
+        }
+
+        vst1q_f32(dst + x * 4, sum);
+    }
+}
+
+#endif
+
+static const cl_ref_row_func tflite_depthwise_conv_test_ref_row_funcs[U_SIMD_LEVEL_COUNT] = {
+    [U_SIMD_LEVEL_NONE] = tflite_depthwise_conv_test_ref_row,
+#if defined(__x86_64__) || defined(__i386__)
+    [U_SIMD_LEVEL_SSE41] = tflite_depthwise_conv_test_ref_row_sse41,
+    [U_SIMD_LEVEL_AVX2] = tflite_depthwise_conv_test_ref_row_avx2,
+#elif defined(__aarch64__)
+    [U_SIMD_LEVEL_NEON] = tflite_depthwise_conv_test_ref_row_neon,
+#endif
+};
+
+static void
+tflite_depthwise_conv_test_ref_rows(void *data, uint32_t begin, uint32_t end)
+{
+    const struct tflite_depthwise_conv_test_ref *ref = data;
+    const struct tflite_depthwise_conv_test *test = ref->test;
+    const int row_size = test->src_width * 4;
+    const int tap_count = test->kernel_width * test->kernel_height;
+
+    float *src_data = malloc(sizeof(float) * row_size * test->kernel_height);
+    const float **src_rows = malloc(sizeof(*src_rows) * test->kernel_height);
+    float *dst = malloc(sizeof(float) * test->dst_width * 4);
+    if (!src_data || !src_rows || !dst)
+        cl_die("failed to alloc ref rows");
+
+    for (uint32_t i = begin; i < end; i++) {
+        const int s = i / test->dst_height;
+        const int y = i % test->dst_height;
+
+        /* the kernel zeroes the clamped reads outside of the image */
+        for (int ky = 0; ky < test->kernel_height; ky++) {
+            const int src_y = y * test->stride_y + test->padding_y + ky * test->dilation_y;
+            if (src_y < 0 || src_y >= test->src_height) {
+                src_rows[ky] = NULL;
+                continue;
+            }
+
+            float *row = src_data + row_size * ky;
+            const cl_half *src =
+                test->src_data + ((s * test->src_height + src_y) * test->src_width) * 4;
+            u_convert_half_to_float(row, src, row_size, ref->level);
+            src_rows[ky] = row;
+        }
+
+        ref->row(test, dst, src_rows, ref->weights + tap_count * 4 * s);
+
+        for (int x = 0; x < test->dst_width * 4; x++)
+            dst[x] += ref->biases[s * 4 + x % 4];
+
+        cl_half *row = test->ref_data + ((s * test->dst_height + y) * test->dst_width) * 4;
+        u_convert_float_to_half(row, dst, test->dst_width * 4, ref->level);
+    }
+
+    free(dst);
+    free(src_rows);
+    free(src_data);
+}
+
+static void
+tflite_depthwise_conv_test_ref(void *data, enum u_simd_level level, uint32_t thread_count)
+{
+    struct tflite_depthwise_conv_test *test = data;
+    const int weight_count = test->kernel_width * test->kernel_height * test->slice_count;
+
+    struct tflite_depthwise_conv_test_ref ref = {
+        .test = test,
+        .level = level,
+        .row = cl_get_ref_row(tflite_depthwise_conv_test_ref_row_funcs, level),
+        .weights = malloc(sizeof(float) * weight_count * 4),
+        .biases = malloc(sizeof(float) * test->slice_count * 4),
+    };
+    if (!ref.weights || !ref.biases)
+        cl_die("failed to alloc ref weights");
+    u_convert_half_to_float(ref.weights, test->weight_data, weight_count * 4, level);
+    u_convert_half_to_float(ref.biases, test->bias_data, test->slice_count * 4, level);
+
+    u_parallel_for(test->slice_count * test->dst_height, 1, thread_count,
+                   tflite_depthwise_conv_test_ref_rows, &ref);
+
+    free(ref.biases);
+    free(ref.weights);
+}
+
+static void
+tflite_depthwise_conv_test_validate(struct tflite_depthwise_conv_test *test)
+{
+    const struct cl_ref ref = {
+        .test = test,
+        .run = tflite_depthwise_conv_test_ref,
+        .width = test->dst_width,
+        .height = test->dst_height,
+        .slice_count = test->slice_count,
+        .ref_data = test->ref_data,
+        .tolerance = test->tolerance,
+        .gpu_ns = test->gpu_ns,
+        .result = &test->result,
+    };
+    cl_validate_ref(&test->cl, &ref, test->dst_buf);
+}
+
 int
 main(void)
 {
@@ -258,6 +556,8 @@ main(void)
         .dilation_x = 1,
         .dilation_y = 1,
 
+        .tolerance = 1.0f / 64.0f,
+
         .buf_size = 14155776,
         .src_offset = 11796480,
         .src_size = 2359296,
@@ -267,6 +567,7 @@ main(void)
 
     tflite_depthwise_conv_test_init(&test);
     tflite_depthwise_conv_test_dispatch(&test);
+    tflite_depthwise_conv_test_validate(&test);
     tflite_depthwise_conv_test_cleanup(&test);
 
     return 0;
@@ -6,6 +6,8 @@
 #include "eglutil.h"
 #include "rdocutil.h"
 
+#include <sys/stat.h>
+
 static const char model_test_vs[] = {
 #include "model_test.vert.inc"
 };
@@ -14,6 +16,59 @@ static const char model_test_fs[] = {
 #include "model_test.frag.inc"
 };
 
+struct model_vertex {
+    float pos[3];
+    float pad1[2];
+    float bone_weight[4];
+    uint8_t bone_index[4];
+    float pad2[2];
+};
+
+/* a mesh cache file is the header followed by the vertices and the indices */
+struct model_cache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t obj_size;
+    int64_t obj_mtime;
+    uint32_t v_count;
+    uint32_t f_count;
+};
+
+#define MODEL_CACHE_MAGIC "MDLCACHE"
+#define MODEL_CACHE_VERSION 2
+#define MODEL_CACHE_FLAG_NORMALIZED (1u << 0)
+#define MODEL_CACHE_FLAG_OPTIMIZED (1u << 1)
+
+/* the post-transform cache size to optimize for and to simulate */
+#define MODEL_VCACHE_SIZE 16
+/* the vertex fetch cache to simulate */
+#define MODEL_FETCH_LINE_SIZE 64
+#define MODEL_FETCH_LINE_COUNT 64
+
+/* a run of triangles between vertex cache flushes, as the unit of overdraw sorting */
+struct model_cluster {
+    float sort_key;
+    int begin;
+    int count;
+};
+
+/* a newline-aligned range of the obj file and what was parsed from it */
+struct model_chunk {
+    const char *begin;
+    const char *end;
+
+    float (*v)[3];
+    int v_count;
+    int v_max;
+
+    int (*f)[3];
+    int f_count;
+    int f_max;
+
+    const char *bad_line;
+};
+
 struct model {
     float (*v)[3];
     int v_count;
@@ -44,10 +99,12 @@ struct model_test {
     GLenum ds_format;
     bool depth_test;
     bool normalize_model;
+    bool optimize_model;
     int outer_loop;
     int inner_loop;
 
     const char *filename;
+    const char *cache_filename;
 
     struct rdoc rdoc;
 
@@ -64,66 +121,61 @@ struct model_test {
 };
 
 static void
-model_test_upload_model(struct model_test *test)
+model_test_upload_model(struct model_test *test,
+                        const struct model_vertex *verts,
+                        const int (*f)[3])
 {
     struct egl *egl = &test->egl;
     struct egl_gl *gl = &egl->gl;
     struct model *model = &test->model;
 
-    struct hwvert {
-        float pos[3];
-        float pad1[2];
-        float bone_weight[4];
-        uint8_t bone_index[4];
-        float pad2[2];
-    };
-
-    struct hwvert *hwverts = calloc(model->v_count, sizeof(*hwverts));
-    if (!hwverts)
-        egl_die("failed to alloc hwverts");
-    for (int i = 0; i < model->v_count; i++) {
-        struct hwvert *hwvert = &hwverts[i];
-
-        memcpy(hwvert->pos, model->v[i], sizeof(hwvert->pos));
-        for (int j = 0; j < 4; j++) {
-            hwvert->bone_weight[j] = 0.25f;
-            hwvert->bone_index[j] = (i * 4 + j) % 32;
-        }
-    }
-
-    const GLsizeiptr vbo_size = sizeof(*hwverts) * model->v_count;
+    const GLsizeiptr vbo_size = sizeof(*verts) * model->v_count;
     gl->GenBuffers(1, &model->vbo);
     gl->BindBuffer(GL_ARRAY_BUFFER, model->vbo);
-    gl->BufferData(GL_ARRAY_BUFFER, vbo_size, hwverts, GL_STATIC_DRAW);
+    gl->BufferData(GL_ARRAY_BUFFER, vbo_size, verts, GL_STATIC_DRAW);
     gl->BindBuffer(GL_ARRAY_BUFFER, 0);
 
-    free(hwverts);
-
-    model->vertex_stride = sizeof(struct hwvert);
+    model->vertex_stride = sizeof(struct model_vertex);
     model->attrs[0].size = 3;
     model->attrs[0].type = GL_FLOAT;
-    model->attrs[0].offset = offsetof(struct hwvert, pos);
+    model->attrs[0].offset = offsetof(struct model_vertex, pos);
     model->attrs[1].size = 4;
     model->attrs[1].type = GL_UNSIGNED_BYTE;
-    model->attrs[1].offset = offsetof(struct hwvert, bone_index);
+    model->attrs[1].offset = offsetof(struct model_vertex, bone_index);
     model->attrs[2].size = 4;
     model->attrs[2].type = GL_FLOAT;
-    model->attrs[2].offset = offsetof(struct hwvert, bone_weight);
+    model->attrs[2].offset = offsetof(struct model_vertex, bone_weight);
 
-    const GLsizeiptr ibo_size = sizeof(*model->f) * model->f_count;
+    const GLsizeiptr ibo_size = sizeof(*f) * model->f_count;
     gl->GenBuffers(1, &model->ibo);
     gl->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->ibo);
-    gl->BufferData(GL_ELEMENT_ARRAY_BUFFER, ibo_size, model->f, GL_STATIC_DRAW);
+    gl->BufferData(GL_ELEMENT_ARRAY_BUFFER, ibo_size, f, GL_STATIC_DRAW);
     gl->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
     model->elem.mode = GL_TRIANGLES;
     model->elem.count = model->f_count * 3;
     model->elem.type = GL_UNSIGNED_INT;
+}
 
-    free(model->v);
-    free(model->f);
-    model->v = NULL;
-    model->f = NULL;
+static struct model_vertex *
+model_test_build_vertices(struct model_test *test)
+{
+    const struct model *model = &test->model;
+
+    struct model_vertex *verts = calloc(model->v_count, sizeof(*verts));
+    if (!verts)
+        egl_die("failed to alloc verts");
+    for (int i = 0; i < model->v_count; i++) {
+        struct model_vertex *vert = &verts[i];
+
+        memcpy(vert->pos, model->v[i], sizeof(vert->pos));
+        for (int j = 0; j < 4; j++) {
+            vert->bone_weight[j] = 0.25f;
+            vert->bone_index[j] = (i * 4 + j) % 32;
+        }
+    }
+
+    return verts;
 }
 
 static void
@@ -179,62 +231,575 @@ model_test_process_model(struct model_test *test)
 
     for (int i = 0; i < model->f_count; i++) {
         int *f = model->f[i];
-        /* zero-based */
-        f[0] -= 1;
-        f[1] -= 1;
-        f[2] -= 1;
+        for (int j = 0; j < 3; j++) {
+            if (f[j] < 1 || f[j] > model->v_count)
+                egl_die("face %d has bad vertex index %d", i, f[j]);
+            /* zero-based */
+            f[j] -= 1;
+        }
     }
 }
 
 static void
-model_test_parse_model(struct model_test *test, const char *ptr, size_t size)
+model_test_analyze_model(struct model_test *test, const char *stage, uint64_t dur)
+{
+    const struct model *model = &test->model;
+
+    int *vcache_stamps = malloc(sizeof(*vcache_stamps) * model->v_count);
+    if (!vcache_stamps)
+        egl_die("failed to alloc vcache stamps");
+    for (int i = 0; i < model->v_count; i++)
+        vcache_stamps[i] = -MODEL_VCACHE_SIZE - 1;
+
+    /* FIFO post-transform cache: a vertex hits if it was inserted within the last N misses */
+    int vcache_misses = 0;
+    int fetch_lines = 0;
+    uint32_t fetch_cache[MODEL_FETCH_LINE_COUNT];
+    uint32_t fetch_next = 0;
+    memset(fetch_cache, 0xff, sizeof(fetch_cache));
+    for (int i = 0; i < model->f_count; i++) {
+        for (int j = 0; j < 3; j++) {
+            const int v = model->f[i][j];
+            if (vcache_misses - vcache_stamps[v] <= MODEL_VCACHE_SIZE)
+                continue;
+            vcache_stamps[v] = vcache_misses++;
+
+            /* FIFO vertex fetch cache of MODEL_FETCH_LINE_SIZE lines */
+            const size_t offset = sizeof(struct model_vertex) * v;
+            const uint32_t first = offset / MODEL_FETCH_LINE_SIZE;
+            const uint32_t last =
+                (offset + sizeof(struct model_vertex) - 1) / MODEL_FETCH_LINE_SIZE;
+            for (uint32_t line = first; line <= last; line++) {
+                bool hit = false;
+                for (uint32_t k = 0; k < MODEL_FETCH_LINE_COUNT && !hit; k++)
+                    hit = fetch_cache[k] == line;
+                if (hit)
+                    continue;
+
+                fetch_cache[fetch_next] = line;
+                fetch_next = (fetch_next + 1) % MODEL_FETCH_LINE_COUNT;
+                fetch_lines++;
+            }
+        }
+    }
+
+    int used_count = 0;
+    for (int i = 0; i < model->v_count; i++)
+        used_count += vcache_stamps[i] >= 0;
+
+    free(vcache_stamps);
+
+    const double acmr = model->f_count ? (double)vcache_misses / model->f_count : 0.0;
+    const double atvr = used_count ? (double)vcache_misses / used_count : 0.0;
+    const double min_fetch_size = (double)sizeof(struct model_vertex) * used_count;
+    const double overfetch =
+        used_count ? (double)fetch_lines * MODEL_FETCH_LINE_SIZE / min_fetch_size : 0.0;
+
+    egl_log("%s: ACMR %.3f, ATVR %.3f, overfetch %.3f (%.1fms)", stage, acmr, atvr, overfetch,
+            dur / 1000000.0);
+}
+
+static int
+model_test_optimize_vcache_next(const int *candidates,
+                                int candidate_count,
+                                const int *live_counts,
+                                const int *vcache_stamps,
+                                int stamp)
+{
+    int best = -1;
+    int best_priority = -1;
+    for (int i = 0; i < candidate_count; i++) {
+        const int v = candidates[i];
+        if (!live_counts[v])
+            continue;
+
+        /* prefer the oldest vertex that stays cached while its remaining triangles emit */
+        int priority = 0;
+        if (stamp - vcache_stamps[v] + 2 * live_counts[v] <= MODEL_VCACHE_SIZE)
+            priority = stamp - vcache_stamps[v];
+        if (priority > best_priority) {
+            best_priority = priority;
+            best = v;
+        }
+    }
+
+    return best;
+}
+
+/* Tipsify from Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced
+ * Overdraw".  Fans around vertices in cache and records a cluster each time it has to restart
+ * from a dead end.
+ */
+static int
+model_test_optimize_vcache(struct model_test *test, int (*out)[3], int *cluster_begins)
+{
+    const struct model *model = &test->model;
+    const int v_count = model->v_count;
+    const int f_count = model->f_count;
+
+    int *adj_offsets = calloc(v_count + 1, sizeof(*adj_offsets));
+    int *adj = malloc(sizeof(*adj) * f_count * 3);
+    int *live_counts = calloc(v_count, sizeof(*live_counts));
+    int *vcache_stamps = malloc(sizeof(*vcache_stamps) * v_count);
+    bool *emitted = calloc(f_count, sizeof(*emitted));
+    int *dead_ends = malloc(sizeof(*dead_ends) * f_count * 3);
+    int *candidates = malloc(sizeof(*candidates) * f_count * 3);
+    if (!adj_offsets || !adj || !live_counts || !vcache_stamps || !emitted || !dead_ends ||
+        !candidates)
+        egl_die("failed to alloc vcache optimization state");
+
+    /* triangle adjacency per vertex */
+    for (int i = 0; i < f_count; i++) {
+        for (int j = 0; j < 3; j++)
+            live_counts[model->f[i][j]]++;
+    }
+    for (int i = 0; i < v_count; i++)
+        adj_offsets[i + 1] = adj_offsets[i] + live_counts[i];
+    for (int i = 0; i < f_count; i++) {
+        for (int j = 0; j < 3; j++) {
+            const int v = model->f[i][j];
+            adj[adj_offsets[v + 1] - live_counts[v]] = i;
+            live_counts[v]--;
+        }
+    }
+    for (int i = 0; i < v_count; i++) {
+        live_counts[i] = adj_offsets[i + 1] - adj_offsets[i];
+        vcache_stamps[i] = -MODEL_VCACHE_SIZE - 1;
+    }
+
+    int out_count = 0;
+    int cluster_count = 0;
+    int dead_end_count = 0;
+    int cursor = 0;
+    int stamp = 0;
+    int fan = -1;
+    while (true) {
+        if (fan < 0) {
+            /* dead end; restart from a recent vertex or the next unfinished one */
+            while (dead_end_count && fan < 0) {
+                const int v = dead_ends[--dead_end_count];
+                if (live_counts[v])
+                    fan = v;
+            }
+            while (fan < 0 && cursor < v_count) {
+                if (live_counts[cursor])
+                    fan = cursor;
+                cursor++;
+            }
+            if (fan < 0)
+                break;
+
+            cluster_begins[cluster_count++] = out_count;
+        }
+
+        int candidate_count = 0;
+        for (int i = adj_offsets[fan]; i < adj_offsets[fan + 1]; i++) {
+            const int t = adj[i];
+            if (emitted[t])
+                continue;
+            emitted[t] = true;
+
+            for (int j = 0; j < 3; j++) {
+                const int v = model->f[t][j];
+                out[out_count][j] = v;
+                dead_ends[dead_end_count++] = v;
+                candidates[candidate_count++] = v;
+                live_counts[v]--;
+                if (stamp - vcache_stamps[v] > MODEL_VCACHE_SIZE)
+                    vcache_stamps[v] = stamp++;
+            }
+            out_count++;
+        }
+
+        fan = model_test_optimize_vcache_next(candidates, candidate_count, live_counts,
+                                              vcache_stamps, stamp);
+    }
+
+    free(candidates);
+    free(dead_ends);
+    free(emitted);
+    free(vcache_stamps);
+    free(live_counts);
+    free(adj);
+    free(adj_offsets);
+
+    return cluster_count;
+}
+
+static int
+model_test_compare_clusters(const void *a, const void *b)
+{
+    const struct model_cluster *ca = a;
+    const struct model_cluster *cb = b;
+    if (ca->sort_key != cb->sort_key)
+        return ca->sort_key < cb->sort_key ? 1 : -1;
+    return ca->begin - cb->begin;
+}
+
+/* Draws outward-facing clusters first so that they occlude the ones behind them.  The key is
+ * how far a cluster's centroid lies along its average normal from the mesh centroid.
+ */
+static void
+model_test_optimize_overdraw(struct model_test *test,
+                             int (*out)[3],
+                             const int *cluster_begins,
+                             int cluster_count)
 {
     struct model *model = &test->model;
-    const char *line = ptr;
-    const char *end = ptr + size;
+
+    struct model_cluster *clusters = malloc(sizeof(*clusters) * cluster_count);
+    float (*normals)[3] = malloc(sizeof(*normals) * cluster_count);
+    if (!clusters || !normals)
+        egl_die("failed to alloc clusters");
+
+    float mesh_centroid[3] = { 0.0f, 0.0f, 0.0f };
+    float mesh_area = 0.0f;
+    for (int i = 0; i < cluster_count; i++) {
+        struct model_cluster *cluster = &clusters[i];
+        cluster->begin = cluster_begins[i];
+        cluster->count =
+            (i + 1 < cluster_count ? cluster_begins[i + 1] : model->f_count) - cluster->begin;
+
+        float normal[3] = { 0.0f, 0.0f, 0.0f };
+        float centroid[3] = { 0.0f, 0.0f, 0.0f };
+        float area = 0.0f;
+        for (int j = cluster->begin; j < cluster->begin + cluster->count; j++) {
+            const float *p0 = model->v[model->f[j][0]];
+            const float *p1 = model->v[model->f[j][1]];
+            const float *p2 = model->v[model->f[j][2]];
+
+            const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            const float n[3] = {
+                e1[1] * e2[2] - e1[2] * e2[1],
+                e1[2] * e2[0] - e1[0] * e2[2],
+                e1[0] * e2[1] - e1[1] * e2[0],
+            };
+            const float a = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+            for (int k = 0; k < 3; k++) {
+                normal[k] += n[k];
+                centroid[k] += (p0[k] + p1[k] + p2[k]) / 3.0f * a;
+            }
+            area += a;
+        }
+
+        const float normal_len =
+            sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        cluster->sort_key = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            normals[i][k] = normal_len > 0.0f ? normal[k] / normal_len : 0.0f;
+            if (area > 0.0f)
+                cluster->sort_key += centroid[k] / area * normals[i][k];
+            mesh_centroid[k] += centroid[k];
+        }
+        mesh_area += area;
+    }
+
+    /* dot(c - m, n) = dot(c, n) - dot(m, n) once the mesh centroid m is known */
+    for (int k = 0; k < 3; k++)
+        mesh_centroid[k] = mesh_area > 0.0f ? mesh_centroid[k] / mesh_area : 0.0f;
+    for (int i = 0; i < cluster_count; i++) {
+        for (int k = 0; k < 3; k++)
+            clusters[i].sort_key -= mesh_centroid[k] * normals[i][k];
+    }
+
+    qsort(clusters, cluster_count, sizeof(*clusters), model_test_compare_clusters);
+
+    int out_count = 0;
+    for (int i = 0; i < cluster_count; i++) {
+        const struct model_cluster *cluster = &clusters[i];
+        memcpy(out + out_count, model->f + cluster->begin, sizeof(*out) * cluster->count);
+        out_count += cluster->count;
+    }
+
+    free(normals);
+    free(clusters);
+}
+
+/* renumbers vertices in first-use order and drops unreferenced ones */
+static void
+model_test_optimize_vfetch(struct model_test *test)
+{
+    struct model *model = &test->model;
+
+    int *remap = malloc(sizeof(*remap) * model->v_count);
+    if (!remap)
+        egl_die("failed to alloc remap");
+    for (int i = 0; i < model->v_count; i++)
+        remap[i] = -1;
+
+    int v_count = 0;
+    for (int i = 0; i < model->f_count; i++) {
+        for (int j = 0; j < 3; j++) {
+            int *v = &model->f[i][j];
+            if (remap[*v] < 0)
+                remap[*v] = v_count++;
+            *v = remap[*v];
+        }
+    }
+
+    float (*v)[3] = malloc(sizeof(*v) * (v_count ? v_count : 1));
+    if (!v)
+        egl_die("failed to alloc v");
+    for (int i = 0; i < model->v_count; i++) {
+        if (remap[i] >= 0)
+            memcpy(v[remap[i]], model->v[i], sizeof(*v));
+    }
+
+    free(remap);
+    free(model->v);
+    model->v = v;
+    model->v_count = v_count;
+}
+
+static void
+model_test_optimize_model(struct model_test *test)
+{
+    struct model *model = &test->model;
+    if (!model->f_count)
+        return;
+
+    model_test_analyze_model(test, "original", 0);
+
+    int (*out)[3] = malloc(sizeof(*out) * model->f_count);
+    int *cluster_begins = malloc(sizeof(*cluster_begins) * (model->f_count + 1));
+    if (!out || !cluster_begins)
+        egl_die("failed to alloc optimized faces");
+
+    uint64_t begin = u_now();
+    const int cluster_count = model_test_optimize_vcache(test, out, cluster_begins);
+    int (*tmp)[3] = model->f;
+    model->f = out;
+    out = tmp;
+    model_test_analyze_model(test, "vertex cache", u_now() - begin);
+
+    begin = u_now();
+    model_test_optimize_overdraw(test, out, cluster_begins, cluster_count);
+    tmp = model->f;
+    model->f = out;
+    out = tmp;
+    model_test_analyze_model(test, "overdraw", u_now() - begin);
+
+    begin = u_now();
+    model_test_optimize_vfetch(test);
+    model_test_analyze_model(test, "vertex fetch", u_now() - begin);
+
+    free(cluster_begins);
+    free(out);
+}
+
+static const char *
+model_test_skip_space(const char *ptr, const char *end)
+{
+    while (ptr < end && (*ptr == ' ' || *ptr == '\t'))
+        ptr++;
+    return ptr;
+}
+
+static const char *
+model_test_parse_int(const char *ptr, const char *end, int *val)
+{
+    ptr = model_test_skip_space(ptr, end);
+
+    const bool neg = ptr < end && *ptr == '-';
+    if (ptr < end && (*ptr == '-' || *ptr == '+'))
+        ptr++;
+
+    const char *digits = ptr;
+    int64_t v = 0;
+    while (ptr < end && *ptr >= '0' && *ptr <= '9' && v <= INT32_MAX)
+        v = v * 10 + (*ptr++ - '0');
+    if (ptr == digits || v > INT32_MAX)
+        return NULL;
+
+    /* only the vertex index of v/vt/vn is used */
+    while (ptr < end && *ptr != ' ' && *ptr != '\t' && *ptr != '\r' && *ptr != '\n')
+        ptr++;
+
+    *val = (int)(neg ? -v : v);
+    return ptr;
+}
+
+static const char *
+model_test_parse_float(const char *ptr, const char *end, float *val)
+{
+    static const double pow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+
+    ptr = model_test_skip_space(ptr, end);
+    const char *begin = ptr;
+
+    const bool neg = ptr < end && *ptr == '-';
+    if (ptr < end && (*ptr == '-' || *ptr == '+'))
+        ptr++;
+
+    /* accumulate up to 19 significant digits and track the decimal exponent */
+    uint64_t mantissa = 0;
+    int digit_count = 0;
+    int exp = 0;
+    bool has_digits = false;
+    while (ptr < end && *ptr >= '0' && *ptr <= '9') {
+        if (digit_count < 19) {
+            mantissa = mantissa * 10 + (*ptr - '0');
+            digit_count += mantissa > 0;
+        } else {
+            exp++;
+        }
+        has_digits = true;
+        ptr++;
+    }
+    if (ptr < end && *ptr == '.') {
+        ptr++;
+        while (ptr < end && *ptr >= '0' && *ptr <= '9') {
+            if (digit_count < 19) {
+                mantissa = mantissa * 10 + (*ptr - '0');
+                digit_count += mantissa > 0;
+                exp--;
+            }
+            has_digits = true;
+            ptr++;
+        }
+    }
+    if (!has_digits)
+        return NULL;
+
+    if (ptr < end && (*ptr == 'e' || *ptr == 'E')) {
+        int e;
+        const char *e_end = model_test_parse_int(ptr + 1, end, &e);
+        if (!e_end || ptr[1] == ' ' || ptr[1] == '\t')
+            return NULL;
+        if (e > 1000)
+            e = 1000;
+        else if (e < -1000)
+            e = -1000;
+        exp += e;
+        ptr = e_end;
+    }
+
+    if (ptr < end && *ptr != ' ' && *ptr != '\t' && *ptr != '\r' && *ptr != '\n')
+        return NULL;
+
+    double v = (double)mantissa;
+    if (exp < -22 || exp > 22) {
+        /* rare; let libc get the rounding right */
+        char buf[64];
+        const size_t len = ptr - begin;
+        if (len >= sizeof(buf))
+            return NULL;
+        memcpy(buf, begin, len);
+        buf[len] = '\0';
+        *val = strtof(buf, NULL);
+        return ptr;
+    }
+    v = exp < 0 ? v / pow10[-exp] : v * pow10[exp];
+
+    *val = (float)(neg ? -v : v);
+    return ptr;
+}
+
+static void
+model_test_parse_chunk(struct model_chunk *chunk)
+{
+    const char *line = chunk->begin;
+    const char *end = chunk->end;
 
     while (line < end) {
         const char *newline = memchr(line, '\n', end - line);
-        if (!newline)
-            break;
-
-        bool parsed = true;
-        if (!strncmp(line, "v ", 2)) {
-            if (model->v) {
-                float *v = model->v[model->v_count];
-                if (sscanf(line, "v %f %f %f", &v[0], &v[1], &v[2]) != 3)
-                    parsed = false;
+        const char *line_end = newline ? newline : end;
+
+        const char *ptr = model_test_skip_space(line, line_end);
+        if (ptr + 1 < line_end && ptr[0] == 'v' && (ptr[1] == ' ' || ptr[1] == '\t')) {
+            if (chunk->v_count == chunk->v_max) {
+                chunk->v_max = chunk->v_max ? chunk->v_max * 2 : 4096;
+                chunk->v = realloc(chunk->v, sizeof(*chunk->v) * chunk->v_max);
+                if (!chunk->v)
+                    egl_die("failed to alloc v");
             }
-            model->v_count++;
-        } else if (!strncmp(line, "f ", 2)) {
-            if (model->f) {
-                int *f = model->f[model->f_count];
-                if (sscanf(line, "f %d %d %d", &f[0], &f[1], &f[2]) != 3)
-                    parsed = false;
+
+            float *v = chunk->v[chunk->v_count++];
+            ptr += 2;
+            for (int i = 0; ptr && i < 3; i++)
+                ptr = model_test_parse_float(ptr, line_end, &v[i]);
+        } else if (ptr + 1 < line_end && ptr[0] == 'f' && (ptr[1] == ' ' || ptr[1] == '\t')) {
+            if (chunk->f_count == chunk->f_max) {
+                chunk->f_max = chunk->f_max ? chunk->f_max * 2 : 4096;
+                chunk->f = realloc(chunk->f, sizeof(*chunk->f) * chunk->f_max);
+                if (!chunk->f)
+                    egl_die("failed to alloc f");
             }
-            model->f_count++;
-        } else {
-            parsed = false;
+
+            int *f = chunk->f[chunk->f_count++];
+            ptr += 2;
+            for (int i = 0; ptr && i < 3; i++)
+                ptr = model_test_parse_int(ptr, line_end, &f[i]);
+        } else if (ptr < line_end && *ptr != '#' && *ptr != '\r') {
+            ptr = NULL;
         }
 
-        if (!parsed)
-            egl_die("unsupported line: %.*s", (int)(newline - line), line);
+        if (!ptr) {
+            chunk->bad_line = line;
+            return;
+        }
 
-        line = newline + 1;
+        line = line_end + 1;
     }
 }
 
 static void
-model_test_init_model(struct model_test *test)
+model_test_parse_chunks(void *data, uint32_t begin, uint32_t end)
+{
+    struct model_chunk *chunks = data;
+    for (uint32_t i = begin; i < end; i++)
+        model_test_parse_chunk(&chunks[i]);
+}
+
+static void
+model_test_parse_model(struct model_test *test, const char *ptr, size_t size)
 {
     struct model *model = &test->model;
+    const char *end = ptr + size;
 
-    size_t size;
-    const char *ptr = u_map_file(test->filename, &size);
-    if (!ptr)
-        egl_die("failed to map %s", test->filename);
+    /* small files are not worth the thread overhead */
+    uint32_t chunk_count = size >= 1024 * 1024 ? u_parallel_get_thread_count() : 1;
+    struct model_chunk chunks[U_PARALLEL_MAX_THREADS] = { 0 };
+    const char *chunk_begin = ptr;
+    for (uint32_t i = 0; i < chunk_count; i++) {
+        const char *chunk_end = ptr + size / chunk_count * (i + 1);
+        if (i == chunk_count - 1) {
+            chunk_end = end;
+        } else {
+            if (chunk_end < chunk_begin)
+                chunk_end = chunk_begin;
+            chunk_end = memchr(chunk_end, '\n', end - chunk_end);
+            chunk_end = chunk_end ? chunk_end + 1 : end;
+        }
 
-    model_test_parse_model(test, ptr, size);
+        chunks[i].begin = chunk_begin;
+        chunks[i].end = chunk_end;
+        chunk_begin = chunk_end;
+
+        if (chunk_end == end) {
+            chunk_count = i + 1;
+            break;
+        }
+    }
+
+    u_parallel_for(chunk_count, 1, chunk_count, model_test_parse_chunks, chunks);
+
+    for (uint32_t i = 0; i < chunk_count; i++) {
+        const char *line = chunks[i].bad_line;
+        if (line) {
+            const char *newline = memchr(line, '\n', end - line);
+            const int len = (int)((newline ? newline : end) - line);
+            egl_die("unsupported line: %.*s", len, line);
+        }
+
+        model->v_count += chunks[i].v_count;
+        model->f_count += chunks[i].f_count;
+    }
 
     model->v = malloc(sizeof(*model->v) * model->v_count);
     if (!model->v)
@@ -244,14 +809,156 @@ model_test_init_model(struct model_test *test)
     if (!model->f)
         egl_die("failed to alloc f");
 
-    model->v_count = 0;
-    model->f_count = 0;
+    int v_count = 0;
+    int f_count = 0;
+    for (uint32_t i = 0; i < chunk_count; i++) {
+        struct model_chunk *chunk = &chunks[i];
+
+        memcpy(model->v + v_count, chunk->v, sizeof(*chunk->v) * chunk->v_count);
+        memcpy(model->f + f_count, chunk->f, sizeof(*chunk->f) * chunk->f_count);
+        v_count += chunk->v_count;
+        f_count += chunk->f_count;
+
+        free(chunk->v);
+        free(chunk->f);
+    }
+}
+
+static void
+model_test_init_cache_header(struct model_test *test, struct model_cache_header *hdr)
+{
+    const struct model *model = &test->model;
+
+    struct stat st;
+    if (stat(test->filename, &st))
+        egl_die("failed to stat %s", test->filename);
+
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, MODEL_CACHE_MAGIC, sizeof(hdr->magic));
+    hdr->version = MODEL_CACHE_VERSION;
+    hdr->flags = (test->normalize_model ? MODEL_CACHE_FLAG_NORMALIZED : 0) |
+                 (test->optimize_model ? MODEL_CACHE_FLAG_OPTIMIZED : 0);
+    hdr->obj_size = st.st_size;
+    hdr->obj_mtime = st.st_mtime;
+    hdr->v_count = model->v_count;
+    hdr->f_count = model->f_count;
+}
+
+static bool
+model_test_load_cache(struct model_test *test)
+{
+    struct model *model = &test->model;
+
+    if (access(test->cache_filename, R_OK))
+        return false;
+
+    /* u_map_file dies on empty or unmappable files, which interrupted writes can leave */
+    struct stat st;
+    if (stat(test->cache_filename, &st) || !S_ISREG(st.st_mode) ||
+        st.st_size < (off_t)sizeof(struct model_cache_header)) {
+        egl_log("ignoring bad model cache %s", test->cache_filename);
+        return false;
+    }
+
+    size_t size;
+    const void *ptr = u_map_file(test->cache_filename, &size);
+
+    struct model_cache_header expected;
+    model_test_init_cache_header(test, &expected);
+
+    struct model_cache_header hdr;
+    bool valid = size >= sizeof(hdr);
+    if (valid) {
+        memcpy(&hdr, ptr, sizeof(hdr));
+
+        /* everything but the counts must match */
+        expected.v_count = hdr.v_count;
+        expected.f_count = hdr.f_count;
+        valid = !memcmp(&hdr, &expected, sizeof(hdr)) &&
+                size == sizeof(hdr) + sizeof(struct model_vertex) * hdr.v_count +
+                            sizeof(*model->f) * hdr.f_count;
+    }
+
+    if (valid) {
+        model->v_count = hdr.v_count;
+        model->f_count = hdr.f_count;
+
+        const struct model_vertex *verts =
+            (const struct model_vertex *)((const char *)ptr + sizeof(hdr));
+        const int (*f)[3] = (const int (*)[3])(verts + hdr.v_count);
+        model_test_upload_model(test, verts, f);
+    } else {
+        egl_log("ignoring stale model cache %s", test->cache_filename);
+    }
+
+    u_unmap_file(ptr, size);
+
+    return valid;
+}
+
+static void
+model_test_save_cache(struct model_test *test, const struct model_vertex *verts)
+{
+    const struct model *model = &test->model;
+
+    struct model_cache_header hdr;
+    model_test_init_cache_header(test, &hdr);
+
+    const size_t v_size = sizeof(*verts) * model->v_count;
+    const size_t f_size = sizeof(*model->f) * model->f_count;
+    const size_t size = sizeof(hdr) + v_size + f_size;
+    char *data = malloc(size);
+    if (!data)
+        egl_die("failed to alloc model cache");
+
+    memcpy(data, &hdr, sizeof(hdr));
+    memcpy(data + sizeof(hdr), verts, v_size);
+    memcpy(data + sizeof(hdr) + v_size, model->f, f_size);
+
+    if (!u_write_file(test->cache_filename, data, size))
+        egl_log("failed to write model cache %s", test->cache_filename);
+
+    free(data);
+}
+
+static void
+model_test_init_model(struct model_test *test)
+{
+    struct model *model = &test->model;
+    const uint64_t begin = u_now();
+
+    if (test->cache_filename && model_test_load_cache(test)) {
+        egl_log("loaded %d vertices and %d faces from %s in %.1fms", model->v_count,
+                model->f_count, test->cache_filename, (u_now() - begin) / 1000000.0);
+        return;
+    }
+
+    size_t size;
+    const char *ptr = u_map_file(test->filename, &size);
+    if (!ptr)
+        egl_die("failed to map %s", test->filename);
+
     model_test_parse_model(test, ptr, size);
 
     u_unmap_file(ptr, size);
 
     model_test_process_model(test);
-    model_test_upload_model(test);
+    if (test->optimize_model)
+        model_test_optimize_model(test);
+
+    struct model_vertex *verts = model_test_build_vertices(test);
+    if (test->cache_filename)
+        model_test_save_cache(test, verts);
+    model_test_upload_model(test, verts, (const int (*)[3])model->f);
+
+    free(verts);
+    free(model->v);
+    free(model->f);
+    model->v = NULL;
+    model->f = NULL;
+
+    egl_log("loaded %d vertices and %d faces from %s in %.1fms", model->v_count,
+            model->f_count, test->filename, (u_now() - begin) / 1000000.0);
 }
 
 static void
@@ -418,16 +1125,22 @@ main(int argc, const char **argv)
         .ds_format = GL_DEPTH_COMPONENT16,
         .depth_test = true,
         .normalize_model = false,
+        .optimize_model = false,
         .outer_loop = 20,
         .inner_loop = 1,
     };
 
-    if (argc < 2 || argc > 3)
-        egl_die("usage: %s <obj> [<depth-test>]", argv[0]);
+    if (argc < 2 || argc > 5)
+        egl_die("usage: %s <obj> [<depth-test> [<mesh-cache> [<optimize>]]]", argv[0]);
 
     test.filename = argv[1];
     if (argc >= 3)
         test.depth_test = atoi(argv[2]);
+    /* an empty mesh cache path disables the cache */
+    if (argc >= 4)
+        test.cache_filename = argv[3][0] ? argv[3] : NULL;
+    if (argc >= 5)
+        test.optimize_model = atoi(argv[4]);
 
     if (!test.depth_test)
         test.ds_format = GL_NONE;
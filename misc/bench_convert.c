@@ -0,0 +1,327 @@
+/*
+ * Copyright 2024 Google LLC
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "util.h"
+
+struct bench_convert_test {
+    uint32_t width;
+    uint32_t height;
+    struct u_bench_params bench_params;
+
+    struct u_result result;
+};
+
+struct bench_convert_test_image {
+    uint32_t format;
+    uint32_t plane_count;
+    void *plane_ptrs[3];
+    uint32_t plane_strides[3];
+    size_t plane_sizes[3];
+};
+
+static void PRINTFLIKE(1, 2) bench_convert_log(const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    u_logv("BENCH_CONVERT", format, ap);
+    va_end(ap);
+}
+
+static void
+bench_convert_test_init_image(struct bench_convert_test *test,
+                              struct bench_convert_test_image *img,
+                              uint32_t format)
+{
+    /* plane layouts as consumed by u_convert_format */
+    uint32_t cpp[3];
+    uint32_t sub = 1;
+    switch (format) {
+    case DRM_FORMAT_ABGR8888:
+    case DRM_FORMAT_AYUV:
+        img->plane_count = 1;
+        cpp[0] = 4;
+        break;
+    case DRM_FORMAT_BGR888:
+    case DRM_FORMAT_RGB888:
+        img->plane_count = 1;
+        cpp[0] = 3;
+        break;
+    case DRM_FORMAT_NV12:
+        img->plane_count = 2;
+        cpp[0] = 1;
+        cpp[1] = 2;
+        sub = 2;
+        break;
+    case DRM_FORMAT_YUV444:
+        img->plane_count = 3;
+        cpp[0] = 1;
+        cpp[1] = 1;
+        cpp[2] = 1;
+        break;
+    default:
+        u_die("BENCH_CONVERT", "unsupported format %.4s", (const char *)&format);
+        break;
+    }
+
+    img->format = format;
+    for (uint32_t i = 0; i < img->plane_count; i++) {
+        const uint32_t width = i ? test->width / sub : test->width;
+        const uint32_t height = i ? test->height / sub : test->height;
+
+        /* pad the stride to catch kernels that ignore it */
+        img->plane_strides[i] = ALIGN(width * cpp[i] + 13, 16);
+        img->plane_sizes[i] = (size_t)img->plane_strides[i] * height;
+        img->plane_ptrs[i] = malloc(img->plane_sizes[i]);
+        if (!img->plane_ptrs[i])
+            u_die("BENCH_CONVERT", "failed to alloc plane");
+
+        uint8_t *ptr = (uint8_t *)img->plane_ptrs[i];
+        for (size_t j = 0; j < img->plane_sizes[i]; j++)
+            ptr[j] = (uint8_t)rand();
+    }
+}
+
+static void
+bench_convert_test_cleanup_image(struct bench_convert_test_image *img)
+{
+    for (uint32_t i = 0; i < img->plane_count; i++)
+        free(img->plane_ptrs[i]);
+}
+
+static void
+bench_convert_test_init_conversion(struct bench_convert_test *test,
+                                   struct u_format_conversion *conv,
+                                   const struct bench_convert_test_image *src,
+                                   const struct bench_convert_test_image *dst)
+{
+    *conv = (struct u_format_conversion){
+        .width = test->width,
+        .height = test->height,
+        .src_format = src->format,
+        .src_plane_count = src->plane_count,
+        .dst_format = dst->format,
+        .dst_plane_count = dst->plane_count,
+    };
+
+    for (uint32_t i = 0; i < src->plane_count; i++) {
+        conv->src_plane_ptrs[i] = src->plane_ptrs[i];
+        conv->src_plane_strides[i] = src->plane_strides[i];
+    }
+    for (uint32_t i = 0; i < dst->plane_count; i++) {
+        conv->dst_plane_ptrs[i] = dst->plane_ptrs[i];
+        conv->dst_plane_strides[i] = dst->plane_strides[i];
+    }
+}
+
+static bool
+bench_convert_test_compare(const struct bench_convert_test_image *a,
+                           const struct bench_convert_test_image *b)
+{
+    for (uint32_t i = 0; i < a->plane_count; i++) {
+        if (memcmp(a->plane_ptrs[i], b->plane_ptrs[i], a->plane_sizes[i]))
+            return false;
+    }
+    return true;
+}
+
+static void
+bench_convert_test_report(struct bench_convert_test *test,
+                          uint32_t src_format,
+                          uint32_t dst_format,
+                          enum u_simd_level level,
+                          uint32_t thread_count,
+                          const struct u_bench_stats *stats)
+{
+    const double mpix = (double)test->width * test->height / 1000000.0;
+    const double mpixps = mpix * 1000000000.0 / (double)stats->median;
+
+    char str[256];
+    bench_convert_log("%.4s -> %.4s: %s x%u: %.1f MPix/s (%s)", (const char *)&src_format,
+                      (const char *)&dst_format, u_simd_level_to_str(level), thread_count,
+                      mpixps, u_bench_stats_to_str(stats, str, sizeof(str)));
+
+    struct u_result *res = &test->result;
+    u_result_clear_params(res);
+    u_result_set_param(res, "src", "%.4s", (const char *)&src_format);
+    u_result_set_param(res, "dst", "%.4s", (const char *)&dst_format);
+    u_result_set_param(res, "simd", "%s", u_simd_level_to_str(level));
+    u_result_set_param(res, "threads", "%u", thread_count);
+    u_result_set_param(res, "width", "%u", test->width);
+    u_result_set_param(res, "height", "%u", test->height);
+    u_result_add(res, "throughput", mpixps, "MPix/s");
+    u_result_add_bench_stats(res, "time", stats);
+}
+
+static void
+bench_convert_test_run(struct bench_convert_test *test,
+                       const struct u_format_conversion *conv,
+                       const struct bench_convert_test_image *ref,
+                       const struct bench_convert_test_image *dst,
+                       enum u_simd_level level,
+                       uint32_t thread_count)
+{
+    struct u_bench bench;
+    struct u_bench_stats stats;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        const uint64_t start_ns = u_now();
+        u_convert_format_threaded(conv, level, thread_count);
+        const uint64_t end_ns = u_now();
+        u_bench_add(&bench, end_ns - start_ns);
+    }
+    u_bench_finish(&bench, &stats);
+
+    if (!bench_convert_test_compare(ref, dst)) {
+        u_die("BENCH_CONVERT", "%.4s -> %.4s: %s x%u is not bit-exact with scalar",
+              (const char *)&conv->src_format, (const char *)&conv->dst_format,
+              u_simd_level_to_str(level), thread_count);
+    }
+
+    bench_convert_test_report(test, conv->src_format, conv->dst_format, level, thread_count,
+                              &stats);
+}
+
+static void
+bench_convert_test_pair(struct bench_convert_test *test, uint32_t src_format, uint32_t dst_format)
+{
+    struct bench_convert_test_image src;
+    struct bench_convert_test_image ref;
+    struct bench_convert_test_image dst;
+    bench_convert_test_init_image(test, &src, src_format);
+    bench_convert_test_init_image(test, &ref, dst_format);
+    bench_convert_test_init_image(test, &dst, dst_format);
+
+    /* the scalar path is the reference; padding bytes stay untouched in both */
+    for (uint32_t i = 0; i < ref.plane_count; i++)
+        memcpy(dst.plane_ptrs[i], ref.plane_ptrs[i], ref.plane_sizes[i]);
+
+    struct u_format_conversion ref_conv;
+    bench_convert_test_init_conversion(test, &ref_conv, &src, &ref);
+    u_convert_format_simd(&ref_conv, U_SIMD_LEVEL_NONE);
+
+    struct u_format_conversion conv;
+    bench_convert_test_init_conversion(test, &conv, &src, &dst);
+
+    for (int i = 0; i < U_SIMD_LEVEL_COUNT; i++) {
+        const enum u_simd_level level = (enum u_simd_level)i;
+        if (!u_simd_level_supported(level))
+            continue;
+
+        bench_convert_test_run(test, &conv, &ref, &dst, level, 1);
+    }
+
+    const uint32_t thread_count = u_parallel_get_thread_count();
+    if (thread_count > 1)
+        bench_convert_test_run(test, &conv, &ref, &dst, u_simd_level_get(), thread_count);
+
+    bench_convert_test_cleanup_image(&dst);
+    bench_convert_test_cleanup_image(&ref);
+    bench_convert_test_cleanup_image(&src);
+}
+
+static void
+bench_convert_test_ppm(struct bench_convert_test *test)
+{
+    struct bench_convert_test_image src;
+    bench_convert_test_init_image(test, &src, DRM_FORMAT_ABGR8888);
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s/bench_convert.%d.ppm", P_tmpdir, (int)getpid());
+
+    struct u_bench bench;
+    struct u_bench_stats stats;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        const uint64_t start_ns = u_now();
+        u_write_ppm(path, src.plane_ptrs[0], test->width, test->height, src.plane_strides[0]);
+        const uint64_t end_ns = u_now();
+        u_bench_add(&bench, end_ns - start_ns);
+    }
+    u_bench_finish(&bench, &stats);
+
+    size_t ppm_size;
+    const void *ppm_data = u_map_file(path, &ppm_size);
+    uint32_t width;
+    uint32_t height;
+    const uint8_t *pixels = (const uint8_t *)u_parse_ppm(ppm_data, ppm_size, &width, &height);
+    if (width != test->width || height != test->height)
+        u_die("BENCH_CONVERT", "bad ppm size %ux%u", width, height);
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t *row = (const uint8_t *)src.plane_ptrs[0] + src.plane_strides[0] * y;
+        for (uint32_t x = 0; x < width; x++) {
+            if (memcmp(pixels + (width * y + x) * 3, row + x * 4, 3))
+                u_die("BENCH_CONVERT", "bad ppm pixel (%u, %u)", x, y);
+        }
+    }
+    u_unmap_file(ppm_data, ppm_size);
+    unlink(path);
+
+    const double mpixps =
+        (double)test->width * test->height * 1000.0 / (double)stats.median;
+    const double mbps = (double)ppm_size * 1000.0 / (double)stats.median;
+
+    char str[256];
+    bench_convert_log("u_write_ppm: %.1f MPix/s, %.1f MB/s (%s)", mpixps, mbps,
+                      u_bench_stats_to_str(&stats, str, sizeof(str)));
+
+    struct u_result *res = &test->result;
+    u_result_clear_params(res);
+    u_result_set_param(res, "width", "%u", test->width);
+    u_result_set_param(res, "height", "%u", test->height);
+    u_result_add(res, "ppm_throughput", mpixps, "MPix/s");
+    u_result_add_bench_stats(res, "ppm_time", &stats);
+
+    bench_convert_test_cleanup_image(&src);
+}
+
+static void
+bench_convert_test_all(struct bench_convert_test *test)
+{
+    static const uint32_t pairs[][2] = {
+        { DRM_FORMAT_BGR888, DRM_FORMAT_ABGR8888 },
+        { DRM_FORMAT_BGR888, DRM_FORMAT_NV12 },
+        { DRM_FORMAT_NV12, DRM_FORMAT_RGB888 },
+        { DRM_FORMAT_YUV444, DRM_FORMAT_RGB888 },
+        { DRM_FORMAT_AYUV, DRM_FORMAT_RGB888 },
+    };
+
+    bench_convert_log("%ux%u, best simd level: %s, threads: %u", test->width, test->height,
+                      u_simd_level_to_str(u_simd_level_get()), u_parallel_get_thread_count());
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(pairs); i++)
+        bench_convert_test_pair(test, pairs[i][0], pairs[i][1]);
+
+    bench_convert_test_ppm(test);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct bench_convert_test test = {
+        .width = 1920,
+        .height = 1080,
+        .bench_params = {
+            .warmup = 1,
+            .min_repeat = 5,
+            .max_repeat = 50,
+            .max_cv = 0.02f,
+        },
+    };
+
+    if (argc == 3) {
+        test.width = atoi(argv[1]);
+        test.height = atoi(argv[2]);
+    } else if (argc != 1) {
+        u_die("BENCH_CONVERT", "usage: %s [<width> <height>]", argv[0]);
+    }
+    if (!test.width || !test.height || (test.width | test.height) & 1)
+        u_die("BENCH_CONVERT", "width and height must be non-zero and even");
+
+    u_result_init(&test.result, "bench_convert", NULL);
+    bench_convert_test_all(&test);
+    u_result_cleanup(&test.result);
+
+    return 0;
+}
@@ -163,6 +163,19 @@ struct cl_init_params {
     uint32_t device_index;
 
     bool profiling;
+
+    /* when set, program binaries are cached to and loaded from this dir */
+    const char *program_cache_dir;
+
+    /* when set, cl_tune_pipeline saves tuned local sizes to and reuses them from this file */
+    const char *tune_db_path;
+};
+
+struct cl_tune_entry {
+    uint64_t key;
+    /* all 0 for the driver-chosen local size */
+    size_t local_size[3];
+    uint64_t ns;
 };
 
 struct cl {
@@ -184,6 +197,18 @@ struct cl {
     cl_context ctx;
 
     cl_command_queue cmdq;
+
+    struct {
+        uint32_t hit_count;
+        uint32_t miss_count;
+        uint64_t build_ns;
+    } program_cache;
+
+    struct {
+        bool loaded;
+        struct cl_tune_entry *entries;
+        uint32_t count;
+    } tune;
 };
 
 struct cl_buffer {
@@ -202,6 +227,34 @@ struct cl_pipeline {
     cl_kernel kern;
 };
 
+/* computes the fp32 sums of one dst row of a cpu reference from src rows widened to fp32 once
+ * per dst row rather than once per tap
+ */
+typedef void (*cl_ref_row_func)(const void *test,
+                                float *dst,
+                                const float *const *src_rows,
+                                const float *weights);
+
+/* a cpu reference of a kernel writing slices of half4 dst texels */
+struct cl_ref {
+    void *test;
+    /* computes ref_data with the row kernel of level on up to thread_count threads */
+    void (*run)(void *test, enum u_simd_level level, uint32_t thread_count);
+    /* optional; returns true for dst texels whose values are undefined */
+    bool (*skip)(const void *test, int x, int y);
+
+    int width;
+    int height;
+    int slice_count;
+    const cl_half *ref_data;
+
+    /* gpu accumulates in fp16 while the cpu reference accumulates in fp32 */
+    float tolerance;
+
+    uint64_t gpu_ns;
+    struct u_result *result;
+};
+
 static inline const char *
 cl_device_type_to_str(cl_device_type val, char *str, size_t size)
 {
@@ -893,6 +946,18 @@ cl_init(struct cl *cl, const struct cl_init_params *params)
     memset(cl, 0, sizeof(*cl));
     if (params)
         cl->params = *params;
+    if (!cl->params.program_cache_dir)
+        cl->params.program_cache_dir = getenv("CLUTIL_PROGRAM_CACHE_DIR");
+    if (!cl->params.tune_db_path)
+        cl->params.tune_db_path = getenv("CLUTIL_TUNE_DB");
+
+    /* these pick another implementation, such as a cpu one for local testing */
+    const char *plat_env = getenv("CLUTIL_PLATFORM");
+    if (plat_env && plat_env[0])
+        cl->params.platform_index = strtoul(plat_env, NULL, 0);
+    const char *dev_env = getenv("CLUTIL_DEVICE");
+    if (dev_env && dev_env[0])
+        cl->params.device_index = strtoul(dev_env, NULL, 0);
 
     cl_init_library(cl);
     cl_init_platforms(cl);
@@ -904,9 +969,26 @@ cl_init(struct cl *cl, const struct cl_init_params *params)
     cl_init_command_queue(cl);
 }
 
+static inline void
+cl_init_result(struct cl *cl, struct u_result *res, const char *tool)
+{
+    char driver[256];
+    snprintf(driver, sizeof(driver), "%s %s", cl->dev->version_str, cl->dev->driver_version);
+
+    u_result_init(res, tool, NULL);
+    u_result_set_device(res, cl->dev->name, driver);
+}
+
 static inline void
 cl_cleanup(struct cl *cl)
 {
+    if (cl->program_cache.hit_count || cl->program_cache.miss_count) {
+        cl_log("program cache: %u hits, %u misses, %" PRIu64 " us build time",
+               cl->program_cache.hit_count, cl->program_cache.miss_count,
+               cl->program_cache.build_ns / 1000);
+    }
+    free(cl->tune.entries);
+
     cl->err = cl->Finish(cl->cmdq);
     cl_check(cl, "failed to finish cmdq");
 
@@ -1121,17 +1203,100 @@ cl_get_program_build_info_alloc(struct cl *cl,
     return buf;
 }
 
-static inline struct cl_pipeline *
-cl_create_pipeline(struct cl *cl, const char *code, const char *main)
+static inline bool
+cl_get_program_cache_path(struct cl *cl,
+                          const char *code,
+                          const char *options,
+                          char *path,
+                          size_t size)
 {
-    cl_program prog = cl->CreateProgramWithSource(cl->ctx, 1, &code, NULL, &cl->err);
-    cl_check(cl, "failed to create program");
+    const char *dir = cl->params.program_cache_dir;
+    if (!dir || !dir[0])
+        return false;
 
-    const char *options;
-    if (CL_VERSION_MAJOR(cl->dev->version) >= 3)
-        options = "-cl-std=CL3.0";
-    else
-        options = "-cl-std=CL2.0";
+    /* key by source, build options, device, and driver version */
+    uint64_t key = u_hash_str(U_HASH_INIT, code);
+    key = u_hash_str(key, options);
+    key = u_hash_str(key, cl->dev->name);
+    key = u_hash_str(key, cl->dev->version_str);
+    key = u_hash_str(key, cl->dev->driver_version);
+
+    const int len = snprintf(path, size, "%s/clutil-%016" PRIx64 ".bin", dir, key);
+    if (len >= (int)size)
+        cl_die("program cache path too long");
+
+    return true;
+}
+
+static inline cl_program
+cl_load_program_binary(struct cl *cl, const char *path, const char *options)
+{
+    size_t size;
+    unsigned char *bin = (unsigned char *)u_read_file(path, &size);
+    if (!bin)
+        return NULL;
+
+    const unsigned char *bins[] = { bin };
+    cl_int bin_status;
+    cl_program prog =
+        cl->CreateProgramWithBinary(cl->ctx, 1, &cl->dev->id, &size, bins, &bin_status, &cl->err);
+    free(bin);
+
+    if (cl->err == CL_SUCCESS && bin_status == CL_SUCCESS) {
+        cl->err = cl->BuildProgram(prog, 1, &cl->dev->id, options, NULL, NULL);
+        if (cl->err == CL_SUCCESS)
+            return prog;
+    }
+
+    /* stale or corrupted; fall back to building from source */
+    cl_log("ignoring incompatible program binary %s", path);
+    if (prog)
+        cl->ReleaseProgram(prog);
+    cl->err = CL_SUCCESS;
+
+    return NULL;
+}
+
+static inline void
+cl_save_program_binary(struct cl *cl, cl_program prog, const char *path)
+{
+    size_t size;
+    cl->err = cl->GetProgramInfo(prog, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL);
+    cl_check(cl, "failed to get program binary size");
+    if (!size)
+        return;
+
+    unsigned char *bin = (unsigned char *)malloc(size);
+    if (!bin)
+        cl_die("failed to alloc program binary");
+
+    unsigned char *bins[] = { bin };
+    cl->err = cl->GetProgramInfo(prog, CL_PROGRAM_BINARIES, sizeof(bins), bins, NULL);
+    cl_check(cl, "failed to get program binary");
+
+    if (!u_write_file(path, bin, size))
+        cl_log("failed to write program binary %s", path);
+
+    free(bin);
+}
+
+static inline cl_program
+cl_build_program(struct cl *cl, const char *code, const char *options)
+{
+    const uint64_t begin = u_now();
+
+    char path[PATH_MAX];
+    const bool cached = cl_get_program_cache_path(cl, code, options, path, sizeof(path));
+
+    cl_program prog = cached ? cl_load_program_binary(cl, path, options) : NULL;
+    if (prog) {
+        cl->program_cache.hit_count++;
+        cl->program_cache.build_ns += u_now() - begin;
+        return prog;
+    }
+
+    prog = cl->CreateProgramWithSource(cl->ctx, 1, &code, NULL, &cl->err);
+    cl_check(cl, "failed to create program");
 
     cl->err = cl->BuildProgram(prog, 1, &cl->dev->id, options, NULL, NULL);
     if (cl->err != CL_SUCCESS) {
@@ -1141,6 +1306,26 @@ cl_create_pipeline(struct cl *cl, const char *code, const char *main)
         cl_die("failed to build program: status %d, log %s", status, log);
     }
 
+    cl->program_cache.miss_count++;
+    cl->program_cache.build_ns += u_now() - begin;
+
+    if (cached)
+        cl_save_program_binary(cl, prog, path);
+
+    return prog;
+}
+
+static inline struct cl_pipeline *
+cl_create_pipeline(struct cl *cl, const char *code, const char *main)
+{
+    const char *options;
+    if (CL_VERSION_MAJOR(cl->dev->version) >= 3)
+        options = "-cl-std=CL3.0";
+    else
+        options = "-cl-std=CL2.0";
+
+    cl_program prog = cl_build_program(cl, code, options);
+
     cl_kernel kern = cl->CreateKernel(prog, main, &cl->err);
     cl_check(cl, "failed to create kernel");
 
@@ -1250,4 +1435,372 @@ cl_wait_event(struct cl *cl, cl_event ev)
     cl_check(cl, "failed to wait for event");
 }
 
+static inline const struct cl_tune_entry *
+cl_find_tune_entry(const struct cl *cl, uint64_t key)
+{
+    for (uint32_t i = 0; i < cl->tune.count; i++) {
+        if (cl->tune.entries[i].key == key)
+            return &cl->tune.entries[i];
+    }
+    return NULL;
+}
+
+static inline void
+cl_add_tune_entry(struct cl *cl, const struct cl_tune_entry *entry)
+{
+    struct cl_tune_entry *old = (struct cl_tune_entry *)cl_find_tune_entry(cl, entry->key);
+    if (old) {
+        *old = *entry;
+        return;
+    }
+
+    cl->tune.entries = (struct cl_tune_entry *)realloc(
+        cl->tune.entries, sizeof(*cl->tune.entries) * (cl->tune.count + 1));
+    if (!cl->tune.entries)
+        cl_die("failed to alloc tune entries");
+    cl->tune.entries[cl->tune.count++] = *entry;
+}
+
+/* one "key local_x local_y local_z ns" line per entry */
+static inline void
+cl_load_tune_db(struct cl *cl)
+{
+    cl->tune.loaded = true;
+
+    size_t size;
+    char *text = (char *)u_read_file(cl->params.tune_db_path, &size);
+    if (!text)
+        return;
+    text = (char *)realloc(text, size + 1);
+    if (!text)
+        cl_die("failed to alloc tune db");
+    text[size] = '\0';
+
+    char *line = text;
+    while (*line) {
+        char *next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        else
+            next = line + strlen(line);
+
+        struct cl_tune_entry entry;
+        if (line[0] && line[0] != '#') {
+            if (sscanf(line, "%" SCNx64 " %zu %zu %zu %" SCNu64, &entry.key,
+                       &entry.local_size[0], &entry.local_size[1], &entry.local_size[2],
+                       &entry.ns) == 5)
+                cl_add_tune_entry(cl, &entry);
+            else
+                cl_log("ignoring bad tune db line: %s", line);
+        }
+
+        line = next;
+    }
+
+    free(text);
+}
+
+static inline void
+cl_save_tune_db(struct cl *cl)
+{
+    const size_t line_size = 128;
+    char *text = (char *)malloc(line_size * (cl->tune.count + 1));
+    if (!text)
+        cl_die("failed to alloc tune db");
+
+    size_t size = snprintf(text, line_size, "# key local_x local_y local_z ns\n");
+    for (uint32_t i = 0; i < cl->tune.count; i++) {
+        const struct cl_tune_entry *entry = &cl->tune.entries[i];
+        size += snprintf(text + size, line_size, "%016" PRIx64 " %zu %zu %zu %" PRIu64 "\n",
+                         entry->key, entry->local_size[0], entry->local_size[1],
+                         entry->local_size[2], entry->ns);
+    }
+
+    if (!u_write_file(cl->params.tune_db_path, text, size))
+        cl_log("failed to write tune db %s", cl->params.tune_db_path);
+
+    free(text);
+}
+
+/* returns the median time of the dispatch, or 0 if the local size is rejected */
+static inline uint64_t
+cl_time_pipeline(struct cl *cl,
+                 struct cl_pipeline *pipeline,
+                 cl_uint dim,
+                 const size_t *global_size,
+                 const size_t *local_size)
+{
+    const struct u_bench_params params = {
+        .warmup = 1,
+        .min_repeat = 3,
+        .max_repeat = 10,
+        .max_cv = 0.05f,
+    };
+    struct u_bench bench;
+    struct u_bench_stats stats;
+    u_bench_init(&bench, &params);
+    while (u_bench_next(&bench)) {
+        cl_event ev;
+        cl->err = cl->EnqueueNDRangeKernel(cl->cmdq, pipeline->kern, dim, NULL, global_size,
+                                           local_size, 0, NULL, &ev);
+        if (cl->err == CL_INVALID_WORK_GROUP_SIZE || cl->err == CL_INVALID_WORK_ITEM_SIZE ||
+            cl->err == CL_OUT_OF_RESOURCES) {
+            cl->err = CL_SUCCESS;
+            free(bench.samples);
+            return 0;
+        }
+        cl_check(cl, "failed to enqueue kernel");
+        cl_wait_event(cl, ev);
+
+        cl_ulong start_ns;
+        cl_ulong end_ns;
+        cl_get_event_profiling_info(cl, ev, CL_PROFILING_COMMAND_START, &start_ns,
+                                    sizeof(start_ns));
+        cl_get_event_profiling_info(cl, ev, CL_PROFILING_COMMAND_END, &end_ns, sizeof(end_ns));
+        cl_destroy_event(cl, ev);
+
+        /* 0 is reserved for rejected sizes */
+        u_bench_add(&bench, end_ns > start_ns ? end_ns - start_ns : 1);
+    }
+    u_bench_finish(&bench, &stats);
+
+    return stats.median;
+}
+
+/*
+ * Replaces local_size by the fastest local size for the dispatch, which must have its args set.
+ * shape must identify the kernel and the problem beyond global_size, which follows the
+ * cl_enqueue_pipeline convention.  Results are keyed by device and driver in the tune db and
+ * reused; without a tune db, local_size is kept.
+ */
+static inline void
+cl_tune_pipeline(struct cl *cl,
+                 struct cl_pipeline *pipeline,
+                 const char *shape,
+                 const size_t global_size[3],
+                 size_t local_size[3])
+{
+    if (!cl->params.tune_db_path || !cl->params.tune_db_path[0])
+        return;
+    if (!cl->params.profiling)
+        cl_die("tuning requires profiling");
+    if (!cl->tune.loaded)
+        cl_load_tune_db(cl);
+
+    char kern_name[256];
+    cl->err = cl->GetKernelInfo(pipeline->kern, CL_KERNEL_FUNCTION_NAME, sizeof(kern_name),
+                                kern_name, NULL);
+    cl_check(cl, "failed to get kernel name");
+
+    uint64_t key = u_hash_str(U_HASH_INIT, cl->dev->name);
+    key = u_hash_str(key, cl->dev->version_str);
+    key = u_hash_str(key, cl->dev->driver_version);
+    key = u_hash_str(key, kern_name);
+    key = u_hash_str(key, shape);
+    key = u_hash(key, global_size, sizeof(*global_size) * 3);
+
+    const struct cl_tune_entry *entry = cl_find_tune_entry(cl, key);
+    if (entry) {
+        memcpy(local_size, entry->local_size, sizeof(entry->local_size));
+        return;
+    }
+
+    size_t kern_max_size;
+    cl->err = cl->GetKernelWorkGroupInfo(pipeline->kern, cl->dev->id, CL_KERNEL_WORK_GROUP_SIZE,
+                                         sizeof(kern_max_size), &kern_max_size, NULL);
+    cl_check(cl, "failed to get kernel work group size");
+
+    const size_t max_size = kern_max_size < cl->dev->max_work_group_size
+                                ? kern_max_size
+                                : cl->dev->max_work_group_size;
+    const bool non_uniform =
+        CL_VERSION_MAJOR(cl->dev->version) == 2 || cl->dev->non_uniform_work_group_support;
+    const cl_uint dim = global_size[2] ? 3 : global_size[1] ? 2 : 1;
+
+    size_t max_local_size[3];
+    for (uint32_t i = 0; i < 3; i++) {
+        const size_t dev_max = cl->dev->max_work_item_sizes[i];
+        max_local_size[i] = i >= dim ? 1 : global_size[i] < dev_max ? global_size[i] : dev_max;
+    }
+
+    struct cl_tune_entry best = {
+        .key = key,
+        .ns = cl_time_pipeline(cl, pipeline, dim, global_size, NULL),
+    };
+    if (!best.ns)
+        cl_die("failed to dispatch with the default local size");
+    const uint64_t default_ns = best.ns;
+    uint32_t candidate_count = 1;
+
+    /* powers of two in each dimension */
+    size_t local[3];
+    for (local[2] = 1; local[2] <= max_local_size[2]; local[2] *= 2) {
+        for (local[1] = 1; local[1] <= max_local_size[1]; local[1] *= 2) {
+            for (local[0] = 1; local[0] <= max_local_size[0]; local[0] *= 2) {
+                if (local[0] * local[1] * local[2] > max_size)
+                    break;
+                if (!non_uniform && (global_size[0] % local[0] || global_size[1] % local[1] ||
+                                     global_size[2] % local[2]))
+                    continue;
+
+                const uint64_t ns = cl_time_pipeline(cl, pipeline, dim, global_size, local);
+                if (!ns)
+                    continue;
+
+                candidate_count++;
+                if (ns < best.ns) {
+                    best.ns = ns;
+                    memcpy(best.local_size, local, sizeof(local));
+                }
+            }
+        }
+    }
+
+    cl_log("tuned %s: local size %zux%zux%zu, %.3f ms (default %.3f ms, %u candidates)", shape,
+           best.local_size[0], best.local_size[1], best.local_size[2], best.ns / 1000000.0,
+           default_ns / 1000000.0, candidate_count);
+
+    cl_add_tune_entry(cl, &best);
+    cl_save_tune_db(cl);
+
+    memcpy(local_size, best.local_size, sizeof(best.local_size));
+}
+
+static inline void
+cl_fill_random_half(cl_half *data, size_t count, float scale)
+{
+    for (size_t i = 0; i < count; i++)
+        data[i] = u_float_to_half(((float)rand() / (float)RAND_MAX * 2.0f - 1.0f) * scale);
+}
+
+/* keeps sums of term_count random products around 1, where fp16 accumulation is accurate */
+static inline float
+cl_get_ref_weight_scale(uint32_t term_count)
+{
+    return 1.0f / sqrtf((float)term_count);
+}
+
+/* funcs is indexed by simd level; levels without a row kernel use the scalar one */
+static inline cl_ref_row_func
+cl_get_ref_row(const cl_ref_row_func funcs[U_SIMD_LEVEL_COUNT], enum u_simd_level level)
+{
+    if (!u_simd_level_supported(level))
+        cl_die("unsupported simd level %s", u_simd_level_to_str(level));
+
+    return funcs[level] ? funcs[level] : funcs[U_SIMD_LEVEL_NONE];
+}
+
+static inline float
+cl_check_ref(const struct cl_ref *ref,
+             const cl_half *gpu_data,
+             enum u_simd_level level,
+             uint32_t thread_count)
+{
+    float max_err = 0.0f;
+    for (int s = 0; s < ref->slice_count; s++) {
+        for (int y = 0; y < ref->height; y++) {
+            for (int x = 0; x < ref->width; x++) {
+                if (ref->skip && ref->skip(ref->test, x, y))
+                    continue;
+
+                const int idx = ((s * ref->height + y) * ref->width + x) * 4;
+                for (int c = 0; c < 4; c++) {
+                    const float gpu = u_half_to_float(gpu_data[idx + c]);
+                    const float cpu = u_half_to_float(ref->ref_data[idx + c]);
+                    const float err = fabsf(gpu - cpu);
+                    if (!(err <= ref->tolerance * (1.0f + fabsf(cpu)))) {
+                        cl_die("%s x%u: dst (%d, %d, %d).%c is %f on gpu but %f on cpu",
+                               u_simd_level_to_str(level), thread_count, x, y, s, "xyzw"[c],
+                               gpu, cpu);
+                    }
+                    if (max_err < err)
+                        max_err = err;
+                }
+            }
+        }
+    }
+
+    return max_err;
+}
+
+static inline void
+cl_report_ref(const struct cl_ref *ref,
+              enum u_simd_level level,
+              uint32_t thread_count,
+              const struct u_bench_stats *stats,
+              float max_err)
+{
+    const double speedup = (double)stats->median / (double)ref->gpu_ns;
+
+    char str[256];
+    cl_log("cpu %s x%u: %.3f ms, gpu: %.3f ms, gpu speedup: %.1fx, max err: %f (%s)",
+           u_simd_level_to_str(level), thread_count, (double)stats->median / 1000000.0,
+           (double)ref->gpu_ns / 1000000.0, speedup, max_err,
+           u_bench_stats_to_str(stats, str, sizeof(str)));
+
+    struct u_result *res = ref->result;
+    u_result_clear_params(res);
+    u_result_set_param(res, "simd", "%s", u_simd_level_to_str(level));
+    u_result_set_param(res, "threads", "%u", thread_count);
+    u_result_add(res, "gpu_time", (double)ref->gpu_ns / 1000000.0, "ms");
+    u_result_add(res, "speedup", speedup, "x");
+    u_result_add(res, "max_error", max_err, "");
+    u_result_add_bench_stats(res, "cpu_time", stats);
+}
+
+static inline void
+cl_run_ref(const struct cl_ref *ref,
+           const cl_half *gpu_data,
+           enum u_simd_level level,
+           uint32_t thread_count)
+{
+    struct u_bench bench;
+    struct u_bench_stats stats;
+    u_bench_init(&bench, NULL);
+    while (u_bench_next(&bench)) {
+        const uint64_t start_ns = u_now();
+        ref->run(ref->test, level, thread_count);
+        const uint64_t end_ns = u_now();
+        u_bench_add(&bench, end_ns - start_ns);
+    }
+    u_bench_finish(&bench, &stats);
+
+    const float max_err = cl_check_ref(ref, gpu_data, level, thread_count);
+    cl_report_ref(ref, level, thread_count, &stats, max_err);
+}
+
+/*
+ * Benchmarks the cpu reference at every supported simd level single-threaded, and at the best
+ * level with all threads.  Each run is checked against dst_buf.
+ */
+static inline void
+cl_validate_ref(struct cl *cl, const struct cl_ref *ref, struct cl_buffer *dst_buf)
+{
+    if (ref->skip) {
+        uint32_t skip_count = 0;
+        for (int y = 0; y < ref->height; y++) {
+            for (int x = 0; x < ref->width; x++)
+                skip_count += ref->skip(ref->test, x, y);
+        }
+        cl_log("skipping %u of %d dst texels per slice with undefined values", skip_count,
+               ref->width * ref->height);
+    }
+
+    const cl_half *gpu_data = (const cl_half *)cl_map_buffer(cl, dst_buf, CL_MAP_READ);
+
+    for (int i = 0; i < U_SIMD_LEVEL_COUNT; i++) {
+        const enum u_simd_level level = (enum u_simd_level)i;
+        if (!u_simd_level_supported(level))
+            continue;
+
+        cl_run_ref(ref, gpu_data, level, 1);
+    }
+
+    const uint32_t thread_count = u_parallel_get_thread_count();
+    if (thread_count > 1)
+        cl_run_ref(ref, gpu_data, u_simd_level_get(), thread_count);
+
+    cl_unmap_buffer(cl, dst_buf);
+}
+
 #endif /* CLUTIL_H */
@@ -45,6 +45,9 @@ struct egl_init_params {
     const char *libegl_name;
     EGLint pbuffer_width;
     EGLint pbuffer_height;
+
+    /* when set, program binaries are cached to and loaded from this dir */
+    const char *program_cache_dir;
 };
 
 struct egl {
@@ -83,6 +86,14 @@ struct egl {
     struct egl_drm_format **drm_formats;
 
     const char *gl_exts;
+
+    struct {
+        bool enabled;
+        uint32_t hit_count;
+        uint32_t miss_count;
+        uint64_t compile_ns;
+        uint64_t load_ns;
+    } program_cache;
 };
 
 struct egl_framebuffer {
@@ -391,6 +402,16 @@ egl_init_gl(struct egl *egl)
     egl->gl_exts = (const char *)egl->gl.GetString(GL_EXTENSIONS);
     if (!egl->gl_exts)
         egl_die("no GLES extensions");
+
+    const char *dir = egl->params.program_cache_dir;
+    if (dir && dir[0]) {
+        GLint format_count;
+        egl->gl.GetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+        if (format_count)
+            egl->program_cache.enabled = true;
+        else
+            egl_log("no program binary formats; program cache disabled");
+    }
 }
 
 static inline void
@@ -402,6 +423,8 @@ egl_init(struct egl *egl, const struct egl_init_params *params)
         egl->params = *params;
     if (!egl->params.libegl_name)
         egl->params.libegl_name = LIBEGL_NAME;
+    if (!egl->params.program_cache_dir)
+        egl->params.program_cache_dir = getenv("EGLUTIL_PROGRAM_CACHE_DIR");
 
     egl_init_library(egl);
     egl_check(egl, "init library");
@@ -427,6 +450,12 @@ egl_cleanup(struct egl *egl)
 {
     egl_check(egl, "cleanup");
 
+    if (egl->program_cache.enabled) {
+        egl_log("program cache: %u hits in %" PRIu64 " us, %u misses in %" PRIu64 " us",
+                egl->program_cache.hit_count, egl->program_cache.load_ns / 1000,
+                egl->program_cache.miss_count, egl->program_cache.compile_ns / 1000);
+    }
+
     if (egl->drm_format_count) {
         for (int i = 0; i < egl->drm_format_count; i++)
             free(egl->drm_formats[i]);
@@ -607,6 +636,8 @@ egl_link_program(struct egl *egl, const GLuint *shaders, int count)
     GLuint prog = gl->CreateProgram();
     for (int i = 0; i < count; i++)
         gl->AttachShader(prog, shaders[i]);
+    if (egl->program_cache.enabled)
+        gl->ProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     gl->LinkProgram(prog);
 
     GLint val;
@@ -620,6 +651,87 @@ egl_link_program(struct egl *egl, const GLuint *shaders, int count)
     return prog;
 }
 
+static inline void
+egl_get_program_cache_path(struct egl *egl,
+                           const char *vs_glsl,
+                           const char *fs_glsl,
+                           char *path,
+                           size_t size)
+{
+    struct egl_gl *gl = &egl->gl;
+
+    /* key by glsl, renderer, and driver version */
+    uint64_t key = u_hash_str(U_HASH_INIT, vs_glsl);
+    key = u_hash_str(key, fs_glsl);
+    key = u_hash_str(key, (const char *)gl->GetString(GL_RENDERER));
+    key = u_hash_str(key, (const char *)gl->GetString(GL_VERSION));
+
+    const int len = snprintf(path, size, "%s/eglutil-%016" PRIx64 ".bin",
+                             egl->params.program_cache_dir, key);
+    if (len >= (int)size)
+        egl_die("program cache path too long");
+}
+
+/* a cached binary is the GLenum binary format followed by the binary */
+static inline GLuint
+egl_load_program_binary(struct egl *egl, const char *path)
+{
+    struct egl_gl *gl = &egl->gl;
+
+    size_t size;
+    void *data = u_read_file(path, &size);
+    if (!data)
+        return 0;
+
+    GLuint prog = 0;
+    GLenum format;
+    if (size > sizeof(format)) {
+        memcpy(&format, data, sizeof(format));
+
+        prog = gl->CreateProgram();
+        gl->ProgramBinary(prog, format, (const char *)data + sizeof(format),
+                          (GLsizei)(size - sizeof(format)));
+
+        /* the driver rejects binaries from other builds */
+        GLint val;
+        gl->GetProgramiv(prog, GL_LINK_STATUS, &val);
+        if (val != GL_TRUE) {
+            gl->DeleteProgram(prog);
+            prog = 0;
+        }
+    }
+    free(data);
+
+    if (!prog)
+        egl_log("ignoring incompatible program binary %s", path);
+
+    return prog;
+}
+
+static inline void
+egl_save_program_binary(struct egl *egl, GLuint prog, const char *path)
+{
+    struct egl_gl *gl = &egl->gl;
+
+    GLint size;
+    gl->GetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0)
+        return;
+
+    GLenum format;
+    char *data = (char *)malloc(sizeof(format) + size);
+    if (!data)
+        egl_die("failed to alloc program binary");
+
+    gl->GetProgramBinary(prog, size, &size, &format, data + sizeof(format));
+    memcpy(data, &format, sizeof(format));
+
+    if (!u_write_file(path, data, sizeof(format) + size))
+        egl_log("failed to write program binary %s", path);
+
+    free(data);
+}
+
 static inline struct egl_program *
 egl_create_program(struct egl *egl, const char *vs_glsl, const char *fs_glsl)
 {
@@ -627,12 +739,33 @@ egl_create_program(struct egl *egl, const char *vs_glsl, const char *fs_glsl)
     if (!prog)
         egl_die("failed to alloc prog");
 
+    const uint64_t begin = u_now();
+
+    char path[PATH_MAX];
+    if (egl->program_cache.enabled) {
+        egl_get_program_cache_path(egl, vs_glsl, fs_glsl, path, sizeof(path));
+
+        /* shaders are not needed with a binary */
+        prog->prog = egl_load_program_binary(egl, path);
+        if (prog->prog) {
+            egl->program_cache.hit_count++;
+            egl->program_cache.load_ns += u_now() - begin;
+            return prog;
+        }
+    }
+
     prog->vs = egl_compile_shader(egl, GL_VERTEX_SHADER, vs_glsl);
     prog->fs = egl_compile_shader(egl, GL_FRAGMENT_SHADER, fs_glsl);
 
     const GLuint shaders[] = { prog->vs, prog->fs };
     prog->prog = egl_link_program(egl, shaders, ARRAY_SIZE(shaders));
 
+    egl->program_cache.miss_count++;
+    egl->program_cache.compile_ns += u_now() - begin;
+
+    if (egl->program_cache.enabled)
+        egl_save_program_binary(egl, prog->prog, path);
+
     return prog;
 }
 
@@ -24,10 +24,16 @@ struct ff {
 
     AVBufferRef *hwdev_ctx;
 
+    /* frames the caller holds on to in addition to what the decoder needs */
+    int extra_hw_frames;
     AVCodecContext *codec_ctx;
 
     AVPacket *packet;
     AVFrame *frame;
+
+    /* accumulated by ff_decode_frame */
+    uint64_t demux_ns;
+    uint64_t decode_ns;
 };
 
 static inline void
@@ -133,6 +139,7 @@ ff_init_codec(struct ff *ff)
 
     ff->codec_ctx->get_format = ff_get_hwdev_format;
     ff->codec_ctx->hw_device_ctx = av_buffer_ref(ff->hwdev_ctx);
+    ff->codec_ctx->extra_hw_frames = ff->extra_hw_frames;
     ff->codec_ctx->opaque = ff;
 
     ret = avcodec_open2(ff->codec_ctx, ff->stream_codec, NULL);
@@ -141,12 +148,8 @@ ff_init_codec(struct ff *ff)
 }
 
 static inline void
-ff_init(struct ff *ff, VADisplay dpy, const char *filename)
+ff_init_frames(struct ff *ff)
 {
-    ff_init_input(ff, filename);
-    ff_init_hwdev(ff, dpy);
-    ff_init_codec(ff);
-
     ff->packet = av_packet_alloc();
     if (!ff->packet)
         ff_die("failed to alloc packet");
@@ -156,6 +159,29 @@ ff_init(struct ff *ff, VADisplay dpy, const char *filename)
         ff_die("failed to alloc frame");
 }
 
+static inline void
+ff_init(struct ff *ff, VADisplay dpy, const char *filename)
+{
+    ff_init_input(ff, filename);
+    ff_init_hwdev(ff, dpy);
+    ff_init_codec(ff);
+    ff_init_frames(ff);
+}
+
+/* opens another decode session on the hwdev of an initialized ff */
+static inline void
+ff_init_with_hwdev(struct ff *ff, AVBufferRef *hwdev_ctx, const char *filename)
+{
+    ff_init_input(ff, filename);
+
+    ff->hwdev_ctx = av_buffer_ref(hwdev_ctx);
+    if (!ff->hwdev_ctx)
+        ff_die("failed to ref hwdev context");
+
+    ff_init_codec(ff);
+    ff_init_frames(ff);
+}
+
 static inline void
 ff_cleanup(struct ff *ff)
 {
@@ -180,8 +206,11 @@ ff_receive_frame(struct ff *ff)
     }
 }
 
+/* the frame is returned before the hw is done decoding to its surface; callers that access the
+ * surface must ff_sync_surface first
+ */
 static inline bool
-ff_decode_frame(struct ff *ff)
+ff_decode_frame_async(struct ff *ff)
 {
     bool input_eof = false;
 
@@ -192,7 +221,9 @@ ff_decode_frame(struct ff *ff)
             if (input_eof)
                 return false;
 
+            const uint64_t demux_begin = u_now();
             ret = av_read_frame(ff->input_ctx, ff->packet);
+            ff->demux_ns += u_now() - demux_begin;
             if (ret < 0) {
                 input_eof = true;
                 /* flush */
@@ -219,10 +250,40 @@ ff_decode_frame(struct ff *ff)
     return true;
 }
 
+static inline bool
+ff_decode_frame(struct ff *ff)
+{
+    const uint64_t begin = u_now();
+    const uint64_t demux_ns = ff->demux_ns;
+
+    const bool ret = ff_decode_frame_async(ff);
+
+    ff->decode_ns += u_now() - begin - (ff->demux_ns - demux_ns);
+    return ret;
+}
+
+static inline VASurfaceID
+ff_get_surface(const AVFrame *frame)
+{
+    return (uintptr_t)frame->data[3];
+}
+
 static inline VASurfaceID
 ff_get_frame_surface(struct ff *ff)
 {
-    return (uintptr_t)ff->frame->data[3];
+    return ff_get_surface(ff->frame);
+}
+
+/* waits for the decode to the surface; frames are returned before the hw is done */
+static inline void
+ff_sync_surface(struct ff *ff, VASurfaceID surf)
+{
+    const AVHWDeviceContext *hwdev_ctx = (const AVHWDeviceContext *)ff->hwdev_ctx->data;
+    const AVVAAPIDeviceContext *vadev_ctx = hwdev_ctx->hwctx;
+
+    const VAStatus status = vaSyncSurface(vadev_ctx->display, surf);
+    if (status != VA_STATUS_SUCCESS)
+        ff_die("failed to sync surface: %d", status);
 }
 
 #endif /* FFUTIL_H */
@@ -12,6 +12,7 @@
 #include <ctype.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <math.h>
 #include <stdalign.h>
 #include <stdarg.h>
@@ -22,9 +23,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <threads.h>
 #include <time.h>
 #include <unistd.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #ifdef __ANDROID__
 #include <android/log.h>
 #endif
@@ -127,6 +135,27 @@ u_minify(uint32_t base, uint32_t level)
     return val ? val : 1;
 }
 
+#define U_HASH_INIT 0xcbf29ce484222325ull
+
+/* 64-bit FNV-1a; chain calls by passing the previous hash */
+static inline uint64_t
+u_hash(uint64_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static inline uint64_t
+u_hash_str(uint64_t hash, const char *str)
+{
+    /* include the terminator to keep adjacent strings distinct */
+    return u_hash(hash, str, strlen(str) + 1);
+}
+
 static inline uint64_t
 u_now(void)
 {
@@ -152,6 +181,515 @@ u_sleep(uint32_t ms)
         u_die("util", "failed to sleep");
 }
 
+#define U_PARALLEL_MAX_THREADS 32
+
+struct u_parallel_task {
+    void (*func)(void *data, uint32_t begin, uint32_t end);
+    void *data;
+    uint32_t begin;
+    uint32_t end;
+
+    thrd_t thrd;
+    bool threaded;
+};
+
+static inline uint32_t
+u_parallel_get_thread_count(void)
+{
+    static uint32_t cached;
+    if (cached)
+        return cached;
+
+    /* UTIL_THREADS overrides the online cpu count */
+    const char *env = getenv("UTIL_THREADS");
+    long count = env && env[0] ? strtol(env, NULL, 0) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (count < 1)
+        count = 1;
+    else if (count > U_PARALLEL_MAX_THREADS)
+        count = U_PARALLEL_MAX_THREADS;
+
+    cached = (uint32_t)count;
+    return cached;
+}
+
+/* small images are not worth the thread overhead */
+static inline uint32_t
+u_parallel_get_image_thread_count(uint32_t width, uint32_t height)
+{
+    return (uint64_t)width * height >= 256 * 1024 ? u_parallel_get_thread_count() : 1;
+}
+
+static inline int
+u_parallel_task_run(void *arg)
+{
+    struct u_parallel_task *task = (struct u_parallel_task *)arg;
+    task->func(task->data, task->begin, task->end);
+    return 0;
+}
+
+/* Splits [0, count) into one contiguous range per thread and calls func on each range.  Each
+ * range starts at a multiple of align, which must be a power of two.  When thread_count is 0,
+ * u_parallel_get_thread_count is used.
+ */
+static inline void
+u_parallel_for(uint32_t count,
+               uint32_t align,
+               uint32_t thread_count,
+               void (*func)(void *data, uint32_t begin, uint32_t end),
+               void *data)
+{
+    if (!thread_count)
+        thread_count = u_parallel_get_thread_count();
+    if (thread_count > U_PARALLEL_MAX_THREADS)
+        thread_count = U_PARALLEL_MAX_THREADS;
+
+    if (thread_count <= 1 || count <= align) {
+        func(data, 0, count);
+        return;
+    }
+
+    const uint32_t chunk = ALIGN(DIV_ROUND_UP(count, thread_count), align);
+    struct u_parallel_task tasks[U_PARALLEL_MAX_THREADS];
+    uint32_t task_count = 0;
+    for (uint32_t begin = 0; begin < count; begin += chunk) {
+        struct u_parallel_task *task = &tasks[task_count++];
+        task->func = func;
+        task->data = data;
+        task->begin = begin;
+        task->end = count - begin > chunk ? begin + chunk : count;
+        task->threaded = false;
+    }
+
+    /* the calling thread takes the first range; fall back to it when thrd_create fails */
+    for (uint32_t i = 1; i < task_count; i++) {
+        struct u_parallel_task *task = &tasks[i];
+        task->threaded = thrd_create(&task->thrd, u_parallel_task_run, task) == thrd_success;
+    }
+
+    u_parallel_task_run(&tasks[0]);
+
+    for (uint32_t i = 1; i < task_count; i++) {
+        struct u_parallel_task *task = &tasks[i];
+        if (!task->threaded)
+            u_parallel_task_run(task);
+        else if (thrd_join(task->thrd, NULL) != thrd_success)
+            u_die("util", "failed to join thread");
+    }
+}
+
+struct u_bench_params {
+    uint32_t warmup;
+    uint32_t min_repeat;
+    uint32_t max_repeat;
+
+    /* stop once the coefficient of variation is at or below this */
+    float max_cv;
+};
+
+struct u_bench {
+    struct u_bench_params params;
+
+    uint32_t iter;
+    uint64_t *samples;
+    uint32_t sample_count;
+};
+
+struct u_bench_stats {
+    uint32_t count;
+
+    uint64_t min;
+    uint64_t median;
+    uint64_t p95;
+    uint64_t p99;
+    uint64_t max;
+
+    double mean;
+    double stddev;
+    double cv;
+};
+
+static inline uint32_t
+u_bench_getenv(const char *name, uint32_t def)
+{
+    const char *val = getenv(name);
+    return val && val[0] ? (uint32_t)strtoul(val, NULL, 0) : def;
+}
+
+static inline void
+u_bench_init(struct u_bench *bench, const struct u_bench_params *params)
+{
+    static const struct u_bench_params default_params = {
+        .warmup = 1,
+        .min_repeat = 5,
+        .max_repeat = 50,
+        .max_cv = 0.02f,
+    };
+
+    memset(bench, 0, sizeof(*bench));
+    bench->params = params ? *params : default_params;
+
+    /* allow the environment to override the params */
+    bench->params.warmup = u_bench_getenv("UTIL_BENCH_WARMUP", bench->params.warmup);
+    bench->params.max_repeat = u_bench_getenv("UTIL_BENCH_REPEAT", bench->params.max_repeat);
+    const char *cv = getenv("UTIL_BENCH_CV");
+    if (cv && cv[0])
+        bench->params.max_cv = strtof(cv, NULL);
+
+    if (!bench->params.max_repeat)
+        bench->params.max_repeat = 1;
+    if (bench->params.min_repeat > bench->params.max_repeat)
+        bench->params.min_repeat = bench->params.max_repeat;
+
+    bench->samples = (uint64_t *)malloc(sizeof(*bench->samples) * bench->params.max_repeat);
+    if (!bench->samples)
+        u_die("util", "failed to alloc bench samples");
+}
+
+static inline void
+u_bench_calc_mean_stddev(const uint64_t *samples, uint32_t count, double *mean, double *stddev)
+{
+    double sum = 0.0;
+    for (uint32_t i = 0; i < count; i++)
+        sum += (double)samples[i];
+    *mean = count ? sum / count : 0.0;
+
+    double var = 0.0;
+    for (uint32_t i = 0; i < count; i++) {
+        const double diff = (double)samples[i] - *mean;
+        var += diff * diff;
+    }
+    *stddev = count > 1 ? sqrt(var / (count - 1)) : 0.0;
+}
+
+static inline bool
+u_bench_next(struct u_bench *bench)
+{
+    if (bench->iter < bench->params.warmup)
+        return true;
+    if (bench->sample_count >= bench->params.max_repeat)
+        return false;
+    if (bench->sample_count < bench->params.min_repeat)
+        return true;
+
+    double mean;
+    double stddev;
+    u_bench_calc_mean_stddev(bench->samples, bench->sample_count, &mean, &stddev);
+
+    return !(mean > 0.0 && stddev / mean <= bench->params.max_cv);
+}
+
+static inline void
+u_bench_add(struct u_bench *bench, uint64_t dur)
+{
+    if (bench->iter++ < bench->params.warmup)
+        return;
+
+    assert(bench->sample_count < bench->params.max_repeat);
+    bench->samples[bench->sample_count++] = dur;
+}
+
+static inline int
+u_bench_compare_samples(const void *a, const void *b)
+{
+    const uint64_t val1 = *(const uint64_t *)a;
+    const uint64_t val2 = *(const uint64_t *)b;
+    return val1 < val2 ? -1 : val1 > val2;
+}
+
+static inline uint64_t
+u_bench_percentile(const uint64_t *sorted, uint32_t count, uint32_t pct)
+{
+    /* nearest-rank */
+    const uint32_t rank = (count * pct + 99) / 100;
+    return sorted[rank ? rank - 1 : 0];
+}
+
+/* computes the stats of arbitrary samples, such as per-call latencies; sorts them in place */
+static inline void
+u_bench_calc_stats(uint64_t *samples, uint32_t count, struct u_bench_stats *stats)
+{
+    if (!count)
+        u_die("util", "no bench samples");
+
+    memset(stats, 0, sizeof(*stats));
+    stats->count = count;
+
+    u_bench_calc_mean_stddev(samples, count, &stats->mean, &stats->stddev);
+    stats->cv = stats->mean > 0.0 ? stats->stddev / stats->mean : 0.0;
+
+    uint64_t *sorted = samples;
+    qsort(sorted, count, sizeof(*sorted), u_bench_compare_samples);
+
+    stats->min = sorted[0];
+    stats->median = count & 1 ? sorted[count / 2]
+                              : (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+    stats->p95 = u_bench_percentile(sorted, count, 95);
+    stats->p99 = u_bench_percentile(sorted, count, 99);
+    stats->max = sorted[count - 1];
+}
+
+static inline void
+u_bench_finish(struct u_bench *bench, struct u_bench_stats *stats)
+{
+    u_bench_calc_stats(bench->samples, bench->sample_count, stats);
+
+    free(bench->samples);
+    bench->samples = NULL;
+}
+
+static inline const char *
+u_bench_stats_to_str(const struct u_bench_stats *stats, char *str, size_t size)
+{
+    const double us = 1000.0;
+    snprintf(str, size,
+             "min %.1f med %.1f p95 %.1f p99 %.1f stddev %.1f us, cv %.2f%%, n %u",
+             stats->min / us, stats->median / us, stats->p95 / us, stats->p99 / us,
+             stats->stddev / us, stats->cv * 100.0, stats->count);
+    return str;
+}
+
+enum u_result_format {
+    U_RESULT_FORMAT_JSON,
+    U_RESULT_FORMAT_CSV,
+};
+
+#define U_RESULT_MAX_PARAMS 16
+
+struct u_result_param {
+    char key[32];
+    char val[64];
+};
+
+/* Structured result sink.  Each metric is written as one JSON line or one
+ * CSV row, together with the tool name, device/driver identity, a timestamp
+ * and the current params.  It is disabled unless a path is given.
+ */
+struct u_result {
+    FILE *fp;
+    enum u_result_format format;
+
+    char tool[32];
+    char device[256];
+    char driver[256];
+
+    struct u_result_param params[U_RESULT_MAX_PARAMS];
+    uint32_t param_count;
+};
+
+static inline void
+u_result_init(struct u_result *res, const char *tool, const char *path)
+{
+    memset(res, 0, sizeof(*res));
+    snprintf(res->tool, sizeof(res->tool), "%s", tool);
+
+    /* defaults to $UTIL_RESULT_PATH; "-" means stdout */
+    if (!path)
+        path = getenv("UTIL_RESULT_PATH");
+    if (!path || !path[0])
+        return;
+
+    const char *format = getenv("UTIL_RESULT_FORMAT");
+    if (format && format[0]) {
+        if (!strcmp(format, "csv"))
+            res->format = U_RESULT_FORMAT_CSV;
+        else if (!strcmp(format, "json"))
+            res->format = U_RESULT_FORMAT_JSON;
+        else
+            u_die("util", "unknown result format %s", format);
+    } else {
+        const size_t len = strlen(path);
+        if (len > 4 && !strcmp(path + len - 4, ".csv"))
+            res->format = U_RESULT_FORMAT_CSV;
+    }
+
+    if (!strcmp(path, "-")) {
+        res->fp = stdout;
+    } else {
+        /* append so that multiple runs can share a file */
+        res->fp = fopen(path, "a");
+        if (!res->fp)
+            u_die("util", "failed to open %s", path);
+    }
+
+    if (res->format == U_RESULT_FORMAT_CSV && !ftell(res->fp))
+        fprintf(res->fp, "timestamp,tool,device,driver,metric,value,unit,params\n");
+}
+
+static inline void
+u_result_cleanup(struct u_result *res)
+{
+    if (!res->fp)
+        return;
+
+    if (res->fp == stdout)
+        fflush(res->fp);
+    else
+        fclose(res->fp);
+    res->fp = NULL;
+}
+
+static inline bool
+u_result_enabled(const struct u_result *res)
+{
+    return res->fp;
+}
+
+static inline void
+u_result_set_device(struct u_result *res, const char *device, const char *driver)
+{
+    snprintf(res->device, sizeof(res->device), "%s", device ? device : "");
+    snprintf(res->driver, sizeof(res->driver), "%s", driver ? driver : "");
+}
+
+static inline void
+u_result_clear_params(struct u_result *res)
+{
+    res->param_count = 0;
+}
+
+static inline void PRINTFLIKE(3, 4)
+    u_result_set_param(struct u_result *res, const char *key, const char *format, ...)
+{
+    struct u_result_param *param = NULL;
+    for (uint32_t i = 0; i < res->param_count; i++) {
+        if (!strcmp(res->params[i].key, key)) {
+            param = &res->params[i];
+            break;
+        }
+    }
+    if (!param) {
+        if (res->param_count >= ARRAY_SIZE(res->params))
+            u_die("util", "too many result params");
+        param = &res->params[res->param_count++];
+        snprintf(param->key, sizeof(param->key), "%s", key);
+    }
+
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(param->val, sizeof(param->val), format, ap);
+    va_end(ap);
+}
+
+static inline void
+u_result_write_str(struct u_result *res, const char *str)
+{
+    if (res->format == U_RESULT_FORMAT_CSV) {
+        fputc('"', res->fp);
+        for (const char *c = str; *c; c++) {
+            if (*c == '"')
+                fputc('"', res->fp);
+            fputc(*c, res->fp);
+        }
+        fputc('"', res->fp);
+    } else {
+        fputc('"', res->fp);
+        for (const char *c = str; *c; c++) {
+            if (*c == '"' || *c == '\\')
+                fprintf(res->fp, "\\%c", *c);
+            else if ((unsigned char)*c < 0x20)
+                fprintf(res->fp, "\\u%04x", *c);
+            else
+                fputc(*c, res->fp);
+        }
+        fputc('"', res->fp);
+    }
+}
+
+static inline void
+u_result_add(struct u_result *res, const char *metric, double val, const char *unit)
+{
+    if (!res->fp)
+        return;
+
+    struct timespec ts;
+    struct tm tm;
+    char timestamp[64];
+    clock_gettime(CLOCK_REALTIME, &ts);
+    gmtime_r(&ts.tv_sec, &tm);
+    const size_t len = strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(timestamp + len, sizeof(timestamp) - len, ".%03ldZ", ts.tv_nsec / 1000000);
+
+    if (res->format == U_RESULT_FORMAT_CSV) {
+        char params[U_RESULT_MAX_PARAMS * 100];
+        size_t off = 0;
+        params[0] = '\0';
+        for (uint32_t i = 0; i < res->param_count; i++) {
+            const struct u_result_param *param = &res->params[i];
+            off += snprintf(params + off, sizeof(params) - off, "%s%s=%s", i ? ";" : "",
+                            param->key, param->val);
+        }
+
+        fprintf(res->fp, "%s,", timestamp);
+        u_result_write_str(res, res->tool);
+        fputc(',', res->fp);
+        u_result_write_str(res, res->device);
+        fputc(',', res->fp);
+        u_result_write_str(res, res->driver);
+        fputc(',', res->fp);
+        u_result_write_str(res, metric);
+        fprintf(res->fp, ",%.10g,", val);
+        u_result_write_str(res, unit);
+        fputc(',', res->fp);
+        u_result_write_str(res, params);
+        fputc('\n', res->fp);
+    } else {
+        fprintf(res->fp, "{\"timestamp\":\"%s\",\"tool\":", timestamp);
+        u_result_write_str(res, res->tool);
+        fprintf(res->fp, ",\"device\":");
+        u_result_write_str(res, res->device);
+        fprintf(res->fp, ",\"driver\":");
+        u_result_write_str(res, res->driver);
+        fprintf(res->fp, ",\"metric\":");
+        u_result_write_str(res, metric);
+        /* JSON has no nan/inf */
+        if (isfinite(val))
+            fprintf(res->fp, ",\"value\":%.10g,\"unit\":", val);
+        else
+            fprintf(res->fp, ",\"value\":null,\"unit\":");
+        u_result_write_str(res, unit);
+        fprintf(res->fp, ",\"params\":{");
+        for (uint32_t i = 0; i < res->param_count; i++) {
+            const struct u_result_param *param = &res->params[i];
+            if (i)
+                fputc(',', res->fp);
+            u_result_write_str(res, param->key);
+            fputc(':', res->fp);
+            u_result_write_str(res, param->val);
+        }
+        fprintf(res->fp, "}}\n");
+    }
+}
+
+static inline void
+u_result_add_bench_stats(struct u_result *res,
+                         const char *metric,
+                         const struct u_bench_stats *stats)
+{
+    char name[96];
+    const struct {
+        const char *suffix;
+        double val;
+        const char *unit;
+    } vals[] = {
+        { "min", (double)stats->min, "ns" },
+        { "median", (double)stats->median, "ns" },
+        { "p95", (double)stats->p95, "ns" },
+        { "p99", (double)stats->p99, "ns" },
+        { "max", (double)stats->max, "ns" },
+        { "stddev", stats->stddev, "ns" },
+        { "cv", stats->cv, "ratio" },
+        { "samples", (double)stats->count, "count" },
+    };
+
+    if (!res->fp)
+        return;
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(vals); i++) {
+        snprintf(name, sizeof(name), "%s.%s", metric, vals[i].suffix);
+        u_result_add(res, name, vals[i].val, vals[i].unit);
+    }
+}
+
 static inline const void *
 u_map_file(const char *filename, size_t *out_size)
 {
@@ -179,6 +717,50 @@ u_unmap_file(const void *ptr, size_t size)
     munmap((void *)ptr, size);
 }
 
+/* unlike u_map_file, a missing or unreadable file is not fatal */
+static inline void *
+u_read_file(const char *filename, size_t *out_size)
+{
+    FILE *fp = fopen(filename, "r");
+    if (!fp)
+        return NULL;
+
+    void *data = NULL;
+    long size = 0;
+    if (!fseek(fp, 0, SEEK_END) && (size = ftell(fp)) > 0 && !fseek(fp, 0, SEEK_SET)) {
+        data = malloc(size);
+        if (data && fread(data, 1, size, fp) != (size_t)size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(fp);
+
+    *out_size = data ? size : 0;
+    return data;
+}
+
+/* write to a temp file and rename to not race with concurrent writers */
+static inline bool
+u_write_file(const char *filename, const void *data, size_t size)
+{
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.%d", filename, (int)getpid()) >= (int)sizeof(tmp))
+        return false;
+
+    FILE *fp = fopen(tmp, "w");
+    if (!fp)
+        return false;
+
+    bool ok = fwrite(data, 1, size, fp) == size;
+    ok = !fclose(fp) && ok;
+    ok = ok && !rename(tmp, filename);
+    if (!ok)
+        unlink(tmp);
+
+    return ok;
+}
+
 static inline const void *
 u_parse_ppm(const void *ppm_data, size_t ppm_size, uint32_t *width, uint32_t *height)
 {
@@ -200,23 +782,121 @@ u_parse_ppm(const void *ppm_data, size_t ppm_size, uint32_t *width, uint32_t *he
     return (const char *)ppm_data + hdr_size;
 }
 
-static inline void
-u_write_ppm(const char *filename, const void *data, int width, int height, int stride)
+struct u_ppm_file {
+    int fd;
+    void *map;
+    size_t size;
+
+    uint8_t *pixels;
+    size_t pitch;
+};
+
+/* Creates a binary ppm and returns a pointer to its tightly-packed rgb pixels.  The pixels are
+ * mapped from the file directly when possible, or buffered and written out by u_ppm_file_close.
+ */
+static inline uint8_t *
+u_ppm_file_create(struct u_ppm_file *ppm,
+                  const char *filename,
+                  uint32_t width,
+                  uint32_t height,
+                  uint32_t max_val)
 {
-    FILE *fp = fopen(filename, "w");
-    if (!fp)
+    char header[64];
+    const int header_size =
+        snprintf(header, sizeof(header), "P6 %u %u %u\n", width, height, max_val);
+
+    ppm->pitch = (size_t)width * 3;
+    ppm->size = header_size + ppm->pitch * height;
+
+    ppm->fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (ppm->fd < 0)
         u_die("util", "failed to open %s", filename);
 
-    fprintf(fp, "P6 %d %d 255\n", width, height);
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            const void *pixel = (const char *)data + stride * y + x * 4;
-            if (fwrite(pixel, 3, 1, fp) != 1)
-                u_die("util", "failed to write pixel (%d, %d)", x, y);
+    ppm->map = MAP_FAILED;
+    if (!ftruncate(ppm->fd, ppm->size))
+        ppm->map = mmap(NULL, ppm->size, PROT_WRITE, MAP_SHARED, ppm->fd, 0);
+
+    if (ppm->map != MAP_FAILED) {
+        close(ppm->fd);
+        ppm->fd = -1;
+    } else {
+        ppm->map = malloc(ppm->size);
+        if (!ppm->map)
+            u_die("util", "failed to alloc ppm");
+    }
+
+    memcpy(ppm->map, header, header_size);
+    ppm->pixels = (uint8_t *)ppm->map + header_size;
+
+    return ppm->pixels;
+}
+
+static inline void
+u_ppm_file_close(struct u_ppm_file *ppm)
+{
+    if (ppm->fd < 0) {
+        munmap(ppm->map, ppm->size);
+        return;
+    }
+
+    const uint8_t *ptr = (const uint8_t *)ppm->map;
+    size_t remaining = ppm->size;
+    while (remaining) {
+        const ssize_t ret = write(ppm->fd, ptr, remaining);
+        if (ret <= 0)
+            u_die("util", "failed to write ppm");
+        ptr += ret;
+        remaining -= ret;
+    }
+
+    free(ppm->map);
+    close(ppm->fd);
+}
+
+struct u_write_ppm_job {
+    const uint8_t *data;
+    int width;
+    int stride;
+
+    uint8_t *pixels;
+    size_t pitch;
+};
+
+static inline void
+u_write_ppm_rows(void *data, uint32_t begin, uint32_t end)
+{
+    const struct u_write_ppm_job *job = (const struct u_write_ppm_job *)data;
+
+    for (uint32_t y = begin; y < end; y++) {
+        const uint8_t *src = job->data + (size_t)job->stride * y;
+        uint8_t *dst = job->pixels + job->pitch * y;
+        for (int x = 0; x < job->width; x++) {
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+
+            src += 4;
+            dst += 3;
         }
     }
+}
 
-    fclose(fp);
+static inline void
+u_write_ppm(const char *filename, const void *data, int width, int height, int stride)
+{
+    struct u_ppm_file ppm;
+    struct u_write_ppm_job job = {
+        .data = (const uint8_t *)data,
+        .width = width,
+        .stride = stride,
+        .pixels = u_ppm_file_create(&ppm, filename, width, height, 255),
+        .pitch = ppm.pitch,
+    };
+
+    u_parallel_for(height, 1, u_parallel_get_image_thread_count(width, height), u_write_ppm_rows,
+                   &job);
+
+    u_ppm_file_close(&ppm);
 }
 
 static inline void
@@ -241,6 +921,10 @@ u_rgb_to_yuv(const uint8_t *rgb, uint8_t *yuv)
 static inline void
 u_yuv_to_rgb(uint8_t y, uint8_t u, uint8_t v, uint8_t *rgb)
 {
+#ifdef __clang__
+    /* no fma; the simd kernels must stay bit-exact */
+#pragma STDC FP_CONTRACT OFF
+#endif
     const int y_val = (int)y;
     const int u_val = (int)u - 128;
     const int v_val = (int)v - 128;
@@ -256,6 +940,738 @@ u_yuv_to_rgb(uint8_t y, uint8_t u, uint8_t v, uint8_t *rgb)
 #undef CLAMP
 }
 
+static inline float
+u_half_to_float(uint16_t val)
+{
+    /* scaling by 2^112 rebiases the exponent and normalizes denormals */
+    const uint32_t exp_mant = val & 0x7fff;
+    uint32_t bits = exp_mant << 13;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    f *= 0x1p112f;
+
+    memcpy(&bits, &f, sizeof(bits));
+    if (exp_mant >= 0x7c00)
+        bits |= 0x7f800000;
+    bits |= (uint32_t)(val & 0x8000) << 16;
+    memcpy(&f, &bits, sizeof(f));
+
+    return f;
+}
+
+/* rounds to nearest even */
+static inline uint16_t
+u_float_to_half(float val)
+{
+    uint32_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    const uint16_t sign = (bits >> 16) & 0x8000;
+    bits &= 0x7fffffff;
+
+    uint16_t half;
+    if (bits >= 0x47800000) {
+        /* 65536 and above, inf, or nan */
+        half = bits > 0x7f800000 ? 0x7e00 : 0x7c00;
+    } else if (bits < 0x38800000) {
+        /* adding 0.5 makes the fpu round the denormal mantissa into the low bits */
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        f += 0.5f;
+        memcpy(&bits, &f, sizeof(bits));
+        half = bits - 0x3f000000;
+    } else {
+        const uint32_t odd = (bits >> 13) & 1;
+        bits += 0xc8000fff + odd;
+        half = bits >> 13;
+    }
+
+    return sign | half;
+}
+
+enum u_simd_level {
+    U_SIMD_LEVEL_NONE,
+    U_SIMD_LEVEL_SSE41,
+    U_SIMD_LEVEL_AVX2,
+    U_SIMD_LEVEL_NEON,
+
+    U_SIMD_LEVEL_COUNT,
+};
+
+static inline const char *
+u_simd_level_to_str(enum u_simd_level level)
+{
+    switch (level) {
+    case U_SIMD_LEVEL_NONE:
+        return "scalar";
+    case U_SIMD_LEVEL_SSE41:
+        return "sse4.1";
+    case U_SIMD_LEVEL_AVX2:
+        return "avx2";
+    case U_SIMD_LEVEL_NEON:
+        return "neon";
+    default:
+        return "unknown";
+    }
+}
+
+static inline bool
+u_simd_level_supported(enum u_simd_level level)
+{
+    switch (level) {
+    case U_SIMD_LEVEL_NONE:
+        return true;
+#if defined(__x86_64__) || defined(__i386__)
+    case U_SIMD_LEVEL_SSE41:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.1");
+    case U_SIMD_LEVEL_AVX2:
+        /* the avx2 kernels may also use fma and f16c, which every avx2 cpu has in practice */
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+               __builtin_cpu_supports("f16c");
+#elif defined(__aarch64__)
+    case U_SIMD_LEVEL_NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+static inline enum u_simd_level
+u_simd_level_get(void)
+{
+    static int cached = -1;
+    if (cached >= 0)
+        return (enum u_simd_level)cached;
+
+    /* UTIL_SIMD=none forces the scalar paths */
+    const char *env = getenv("UTIL_SIMD");
+    const bool disabled = env && !strcmp(env, "none");
+
+    enum u_simd_level level = U_SIMD_LEVEL_NONE;
+    for (int i = U_SIMD_LEVEL_COUNT - 1; i > U_SIMD_LEVEL_NONE && !disabled; i--) {
+        if (u_simd_level_supported((enum u_simd_level)i)) {
+            level = (enum u_simd_level)i;
+            break;
+        }
+    }
+
+    cached = level;
+    return level;
+}
+
+struct u_convert_row_funcs {
+    void (*rgb888_to_rgba8888)(uint8_t *dst, const uint8_t *src, uint32_t width);
+    void (*rgb888_to_yuv444)(
+        uint8_t *dst_y, uint8_t *dst_u, uint8_t *dst_v, const uint8_t *src, uint32_t width);
+    void (*yuv444_to_rgb888)(uint8_t *dst,
+                             const uint8_t *src_y,
+                             const uint8_t *src_u,
+                             const uint8_t *src_v,
+                             uint32_t width);
+    void (*half_to_float)(float *dst, const uint16_t *src, uint32_t count);
+    void (*float_to_half)(uint16_t *dst, const float *src, uint32_t count);
+};
+
+static inline void
+u_convert_row_rgb888_to_rgba8888(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+    for (uint32_t x = 0; x < width; x++) {
+        memcpy(dst, src, 3);
+        dst[3] = 0xff;
+
+        src += 3;
+        dst += 4;
+    }
+}
+
+static inline void
+u_convert_row_rgb888_to_yuv444(
+    uint8_t *dst_y, uint8_t *dst_u, uint8_t *dst_v, const uint8_t *src, uint32_t width)
+{
+    for (uint32_t x = 0; x < width; x++) {
+        uint8_t yuv[3];
+        u_rgb_to_yuv(src + 3 * x, yuv);
+
+        dst_y[x] = yuv[0];
+        dst_u[x] = yuv[1];
+        dst_v[x] = yuv[2];
+    }
+}
+
+static inline void
+u_convert_row_yuv444_to_rgb888(uint8_t *dst,
+                               const uint8_t *src_y,
+                               const uint8_t *src_u,
+                               const uint8_t *src_v,
+                               uint32_t width)
+{
+    for (uint32_t x = 0; x < width; x++)
+        u_yuv_to_rgb(src_y[x], src_u[x], src_v[x], dst + 3 * x);
+}
+
+static inline void
+u_convert_row_half_to_float(float *dst, const uint16_t *src, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+        dst[i] = u_half_to_float(src[i]);
+}
+
+static inline void
+u_convert_row_float_to_half(uint16_t *dst, const float *src, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+        dst[i] = u_float_to_half(src[i]);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#define U_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define U_TARGET_AVX2 __attribute__((target("avx2")))
+#define U_TARGET_F16C __attribute__((target("avx2,f16c")))
+
+/* pshufb mask to gather channel ch of 16 rgb888 pixels from their k-th 16-byte chunk */
+static inline U_TARGET_SSE41 __m128i
+u_convert_sse41_deinterleave_mask(uint32_t ch, uint32_t k)
+{
+    alignas(16) int8_t mask[16];
+    for (uint32_t i = 0; i < 16; i++) {
+        const uint32_t idx = 3 * i + ch;
+        mask[i] = idx / 16 == k ? (int8_t)(idx % 16) : (int8_t)-128;
+    }
+    return _mm_load_si128((const __m128i *)mask);
+}
+
+/* pshufb mask to scatter channel ch of 16 pixels to the k-th 16-byte chunk of rgb888 */
+static inline U_TARGET_SSE41 __m128i
+u_convert_sse41_interleave_mask(uint32_t ch, uint32_t k)
+{
+    alignas(16) int8_t mask[16];
+    for (uint32_t i = 0; i < 16; i++) {
+        const uint32_t idx = 16 * k + i;
+        mask[i] = idx % 3 == ch ? (int8_t)(idx / 3) : (int8_t)-128;
+    }
+    return _mm_load_si128((const __m128i *)mask);
+}
+
+struct u_convert_sse41_masks {
+    __m128i deinterleave[3][3];
+    __m128i interleave[3][3];
+};
+
+static inline U_TARGET_SSE41 void
+u_convert_sse41_init_masks(struct u_convert_sse41_masks *masks)
+{
+    for (uint32_t ch = 0; ch < 3; ch++) {
+        for (uint32_t k = 0; k < 3; k++) {
+            masks->deinterleave[ch][k] = u_convert_sse41_deinterleave_mask(ch, k);
+            masks->interleave[ch][k] = u_convert_sse41_interleave_mask(ch, k);
+        }
+    }
+}
+
+static inline U_TARGET_SSE41 void
+u_convert_sse41_load_rgb888(const struct u_convert_sse41_masks *masks,
+                            const uint8_t *src,
+                            __m128i rgb[3])
+{
+    const __m128i chunks[3] = {
+        _mm_loadu_si128((const __m128i *)src),
+        _mm_loadu_si128((const __m128i *)(src + 16)),
+        _mm_loadu_si128((const __m128i *)(src + 32)),
+    };
+
+    for (uint32_t ch = 0; ch < 3; ch++) {
+        const __m128i *m = masks->deinterleave[ch];
+        rgb[ch] = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(chunks[0], m[0]),
+                                            _mm_shuffle_epi8(chunks[1], m[1])),
+                               _mm_shuffle_epi8(chunks[2], m[2]));
+    }
+}
+
+static inline U_TARGET_SSE41 void
+u_convert_sse41_store_rgb888(const struct u_convert_sse41_masks *masks,
+                             uint8_t *dst,
+                             const __m128i rgb[3])
+{
+    for (uint32_t k = 0; k < 3; k++) {
+        const __m128i chunk =
+            _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(rgb[0], masks->interleave[0][k]),
+                                      _mm_shuffle_epi8(rgb[1], masks->interleave[1][k])),
+                         _mm_shuffle_epi8(rgb[2], masks->interleave[2][k]));
+        _mm_storeu_si128((__m128i *)(dst + 16 * k), chunk);
+    }
+}
+
+static inline U_TARGET_SSE41 void
+u_convert_row_rgb888_to_rgba8888_sse41(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+    const __m128i mask =
+        _mm_setr_epi8(0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128);
+    const __m128i alpha = _mm_set1_epi32((int)0xff000000u);
+
+    /* each iteration loads 16 bytes but consumes only 4 pixels */
+    uint32_t x = 0;
+    for (; x + 6 <= width; x += 4) {
+        const __m128i px = _mm_loadu_si128((const __m128i *)(src + 3 * x));
+        _mm_storeu_si128((__m128i *)(dst + 4 * x),
+                         _mm_or_si128(_mm_shuffle_epi8(px, mask), alpha));
+    }
+
+    u_convert_row_rgb888_to_rgba8888(dst + 4 * x, src + 3 * x, width - x);
+}
+
+/* 16-bit fixed point matching u_rgb_to_yuv; y is unsigned while u/v are signed */
+static inline U_TARGET_SSE41 __m128i
+u_convert_sse41_rgb_to_yuv_chan(
+    __m128i r, __m128i g, __m128i b, int16_t cr, int16_t cg, int16_t cb, bool is_signed)
+{
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)),
+                              _mm_mullo_epi16(g, _mm_set1_epi16(cg)));
+    t = _mm_add_epi16(t, _mm_mullo_epi16(b, _mm_set1_epi16(cb)));
+    t = _mm_add_epi16(t, _mm_set1_epi16(128));
+    if (is_signed)
+        return _mm_add_epi16(_mm_srai_epi16(t, 8), _mm_set1_epi16(128));
+    else
+        return _mm_add_epi16(_mm_srli_epi16(t, 8), _mm_set1_epi16(16));
+}
+
+static inline U_TARGET_SSE41 void
+u_convert_row_rgb888_to_yuv444_sse41(
+    uint8_t *dst_y, uint8_t *dst_u, uint8_t *dst_v, const uint8_t *src, uint32_t width)
+{
+    struct u_convert_sse41_masks masks;
+    u_convert_sse41_init_masks(&masks);
+
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i rgb[3];
+        u_convert_sse41_load_rgb888(&masks, src + 3 * x, rgb);
+
+        __m128i lo[3];
+        __m128i hi[3];
+        for (uint32_t ch = 0; ch < 3; ch++) {
+            lo[ch] = _mm_unpacklo_epi8(rgb[ch], _mm_setzero_si128());
+            hi[ch] = _mm_unpackhi_epi8(rgb[ch], _mm_setzero_si128());
+        }
+
+        const __m128i y = _mm_packus_epi16(
+            u_convert_sse41_rgb_to_yuv_chan(lo[0], lo[1], lo[2], 66, 129, 25, false),
+            u_convert_sse41_rgb_to_yuv_chan(hi[0], hi[1], hi[2], 66, 129, 25, false));
+        const __m128i u = _mm_packus_epi16(
+            u_convert_sse41_rgb_to_yuv_chan(lo[0], lo[1], lo[2], -38, -74, 112, true),
+            u_convert_sse41_rgb_to_yuv_chan(hi[0], hi[1], hi[2], -38, -74, 112, true));
+        const __m128i v = _mm_packus_epi16(
+            u_convert_sse41_rgb_to_yuv_chan(lo[0], lo[1], lo[2], 112, -94, -18, true),
+            u_convert_sse41_rgb_to_yuv_chan(hi[0], hi[1], hi[2], 112, -94, -18, true));
+
+        _mm_storeu_si128((__m128i *)(dst_y + x), y);
+        _mm_storeu_si128((__m128i *)(dst_u + x), u);
+        _mm_storeu_si128((__m128i *)(dst_v + x), v);
+    }
+
+    u_convert_row_rgb888_to_yuv444(dst_y + x, dst_u + x, dst_v + x, src + 3 * x, width - x);
+}
+
+/* converts 4 pixels in the same operation order as u_yuv_to_rgb */
+static inline U_TARGET_SSE41 void
+u_convert_sse41_yuv_to_rgb(__m128i y, __m128i u, __m128i v, __m128i rgb[3])
+{
+    const __m128 yf = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(y));
+    const __m128 uf = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_cvtepu8_epi32(u), _mm_set1_epi32(128)));
+    const __m128 vf = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_cvtepu8_epi32(v), _mm_set1_epi32(128)));
+
+    const __m128 r = _mm_add_ps(yf, _mm_mul_ps(_mm_set1_ps(1.402000f), vf));
+    const __m128 g = _mm_sub_ps(_mm_sub_ps(yf, _mm_mul_ps(_mm_set1_ps(0.344136f), uf)),
+                                _mm_mul_ps(_mm_set1_ps(0.714136f), vf));
+    const __m128 b = _mm_add_ps(yf, _mm_mul_ps(_mm_set1_ps(1.772000f), uf));
+
+    /* truncate like the scalar cast and let the saturating packs clamp */
+    rgb[0] = _mm_cvttps_epi32(r);
+    rgb[1] = _mm_cvttps_epi32(g);
+    rgb[2] = _mm_cvttps_epi32(b);
+}
+
+static inline U_TARGET_SSE41 void
+u_convert_row_yuv444_to_rgb888_sse41(uint8_t *dst,
+                                     const uint8_t *src_y,
+                                     const uint8_t *src_u,
+                                     const uint8_t *src_v,
+                                     uint32_t width)
+{
+    struct u_convert_sse41_masks masks;
+    u_convert_sse41_init_masks(&masks);
+
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const __m128i y = _mm_loadu_si128((const __m128i *)(src_y + x));
+        const __m128i u = _mm_loadu_si128((const __m128i *)(src_u + x));
+        const __m128i v = _mm_loadu_si128((const __m128i *)(src_v + x));
+
+        __m128i rgb32[4][3];
+        u_convert_sse41_yuv_to_rgb(y, u, v, rgb32[0]);
+        u_convert_sse41_yuv_to_rgb(
+            _mm_srli_si128(y, 4), _mm_srli_si128(u, 4), _mm_srli_si128(v, 4), rgb32[1]);
+        u_convert_sse41_yuv_to_rgb(
+            _mm_srli_si128(y, 8), _mm_srli_si128(u, 8), _mm_srli_si128(v, 8), rgb32[2]);
+        u_convert_sse41_yuv_to_rgb(
+            _mm_srli_si128(y, 12), _mm_srli_si128(u, 12), _mm_srli_si128(v, 12), rgb32[3]);
+
+        __m128i rgb[3];
+        for (uint32_t ch = 0; ch < 3; ch++) {
+            rgb[ch] = _mm_packus_epi16(_mm_packs_epi32(rgb32[0][ch], rgb32[1][ch]),
+                                       _mm_packs_epi32(rgb32[2][ch], rgb32[3][ch]));
+        }
+        u_convert_sse41_store_rgb888(&masks, dst + 3 * x, rgb);
+    }
+
+    u_convert_row_yuv444_to_rgb888(dst + 3 * x, src_y + x, src_u + x, src_v + x, width - x);
+}
+
+/* 256-bit variant of u_convert_sse41_rgb_to_yuv_chan */
+static inline U_TARGET_AVX2 __m128i
+u_convert_avx2_rgb_to_yuv_chan(
+    __m256i r, __m256i g, __m256i b, int16_t cr, int16_t cg, int16_t cb, bool is_signed)
+{
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(cr)),
+                                 _mm256_mullo_epi16(g, _mm256_set1_epi16(cg)));
+    t = _mm256_add_epi16(t, _mm256_mullo_epi16(b, _mm256_set1_epi16(cb)));
+    t = _mm256_add_epi16(t, _mm256_set1_epi16(128));
+    if (is_signed)
+        t = _mm256_add_epi16(_mm256_srai_epi16(t, 8), _mm256_set1_epi16(128));
+    else
+        t = _mm256_add_epi16(_mm256_srli_epi16(t, 8), _mm256_set1_epi16(16));
+
+    return _mm_packus_epi16(_mm256_castsi256_si128(t), _mm256_extracti128_si256(t, 1));
+}
+
+static inline U_TARGET_AVX2 void
+u_convert_row_rgb888_to_yuv444_avx2(
+    uint8_t *dst_y, uint8_t *dst_u, uint8_t *dst_v, const uint8_t *src, uint32_t width)
+{
+    struct u_convert_sse41_masks masks;
+    u_convert_sse41_init_masks(&masks);
+
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i rgb[3];
+        u_convert_sse41_load_rgb888(&masks, src + 3 * x, rgb);
+
+        const __m256i r = _mm256_cvtepu8_epi16(rgb[0]);
+        const __m256i g = _mm256_cvtepu8_epi16(rgb[1]);
+        const __m256i b = _mm256_cvtepu8_epi16(rgb[2]);
+
+        _mm_storeu_si128((__m128i *)(dst_y + x),
+                         u_convert_avx2_rgb_to_yuv_chan(r, g, b, 66, 129, 25, false));
+        _mm_storeu_si128((__m128i *)(dst_u + x),
+                         u_convert_avx2_rgb_to_yuv_chan(r, g, b, -38, -74, 112, true));
+        _mm_storeu_si128((__m128i *)(dst_v + x),
+                         u_convert_avx2_rgb_to_yuv_chan(r, g, b, 112, -94, -18, true));
+    }
+
+    u_convert_row_rgb888_to_yuv444(dst_y + x, dst_u + x, dst_v + x, src + 3 * x, width - x);
+}
+
+/* 256-bit variant of u_convert_sse41_yuv_to_rgb */
+static inline U_TARGET_AVX2 void
+u_convert_avx2_yuv_to_rgb(__m128i y, __m128i u, __m128i v, __m256i rgb[3])
+{
+    const __m256i bias = _mm256_set1_epi32(128);
+    const __m256 yf = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(y));
+    const __m256 uf = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_cvtepu8_epi32(u), bias));
+    const __m256 vf = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_cvtepu8_epi32(v), bias));
+
+    const __m256 r = _mm256_add_ps(yf, _mm256_mul_ps(_mm256_set1_ps(1.402000f), vf));
+    const __m256 g =
+        _mm256_sub_ps(_mm256_sub_ps(yf, _mm256_mul_ps(_mm256_set1_ps(0.344136f), uf)),
+                      _mm256_mul_ps(_mm256_set1_ps(0.714136f), vf));
+    const __m256 b = _mm256_add_ps(yf, _mm256_mul_ps(_mm256_set1_ps(1.772000f), uf));
+
+    rgb[0] = _mm256_cvttps_epi32(r);
+    rgb[1] = _mm256_cvttps_epi32(g);
+    rgb[2] = _mm256_cvttps_epi32(b);
+}
+
+static inline U_TARGET_AVX2 void
+u_convert_row_yuv444_to_rgb888_avx2(uint8_t *dst,
+                                    const uint8_t *src_y,
+                                    const uint8_t *src_u,
+                                    const uint8_t *src_v,
+                                    uint32_t width)
+{
+    struct u_convert_sse41_masks masks;
+    u_convert_sse41_init_masks(&masks);
+
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i rgb32[2][3];
+        for (uint32_t i = 0; i < 2; i++) {
+            const __m128i y = _mm_loadl_epi64((const __m128i *)(src_y + x + 8 * i));
+            const __m128i u = _mm_loadl_epi64((const __m128i *)(src_u + x + 8 * i));
+            const __m128i v = _mm_loadl_epi64((const __m128i *)(src_v + x + 8 * i));
+            u_convert_avx2_yuv_to_rgb(y, u, v, rgb32[i]);
+        }
+
+        __m128i rgb[3];
+        for (uint32_t ch = 0; ch < 3; ch++) {
+            /* packs works per 128-bit lane; restore the pixel order before narrowing */
+            const __m256i rgb16 = _mm256_permute4x64_epi64(
+                _mm256_packs_epi32(rgb32[0][ch], rgb32[1][ch]), 0xd8);
+            rgb[ch] = _mm_packus_epi16(_mm256_castsi256_si128(rgb16),
+                                       _mm256_extracti128_si256(rgb16, 1));
+        }
+        u_convert_sse41_store_rgb888(&masks, dst + 3 * x, rgb);
+    }
+
+    u_convert_row_yuv444_to_rgb888(dst + 3 * x, src_y + x, src_u + x, src_v + x, width - x);
+}
+
+static inline U_TARGET_SSE41 void
+u_convert_row_half_to_float_sse41(float *dst, const uint16_t *src, uint32_t count)
+{
+    /* same rebias as u_half_to_float */
+    const __m128i exp_mant_mask = _mm_set1_epi32(0x7fff);
+    const __m128i inf_nan_min = _mm_set1_epi32(0x7bff);
+    const __m128i inf_nan_exp = _mm_set1_epi32(0x7f800000);
+    const __m128 scale = _mm_set1_ps(0x1p112f);
+
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i val = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)(src + i)));
+        const __m128i exp_mant = _mm_and_si128(val, exp_mant_mask);
+        const __m128i sign = _mm_slli_epi32(_mm_xor_si128(val, exp_mant), 16);
+        const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(exp_mant, 13)), scale);
+        const __m128i inf_nan =
+            _mm_and_si128(_mm_cmpgt_epi32(exp_mant, inf_nan_min), inf_nan_exp);
+        const __m128i bits = _mm_or_si128(_mm_castps_si128(scaled), _mm_or_si128(sign, inf_nan));
+        _mm_storeu_ps(dst + i, _mm_castsi128_ps(bits));
+    }
+
+    u_convert_row_half_to_float(dst + i, src + i, count - i);
+}
+
+static inline U_TARGET_F16C void
+u_convert_row_half_to_float_avx2(float *dst, const uint16_t *src, uint32_t count)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i val = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(val));
+    }
+
+    u_convert_row_half_to_float(dst + i, src + i, count - i);
+}
+
+static inline U_TARGET_F16C void
+u_convert_row_float_to_half_avx2(uint16_t *dst, const float *src, uint32_t count)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i val = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i *)(dst + i), val);
+    }
+
+    u_convert_row_float_to_half(dst + i, src + i, count - i);
+}
+
+#undef U_TARGET_SSE41
+#undef U_TARGET_AVX2
+#undef U_TARGET_F16C
+
+#elif defined(__aarch64__)
+
+static inline void
+u_convert_row_rgb888_to_rgba8888_neon(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const uint8x8x3_t rgb = vld3_u8(src + 3 * x);
+        const uint8x8x4_t rgba = { { rgb.val[0], rgb.val[1], rgb.val[2], vdup_n_u8(0xff) } };
+        vst4_u8(dst + 4 * x, rgba);
+    }
+
+    u_convert_row_rgb888_to_rgba8888(dst + 4 * x, src + 3 * x, width - x);
+}
+
+/* 16-bit fixed point matching u_rgb_to_yuv */
+static inline uint8x8_t
+u_convert_neon_rgb_to_y(uint16x8_t r, uint16x8_t g, uint16x8_t b)
+{
+    uint16x8_t t = vmulq_n_u16(r, 66);
+    t = vmlaq_n_u16(t, g, 129);
+    t = vmlaq_n_u16(t, b, 25);
+    t = vaddq_u16(vshrq_n_u16(vaddq_u16(t, vdupq_n_u16(128)), 8), vdupq_n_u16(16));
+    return vqmovn_u16(t);
+}
+
+static inline uint8x8_t
+u_convert_neon_rgb_to_uv(
+    int16x8_t r, int16x8_t g, int16x8_t b, int16_t cr, int16_t cg, int16_t cb)
+{
+    int16x8_t t = vmulq_n_s16(r, cr);
+    t = vmlaq_n_s16(t, g, cg);
+    t = vmlaq_n_s16(t, b, cb);
+    t = vaddq_s16(vshrq_n_s16(vaddq_s16(t, vdupq_n_s16(128)), 8), vdupq_n_s16(128));
+    return vqmovun_s16(t);
+}
+
+static inline void
+u_convert_row_rgb888_to_yuv444_neon(
+    uint8_t *dst_y, uint8_t *dst_u, uint8_t *dst_v, const uint8_t *src, uint32_t width)
+{
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const uint8x16x3_t rgb = vld3q_u8(src + 3 * x);
+        uint8x8_t y[2];
+        uint8x8_t u[2];
+        uint8x8_t v[2];
+
+        for (uint32_t i = 0; i < 2; i++) {
+            const uint16x8_t r = vmovl_u8(i ? vget_high_u8(rgb.val[0]) : vget_low_u8(rgb.val[0]));
+            const uint16x8_t g = vmovl_u8(i ? vget_high_u8(rgb.val[1]) : vget_low_u8(rgb.val[1]));
+            const uint16x8_t b = vmovl_u8(i ? vget_high_u8(rgb.val[2]) : vget_low_u8(rgb.val[2]));
+            const int16x8_t sr = vreinterpretq_s16_u16(r);
+            const int16x8_t sg = vreinterpretq_s16_u16(g);
+            const int16x8_t sb = vreinterpretq_s16_u16(b);
+
+            y[i] = u_convert_neon_rgb_to_y(r, g, b);
+            u[i] = u_convert_neon_rgb_to_uv(sr, sg, sb, -38, -74, 112);
+            v[i] = u_convert_neon_rgb_to_uv(sr, sg, sb, 112, -94, -18);
+        }
+
+        vst1q_u8(dst_y + x, vcombine_u8(y[0], y[1]));
+        vst1q_u8(dst_u + x, vcombine_u8(u[0], u[1]));
+        vst1q_u8(dst_v + x, vcombine_u8(v[0], v[1]));
+    }
+
+    u_convert_row_rgb888_to_yuv444(dst_y + x, dst_u + x, dst_v + x, src + 3 * x, width - x);
+}
+
+/* converts 4 pixels in the same operation order as u_yuv_to_rgb */
+static inline void
+u_convert_neon_yuv_to_rgb(uint16x4_t y, uint16x4_t u, uint16x4_t v, int16x4_t rgb[3])
+{
+    const int32x4_t bias = vdupq_n_s32(128);
+    const float32x4_t yf = vcvtq_f32_s32(vreinterpretq_s32_u32(vmovl_u16(y)));
+    const float32x4_t uf = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vmovl_u16(u)), bias));
+    const float32x4_t vf = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vmovl_u16(v)), bias));
+
+    const float32x4_t r = vaddq_f32(yf, vmulq_n_f32(vf, 1.402000f));
+    const float32x4_t g =
+        vsubq_f32(vsubq_f32(yf, vmulq_n_f32(uf, 0.344136f)), vmulq_n_f32(vf, 0.714136f));
+    const float32x4_t b = vaddq_f32(yf, vmulq_n_f32(uf, 1.772000f));
+
+    /* truncate like the scalar cast and let the saturating narrows clamp */
+    rgb[0] = vqmovn_s32(vcvtq_s32_f32(r));
+    rgb[1] = vqmovn_s32(vcvtq_s32_f32(g));
+    rgb[2] = vqmovn_s32(vcvtq_s32_f32(b));
+}
+
+static inline void
+u_convert_row_yuv444_to_rgb888_neon(uint8_t *dst,
+                                    const uint8_t *src_y,
+                                    const uint8_t *src_u,
+                                    const uint8_t *src_v,
+                                    uint32_t width)
+{
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const uint16x8_t y = vmovl_u8(vld1_u8(src_y + x));
+        const uint16x8_t u = vmovl_u8(vld1_u8(src_u + x));
+        const uint16x8_t v = vmovl_u8(vld1_u8(src_v + x));
+
+        int16x4_t lo[3];
+        int16x4_t hi[3];
+        u_convert_neon_yuv_to_rgb(vget_low_u16(y), vget_low_u16(u), vget_low_u16(v), lo);
+        u_convert_neon_yuv_to_rgb(vget_high_u16(y), vget_high_u16(u), vget_high_u16(v), hi);
+
+        uint8x8x3_t rgb;
+        for (uint32_t ch = 0; ch < 3; ch++)
+            rgb.val[ch] = vqmovun_s16(vcombine_s16(lo[ch], hi[ch]));
+        vst3_u8(dst + 3 * x, rgb);
+    }
+
+    u_convert_row_yuv444_to_rgb888(dst + 3 * x, src_y + x, src_u + x, src_v + x, width - x);
+}
+
+static inline void
+u_convert_row_half_to_float_neon(float *dst, const uint16_t *src, uint32_t count)
+{
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src + i))));
+
+    u_convert_row_half_to_float(dst + i, src + i, count - i);
+}
+
+static inline void
+u_convert_row_float_to_half_neon(uint16_t *dst, const float *src, uint32_t count)
+{
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        vst1_u16(dst + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(src + i))));
+
+    u_convert_row_float_to_half(dst + i, src + i, count - i);
+}
+
+#endif
+
+static inline const struct u_convert_row_funcs *
+u_convert_get_row_funcs(enum u_simd_level level)
+{
+    static const struct u_convert_row_funcs scalar_funcs = {
+        u_convert_row_rgb888_to_rgba8888,
+        u_convert_row_rgb888_to_yuv444,
+        u_convert_row_yuv444_to_rgb888,
+        u_convert_row_half_to_float,
+        u_convert_row_float_to_half,
+    };
+#if defined(__x86_64__) || defined(__i386__)
+    static const struct u_convert_row_funcs sse41_funcs = {
+        u_convert_row_rgb888_to_rgba8888_sse41,
+        u_convert_row_rgb888_to_yuv444_sse41,
+        u_convert_row_yuv444_to_rgb888_sse41,
+        u_convert_row_half_to_float_sse41,
+        /* rounding to half takes more than sse4.1 offers */
+        u_convert_row_float_to_half,
+    };
+    /* the rgba expansion is load/store bound and gains nothing from avx2 */
+    static const struct u_convert_row_funcs avx2_funcs = {
+        u_convert_row_rgb888_to_rgba8888_sse41,
+        u_convert_row_rgb888_to_yuv444_avx2,
+        u_convert_row_yuv444_to_rgb888_avx2,
+        u_convert_row_half_to_float_avx2,
+        u_convert_row_float_to_half_avx2,
+    };
+#elif defined(__aarch64__)
+    static const struct u_convert_row_funcs neon_funcs = {
+        u_convert_row_rgb888_to_rgba8888_neon,
+        u_convert_row_rgb888_to_yuv444_neon,
+        u_convert_row_yuv444_to_rgb888_neon,
+        u_convert_row_half_to_float_neon,
+        u_convert_row_float_to_half_neon,
+    };
+#endif
+
+    if (!u_simd_level_supported(level))
+        u_die("util", "unsupported simd level %s", u_simd_level_to_str(level));
+
+    switch (level) {
+#if defined(__x86_64__) || defined(__i386__)
+    case U_SIMD_LEVEL_SSE41:
+        return &sse41_funcs;
+    case U_SIMD_LEVEL_AVX2:
+        return &avx2_funcs;
+#elif defined(__aarch64__)
+    case U_SIMD_LEVEL_NEON:
+        return &neon_funcs;
+#endif
+    default:
+        return &scalar_funcs;
+    }
+}
+
 struct u_format_conversion {
     uint32_t width;
     uint32_t height;
@@ -272,8 +1688,18 @@ struct u_format_conversion {
 };
 
 static inline void
-u_convert_format(const struct u_format_conversion *conv)
+u_convert_format_simd(const struct u_format_conversion *conv, enum u_simd_level level)
 {
+    const struct u_convert_row_funcs *funcs = u_convert_get_row_funcs(level);
+
+    /* rows of deinterleaved or upsampled y/u/v for the row kernels */
+    uint8_t *tmp = (uint8_t *)malloc(conv->width * 3);
+    if (!tmp)
+        u_die("util", "failed to alloc conversion rows");
+    uint8_t *tmp_y = tmp;
+    uint8_t *tmp_u = tmp + conv->width;
+    uint8_t *tmp_v = tmp + conv->width * 2;
+
     if (conv->src_format == DRM_FORMAT_BGR888) {
         if (conv->src_plane_count != 1)
             u_die("util", "bad src plane count");
@@ -288,13 +1714,7 @@ u_convert_format(const struct u_format_conversion *conv)
                     (const uint8_t *)conv->src_plane_ptrs[0] + conv->src_plane_strides[0] * y;
                 uint8_t *dst =
                     (uint8_t *)conv->dst_plane_ptrs[0] + conv->dst_plane_strides[0] * y;
-                for (uint32_t x = 0; x < conv->width; x++) {
-                    memcpy(dst, src, 3);
-                    dst[3] = 0xff;
-
-                    src += 3;
-                    dst += 4;
-                }
+                funcs->rgb888_to_rgba8888(dst, src, conv->width);
             }
             break;
         case DRM_FORMAT_NV12:
@@ -311,17 +1731,12 @@ u_convert_format(const struct u_format_conversion *conv)
                                           : (uint8_t *)conv->dst_plane_ptrs[1] +
                                                 conv->dst_plane_strides[1] * y / 2;
 
-                for (uint32_t x = 0; x < conv->width; x++) {
-                    uint8_t yuv[3];
-                    u_rgb_to_yuv(src, yuv);
-                    src += 3;
-
-                    dst_y[0] = yuv[0];
-                    dst_y += 1;
+                funcs->rgb888_to_yuv444(dst_y, tmp_u, tmp_v, src, conv->width);
 
-                    if (dst_uv && !(x & 1)) {
-                        dst_uv[0] = yuv[1];
-                        dst_uv[1] = yuv[2];
+                if (dst_uv) {
+                    for (uint32_t x = 0; x < conv->width; x += 2) {
+                        dst_uv[0] = tmp_u[x];
+                        dst_uv[1] = tmp_v[x];
                         dst_uv += 2;
                     }
                 }
@@ -331,6 +1746,8 @@ u_convert_format(const struct u_format_conversion *conv)
             u_die("util", "unsupported dst format");
             break;
         }
+
+        free(tmp);
         return;
     }
 
@@ -353,8 +1770,10 @@ u_convert_format(const struct u_format_conversion *conv)
 
                 for (uint32_t x = 0; x < conv->width; x++) {
                     const uint32_t uv_x = (x & ~1);
-                    u_yuv_to_rgb(src_y[x], src_uv[uv_x], src_uv[uv_x + 1], dst + 3 * x);
+                    tmp_u[x] = src_uv[uv_x];
+                    tmp_v[x] = src_uv[uv_x + 1];
                 }
+                funcs->yuv444_to_rgb888(dst, src_y, tmp_u, tmp_v, conv->width);
             }
             break;
         }
@@ -373,9 +1792,7 @@ u_convert_format(const struct u_format_conversion *conv)
                 uint8_t *dst =
                     (uint8_t *)conv->dst_plane_ptrs[0] + conv->dst_plane_strides[0] * y;
 
-                for (uint32_t x = 0; x < conv->width; x++) {
-                    u_yuv_to_rgb(src_y[x], src_u[x], src_v[x], dst + 3 * x);
-                }
+                funcs->yuv444_to_rgb888(dst, src_y, src_u, src_v, conv->width);
             }
             break;
         }
@@ -391,8 +1808,11 @@ u_convert_format(const struct u_format_conversion *conv)
 
                 for (uint32_t x = 0; x < conv->width; x++) {
                     const uint8_t *px = src_px + 4 * x;
-                    u_yuv_to_rgb(px[2], px[1], px[0], dst + 3 * x);
+                    tmp_y[x] = px[2];
+                    tmp_u[x] = px[1];
+                    tmp_v[x] = px[0];
                 }
+                funcs->yuv444_to_rgb888(dst, tmp_y, tmp_u, tmp_v, conv->width);
             }
             break;
         }
@@ -400,12 +1820,85 @@ u_convert_format(const struct u_format_conversion *conv)
             u_die("util", "unsupported src format");
             break;
         }
+
+        free(tmp);
         return;
     }
 
     u_die("util", "unsupported conversion");
 }
 
+struct u_convert_format_job {
+    const struct u_format_conversion *conv;
+    enum u_simd_level level;
+};
+
+static inline size_t
+u_convert_format_plane_offset(uint32_t format, uint32_t plane, uint32_t stride, uint32_t y)
+{
+    /* nv12 is the only vertically subsampled format supported */
+    if (format == DRM_FORMAT_NV12 && plane)
+        y /= 2;
+    return (size_t)stride * y;
+}
+
+static inline void
+u_convert_format_rows(void *data, uint32_t begin, uint32_t end)
+{
+    const struct u_convert_format_job *job = (const struct u_convert_format_job *)data;
+    const struct u_format_conversion *conv = job->conv;
+
+    struct u_format_conversion rows = *conv;
+    rows.height = end - begin;
+
+    for (uint32_t i = 0; i < conv->src_plane_count && i < ARRAY_SIZE(rows.src_plane_ptrs); i++) {
+        rows.src_plane_ptrs[i] =
+            (const uint8_t *)conv->src_plane_ptrs[i] +
+            u_convert_format_plane_offset(conv->src_format, i, conv->src_plane_strides[i], begin);
+    }
+    for (uint32_t i = 0; i < conv->dst_plane_count && i < ARRAY_SIZE(rows.dst_plane_ptrs); i++) {
+        rows.dst_plane_ptrs[i] =
+            (uint8_t *)conv->dst_plane_ptrs[i] +
+            u_convert_format_plane_offset(conv->dst_format, i, conv->dst_plane_strides[i], begin);
+    }
+
+    u_convert_format_simd(&rows, job->level);
+}
+
+/* converts row tiles on up to thread_count threads */
+static inline void
+u_convert_format_threaded(const struct u_format_conversion *conv,
+                          enum u_simd_level level,
+                          uint32_t thread_count)
+{
+    const struct u_convert_format_job job = {
+        .conv = conv,
+        .level = level,
+    };
+
+    /* tiles start on even rows to keep 4:2:0 chroma rows intact */
+    u_parallel_for(conv->height, 2, thread_count, u_convert_format_rows, (void *)&job);
+}
+
+static inline void
+u_convert_format(const struct u_format_conversion *conv)
+{
+    u_convert_format_threaded(conv, u_simd_level_get(),
+                              u_parallel_get_image_thread_count(conv->width, conv->height));
+}
+
+static inline void
+u_convert_half_to_float(float *dst, const uint16_t *src, uint32_t count, enum u_simd_level level)
+{
+    u_convert_get_row_funcs(level)->half_to_float(dst, src, count);
+}
+
+static inline void
+u_convert_float_to_half(uint16_t *dst, const float *src, uint32_t count, enum u_simd_level level)
+{
+    u_convert_get_row_funcs(level)->float_to_half(dst, src, count);
+}
+
 static inline uint32_t
 u_drm_format_to_plane_count(uint32_t drm_format)
 {
@@ -222,9 +222,14 @@ va_destroy_config(struct va *va, VAConfigID config)
     va_check(va, "failed to destroy config");
 }
 
-static inline VASurfaceID
-va_create_surface(
-    struct va *va, unsigned int rt_format, unsigned int width, unsigned int height, int fourcc)
+static inline void
+va_create_surfaces(struct va *va,
+                   unsigned int rt_format,
+                   unsigned int width,
+                   unsigned int height,
+                   int fourcc,
+                   VASurfaceID *surfs,
+                   int count)
 {
     VASurfaceAttrib attrs[VASurfaceAttribCount];
     int attr_count = 0;
@@ -233,19 +238,31 @@ va_create_surface(
     attrs[attr_count].value.type = VAGenericValueTypeInteger;
     attrs[attr_count++].value.value.i = fourcc;
 
-    VASurfaceID surf;
     va->status =
-        vaCreateSurfaces(va->display, rt_format, width, height, &surf, 1, attrs, attr_count);
-    va_check(va, "failed to create surface");
+        vaCreateSurfaces(va->display, rt_format, width, height, surfs, count, attrs, attr_count);
+    va_check(va, "failed to create surfaces");
+}
 
+static inline VASurfaceID
+va_create_surface(
+    struct va *va, unsigned int rt_format, unsigned int width, unsigned int height, int fourcc)
+{
+    VASurfaceID surf;
+    va_create_surfaces(va, rt_format, width, height, fourcc, &surf, 1);
     return surf;
 }
 
+static inline void
+va_destroy_surfaces(struct va *va, VASurfaceID *surfs, int count)
+{
+    va->status = vaDestroySurfaces(va->display, surfs, count);
+    va_check(va, "failed to destroy surfaces");
+}
+
 static inline void
 va_destroy_surface(struct va *va, VASurfaceID surf)
 {
-    va->status = vaDestroySurfaces(va->display, &surf, 1);
-    va_check(va, "failed to destroy surface");
+    va_destroy_surfaces(va, &surf, 1);
 }
 
 static inline void
@@ -267,16 +284,28 @@ va_export_surface(struct va *va,
 }
 
 static inline VAContextID
-va_create_context(
-    struct va *va, VAConfigID config, int width, int height, int flag, VASurfaceID surf)
+va_create_context_for_surfaces(struct va *va,
+                               VAConfigID config,
+                               int width,
+                               int height,
+                               int flag,
+                               VASurfaceID *surfs,
+                               int count)
 {
     VAContextID ctx;
-    va->status = vaCreateContext(va->display, config, width, height, flag, &surf, 1, &ctx);
+    va->status = vaCreateContext(va->display, config, width, height, flag, surfs, count, &ctx);
     va_check(va, "failed to create context");
 
     return ctx;
 }
 
+static inline VAContextID
+va_create_context(
+    struct va *va, VAConfigID config, int width, int height, int flag, VASurfaceID surf)
+{
+    return va_create_context_for_surfaces(va, config, width, height, flag, &surf, 1);
+}
+
 static inline void
 va_destroy_context(struct va *va, VAContextID ctx)
 {
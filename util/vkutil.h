@@ -51,6 +51,22 @@ struct vk_init_params {
     bool protected_memory;
     bool high_priority;
 
+    /* when non-zero, create up to this many queues from every queue family */
+    uint32_t queues_per_family;
+    /* command buffers in flight per queue; defaults to 4 */
+    uint32_t submit_ring_depth;
+
+    /* defaults to $VKUTIL_PIPELINE_CACHE_DIR; the cache is not persisted when unset */
+    const char *pipeline_cache_dir;
+
+    /* sub-allocate buffer and image memory from blocks rather than giving every resource its
+     * own VkDeviceMemory; vk_create_* and vk_destroy_* of buffers and images are then not
+     * thread-safe.  A non-zero $VKUTIL_DEDICATED_ALLOC overrides it
+     */
+    bool suballoc;
+    /* defaults to 64MiB; resources larger than half a block get their own memory */
+    VkDeviceSize suballoc_block_size;
+
     const char *const *instance_exts;
     uint32_t instance_ext_count;
 
@@ -58,6 +74,118 @@ struct vk_init_params {
     uint32_t dev_ext_count;
 };
 
+#define VK_MAX_QUEUE_FAMILY_COUNT 8
+#define VK_MAX_QUEUE_COUNT 16
+
+/* Chains descriptor pools of max_sets sets and desc_count descriptors per type, adding one
+ * whenever the current pool runs out.  An allocator must only be used by one thread at a time;
+ * give each thread, or each frame in flight, its own allocator and reset it in bulk.
+ */
+struct vk_descriptor_allocator {
+    uint32_t max_sets;
+    uint32_t desc_count;
+
+    VkDescriptorPool *pools;
+    uint32_t pool_count;
+    uint32_t pool_max;
+    /* pools before this one are exhausted */
+    uint32_t pool_cur;
+};
+
+struct vk_mem_range {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+};
+
+/* a VkDeviceMemory that buffers and images are sub-allocated from */
+struct vk_mem_block {
+    struct vk_mem_block *next;
+
+    VkDeviceMemory mem;
+    VkDeviceSize size;
+    void *ptr;
+    uint32_t mt_idx;
+    bool linear;
+    /* sub-allocation sizes are padded to this, for non-coherent memory */
+    VkDeviceSize atom_size;
+
+    /* sorted by offset and never adjacent */
+    struct vk_mem_range *free_ranges;
+    uint32_t free_count;
+    uint32_t free_max;
+
+    uint32_t alloc_count;
+    /* requested bytes, before padding */
+    VkDeviceSize alloc_size;
+};
+
+struct vk_submit_cmd {
+    VkCommandBuffer cmd;
+    uint64_t sem_val;
+    bool protected_submit;
+};
+
+struct vk_queue {
+    VkQueue queue;
+    uint32_t family_index;
+    uint32_t index;
+    VkQueueFlags flags;
+
+    VkCommandPool cmd_pool;
+    VkCommandPool protected_cmd_pool;
+    struct {
+        VkSemaphore sem;
+        uint64_t sem_next;
+        uint64_t sem_submitted;
+
+        struct vk_submit_cmd *cmds;
+        uint32_t count;
+        uint32_t next;
+
+        /* ended command buffers that are not submitted yet */
+        VkCommandBufferSubmitInfo *batch;
+        uint32_t batch_count;
+        uint64_t batch_sem_val;
+        bool batch_protected;
+    } submit;
+};
+
+/* staging ring bytes that become reusable once queue->submit.sem reaches sem_val */
+struct vk_staging_region {
+    /* ring position one past the region */
+    VkDeviceSize end;
+    uint64_t sem_val;
+};
+
+#define VK_STAGING_RING_MAX_REGIONS 64
+
+/* A persistently mapped staging buffer that is sub-allocated in fifo order.  Allocations are
+ * tagged with the timeline value of the command buffer that consumes them and are reclaimed
+ * when the queue timeline reaches the value.
+ */
+struct vk_staging_ring {
+    struct vk_queue *queue;
+    struct vk_buffer *buf;
+    VkDeviceSize size;
+    /* uploads are split into copies of at most this many bytes */
+    VkDeviceSize chunk_size;
+
+    /* monotonic positions; the buffer offset of a position is position % size */
+    VkDeviceSize head;
+    VkDeviceSize tail;
+    /* allocations between this and head are not tagged yet */
+    VkDeviceSize untagged;
+
+    /* in submission order */
+    struct vk_staging_region regions[VK_STAGING_RING_MAX_REGIONS];
+    uint32_t region_first;
+    uint32_t region_count;
+
+    /* stats */
+    VkDeviceSize peak_size;
+    uint32_t stall_count;
+};
+
 struct vk {
     struct vk_init_params params;
     bool KHR_get_surface_capabilities2;
@@ -117,24 +245,41 @@ struct vk {
     VkPhysicalDeviceMemoryProperties mem_props;
     uint32_t buf_mt_mask;
 
+    struct {
+        /* indexed by memory type and, unless bufferImageGranularity is 1, by whether the
+         * resources are linear
+         */
+        struct vk_mem_block *pools[VK_MAX_MEMORY_TYPES][2];
+
+        uint32_t dedicated_count;
+        VkDeviceSize dedicated_size;
+    } suballoc;
+
     VkDevice dev;
     VkQueue queue;
     uint32_t queue_family_index;
 
-    VkDescriptorPool desc_pool;
+    VkQueueFamilyProperties queue_family_props[VK_MAX_QUEUE_FAMILY_COUNT];
+    uint32_t queue_family_count;
+
+    /* queues[0] is the primary queue above */
+    struct vk_queue queues[VK_MAX_QUEUE_COUNT];
+    uint32_t queue_count;
+
+    struct vk_descriptor_allocator desc_alloc;
 
-    VkCommandPool cmd_pool;
-    VkCommandPool protected_cmd_pool;
     struct {
-        VkSemaphore sem;
-        uint64_t sem_next;
+        VkPipelineCache cache;
+        char path[512];
 
-        VkCommandBuffer cmds[4];
-        uint64_t sem_vals[4];
-        bool protected_submits[4];
-        uint32_t count;
-        uint32_t next;
-    } submit;
+        uint32_t hit_count;
+        uint32_t miss_count;
+        uint64_t compile_ns;
+    } pipeline_cache;
+
+    /* the command pools of the primary queue */
+    VkCommandPool cmd_pool;
+    VkCommandPool protected_cmd_pool;
 };
 
 struct vk_buffer {
@@ -143,9 +288,12 @@ struct vk_buffer {
     VkBuffer buf;
 
     VkDeviceMemory mem;
+    VkDeviceSize mem_offset;
     VkDeviceSize mem_size;
     void *mem_ptr;
     bool is_coherent;
+    /* NULL when mem is a dedicated allocation */
+    struct vk_mem_block *mem_block;
 };
 
 struct vk_image {
@@ -154,9 +302,12 @@ struct vk_image {
     VkImage img;
 
     VkDeviceMemory mem;
+    VkDeviceSize mem_offset;
     VkDeviceSize mem_size;
     void *mem_ptr;
     bool is_coherent;
+    /* NULL when mem is a dedicated allocation */
+    struct vk_mem_block *mem_block;
 
     VkImageView render_view;
 
@@ -168,6 +319,8 @@ struct vk_image {
     VkSampler sampler;
 };
 
+#define VK_PIPELINE_MAX_SPEC_CONSTS 16
+
 struct vk_pipeline {
     VkPipelineCreateFlags2 flags2;
 
@@ -175,6 +328,11 @@ struct vk_pipeline {
     VkShaderModuleCreateInfo mods[5];
     uint32_t stage_count;
 
+    /* 32-bit specialization constants of each stage */
+    VkSpecializationInfo spec_infos[5];
+    VkSpecializationMapEntry spec_entries[5][VK_PIPELINE_MAX_SPEC_CONSTS];
+    uint32_t spec_data[5][VK_PIPELINE_MAX_SPEC_CONSTS];
+
     VkDescriptorSetLayout set_layouts[4];
     uint32_t set_layout_count;
     VkPushConstantRange push_const;
@@ -258,6 +416,16 @@ vk_init_params(struct vk *vk, const struct vk_init_params *params)
         vk->params = *params;
     if (vk->params.api_version < VKUTIL_MIN_API_VERSION)
         vk->params.api_version = VKUTIL_MIN_API_VERSION;
+    if (!vk->params.pipeline_cache_dir)
+        vk->params.pipeline_cache_dir = getenv("VKUTIL_PIPELINE_CACHE_DIR");
+    if (!vk->params.submit_ring_depth)
+        vk->params.submit_ring_depth = 4;
+    if (vk->params.suballoc) {
+        const char *env = getenv("VKUTIL_DEDICATED_ALLOC");
+        vk->params.suballoc = !(env && atoi(env));
+    }
+    if (!vk->params.suballoc_block_size)
+        vk->params.suballoc_block_size = 64ull * 1024 * 1024;
 
     for (uint32_t i = 0; i < vk->params.instance_ext_count; i++) {
         if (!strcmp(vk->params.instance_exts[i],
@@ -667,50 +835,79 @@ vk_init_device(struct vk *vk)
 {
     vk->queue_family_index = 0;
 
-    VkQueueFamilyGlobalPriorityProperties prio_props = {
-        .sType = VK_STRUCTURE_TYPE_QUEUE_FAMILY_GLOBAL_PRIORITY_PROPERTIES,
-    };
-    VkQueueFamilyProperties2 queue_props = {
-        .sType = VK_STRUCTURE_TYPE_QUEUE_FAMILY_PROPERTIES_2,
-        .pNext = &prio_props,
-    };
-    uint32_t queue_count = 1;
-    vk->GetPhysicalDeviceQueueFamilyProperties2(vk->physical_dev, &queue_count, &queue_props);
-    if (!(queue_props.queueFamilyProperties.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+    VkQueueFamilyGlobalPriorityProperties prio_props[VK_MAX_QUEUE_FAMILY_COUNT];
+    VkQueueFamilyProperties2 family_props[VK_MAX_QUEUE_FAMILY_COUNT];
+    for (uint32_t i = 0; i < VK_MAX_QUEUE_FAMILY_COUNT; i++) {
+        prio_props[i] = (VkQueueFamilyGlobalPriorityProperties){
+            .sType = VK_STRUCTURE_TYPE_QUEUE_FAMILY_GLOBAL_PRIORITY_PROPERTIES,
+        };
+        family_props[i] = (VkQueueFamilyProperties2){
+            .sType = VK_STRUCTURE_TYPE_QUEUE_FAMILY_PROPERTIES_2,
+            .pNext = &prio_props[i],
+        };
+    }
+    vk->queue_family_count = VK_MAX_QUEUE_FAMILY_COUNT;
+    vk->GetPhysicalDeviceQueueFamilyProperties2(vk->physical_dev, &vk->queue_family_count,
+                                                family_props);
+    for (uint32_t i = 0; i < vk->queue_family_count; i++)
+        vk->queue_family_props[i] = family_props[i].queueFamilyProperties;
+
+    const VkQueueFamilyProperties *queue_props = &vk->queue_family_props[0];
+    if (!(queue_props->queueFlags & VK_QUEUE_GRAPHICS_BIT))
         vk_die("queue family 0 does not support graphics");
-    if (vk->params.protected_memory &&
-        !(queue_props.queueFamilyProperties.queueFlags & VK_QUEUE_PROTECTED_BIT))
+    if (vk->params.protected_memory && !(queue_props->queueFlags & VK_QUEUE_PROTECTED_BIT))
         vk_die("queue family 0 does not support protected");
-    if (!queue_props.queueFamilyProperties.timestampValidBits)
+    if (!queue_props->timestampValidBits)
         vk_die("queue family 0 does not support timestamps");
 
     VkQueueGlobalPriority global_priority = VK_QUEUE_GLOBAL_PRIORITY_MEDIUM;
     if (vk->params.high_priority) {
-        global_priority = prio_props.priorities[prio_props.priorityCount - 1];
+        global_priority = prio_props[0].priorities[prio_props[0].priorityCount - 1];
         if (global_priority <= VK_QUEUE_GLOBAL_PRIORITY_MEDIUM)
             vk_die("queue family 0 does not support high priority");
     }
 
+    /* protected and priority only apply to queue family 0 */
     const VkDeviceQueueCreateFlags queue_flags =
         vk->params.protected_memory ? VK_DEVICE_QUEUE_CREATE_PROTECTED_BIT : 0;
-    const float queue_priority = 1.0f;
+    float queue_priorities[VK_MAX_QUEUE_COUNT];
+    for (uint32_t i = 0; i < ARRAY_SIZE(queue_priorities); i++)
+        queue_priorities[i] = 1.0f;
     const VkDeviceQueueGlobalPriorityCreateInfo global_prio_info = {
         .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_GLOBAL_PRIORITY_CREATE_INFO,
         .globalPriority = global_priority,
     };
-    const VkDeviceQueueCreateInfo queue_create_info = {
-        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-        .pNext = &global_prio_info,
-        .flags = queue_flags,
-        .queueFamilyIndex = vk->queue_family_index,
-        .queueCount = 1,
-        .pQueuePriorities = &queue_priority,
-    };
+
+    VkDeviceQueueCreateInfo queue_create_infos[VK_MAX_QUEUE_FAMILY_COUNT];
+    uint32_t queue_create_info_count = 0;
+    uint32_t total_queue_count = 0;
+    for (uint32_t i = 0; i < vk->queue_family_count; i++) {
+        uint32_t queue_count = vk->params.queues_per_family;
+        if (!i && !queue_count)
+            queue_count = 1;
+        if (queue_count > vk->queue_family_props[i].queueCount)
+            queue_count = vk->queue_family_props[i].queueCount;
+        if (queue_count > VK_MAX_QUEUE_COUNT - total_queue_count)
+            queue_count = VK_MAX_QUEUE_COUNT - total_queue_count;
+        if (!queue_count)
+            continue;
+
+        queue_create_infos[queue_create_info_count++] = (VkDeviceQueueCreateInfo){
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .pNext = i ? NULL : &global_prio_info,
+            .flags = i ? 0 : queue_flags,
+            .queueFamilyIndex = i,
+            .queueCount = queue_count,
+            .pQueuePriorities = queue_priorities,
+        };
+        total_queue_count += queue_count;
+    }
+
     const VkDeviceCreateInfo dev_info = {
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
         .pNext = &vk->features,
-        .queueCreateInfoCount = 1,
-        .pQueueCreateInfos = &queue_create_info,
+        .queueCreateInfoCount = queue_create_info_count,
+        .pQueueCreateInfos = queue_create_infos,
         .enabledExtensionCount = vk->params.dev_ext_count,
         .ppEnabledExtensionNames = vk->params.dev_exts,
     };
@@ -719,83 +916,246 @@ vk_init_device(struct vk *vk)
 
     vk_init_device_dispatch(vk);
 
-    const VkDeviceQueueInfo2 queue_info = {
-        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_INFO_2,
-        .flags = queue_flags,
-        .queueFamilyIndex = vk->queue_family_index,
-    };
-    vk->GetDeviceQueue2(vk->dev, &queue_info, &vk->queue);
+    for (uint32_t i = 0; i < queue_create_info_count; i++) {
+        const VkDeviceQueueCreateInfo *create_info = &queue_create_infos[i];
+        for (uint32_t j = 0; j < create_info->queueCount; j++) {
+            struct vk_queue *queue = &vk->queues[vk->queue_count++];
+            queue->family_index = create_info->queueFamilyIndex;
+            queue->index = j;
+            queue->flags = vk->queue_family_props[queue->family_index].queueFlags;
+
+            const VkDeviceQueueInfo2 queue_info = {
+                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_INFO_2,
+                .flags = create_info->flags,
+                .queueFamilyIndex = queue->family_index,
+                .queueIndex = queue->index,
+            };
+            vk->GetDeviceQueue2(vk->dev, &queue_info, &queue->queue);
+        }
+    }
+
+    vk->queue = vk->queues[0].queue;
 }
 
-static inline void
-vk_init_desc_pool(struct vk *vk)
+/* thread-safe for distinct allocators, and thus does not touch vk->result */
+static inline VkDescriptorPool
+vk_create_descriptor_pool(struct vk *vk, uint32_t max_sets, uint32_t desc_count)
 {
     const VkDescriptorPoolSize pool_sizes[] = {
         [0] = {
             .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            .descriptorCount = 32,
+            .descriptorCount = desc_count,
         },
         [1] = {
             .type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
-            .descriptorCount = 32,
+            .descriptorCount = desc_count,
         },
         [2] = {
             .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-            .descriptorCount = 32,
+            .descriptorCount = desc_count,
         },
         [3] = {
             .type = VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER,
-            .descriptorCount = 32,
+            .descriptorCount = desc_count,
         },
         [4] = {
             .type = VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER,
-            .descriptorCount = 32,
+            .descriptorCount = desc_count,
         },
         [5] = {
             .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .descriptorCount = 32,
+            .descriptorCount = desc_count,
         },
         [6] = {
             .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .descriptorCount = 32,
+            .descriptorCount = desc_count,
         },
         [7] = {
             .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
-            .descriptorCount = 32,
+            .descriptorCount = desc_count,
         },
         [8] = {
             .type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-            .descriptorCount = 32,
+            .descriptorCount = desc_count,
         },
     };
     const VkDescriptorPoolCreateInfo pool_info = {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .maxSets = 256,
+        .maxSets = max_sets,
         .poolSizeCount = ARRAY_SIZE(pool_sizes),
         .pPoolSizes = pool_sizes,
     };
 
-    vk->result = vk->CreateDescriptorPool(vk->dev, &pool_info, NULL, &vk->desc_pool);
-    vk_check(vk, "failed to create descriptor pool");
+    VkDescriptorPool pool;
+    const VkResult result = vk->CreateDescriptorPool(vk->dev, &pool_info, NULL, &pool);
+    if (result != VK_SUCCESS)
+        vk_die("failed to create descriptor pool: %d", result);
+
+    return pool;
 }
 
 static inline void
-vk_init_cmd_pool(struct vk *vk)
+vk_init_descriptor_allocator(struct vk *vk,
+                             struct vk_descriptor_allocator *alloc,
+                             uint32_t max_sets,
+                             uint32_t desc_count)
+{
+    memset(alloc, 0, sizeof(*alloc));
+    alloc->max_sets = max_sets;
+    alloc->desc_count = desc_count;
+}
+
+static inline void
+vk_cleanup_descriptor_allocator(struct vk *vk, struct vk_descriptor_allocator *alloc)
+{
+    for (uint32_t i = 0; i < alloc->pool_count; i++)
+        vk->DestroyDescriptorPool(vk->dev, alloc->pools[i], NULL);
+    free(alloc->pools);
+    memset(alloc, 0, sizeof(*alloc));
+}
+
+/* frees all sets at once and rewinds to the first pool; pools are kept for reuse */
+static inline void
+vk_reset_descriptor_allocator(struct vk *vk, struct vk_descriptor_allocator *alloc)
+{
+    for (uint32_t i = 0; i < alloc->pool_count && i <= alloc->pool_cur; i++)
+        vk->ResetDescriptorPool(vk->dev, alloc->pools[i], 0);
+    alloc->pool_cur = 0;
+}
+
+static inline VkDescriptorSet
+vk_alloc_descriptor_set(struct vk *vk,
+                        struct vk_descriptor_allocator *alloc,
+                        VkDescriptorSetLayout layout)
+{
+    while (true) {
+        const bool fresh = alloc->pool_cur == alloc->pool_count;
+        if (fresh) {
+            if (alloc->pool_count == alloc->pool_max) {
+                alloc->pool_max = alloc->pool_max ? alloc->pool_max * 2 : 4;
+                alloc->pools = (VkDescriptorPool *)realloc(
+                    alloc->pools, sizeof(*alloc->pools) * alloc->pool_max);
+                if (!alloc->pools)
+                    vk_die("failed to grow descriptor pools");
+            }
+            alloc->pools[alloc->pool_count++] =
+                vk_create_descriptor_pool(vk, alloc->max_sets, alloc->desc_count);
+        }
+
+        const VkDescriptorSetAllocateInfo set_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = alloc->pools[alloc->pool_cur],
+            .descriptorSetCount = 1,
+            .pSetLayouts = &layout,
+        };
+        VkDescriptorSet set;
+        const VkResult result = vk->AllocateDescriptorSets(vk->dev, &set_info, &set);
+        if (result == VK_SUCCESS)
+            return set;
+
+        const bool exhausted =
+            result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL;
+        if (!exhausted || fresh)
+            vk_die("failed to allocate descriptor set: %d", result);
+
+        alloc->pool_cur++;
+    }
+}
+
+static inline void
+vk_init_desc_pool(struct vk *vk)
 {
-    VkCommandPoolCreateInfo pool_info = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-        .queueFamilyIndex = vk->queue_family_index,
+    vk_init_descriptor_allocator(vk, &vk->desc_alloc, 256, 32);
+}
+
+static inline bool
+vk_validate_pipeline_cache_data(struct vk *vk, const void *data, size_t size)
+{
+    VkPipelineCacheHeaderVersionOne hdr;
+    if (size < sizeof(hdr))
+        return false;
+    memcpy(&hdr, data, sizeof(hdr));
+
+    return hdr.headerSize >= sizeof(hdr) && hdr.headerSize <= size &&
+           hdr.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           hdr.vendorID == vk->props.properties.vendorID &&
+           hdr.deviceID == vk->props.properties.deviceID &&
+           !memcmp(hdr.pipelineCacheUUID, vk->props.properties.pipelineCacheUUID, VK_UUID_SIZE);
+}
+
+static inline void *
+vk_read_pipeline_cache_file(struct vk *vk, size_t *out_size)
+{
+    size_t size;
+    void *data = u_read_file(vk->pipeline_cache.path, &size);
+    if (data && !vk_validate_pipeline_cache_data(vk, data, size)) {
+        vk_log("ignoring incompatible pipeline cache %s", vk->pipeline_cache.path);
+        free(data);
+        data = NULL;
+    }
+
+    *out_size = data ? size : 0;
+    return data;
+}
+
+static inline void
+vk_init_pipeline_cache(struct vk *vk)
+{
+    const char *dir = vk->params.pipeline_cache_dir;
+    void *data = NULL;
+    size_t size = 0;
+
+    if (dir && dir[0]) {
+        /* key by device and driver version */
+        char uuid[VK_UUID_SIZE * 2 + 1];
+        for (uint32_t i = 0; i < VK_UUID_SIZE; i++)
+            snprintf(uuid + i * 2, 3, "%02x", vk->vulkan_11_props.deviceUUID[i]);
+
+        const int len = snprintf(vk->pipeline_cache.path, sizeof(vk->pipeline_cache.path),
+                                 "%s/vkutil-%s-%08x.bin", dir, uuid,
+                                 vk->props.properties.driverVersion);
+        if (len >= (int)sizeof(vk->pipeline_cache.path))
+            vk_die("pipeline cache path too long");
+
+        data = vk_read_pipeline_cache_file(vk, &size);
+    }
+
+    const VkPipelineCacheCreateInfo cache_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = size,
+        .pInitialData = data,
     };
+    vk->result = vk->CreatePipelineCache(vk->dev, &cache_info, NULL, &vk->pipeline_cache.cache);
+    vk_check(vk, "failed to create pipeline cache");
 
-    vk->result = vk->CreateCommandPool(vk->dev, &pool_info, NULL, &vk->cmd_pool);
-    vk_check(vk, "failed to create command pool");
+    free(data);
+}
 
-    if (vk->params.protected_memory) {
-        pool_info.flags |= VK_COMMAND_POOL_CREATE_PROTECTED_BIT;
-        vk->result = vk->CreateCommandPool(vk->dev, &pool_info, NULL, &vk->protected_cmd_pool);
-        vk_check(vk, "failed to create protected command pool");
+static inline void
+vk_init_cmd_pool(struct vk *vk)
+{
+    for (uint32_t i = 0; i < vk->queue_count; i++) {
+        struct vk_queue *queue = &vk->queues[i];
+
+        VkCommandPoolCreateInfo pool_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = queue->family_index,
+        };
+
+        vk->result = vk->CreateCommandPool(vk->dev, &pool_info, NULL, &queue->cmd_pool);
+        vk_check(vk, "failed to create command pool");
+
+        if (vk->params.protected_memory && queue->family_index == vk->queue_family_index) {
+            pool_info.flags |= VK_COMMAND_POOL_CREATE_PROTECTED_BIT;
+            vk->result =
+                vk->CreateCommandPool(vk->dev, &pool_info, NULL, &queue->protected_cmd_pool);
+            vk_check(vk, "failed to create protected command pool");
+        }
     }
+
+    vk->cmd_pool = vk->queues[0].cmd_pool;
+    vk->protected_cmd_pool = vk->queues[0].protected_cmd_pool;
 }
 
 static inline void
@@ -810,14 +1170,387 @@ vk_init_submit(struct vk *vk)
         .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
         .pNext = &sem_type_info,
     };
-    vk->result = vk->CreateSemaphore(vk->dev, &sem_info, NULL, &vk->submit.sem);
-    vk_check(vk, "failed to create submit semaphore");
 
-    vk->submit.sem_next = 1;
+    for (uint32_t i = 0; i < vk->queue_count; i++) {
+        struct vk_queue *queue = &vk->queues[i];
+
+        vk->result = vk->CreateSemaphore(vk->dev, &sem_info, NULL, &queue->submit.sem);
+        vk_check(vk, "failed to create submit semaphore");
+
+        queue->submit.sem_next = 1;
+
+        queue->submit.count = vk->params.submit_ring_depth;
+        queue->submit.cmds = (struct vk_submit_cmd *)calloc(queue->submit.count,
+                                                            sizeof(*queue->submit.cmds));
+        queue->submit.batch = (VkCommandBufferSubmitInfo *)calloc(
+            queue->submit.count, sizeof(*queue->submit.batch));
+        if (!queue->submit.cmds || !queue->submit.batch)
+            vk_die("failed to alloc submit ring");
+    }
+}
+
+static inline VkDeviceMemory
+vk_alloc_memory(struct vk *vk, VkDeviceSize size, uint32_t mt_index)
+{
+    const VkMemoryAllocateInfo alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = size,
+        .memoryTypeIndex = mt_index,
+    };
+
+    VkDeviceMemory mem;
+    vk->result = vk->AllocateMemory(vk->dev, &alloc_info, NULL, &mem);
+    vk_check(vk, "failed to allocate memory of size %zu\n", (size_t)size);
+
+    return mem;
+}
+
+static inline void *
+vk_map_memory(struct vk *vk, VkDeviceMemory mem, VkDeviceSize size)
+{
+    const VkMemoryMapInfo map_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_MAP_INFO,
+        .memory = mem,
+        .size = size,
+    };
+    void *ptr;
+    vk->result = vk->MapMemory2(vk->dev, &map_info, &ptr);
+    vk_check(vk, "failed to map memory");
+
+    return ptr;
+}
+
+static inline VkDeviceSize
+vk_get_mem_block_size(struct vk *vk, uint32_t mt_idx)
+{
+    const VkMemoryType *mt = &vk->mem_props.memoryTypes[mt_idx];
+    const VkMemoryHeap *heap = &vk->mem_props.memoryHeaps[mt->heapIndex];
+
+    /* do not let a few blocks exhaust a small heap */
+    VkDeviceSize size = vk->params.suballoc_block_size;
+    while (size > 1024 * 1024 && size > heap->size / 8)
+        size /= 2;
+
+    return size;
+}
+
+static inline void
+vk_mem_block_insert_range(struct vk_mem_block *block,
+                          uint32_t idx,
+                          VkDeviceSize offset,
+                          VkDeviceSize size)
+{
+    if (block->free_count == block->free_max) {
+        block->free_max = block->free_max ? block->free_max * 2 : 16;
+        block->free_ranges = (struct vk_mem_range *)realloc(
+            block->free_ranges, sizeof(*block->free_ranges) * block->free_max);
+        if (!block->free_ranges)
+            vk_die("failed to grow free ranges");
+    }
+
+    memmove(&block->free_ranges[idx + 1], &block->free_ranges[idx],
+            sizeof(*block->free_ranges) * (block->free_count - idx));
+    block->free_ranges[idx] = (struct vk_mem_range){
+        .offset = offset,
+        .size = size,
+    };
+    block->free_count++;
+}
+
+static inline void
+vk_mem_block_remove_range(struct vk_mem_block *block, uint32_t idx)
+{
+    block->free_count--;
+    memmove(&block->free_ranges[idx], &block->free_ranges[idx + 1],
+            sizeof(*block->free_ranges) * (block->free_count - idx));
+}
+
+static inline struct vk_mem_block *
+vk_create_mem_block(struct vk *vk, uint32_t mt_idx, bool linear)
+{
+    const VkMemoryType *mt = &vk->mem_props.memoryTypes[mt_idx];
+
+    struct vk_mem_block *block = (struct vk_mem_block *)calloc(1, sizeof(*block));
+    if (!block)
+        vk_die("failed to alloc mem block");
+
+    block->size = vk_get_mem_block_size(vk, mt_idx);
+    block->mem = vk_alloc_memory(vk, block->size, mt_idx);
+    block->mt_idx = mt_idx;
+    block->linear = linear;
+
+    block->atom_size = 1;
+    if (mt->propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        block->ptr = vk_map_memory(vk, block->mem, VK_WHOLE_SIZE);
+
+        /* keep flushes and invalidations of neighbors from overlapping */
+        if (!(mt->propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+            block->atom_size = vk->props.properties.limits.nonCoherentAtomSize;
+    }
+
+    vk_mem_block_insert_range(block, 0, 0, block->size);
+
+    return block;
+}
+
+static inline void
+vk_destroy_mem_block(struct vk *vk, struct vk_mem_block *block)
+{
+    vk->FreeMemory(vk->dev, block->mem, NULL);
+    free(block->free_ranges);
+    free(block);
+}
+
+/* first fit */
+static inline bool
+vk_mem_block_alloc(struct vk_mem_block *block,
+                   VkDeviceSize size,
+                   VkDeviceSize align,
+                   VkDeviceSize *offset)
+{
+    const VkDeviceSize padded_size = ALIGN(size, block->atom_size);
+    if (align < block->atom_size)
+        align = block->atom_size;
+
+    for (uint32_t i = 0; i < block->free_count; i++) {
+        struct vk_mem_range *range = &block->free_ranges[i];
+        const VkDeviceSize range_end = range->offset + range->size;
+        const VkDeviceSize start = ALIGN(range->offset, align);
+        if (start >= range_end || range_end - start < padded_size)
+            continue;
+
+        const VkDeviceSize end = start + padded_size;
+        const VkDeviceSize head = start - range->offset;
+        const VkDeviceSize tail = range_end - end;
+        if (head && tail) {
+            range->size = head;
+            vk_mem_block_insert_range(block, i + 1, end, tail);
+        } else if (head) {
+            range->size = head;
+        } else if (tail) {
+            range->offset = end;
+            range->size = tail;
+        } else {
+            vk_mem_block_remove_range(block, i);
+        }
+
+        block->alloc_count++;
+        block->alloc_size += size;
+        *offset = start;
+        return true;
+    }
 
-    static_assert(ARRAY_SIZE(vk->submit.cmds) == ARRAY_SIZE(vk->submit.sem_vals), "");
-    static_assert(ARRAY_SIZE(vk->submit.cmds) == ARRAY_SIZE(vk->submit.protected_submits), "");
-    vk->submit.count = ARRAY_SIZE(vk->submit.cmds);
+    return false;
+}
+
+static inline void
+vk_mem_block_free(struct vk_mem_block *block, VkDeviceSize offset, VkDeviceSize size)
+{
+    block->alloc_count--;
+    block->alloc_size -= size;
+    size = ALIGN(size, block->atom_size);
+
+    /* find the first free range after offset */
+    uint32_t lo = 0;
+    uint32_t hi = block->free_count;
+    while (lo < hi) {
+        const uint32_t mid = (lo + hi) / 2;
+        if (block->free_ranges[mid].offset < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    struct vk_mem_range *prev = lo ? &block->free_ranges[lo - 1] : NULL;
+    struct vk_mem_range *next = lo < block->free_count ? &block->free_ranges[lo] : NULL;
+    const bool merge_prev = prev && prev->offset + prev->size == offset;
+    const bool merge_next = next && offset + size == next->offset;
+    if (merge_prev && merge_next) {
+        prev->size += size + next->size;
+        vk_mem_block_remove_range(block, lo);
+    } else if (merge_prev) {
+        prev->size += size;
+    } else if (merge_next) {
+        next->offset = offset;
+        next->size += size;
+    } else {
+        vk_mem_block_insert_range(block, lo, offset, size);
+    }
+}
+
+static inline struct vk_mem_block **
+vk_get_mem_pool(struct vk *vk, uint32_t mt_idx, bool linear)
+{
+    const bool split = vk->props.properties.limits.bufferImageGranularity > 1;
+    return &vk->suballoc.pools[mt_idx][split && linear];
+}
+
+/* returns NULL when the resource should get a dedicated allocation instead */
+static inline struct vk_mem_block *
+vk_suballoc_memory(struct vk *vk,
+                   const VkMemoryRequirements *reqs,
+                   uint32_t mt_idx,
+                   bool linear,
+                   VkDeviceSize *offset)
+{
+    if (!vk->params.suballoc || reqs->size > vk_get_mem_block_size(vk, mt_idx) / 2)
+        return NULL;
+
+    struct vk_mem_block **pool = vk_get_mem_pool(vk, mt_idx, linear);
+    struct vk_mem_block **tail = pool;
+    for (struct vk_mem_block *block = *pool; block; block = block->next) {
+        if (vk_mem_block_alloc(block, reqs->size, reqs->alignment, offset))
+            return block;
+        tail = &block->next;
+    }
+
+    /* append such that older blocks are filled first and newer ones can drain */
+    struct vk_mem_block *block = vk_create_mem_block(vk, mt_idx, linear);
+    *tail = block;
+
+    if (!vk_mem_block_alloc(block, reqs->size, reqs->alignment, offset))
+        vk_die("failed to sub-allocate %zu bytes", (size_t)reqs->size);
+
+    return block;
+}
+
+static inline void
+vk_free_suballoc_memory(struct vk *vk,
+                        struct vk_mem_block *block,
+                        VkDeviceSize offset,
+                        VkDeviceSize size)
+{
+    vk_mem_block_free(block, offset, size);
+    if (block->alloc_count)
+        return;
+
+    /* keep one empty block per pool to absorb churn */
+    struct vk_mem_block **pool = vk_get_mem_pool(vk, block->mt_idx, block->linear);
+    struct vk_mem_block **link = NULL;
+    bool has_spare = false;
+    for (struct vk_mem_block **iter = pool; *iter; iter = &(*iter)->next) {
+        if (*iter == block)
+            link = iter;
+        else if (!(*iter)->alloc_count)
+            has_spare = true;
+    }
+
+    if (has_spare) {
+        *link = block->next;
+        vk_destroy_mem_block(vk, block);
+    }
+}
+
+/* allocates and maps memory for a buffer or an image, sub-allocating when possible */
+static inline struct vk_mem_block *
+vk_alloc_resource_memory(struct vk *vk,
+                         const VkMemoryRequirements *reqs,
+                         uint32_t mt_idx,
+                         bool linear,
+                         const VkMemoryDedicatedAllocateInfo *dedicated_info,
+                         VkDeviceMemory *mem,
+                         VkDeviceSize *offset,
+                         void **ptr)
+{
+    struct vk_mem_block *block =
+        dedicated_info ? NULL : vk_suballoc_memory(vk, reqs, mt_idx, linear, offset);
+    if (block) {
+        *mem = block->mem;
+        *ptr = block->ptr ? (uint8_t *)block->ptr + *offset : NULL;
+        return block;
+    }
+
+    const VkMemoryAllocateInfo alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = dedicated_info,
+        .allocationSize = reqs->size,
+        .memoryTypeIndex = mt_idx,
+    };
+    vk->result = vk->AllocateMemory(vk->dev, &alloc_info, NULL, mem);
+    vk_check(vk, "failed to allocate memory of size %zu\n", (size_t)reqs->size);
+
+    vk->suballoc.dedicated_count++;
+    vk->suballoc.dedicated_size += reqs->size;
+
+    *offset = 0;
+    *ptr = NULL;
+    const VkMemoryType *mt = &vk->mem_props.memoryTypes[mt_idx];
+    if (mt->propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        *ptr = vk_map_memory(vk, *mem, reqs->size);
+
+    return NULL;
+}
+
+static inline void
+vk_free_resource_memory(struct vk *vk,
+                        struct vk_mem_block *block,
+                        VkDeviceMemory mem,
+                        VkDeviceSize offset,
+                        VkDeviceSize size)
+{
+    if (block) {
+        vk_free_suballoc_memory(vk, block, offset, size);
+    } else {
+        vk->FreeMemory(vk->dev, mem, NULL);
+        vk->suballoc.dedicated_count--;
+        vk->suballoc.dedicated_size -= size;
+    }
+}
+
+static inline void
+vk_log_suballoc_stats(struct vk *vk)
+{
+    for (uint32_t i = 0; i < vk->mem_props.memoryTypeCount; i++) {
+        for (uint32_t j = 0; j < ARRAY_SIZE(vk->suballoc.pools[i]); j++) {
+            uint32_t block_count = 0;
+            uint32_t alloc_count = 0;
+            VkDeviceSize block_size = 0;
+            VkDeviceSize alloc_size = 0;
+            VkDeviceSize free_size = 0;
+            VkDeviceSize largest_free = 0;
+            for (const struct vk_mem_block *block = vk->suballoc.pools[i][j]; block;
+                 block = block->next) {
+                block_count++;
+                alloc_count += block->alloc_count;
+                block_size += block->size;
+                alloc_size += block->alloc_size;
+                for (uint32_t k = 0; k < block->free_count; k++) {
+                    const VkDeviceSize size = block->free_ranges[k].size;
+                    free_size += size;
+                    if (largest_free < size)
+                        largest_free = size;
+                }
+            }
+            if (!block_count)
+                continue;
+
+            /* wasted bytes are reserved from the driver but back no resource */
+            const float frag = free_size ? 1.0f - (float)largest_free / (float)free_size : 0.0f;
+            vk_log("mt %u%s: %u blocks of %zu KiB, %u allocs of %zu KiB, %zu KiB wasted, "
+                   "%.1f%% fragmentation",
+                   i, j ? " (linear)" : "", block_count, (size_t)(block_size / 1024),
+                   alloc_count, (size_t)(alloc_size / 1024),
+                   (size_t)((block_size - alloc_size) / 1024), frag * 100.0f);
+        }
+    }
+
+    vk_log("dedicated: %u allocs of %zu KiB", vk->suballoc.dedicated_count,
+           (size_t)(vk->suballoc.dedicated_size / 1024));
+}
+
+static inline void
+vk_cleanup_suballoc(struct vk *vk)
+{
+    for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++) {
+        for (uint32_t j = 0; j < ARRAY_SIZE(vk->suballoc.pools[i]); j++) {
+            struct vk_mem_block *block = vk->suballoc.pools[i][j];
+            while (block) {
+                struct vk_mem_block *next = block->next;
+                vk_destroy_mem_block(vk, block);
+                block = next;
+            }
+        }
+    }
 }
 
 static inline void
@@ -833,6 +1566,7 @@ vk_init(struct vk *vk, const struct vk_init_params *params)
     vk_init_device(vk);
 
     vk_init_desc_pool(vk);
+    vk_init_pipeline_cache(vk);
     vk_init_cmd_pool(vk);
     vk_init_submit(vk);
 
@@ -841,16 +1575,49 @@ vk_init(struct vk *vk, const struct vk_init_params *params)
     vk->params.dev_ext_count = 0;
 }
 
+static inline void
+vk_write_pipeline_cache_file(struct vk *vk)
+{
+    size_t size;
+    vk->result = vk->GetPipelineCacheData(vk->dev, vk->pipeline_cache.cache, &size, NULL);
+    vk_check(vk, "failed to get pipeline cache size");
+
+    void *data = malloc(size);
+    if (!data)
+        vk_die("failed to alloc pipeline cache data");
+    vk->result = vk->GetPipelineCacheData(vk->dev, vk->pipeline_cache.cache, &size, data);
+    vk_check(vk, "failed to get pipeline cache data");
+
+    if (!u_write_file(vk->pipeline_cache.path, data, size))
+        vk_log("failed to write pipeline cache %s", vk->pipeline_cache.path);
+
+    free(data);
+
+    vk_log("pipeline cache: %u hits, %u misses, %" PRIu64 " us compile time, %zu bytes",
+           vk->pipeline_cache.hit_count, vk->pipeline_cache.miss_count,
+           vk->pipeline_cache.compile_ns / 1000, size);
+}
+
 static inline void
 vk_cleanup(struct vk *vk)
 {
     vk->DeviceWaitIdle(vk->dev);
 
-    vk->DestroyDescriptorPool(vk->dev, vk->desc_pool, NULL);
-    vk->DestroyCommandPool(vk->dev, vk->protected_cmd_pool, NULL);
-    vk->DestroyCommandPool(vk->dev, vk->cmd_pool, NULL);
-    vk->DestroySemaphore(vk->dev, vk->submit.sem, NULL);
+    if (vk->pipeline_cache.path[0])
+        vk_write_pipeline_cache_file(vk);
+    vk->DestroyPipelineCache(vk->dev, vk->pipeline_cache.cache, NULL);
+
+    vk_cleanup_descriptor_allocator(vk, &vk->desc_alloc);
+    for (uint32_t i = 0; i < vk->queue_count; i++) {
+        struct vk_queue *queue = &vk->queues[i];
+        vk->DestroyCommandPool(vk->dev, queue->protected_cmd_pool, NULL);
+        vk->DestroyCommandPool(vk->dev, queue->cmd_pool, NULL);
+        vk->DestroySemaphore(vk->dev, queue->submit.sem, NULL);
+        free(queue->submit.cmds);
+        free(queue->submit.batch);
+    }
 
+    vk_cleanup_suballoc(vk);
     vk->DestroyDevice(vk->dev, NULL);
 
     if (vk->debug_utils)
@@ -860,20 +1627,16 @@ vk_cleanup(struct vk *vk)
     dlclose(vk->handle);
 }
 
-static inline VkDeviceMemory
-vk_alloc_memory(struct vk *vk, VkDeviceSize size, uint32_t mt_index)
+static inline void
+vk_init_result(struct vk *vk, struct u_result *res, const char *tool)
 {
-    const VkMemoryAllocateInfo alloc_info = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = size,
-        .memoryTypeIndex = mt_index,
-    };
-
-    VkDeviceMemory mem;
-    vk->result = vk->AllocateMemory(vk->dev, &alloc_info, NULL, &mem);
-    vk_check(vk, "failed to allocate memory of size %zu\n", (size_t)size);
+    u_result_init(res, tool, NULL);
+    u_result_set_device(res, vk->props.properties.deviceName, NULL);
 
-    return mem;
+    /* long driver infos are truncated */
+    snprintf(res->driver, sizeof(res->driver), "%.*s %.*s",
+             (int)(sizeof(res->driver) / 2 - 1), vk->vulkan_12_props.driverName,
+             (int)(sizeof(res->driver) / 2 - 1), vk->vulkan_12_props.driverInfo);
 }
 
 static inline uint32_t
@@ -939,38 +1702,43 @@ vk_create_buffer_with_mt_mask(struct vk *vk,
         .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2,
         .buffer = buf->buf,
     };
+    VkMemoryDedicatedRequirements dedicated_reqs = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS,
+    };
     VkMemoryRequirements2 reqs2 = {
         .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+        .pNext = &dedicated_reqs,
     };
     vk->GetBufferMemoryRequirements2(vk->dev, &reqs_info, &reqs2);
     const VkMemoryRequirements *reqs = &reqs2.memoryRequirements;
 
+    /* prefer mappable memory unless mt_mask asks for other memory */
     mt_mask &= reqs->memoryTypeBits;
-    mt_mask &= vk->buf_mt_mask;
+    if (mt_mask & vk->buf_mt_mask)
+        mt_mask &= vk->buf_mt_mask;
     if (!mt_mask)
         vk_die("failed to meet buf memory reqs: 0x%x", reqs->memoryTypeBits);
 
+    const VkMemoryDedicatedAllocateInfo dedicated_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+        .buffer = buf->buf,
+    };
     const uint32_t mt_idx = (uint32_t)(ffs(mt_mask) - 1);
-    buf->mem = vk_alloc_memory(vk, reqs->size, mt_idx);
+    const bool dedicated = dedicated_reqs.prefersDedicatedAllocation;
+    buf->mem_block =
+        vk_alloc_resource_memory(vk, reqs, mt_idx, true, dedicated ? &dedicated_info : NULL,
+                                 &buf->mem, &buf->mem_offset, &buf->mem_ptr);
     buf->mem_size = reqs->size;
 
     const VkMemoryType *mt = &vk->mem_props.memoryTypes[mt_idx];
-    if (mt->propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
-        const VkMemoryMapInfo map_info = {
-            .sType = VK_STRUCTURE_TYPE_MEMORY_MAP_INFO,
-            .memory = buf->mem,
-            .size = buf->mem_size,
-        };
-        vk->result = vk->MapMemory2(vk->dev, &map_info, &buf->mem_ptr);
-        vk_check(vk, "failed to map buffer memory");
-
+    if (mt->propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
         buf->is_coherent = mt->propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    }
 
     const VkBindBufferMemoryInfo bind_info = {
         .sType = VK_STRUCTURE_TYPE_BIND_BUFFER_MEMORY_INFO,
         .buffer = buf->buf,
         .memory = buf->mem,
+        .memoryOffset = buf->mem_offset,
     };
     vk->result = vk->BindBufferMemory2(vk->dev, 1, &bind_info);
     vk_check(vk, "failed to bind buffer memory");
@@ -990,8 +1758,8 @@ vk_create_buffer(struct vk *vk,
 static inline void
 vk_destroy_buffer(struct vk *vk, struct vk_buffer *buf)
 {
-    vk->FreeMemory(vk->dev, buf->mem, NULL);
     vk->DestroyBuffer(vk->dev, buf->buf, NULL);
+    vk_free_resource_memory(vk, buf->mem_block, buf->mem, buf->mem_offset, buf->mem_size);
     free(buf);
 }
 
@@ -1095,8 +1863,12 @@ vk_init_image(struct vk *vk, struct vk_image *img, uint32_t mt_mask)
         .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2,
         .image = img->img,
     };
+    VkMemoryDedicatedRequirements dedicated_reqs = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS,
+    };
     VkMemoryRequirements2 reqs2 = {
         .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+        .pNext = &dedicated_reqs,
     };
     vk->GetImageMemoryRequirements2(vk->dev, &reqs_info, &reqs2);
     const VkMemoryRequirements *reqs = &reqs2.memoryRequirements;
@@ -1107,27 +1879,34 @@ vk_init_image(struct vk *vk, struct vk_image *img, uint32_t mt_mask)
     if (!mt_mask)
         vk_die("failed to meet img memory reqs: 0x%x", reqs->memoryTypeBits);
 
+    /* external images are never sub-allocated */
+    bool dedicated = dedicated_reqs.prefersDedicatedAllocation;
+    for (const VkBaseInStructure *s = (const VkBaseInStructure *)img->info.pNext; s;
+         s = s->pNext) {
+        if (s->sType == VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO)
+            dedicated = true;
+    }
+
+    const VkMemoryDedicatedAllocateInfo dedicated_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+        .image = img->img,
+    };
     const uint32_t mt_idx = (uint32_t)(ffs(mt_mask) - 1);
-    img->mem = vk_alloc_memory(vk, reqs->size, mt_idx);
+    const bool linear = img->info.tiling == VK_IMAGE_TILING_LINEAR;
+    img->mem_block =
+        vk_alloc_resource_memory(vk, reqs, mt_idx, linear, dedicated ? &dedicated_info : NULL,
+                                 &img->mem, &img->mem_offset, &img->mem_ptr);
     img->mem_size = reqs->size;
 
     const VkMemoryType *mt = &vk->mem_props.memoryTypes[mt_idx];
-    if (mt->propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
-        const VkMemoryMapInfo map_info = {
-            .sType = VK_STRUCTURE_TYPE_MEMORY_MAP_INFO,
-            .memory = img->mem,
-            .size = img->mem_size,
-        };
-        vk->result = vk->MapMemory2(vk->dev, &map_info, &img->mem_ptr);
-        vk_check(vk, "failed to map image memory");
-
+    if (mt->propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
         img->is_coherent = mt->propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    }
 
     const VkBindImageMemoryInfo bind_info = {
         .sType = VK_STRUCTURE_TYPE_BIND_IMAGE_MEMORY_INFO,
         .image = img->img,
         .memory = img->mem,
+        .memoryOffset = img->mem_offset,
     };
     vk->result = vk->BindImageMemory2(vk->dev, 1, &bind_info);
     vk_check(vk, "failed to bind image memory");
@@ -1428,8 +2207,8 @@ vk_destroy_image(struct vk *vk, struct vk_image *img)
 
     vk->DestroyImageView(vk->dev, img->render_view, NULL);
 
-    vk->FreeMemory(vk->dev, img->mem, NULL);
     vk->DestroyImage(vk->dev, img->img, NULL);
+    vk_free_resource_memory(vk, img->mem_block, img->mem, img->mem_offset, img->mem_size);
     free(img);
 }
 
@@ -1445,6 +2224,60 @@ vk_fill_image(struct vk *vk, struct vk_image *img, uint8_t val)
     memset(img->mem_ptr, val, img->mem_size);
 }
 
+struct vk_write_ppm_job {
+    const uint8_t *data;
+    VkFormat format;
+    uint32_t width;
+    VkDeviceSize pitch;
+
+    uint8_t swizzle[3];
+    uint32_t cpp;
+    bool packed;
+
+    uint8_t *pixels;
+    size_t ppm_pitch;
+};
+
+static inline void
+vk_write_ppm_rows(void *data, uint32_t begin, uint32_t end)
+{
+    const struct vk_write_ppm_job *job = (const struct vk_write_ppm_job *)data;
+    const uint8_t *swizzle = job->swizzle;
+
+    for (uint32_t y = begin; y < end; y++) {
+        const uint8_t *src = job->data + job->pitch * y;
+        uint8_t *dst = job->pixels + job->ppm_pitch * y;
+
+        for (uint32_t x = 0; x < job->width; x++) {
+            if (job->format == VK_FORMAT_R32G32B32A32_UINT) {
+                const uint32_t *pixel = (const uint32_t *)src;
+                /* discard the higher bytes */
+                dst[0] = (uint8_t)pixel[swizzle[0]];
+                dst[1] = (uint8_t)pixel[swizzle[1]];
+                dst[2] = (uint8_t)pixel[swizzle[2]];
+            } else if (job->packed) {
+                const uint16_t *pixel = (const uint16_t *)src;
+                uint16_t val = *pixel;
+                if (job->format == VK_FORMAT_R5G5B5A1_UNORM_PACK16)
+                    val >>= 1;
+
+                const uint8_t comps[3] = { (uint8_t)(val & 0x1f), (uint8_t)((val >> 5) & 0x1f),
+                                           (uint8_t)((val >> 10) & 0x1f) };
+                dst[0] = comps[swizzle[0]];
+                dst[1] = comps[swizzle[1]];
+                dst[2] = comps[swizzle[2]];
+            } else {
+                dst[0] = src[swizzle[0]];
+                dst[1] = src[swizzle[1]];
+                dst[2] = src[swizzle[2]];
+            }
+
+            src += job->cpp;
+            dst += 3;
+        }
+    }
+}
+
 static inline void
 vk_write_ppm(const char *filename,
              const void *data,
@@ -1453,47 +2286,51 @@ vk_write_ppm(const char *filename,
              uint32_t height,
              VkDeviceSize pitch)
 {
-    uint8_t swizzle[3];
-    uint32_t cpp;
+    struct vk_write_ppm_job job = {
+        .data = (const uint8_t *)data,
+        .format = format,
+        .width = width,
+        .pitch = pitch,
+    };
+    uint8_t *swizzle = job.swizzle;
     uint16_t max_val;
-    bool packed;
     switch (format) {
     case VK_FORMAT_R8G8B8A8_UNORM:
-        cpp = 4;
+        job.cpp = 4;
         max_val = 255;
-        packed = false;
+        job.packed = false;
         swizzle[0] = 0;
         swizzle[1] = 1;
         swizzle[2] = 2;
         break;
     case VK_FORMAT_B8G8R8A8_UNORM:
-        cpp = 4;
+        job.cpp = 4;
         max_val = 255;
-        packed = false;
+        job.packed = false;
         swizzle[0] = 2;
         swizzle[1] = 1;
         swizzle[2] = 0;
         break;
     case VK_FORMAT_R5G5B5A1_UNORM_PACK16:
-        cpp = 2;
+        job.cpp = 2;
         max_val = 31;
-        packed = true;
+        job.packed = true;
         swizzle[0] = 2;
         swizzle[1] = 1;
         swizzle[2] = 0;
         break;
     case VK_FORMAT_A1R5G5B5_UNORM_PACK16:
-        cpp = 2;
+        job.cpp = 2;
         max_val = 31;
-        packed = true;
+        job.packed = true;
         swizzle[0] = 2;
         swizzle[1] = 1;
         swizzle[2] = 0;
         break;
     case VK_FORMAT_R32G32B32A32_UINT:
-        cpp = 16;
+        job.cpp = 16;
         max_val = 255;
-        packed = false;
+        job.packed = false;
         swizzle[0] = 0;
         swizzle[1] = 1;
         swizzle[2] = 2;
@@ -1503,43 +2340,15 @@ vk_write_ppm(const char *filename,
         break;
     }
 
-    FILE *fp = fopen(filename, "w");
-    if (!fp)
-        vk_die("failed to open %s", filename);
+    /* convert whole rows straight into the mapped file */
+    struct u_ppm_file ppm;
+    job.pixels = u_ppm_file_create(&ppm, filename, width, height, max_val);
+    job.ppm_pitch = ppm.pitch;
 
-    fprintf(fp, "P6 %u %u %u\n", width, height, max_val);
-    for (uint32_t y = 0; y < height; y++) {
-        for (uint32_t x = 0; x < width; x++) {
-            if (format == VK_FORMAT_R32G32B32A32_UINT) {
-                const uint32_t *pixel =
-                    (const uint32_t *)((const uint8_t *)data + pitch * y + cpp * x);
-                /* discard the higher bytes */
-                const char bytes[3] = { (char)pixel[swizzle[0]], (char)pixel[swizzle[1]],
-                                        (char)pixel[swizzle[2]] };
-                if (fwrite(bytes, sizeof(bytes), 1, fp) != 1)
-                    vk_die("failed to write pixel (%u, %u)", x, y);
-            } else if (packed) {
-                const uint16_t *pixel =
-                    (const uint16_t *)((const uint8_t *)data + pitch * y + cpp * x);
-                uint16_t val = *pixel;
-                if (format == VK_FORMAT_R5G5B5A1_UNORM_PACK16)
-                    val >>= 1;
+    u_parallel_for(height, 1, u_parallel_get_image_thread_count(width, height),
+                   vk_write_ppm_rows, &job);
 
-                const char comps[3] = { (char)(val & 0x1f), (char)((val >> 5) & 0x1f),
-                                        (char)((val >> 10) & 0x1f) };
-                const char bytes[3] = { comps[swizzle[0]], comps[swizzle[1]], comps[swizzle[2]] };
-                if (fwrite(bytes, sizeof(bytes), 1, fp) != 1)
-                    vk_die("failed to write pixel (%u, %u)", x, y);
-            } else {
-                const char *pixel = (const char *)((const uint8_t *)data + pitch * y + cpp * x);
-                const char bytes[3] = { pixel[swizzle[0]], pixel[swizzle[1]], pixel[swizzle[2]] };
-                if (fwrite(bytes, sizeof(bytes), 1, fp) != 1)
-                    vk_die("failed to write pixel (%u, %u)", x, y);
-            }
-        }
-    }
-
-    fclose(fp);
+    u_ppm_file_close(&ppm);
 }
 
 static inline void
@@ -1568,9 +2377,16 @@ vk_dump_image(struct vk *vk,
     };
     vk->GetImageSubresourceLayout2(vk->dev, img->img, &subres2, &layout2);
 
+    const uint32_t width = img->info.extent.width * img->info.samples;
+    const uint32_t height = img->info.extent.height;
+
+    const uint64_t begin = u_now();
     vk_write_ppm(filename, (const uint8_t *)img->mem_ptr + layout2.subresourceLayout.offset,
-                 img->info.format, img->info.extent.width * img->info.samples,
-                 img->info.extent.height, layout2.subresourceLayout.rowPitch);
+                 img->info.format, width, height, layout2.subresourceLayout.rowPitch);
+    const uint64_t dur = u_now() - begin;
+
+    vk_log("dumped %ux%u to %s in %.1f ms (%.1f MPix/s)", width, height, filename,
+           (double)dur / 1000000.0, (double)width * height * 1000.0 / (double)dur);
 }
 
 static inline void
@@ -1650,6 +2466,49 @@ vk_add_pipeline_shader(struct vk *vk,
     };
 }
 
+/* sets a specialization constant of a stage added by vk_add_pipeline_shader */
+static inline void
+vk_set_pipeline_spec_constant(struct vk *vk,
+                              struct vk_pipeline *pipeline,
+                              VkShaderStageFlagBits stage,
+                              uint32_t id,
+                              uint32_t val)
+{
+    uint32_t idx;
+    for (idx = 0; idx < pipeline->stage_count; idx++) {
+        if (pipeline->stages[idx].stage == stage)
+            break;
+    }
+    if (idx == pipeline->stage_count)
+        vk_die("no shader for stage 0x%x", stage);
+
+    VkSpecializationInfo *spec_info = &pipeline->spec_infos[idx];
+    VkSpecializationMapEntry *entries = pipeline->spec_entries[idx];
+
+    uint32_t entry_idx;
+    for (entry_idx = 0; entry_idx < spec_info->mapEntryCount; entry_idx++) {
+        if (entries[entry_idx].constantID == id)
+            break;
+    }
+    if (entry_idx == spec_info->mapEntryCount) {
+        if (entry_idx == VK_PIPELINE_MAX_SPEC_CONSTS)
+            vk_die("too many specialization constants");
+
+        entries[entry_idx] = (VkSpecializationMapEntry){
+            .constantID = id,
+            .offset = (uint32_t)(sizeof(uint32_t) * entry_idx),
+            .size = sizeof(uint32_t),
+        };
+        spec_info->mapEntryCount++;
+        spec_info->pMapEntries = entries;
+        spec_info->dataSize = sizeof(uint32_t) * spec_info->mapEntryCount;
+        spec_info->pData = pipeline->spec_data[idx];
+    }
+
+    pipeline->spec_data[idx][entry_idx] = val;
+    pipeline->stages[idx].pSpecializationInfo = spec_info;
+}
+
 static inline void
 vk_add_pipeline_set_layout_from_info(struct vk *vk,
                                      struct vk_pipeline *pipeline,
@@ -1752,6 +2611,22 @@ vk_set_pipeline_viewport(struct vk *vk,
     };
 }
 
+static inline void
+vk_update_pipeline_cache_stats(struct vk *vk,
+                               const VkPipelineCreationFeedback *feedback,
+                               uint64_t dur)
+{
+    /* drivers are not required to fill in the feedback */
+    if (feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT) {
+        if (feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT)
+            vk->pipeline_cache.hit_count++;
+        else
+            vk->pipeline_cache.miss_count++;
+    }
+
+    vk->pipeline_cache.compile_ns += dur;
+}
+
 static inline void
 vk_compile_pipeline(struct vk *vk, struct vk_pipeline *pipeline)
 {
@@ -1771,16 +2646,25 @@ vk_compile_pipeline(struct vk *vk, struct vk_pipeline *pipeline)
         .flags = pipeline->flags2,
     };
 
+    VkPipelineCreationFeedback feedback = { 0 };
+    const VkPipelineCreationFeedbackCreateInfo feedback_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO,
+        .pNext = &flags2_info,
+        .pPipelineCreationFeedback = &feedback,
+    };
+
     if (pipeline->stage_count == 1 && pipeline->stages[0].stage == VK_SHADER_STAGE_COMPUTE_BIT) {
         const VkComputePipelineCreateInfo compute_info = {
             .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-            .pNext = &flags2_info,
+            .pNext = &feedback_info,
             .stage = pipeline->stages[0],
             .layout = pipeline->layout,
         };
-        vk->result = vk->CreateComputePipelines(vk->dev, VK_NULL_HANDLE, 1, &compute_info, NULL,
-                                                &pipeline->pipeline);
+        const uint64_t begin = u_now();
+        vk->result = vk->CreateComputePipelines(vk->dev, vk->pipeline_cache.cache, 1,
+                                                &compute_info, NULL, &pipeline->pipeline);
         vk_check(vk, "failed to create compute pipeline");
+        vk_update_pipeline_cache_stats(vk, &feedback, u_now() - begin);
         return;
     }
 
@@ -1859,12 +2743,13 @@ vk_compile_pipeline(struct vk *vk, struct vk_pipeline *pipeline)
 
     const VkExternalFormatANDROID ext_fmt = {
         .sType = VK_STRUCTURE_TYPE_EXTERNAL_FORMAT_ANDROID,
-        .pNext = (void *)&flags2_info,
+        .pNext = (void *)&feedback_info,
         .externalFormat = pipeline->external_format,
     };
     const VkPipelineRenderingCreateInfo rendering_info = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
-        .pNext = pipeline->external_format ? (const void *)&ext_fmt : (const void *)&flags2_info,
+        .pNext =
+            pipeline->external_format ? (const void *)&ext_fmt : (const void *)&feedback_info,
         .colorAttachmentCount = pipeline->color_count,
         .pColorAttachmentFormats = pipeline->color_formats,
         .depthAttachmentFormat = pipeline->depth_format,
@@ -1887,9 +2772,11 @@ vk_compile_pipeline(struct vk *vk, struct vk_pipeline *pipeline)
         .layout = pipeline->layout,
     };
 
-    vk->result = vk->CreateGraphicsPipelines(vk->dev, VK_NULL_HANDLE, 1, &pipeline_info, NULL,
-                                             &pipeline->pipeline);
+    const uint64_t begin = u_now();
+    vk->result = vk->CreateGraphicsPipelines(vk->dev, vk->pipeline_cache.cache, 1, &pipeline_info,
+                                             NULL, &pipeline->pipeline);
     vk_check(vk, "failed to create graphics pipeline");
+    vk_update_pipeline_cache_stats(vk, &feedback, u_now() - begin);
 }
 
 static inline void
@@ -1944,15 +2831,7 @@ vk_create_descriptor_set(struct vk *vk, VkDescriptorSetLayout layout)
     if (!set)
         vk_die("failed to alloc set");
 
-    const VkDescriptorSetAllocateInfo set_info = {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-        .descriptorPool = vk->desc_pool,
-        .descriptorSetCount = 1,
-        .pSetLayouts = &layout,
-    };
-
-    vk->result = vk->AllocateDescriptorSets(vk->dev, &set_info, &set->set);
-    vk_check(vk, "failed to allocate descriptor set");
+    set->set = vk_alloc_descriptor_set(vk, &vk->desc_alloc, layout);
 
     return set;
 }
@@ -2234,98 +3113,495 @@ vk_read_stopwatch(struct vk *vk, struct vk_stopwatch *stopwatch, uint32_t idx)
     return cycles * (uint64_t)vk->props.properties.limits.timestampPeriod;
 }
 
+static inline struct vk_queue *
+vk_find_queue(struct vk *vk, VkQueueFlags required, VkQueueFlags excluded)
+{
+    for (uint32_t i = 0; i < vk->queue_count; i++) {
+        struct vk_queue *queue = &vk->queues[i];
+        if ((queue->flags & required) == required && !(queue->flags & excluded))
+            return queue;
+    }
+    return NULL;
+}
+
+/* submits all command buffers ended by vk_queue_end_cmd_batched in one QueueSubmit2 */
+static inline void
+vk_queue_submit_batch(struct vk *vk, struct vk_queue *queue)
+{
+    if (!queue->submit.batch_count)
+        return;
+
+    const VkSemaphoreSubmitInfo signal_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+        .semaphore = queue->submit.sem,
+        .value = queue->submit.batch_sem_val,
+        .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+    };
+    const VkSubmitInfo2 submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+        .flags = queue->submit.batch_protected ? (VkSubmitFlags)VK_SUBMIT_PROTECTED_BIT : 0,
+        .commandBufferInfoCount = queue->submit.batch_count,
+        .pCommandBufferInfos = queue->submit.batch,
+        .signalSemaphoreInfoCount = 1,
+        .pSignalSemaphoreInfos = &signal_info,
+    };
+    vk->result = vk->QueueSubmit2(queue->queue, 1, &submit_info, VK_NULL_HANDLE);
+    vk_check(vk, "failed to submit command buffer");
+
+    queue->submit.sem_submitted = queue->submit.batch_sem_val;
+    queue->submit.batch_count = 0;
+}
+
 static inline VkCommandBuffer
-vk_begin_cmd(struct vk *vk, bool prot)
+vk_queue_begin_cmd(struct vk *vk, struct vk_queue *queue, bool prot)
 {
-    VkCommandBuffer *cmd = &vk->submit.cmds[vk->submit.next];
-    const uint64_t *sem_val = &vk->submit.sem_vals[vk->submit.next];
-    bool *protected_submit = &vk->submit.protected_submits[vk->submit.next];
+    struct vk_submit_cmd *slot = &queue->submit.cmds[queue->submit.next];
+
+    if (prot && !queue->protected_cmd_pool)
+        vk_die("queue does not support protected submits");
+
+    /* the ring has wrapped around to a pending command buffer */
+    if (slot->sem_val > queue->submit.sem_submitted)
+        vk_queue_submit_batch(vk, queue);
 
     const VkSemaphoreWaitInfo wait_info = {
         .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
         .semaphoreCount = 1,
-        .pSemaphores = &vk->submit.sem,
-        .pValues = sem_val,
+        .pSemaphores = &queue->submit.sem,
+        .pValues = &slot->sem_val,
     };
     vk->result = vk->WaitSemaphores(vk->dev, &wait_info, UINT64_MAX);
     vk_check(vk, "failed to wait submit semaphore");
 
     /* reuse or allocate */
-    if (*cmd && *protected_submit == prot) {
-        vk->result = vk->ResetCommandBuffer(*cmd, 0);
+    if (slot->cmd && slot->protected_submit == prot) {
+        vk->result = vk->ResetCommandBuffer(slot->cmd, 0);
         vk_check(vk, "failed to reset command buffer");
     } else {
-        if (*cmd) {
+        if (slot->cmd) {
             vk->FreeCommandBuffers(
-                vk->dev, *protected_submit ? vk->protected_cmd_pool : vk->cmd_pool, 1, cmd);
+                vk->dev, slot->protected_submit ? queue->protected_cmd_pool : queue->cmd_pool, 1,
+                &slot->cmd);
         }
 
         const VkCommandBufferAllocateInfo alloc_info = {
             .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-            .commandPool = prot ? vk->protected_cmd_pool : vk->cmd_pool,
+            .commandPool = prot ? queue->protected_cmd_pool : queue->cmd_pool,
             .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
             .commandBufferCount = 1,
         };
 
-        vk->result = vk->AllocateCommandBuffers(vk->dev, &alloc_info, cmd);
+        vk->result = vk->AllocateCommandBuffers(vk->dev, &alloc_info, &slot->cmd);
         vk_check(vk, "failed to allocate command buffer");
 
-        *protected_submit = prot;
+        slot->protected_submit = prot;
     }
 
     const VkCommandBufferBeginInfo begin_info = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
     };
-    vk->result = vk->BeginCommandBuffer(*cmd, &begin_info);
+    vk->result = vk->BeginCommandBuffer(slot->cmd, &begin_info);
     vk_check(vk, "failed to begin command buffer");
 
-    return *cmd;
+    return slot->cmd;
 }
 
-static inline void
-vk_end_cmd(struct vk *vk)
+/* Ends the command buffer and adds it to the batch for the next vk_queue_submit_batch.  Returns
+ * the timeline value that queue->submit.sem reaches when the command buffer completes.
+ */
+static inline uint64_t
+vk_queue_end_cmd_batched(struct vk *vk, struct vk_queue *queue)
 {
-    VkCommandBuffer cmd = vk->submit.cmds[vk->submit.next];
-    uint64_t *sem_val = &vk->submit.sem_vals[vk->submit.next];
-    bool protected_submit = vk->submit.protected_submits[vk->submit.next];
+    struct vk_submit_cmd *slot = &queue->submit.cmds[queue->submit.next];
 
-    *sem_val = vk->submit.sem_next++;
+    slot->sem_val = queue->submit.sem_next++;
 
     /* increment */
-    vk->submit.next = (vk->submit.next + 1) % vk->submit.count;
+    queue->submit.next = (queue->submit.next + 1) % queue->submit.count;
 
-    vk->result = vk->EndCommandBuffer(cmd);
+    vk->result = vk->EndCommandBuffer(slot->cmd);
     vk_check(vk, "failed to end command buffer");
 
-    const VkCommandBufferSubmitInfo cmd_info = {
+    /* a submit is either protected or not */
+    if (queue->submit.batch_count && queue->submit.batch_protected != slot->protected_submit)
+        vk_queue_submit_batch(vk, queue);
+
+    queue->submit.batch[queue->submit.batch_count++] = (VkCommandBufferSubmitInfo){
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
-        .commandBuffer = cmd,
+        .commandBuffer = slot->cmd,
     };
-    const VkSemaphoreSubmitInfo signal_info = {
-        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
-        .semaphore = vk->submit.sem,
-        .value = *sem_val,
-        .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-    };
-    const VkSubmitInfo2 submit_info = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
-        .flags = protected_submit ? (VkSubmitFlags)VK_SUBMIT_PROTECTED_BIT : 0,
-        .commandBufferInfoCount = 1,
-        .pCommandBufferInfos = &cmd_info,
-        .signalSemaphoreInfoCount = 1,
-        .pSignalSemaphoreInfos = &signal_info,
+    queue->submit.batch_sem_val = slot->sem_val;
+    queue->submit.batch_protected = slot->protected_submit;
+
+    return slot->sem_val;
+}
+
+static inline uint64_t
+vk_queue_end_cmd(struct vk *vk, struct vk_queue *queue)
+{
+    const uint64_t sem_val = vk_queue_end_cmd_batched(vk, queue);
+    vk_queue_submit_batch(vk, queue);
+    return sem_val;
+}
+
+/* waits for a value returned by vk_queue_end_cmd or vk_queue_end_cmd_batched */
+static inline void
+vk_queue_wait_value(struct vk *vk, struct vk_queue *queue, uint64_t sem_val)
+{
+    if (sem_val > queue->submit.sem_submitted)
+        vk_queue_submit_batch(vk, queue);
+
+    const VkSemaphoreWaitInfo wait_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores = &queue->submit.sem,
+        .pValues = &sem_val,
     };
-    vk->result = vk->QueueSubmit2(vk->queue, 1, &submit_info, VK_NULL_HANDLE);
-    vk_check(vk, "failed to submit command buffer");
+    vk->result = vk->WaitSemaphores(vk->dev, &wait_info, UINT64_MAX);
+    vk_check(vk, "failed to wait submit semaphore");
 }
 
 static inline void
-vk_wait(struct vk *vk)
+vk_queue_wait(struct vk *vk, struct vk_queue *queue)
 {
-    vk->result = vk->QueueWaitIdle(vk->queue);
+    vk_queue_submit_batch(vk, queue);
+
+    vk->result = vk->QueueWaitIdle(queue->queue);
     vk_check(vk, "failed to wait queue");
 }
 
+static inline VkCommandBuffer
+vk_begin_cmd(struct vk *vk, bool prot)
+{
+    return vk_queue_begin_cmd(vk, &vk->queues[0], prot);
+}
+
+static inline uint64_t
+vk_end_cmd(struct vk *vk)
+{
+    return vk_queue_end_cmd(vk, &vk->queues[0]);
+}
+
+static inline uint64_t
+vk_end_cmd_batched(struct vk *vk)
+{
+    return vk_queue_end_cmd_batched(vk, &vk->queues[0]);
+}
+
+static inline void
+vk_submit_batch(struct vk *vk)
+{
+    vk_queue_submit_batch(vk, &vk->queues[0]);
+}
+
+static inline void
+vk_wait_value(struct vk *vk, uint64_t sem_val)
+{
+    vk_queue_wait_value(vk, &vk->queues[0], sem_val);
+}
+
+static inline void
+vk_wait(struct vk *vk)
+{
+    vk_queue_wait(vk, &vk->queues[0]);
+}
+
+/* chunk_size defaults to a quarter of the ring such that the gpu copies a chunk while the cpu
+ * fills the next ones
+ */
+static inline void
+vk_init_staging_ring(struct vk *vk,
+                     struct vk_staging_ring *ring,
+                     struct vk_queue *queue,
+                     VkDeviceSize size,
+                     VkDeviceSize chunk_size)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->queue = queue;
+    ring->size = size;
+    ring->chunk_size = chunk_size ? chunk_size : size / 4;
+    if (!ring->chunk_size || ring->chunk_size > size)
+        vk_die("bad staging chunk size");
+
+    ring->buf = vk_create_buffer(vk, 0, size, VK_BUFFER_USAGE_2_TRANSFER_SRC_BIT);
+    if (!ring->buf->mem_ptr)
+        vk_die("staging ring is not mappable");
+}
+
+static inline void
+vk_cleanup_staging_ring(struct vk *vk, struct vk_staging_ring *ring)
+{
+    if (ring->untagged != ring->head)
+        vk_die("staging ring has untagged allocations");
+
+    if (ring->region_count) {
+        const uint32_t last =
+            (ring->region_first + ring->region_count - 1) % VK_STAGING_RING_MAX_REGIONS;
+        vk_queue_wait_value(vk, ring->queue, ring->regions[last].sem_val);
+    }
+
+    vk_destroy_buffer(vk, ring->buf);
+    memset(ring, 0, sizeof(*ring));
+}
+
+/* reclaims completed regions, after waiting for the oldest one if wait is set */
+static inline void
+vk_staging_ring_reclaim(struct vk *vk, struct vk_staging_ring *ring, bool wait)
+{
+    if (!ring->region_count)
+        return;
+
+    if (wait) {
+        vk_queue_wait_value(vk, ring->queue, ring->regions[ring->region_first].sem_val);
+        ring->stall_count++;
+    }
+
+    uint64_t completed;
+    vk->result = vk->GetSemaphoreCounterValue(vk->dev, ring->queue->submit.sem, &completed);
+    vk_check(vk, "failed to get submit semaphore value");
+
+    while (ring->region_count) {
+        const struct vk_staging_region *region = &ring->regions[ring->region_first];
+        if (region->sem_val > completed)
+            break;
+
+        ring->tail = region->end;
+        ring->region_first = (ring->region_first + 1) % VK_STAGING_RING_MAX_REGIONS;
+        ring->region_count--;
+    }
+}
+
+/* Returns a mapped pointer to size bytes at *offset of ring->buf, waiting for earlier copies
+ * when the ring is full.  The allocation must be tagged by vk_staging_ring_tag.
+ */
+static inline void *
+vk_staging_ring_alloc(struct vk *vk,
+                      struct vk_staging_ring *ring,
+                      VkDeviceSize size,
+                      VkDeviceSize align,
+                      VkDeviceSize *offset)
+{
+    if (size > ring->size)
+        vk_die("staging allocation of %zu bytes is larger than the ring", (size_t)size);
+
+    /* allocations never straddle the end of the buffer */
+    const VkDeviceSize head_offset = ring->head % ring->size;
+    VkDeviceSize alloc_offset = DIV_ROUND_UP(head_offset, align) * align;
+    if (alloc_offset + size > ring->size)
+        alloc_offset = 0;
+    const VkDeviceSize begin = ring->head - head_offset + alloc_offset +
+                               (alloc_offset < head_offset ? ring->size : 0);
+    const VkDeviceSize end = begin + size;
+
+    if (end - ring->tail > ring->size) {
+        vk_staging_ring_reclaim(vk, ring, false);
+        while (end - ring->tail > ring->size) {
+            if (!ring->region_count)
+                vk_die("staging ring is full of untagged allocations");
+            vk_staging_ring_reclaim(vk, ring, true);
+        }
+    }
+
+    ring->head = end;
+    if (ring->peak_size < end - ring->tail)
+        ring->peak_size = end - ring->tail;
+
+    *offset = alloc_offset;
+    return (uint8_t *)ring->buf->mem_ptr + alloc_offset;
+}
+
+/* marks untagged allocations reusable once the queue timeline reaches sem_val */
+static inline void
+vk_staging_ring_tag(struct vk *vk, struct vk_staging_ring *ring, uint64_t sem_val)
+{
+    if (ring->untagged == ring->head)
+        return;
+
+    struct vk_staging_region *region = NULL;
+    if (ring->region_count) {
+        const uint32_t last =
+            (ring->region_first + ring->region_count - 1) % VK_STAGING_RING_MAX_REGIONS;
+        if (ring->regions[last].sem_val == sem_val)
+            region = &ring->regions[last];
+    }
+
+    if (!region) {
+        if (ring->region_count == VK_STAGING_RING_MAX_REGIONS)
+            vk_staging_ring_reclaim(vk, ring, true);
+
+        const uint32_t idx =
+            (ring->region_first + ring->region_count++) % VK_STAGING_RING_MAX_REGIONS;
+        region = &ring->regions[idx];
+        region->sem_val = sem_val;
+    }
+
+    region->end = ring->head;
+    ring->untagged = ring->head;
+}
+
+/* Uploads size bytes of data to buf at offset, with one command buffer per chunk.  Returns the
+ * timeline value of the last copy.
+ */
+static inline uint64_t
+vk_staging_ring_upload_buffer(struct vk *vk,
+                              struct vk_staging_ring *ring,
+                              struct vk_buffer *buf,
+                              VkDeviceSize offset,
+                              const void *data,
+                              VkDeviceSize size)
+{
+    const VkDeviceSize align = vk->props.properties.limits.optimalBufferCopyOffsetAlignment;
+
+    uint64_t sem_val = 0;
+    for (VkDeviceSize done = 0; done < size;) {
+        const VkDeviceSize chunk =
+            size - done < ring->chunk_size ? size - done : ring->chunk_size;
+
+        VkDeviceSize src_offset;
+        void *ptr = vk_staging_ring_alloc(vk, ring, chunk, align, &src_offset);
+        memcpy(ptr, (const uint8_t *)data + done, chunk);
+
+        VkCommandBuffer cmd = vk_queue_begin_cmd(vk, ring->queue, false);
+        const VkBufferCopy2 copy = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_COPY_2,
+            .srcOffset = src_offset,
+            .dstOffset = offset + done,
+            .size = chunk,
+        };
+        const VkCopyBufferInfo2 copy_info = {
+            .sType = VK_STRUCTURE_TYPE_COPY_BUFFER_INFO_2,
+            .srcBuffer = ring->buf->buf,
+            .dstBuffer = buf->buf,
+            .regionCount = 1,
+            .pRegions = &copy,
+        };
+        vk->CmdCopyBuffer2(cmd, &copy_info);
+
+        /* submit now for the gpu to copy while the cpu fills the next chunk */
+        sem_val = vk_queue_end_cmd(vk, ring->queue);
+        vk_staging_ring_tag(vk, ring, sem_val);
+
+        done += chunk;
+    }
+
+    return sem_val;
+}
+
+/* Uploads tightly packed texels to the first level and layer of a 2D color image, in chunks of
+ * rows, and transitions the image from undefined to layout.  Returns the timeline value of the
+ * last copy.
+ */
+static inline uint64_t
+vk_staging_ring_upload_image(struct vk *vk,
+                             struct vk_staging_ring *ring,
+                             struct vk_image *img,
+                             const void *data,
+                             uint32_t texel_size,
+                             VkImageLayout layout)
+{
+    const uint32_t width = img->info.extent.width;
+    const uint32_t height = img->info.extent.height;
+    const VkDeviceSize row_size = (VkDeviceSize)width * texel_size;
+
+    /* texel and 4-byte aligned, preferably optimally aligned */
+    const VkDeviceSize optimal_align =
+        vk->props.properties.limits.optimalBufferCopyOffsetAlignment;
+    VkDeviceSize align = texel_size;
+    while (align % 4 || align % optimal_align)
+        align += texel_size;
+
+    uint32_t chunk_rows = (uint32_t)(ring->chunk_size / row_size);
+    if (!chunk_rows)
+        chunk_rows = 1;
+
+    const VkImageSubresourceRange subres_range = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .levelCount = 1,
+        .layerCount = 1,
+    };
+    const VkImageMemoryBarrier2 barrier1 = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_NONE,
+        .srcAccessMask = VK_ACCESS_2_NONE,
+        .dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+        .dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .image = img->img,
+        .subresourceRange = subres_range,
+    };
+    const VkImageMemoryBarrier2 barrier2 = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+        .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+        .dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .newLayout = layout,
+        .image = img->img,
+        .subresourceRange = subres_range,
+    };
+    const VkDependencyInfo dep_info1 = {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .imageMemoryBarrierCount = 1,
+        .pImageMemoryBarriers = &barrier1,
+    };
+    const VkDependencyInfo dep_info2 = {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .imageMemoryBarrierCount = 1,
+        .pImageMemoryBarriers = &barrier2,
+    };
+
+    uint64_t sem_val = 0;
+    for (uint32_t y = 0; y < height; y += chunk_rows) {
+        const uint32_t rows = height - y < chunk_rows ? height - y : chunk_rows;
+        const VkDeviceSize size = row_size * rows;
+
+        VkDeviceSize src_offset;
+        void *ptr = vk_staging_ring_alloc(vk, ring, size, align, &src_offset);
+        memcpy(ptr, (const uint8_t *)data + row_size * y, size);
+
+        VkCommandBuffer cmd = vk_queue_begin_cmd(vk, ring->queue, false);
+        /* barriers are ordered against the copies of other chunks by submission order */
+        if (!y)
+            vk->CmdPipelineBarrier2(cmd, &dep_info1);
+
+        const VkBufferImageCopy2 copy = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2,
+            .bufferOffset = src_offset,
+            .imageSubresource = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .layerCount = 1,
+            },
+            .imageOffset = {
+                .y = (int32_t)y,
+            },
+            .imageExtent = {
+                .width = width,
+                .height = rows,
+                .depth = 1,
+            },
+        };
+        const VkCopyBufferToImageInfo2 copy_info = {
+            .sType = VK_STRUCTURE_TYPE_COPY_BUFFER_TO_IMAGE_INFO_2,
+            .srcBuffer = ring->buf->buf,
+            .dstImage = img->img,
+            .dstImageLayout = barrier1.newLayout,
+            .regionCount = 1,
+            .pRegions = &copy,
+        };
+        vk->CmdCopyBufferToImage2(cmd, &copy_info);
+
+        if (y + rows == height)
+            vk->CmdPipelineBarrier2(cmd, &dep_info2);
+
+        sem_val = vk_queue_end_cmd(vk, ring->queue);
+        vk_staging_ring_tag(vk, ring, sem_val);
+    }
+
+    return sem_val;
+}
+
 static inline void
 vk_validate_swapchain(struct vk *vk, const struct vk_swapchain *swapchain)
 {
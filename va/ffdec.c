@@ -7,12 +7,44 @@
 #include "ffutil.h"
 #include "vautil.h"
 
+#define FFDEC_TEST_MAX_DEPTH 16
+
+/* an independent demuxer and decoder on a shared hwdev */
+struct ffdec_test_session {
+    struct ffdec_test *test;
+    struct ff ff;
+    thrd_t thread;
+    thrd_t sync_thread;
+
+    /* decoded frames waiting for the sync thread, which syncs them in order */
+    mtx_t mutex;
+    cnd_t cond;
+    AVFrame *frames[FFDEC_TEST_MAX_DEPTH];
+    uint64_t frame_begin_ns[FFDEC_TEST_MAX_DEPTH];
+    int decoded_count;
+    int synced_count;
+    bool decode_done;
+
+    int frame_count;
+    uint64_t sync_ns;
+    uint64_t end_ns;
+
+    /* one per frame */
+    uint64_t *latencies;
+    int latency_capacity;
+};
+
 struct ffdec_test {
     const char *filename;
+    int session_count;
+    int depth;
 
     struct drm drm;
     struct va va;
     struct ff ff;
+
+    struct ffdec_test_session *sessions;
+    struct u_result result;
 };
 
 static void
@@ -30,7 +62,8 @@ ffdec_test_init(struct ffdec_test *test)
     };
     va_init(va, &params);
 
-    ff_init(ff, va->display, test->filename);
+    if (!test->session_count)
+        ff_init(ff, va->display, test->filename);
 }
 
 static void
@@ -40,7 +73,8 @@ ffdec_test_cleanup(struct ffdec_test *test)
     struct va *va = &test->va;
     struct ff *ff = &test->ff;
 
-    ff_cleanup(ff);
+    if (!test->session_count)
+        ff_cleanup(ff);
     va_cleanup(va);
 
     drm_close(drm);
@@ -88,17 +122,243 @@ ffdec_test_decode(struct ffdec_test *test)
     va_log("decoded %d frames in %.3fs", frame_idx, decode_ms / 1000.0f);
 }
 
+static void
+ffdec_test_init_sessions(struct ffdec_test *test)
+{
+    struct va *va = &test->va;
+
+    test->sessions = calloc(test->session_count, sizeof(*test->sessions));
+    if (!test->sessions)
+        va_die("failed to alloc sessions");
+
+    /* the sessions share the hwdev of the first one */
+    for (int i = 0; i < test->session_count; i++) {
+        struct ffdec_test_session *session = &test->sessions[i];
+        struct ff *ff = &session->ff;
+
+        session->test = test;
+        ff->extra_hw_frames = test->depth;
+        if (i)
+            ff_init_with_hwdev(ff, test->sessions[0].ff.hwdev_ctx, test->filename);
+        else
+            ff_init(ff, va->display, test->filename);
+
+        for (int j = 0; j < test->depth; j++) {
+            session->frames[j] = av_frame_alloc();
+            if (!session->frames[j])
+                va_die("failed to alloc frame");
+        }
+
+        if (mtx_init(&session->mutex, mtx_plain) != thrd_success ||
+            cnd_init(&session->cond) != thrd_success)
+            va_die("failed to init session mutex");
+    }
+}
+
+static void
+ffdec_test_cleanup_sessions(struct ffdec_test *test)
+{
+    for (int i = 0; i < test->session_count; i++) {
+        struct ffdec_test_session *session = &test->sessions[i];
+
+        cnd_destroy(&session->cond);
+        mtx_destroy(&session->mutex);
+        for (int j = 0; j < test->depth; j++)
+            av_frame_free(&session->frames[j]);
+        ff_cleanup(&session->ff);
+        free(session->latencies);
+    }
+    free(test->sessions);
+}
+
+static void
+ffdec_test_add_session_latency(struct ffdec_test_session *session, uint64_t latency)
+{
+    if (session->frame_count == session->latency_capacity) {
+        const int capacity = session->latency_capacity ? session->latency_capacity * 2 : 256;
+        uint64_t *latencies =
+            (uint64_t *)realloc(session->latencies, sizeof(*latencies) * capacity);
+        if (!latencies)
+            va_die("failed to alloc latencies");
+        session->latencies = latencies;
+        session->latency_capacity = capacity;
+    }
+
+    session->latencies[session->frame_count++] = latency;
+}
+
+/* syncs decoded frames in order and timestamps their completion as it happens */
+static int
+ffdec_test_session_sync_thread(void *arg)
+{
+    struct ffdec_test_session *session = arg;
+    const int depth = session->test->depth;
+
+    mtx_lock(&session->mutex);
+    while (true) {
+        while (session->synced_count == session->decoded_count && !session->decode_done)
+            cnd_wait(&session->cond, &session->mutex);
+        if (session->synced_count == session->decoded_count)
+            break;
+
+        const int slot = session->synced_count % depth;
+        mtx_unlock(&session->mutex);
+
+        AVFrame *frame = session->frames[slot];
+        const uint64_t begin = u_now();
+        ff_sync_surface(&session->ff, ff_get_surface(frame));
+        const uint64_t end = u_now();
+
+        ffdec_test_add_session_latency(session, end - session->frame_begin_ns[slot]);
+        session->sync_ns += end - begin;
+        av_frame_unref(frame);
+
+        mtx_lock(&session->mutex);
+        session->synced_count++;
+        cnd_broadcast(&session->cond);
+    }
+    mtx_unlock(&session->mutex);
+
+    return 0;
+}
+
+/* keeps up to depth frames in flight and waits for a free slot before decoding more */
+static int
+ffdec_test_session_thread(void *arg)
+{
+    struct ffdec_test_session *session = arg;
+    const int depth = session->test->depth;
+    struct ff *ff = &session->ff;
+
+    if (thrd_create(&session->sync_thread, ffdec_test_session_sync_thread, session) !=
+        thrd_success)
+        va_die("failed to create sync thread");
+
+    uint64_t begin = u_now();
+    while (ff_decode_frame(ff)) {
+        mtx_lock(&session->mutex);
+        while (session->decoded_count - session->synced_count == depth)
+            cnd_wait(&session->cond, &session->mutex);
+        mtx_unlock(&session->mutex);
+
+        const int slot = session->decoded_count % depth;
+        av_frame_move_ref(session->frames[slot], ff->frame);
+        session->frame_begin_ns[slot] = begin;
+
+        mtx_lock(&session->mutex);
+        session->decoded_count++;
+        cnd_broadcast(&session->cond);
+        mtx_unlock(&session->mutex);
+
+        begin = u_now();
+    }
+
+    mtx_lock(&session->mutex);
+    session->decode_done = true;
+    cnd_broadcast(&session->cond);
+    mtx_unlock(&session->mutex);
+
+    thrd_join(session->sync_thread, NULL);
+    session->end_ns = u_now();
+
+    return 0;
+}
+
+static void
+ffdec_test_report_session(struct ffdec_test *test, int idx, uint64_t begin)
+{
+    struct ffdec_test_session *session = &test->sessions[idx];
+    const struct ff *ff = &session->ff;
+
+    if (!session->frame_count) {
+        va_log("session %d: no frames", idx);
+        return;
+    }
+
+    struct u_bench_stats stats;
+    u_bench_calc_stats(session->latencies, session->frame_count, &stats);
+
+    const double dur = (double)(session->end_ns - begin);
+    const double fps = session->frame_count * 1000000000.0 / dur;
+    const double busy = (double)(ff->demux_ns + ff->decode_ns + session->sync_ns);
+
+    char str[256];
+    va_log("session %d: %d frames, %.1f fps, demux %.1f%%, decode %.1f%%, sync %.1f%%", idx,
+           session->frame_count, fps, ff->demux_ns * 100.0 / busy, ff->decode_ns * 100.0 / busy,
+           session->sync_ns * 100.0 / busy);
+    va_log("  latency: %s", u_bench_stats_to_str(&stats, str, sizeof(str)));
+
+    struct u_result *res = &test->result;
+    u_result_clear_params(res);
+    u_result_set_param(res, "sessions", "%d", test->session_count);
+    u_result_set_param(res, "depth", "%d", test->depth);
+    u_result_set_param(res, "session", "%d", idx);
+    u_result_add(res, "fps", fps, "1/s");
+    u_result_add(res, "demux_time", ff->demux_ns / 1000000.0, "ms");
+    u_result_add(res, "decode_time", ff->decode_ns / 1000000.0, "ms");
+    u_result_add(res, "sync_time", session->sync_ns / 1000000.0, "ms");
+    u_result_add_bench_stats(res, "latency", &stats);
+}
+
+static void
+ffdec_test_bench(struct ffdec_test *test)
+{
+    ffdec_test_init_sessions(test);
+
+    const uint64_t begin = u_now();
+    for (int i = 0; i < test->session_count; i++) {
+        struct ffdec_test_session *session = &test->sessions[i];
+        if (thrd_create(&session->thread, ffdec_test_session_thread, session) != thrd_success)
+            va_die("failed to create session thread");
+    }
+
+    int frame_count = 0;
+    for (int i = 0; i < test->session_count; i++) {
+        struct ffdec_test_session *session = &test->sessions[i];
+        thrd_join(session->thread, NULL);
+        frame_count += session->frame_count;
+    }
+    const uint64_t dur = u_now() - begin;
+    const double fps = frame_count * 1000000000.0 / (double)dur;
+
+    va_log("%d sessions, depth %d: %d frames in %.3fs, %.1f fps", test->session_count,
+           test->depth, frame_count, dur / 1000000000.0, fps);
+
+    u_result_init(&test->result, "ffdec", NULL);
+    u_result_set_param(&test->result, "sessions", "%d", test->session_count);
+    u_result_set_param(&test->result, "depth", "%d", test->depth);
+    u_result_add(&test->result, "fps", fps, "1/s");
+
+    for (int i = 0; i < test->session_count; i++)
+        ffdec_test_report_session(test, i, begin);
+
+    u_result_cleanup(&test->result);
+    ffdec_test_cleanup_sessions(test);
+}
+
 int
 main(int argc, char **argv)
 {
-    struct ffdec_test test = {};
+    struct ffdec_test test = {
+        .depth = 4,
+    };
 
-    if (argc != 2)
-        va_die("usage: %s <file>", argv[0]);
+    if (argc < 2 || argc > 4)
+        va_die("usage: %s <file> [<session-count> [<depth>]]", argv[0]);
     test.filename = argv[1];
+    if (argc > 2)
+        test.session_count = atoi(argv[2]);
+    if (argc > 3)
+        test.depth = atoi(argv[3]);
+    if ((argc > 2 && test.session_count < 1) || test.depth < 1 ||
+        test.depth > FFDEC_TEST_MAX_DEPTH)
+        va_die("bad session count or depth");
 
     ffdec_test_init(&test);
-    ffdec_test_decode(&test);
+    if (test.session_count)
+        ffdec_test_bench(&test);
+    else
+        ffdec_test_decode(&test);
     ffdec_test_cleanup(&test);
 
     return 0;
@@ -6,6 +6,12 @@
 #include "drmutil.h"
 #include "vautil.h"
 
+#include <dirent.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#define JPEGDEC_TEST_MAX_RESTARTS 1024
+
 struct jpegdec_test_file {
     const void *ptr;
     size_t size;
@@ -56,17 +62,78 @@ struct jpegdec_test_file {
         int Ri;
     } dri;
 
+    /* RSTn markers in the scan, with the offsets of the first JPEGDEC_TEST_MAX_RESTARTS */
+    struct {
+        int count;
+        int offsets[JPEGDEC_TEST_MAX_RESTARTS];
+    } rst;
+
     const void *eoi;
 };
 
+struct jpegdec_test_params {
+    unsigned int rt_format;
+    unsigned int pix_format;
+
+    VAPictureParameterBufferJPEGBaseline pic_param;
+    VAIQMatrixBufferJPEGBaseline iq_matrix;
+    VAHuffmanTableBufferJPEGBaseline huffman_table;
+    VASliceParameterBufferJPEGBaseline slice_param;
+};
+
+#define JPEGDEC_TEST_BATCH_DEPTH 8
+#define JPEGDEC_TEST_SURFACE_COUNT 4
+
+/* a mapped and parsed file waiting to be submitted */
+struct jpegdec_test_job {
+    struct jpegdec_test_file file;
+    struct jpegdec_test_params params;
+};
+
+struct jpegdec_test_batch {
+    char **filenames;
+    int file_count;
+
+    /* the parse thread runs up to JPEGDEC_TEST_BATCH_DEPTH jobs ahead of submission, and the
+     * sync thread waits for submitted jobs in order
+     */
+    mtx_t mutex;
+    cnd_t cond;
+    struct jpegdec_test_job jobs[JPEGDEC_TEST_BATCH_DEPTH];
+    int parsed_count;
+    int submitted_count;
+    int synced_count;
+
+    /* reused until the format or the size changes */
+    unsigned int rt_format;
+    unsigned int pix_format;
+    int width;
+    int height;
+    VAConfigID config;
+    VAContextID context;
+    VASurfaceID surfaces[JPEGDEC_TEST_SURFACE_COUNT];
+    uint64_t submit_ns[JPEGDEC_TEST_SURFACE_COUNT];
+    int reconfig_count;
+
+    /* indexed by image */
+    uint64_t *parse_samples;
+    uint64_t *submit_samples;
+    uint64_t *decode_samples;
+};
+
 struct jpegdec_test {
     VAProfile profile;
     VAEntrypoint entrypoint;
+    bool batch;
+    bool parse_only;
+    enum u_simd_level simd_level;
 
     struct drm drm;
     struct va va;
+    struct u_result result;
 
     struct jpegdec_test_file file;
+    struct jpegdec_test_batch batch_state;
 
     VASurfaceID surface;
     VAConfigID config;
@@ -121,7 +188,7 @@ jpegdec_test_dump(struct jpegdec_test *test, const char *filename)
 }
 
 static void
-jpegdec_test_decode(struct jpegdec_test *test)
+jpegdec_test_submit(struct jpegdec_test *test, VAContextID context, VASurfaceID surface)
 {
     struct va *va = &test->va;
 
@@ -129,19 +196,23 @@ jpegdec_test_decode(struct jpegdec_test *test)
         test->pic_param,   test->iq_matrix,  test->huffman_table,
         test->slice_param, test->slice_data,
     };
-    va_begin_picture(va, test->context, test->surface);
-    va_render_picture(va, test->context, bufs, ARRAY_SIZE(bufs));
-    va_end_picture(va, test->context);
-
-    va_sync_surface(va, test->surface);
+    va_begin_picture(va, context, surface);
+    va_render_picture(va, context, bufs, ARRAY_SIZE(bufs));
+    va_end_picture(va, context);
 }
 
 static void
-jpegdec_test_prepare(struct jpegdec_test *test)
+jpegdec_test_decode(struct jpegdec_test *test)
 {
-    const struct jpegdec_test_file *file = &test->file;
     struct va *va = &test->va;
 
+    jpegdec_test_submit(test, test->context, test->surface);
+    va_sync_surface(va, test->surface);
+}
+
+static void
+jpegdec_test_init_params(const struct jpegdec_test_file *file, struct jpegdec_test_params *params)
+{
     unsigned int rt_format = VA_RT_FORMAT_YUV420;
     unsigned int pix_format = VA_FOURCC_NV12;
 
@@ -236,28 +307,68 @@ jpegdec_test_prepare(struct jpegdec_test *test)
     const int mcu_rows = (file->sof0.Y + max_v * 8 - 1) / (max_v * 8);
     slice_param.num_mcus = mcu_cols * mcu_rows;
 
-    test->config = va_create_config(va, test->profile, test->entrypoint, rt_format);
-    test->surface = va_create_surface(va, rt_format, file->sof0.X, file->sof0.Y, pix_format);
-    test->context = va_create_context(va, test->config, file->sof0.X, file->sof0.Y,
-                                      VA_PROGRESSIVE, test->surface);
+    params->rt_format = rt_format;
+    params->pix_format = pix_format;
+    params->pic_param = pic_param;
+    params->iq_matrix = iq_matrix;
+    params->huffman_table = huffman_table;
+    params->slice_param = slice_param;
+}
 
-    test->pic_param = va_create_buffer(va, test->context, VAPictureParameterBufferType,
-                                       sizeof(pic_param), &pic_param);
-    test->iq_matrix =
-        va_create_buffer(va, test->context, VAIQMatrixBufferType, sizeof(iq_matrix), &iq_matrix);
-    test->huffman_table = va_create_buffer(va, test->context, VAHuffmanTableBufferType,
-                                           sizeof(huffman_table), &huffman_table);
-    test->slice_param = va_create_buffer(va, test->context, VASliceParameterBufferType,
-                                         sizeof(slice_param), &slice_param);
+static void
+jpegdec_test_create_buffers(struct jpegdec_test *test,
+                            VAContextID context,
+                            const struct jpegdec_test_file *file,
+                            const struct jpegdec_test_params *params)
+{
+    struct va *va = &test->va;
+
+    test->pic_param = va_create_buffer(va, context, VAPictureParameterBufferType,
+                                       sizeof(params->pic_param), &params->pic_param);
+    test->iq_matrix = va_create_buffer(va, context, VAIQMatrixBufferType,
+                                       sizeof(params->iq_matrix), &params->iq_matrix);
+    test->huffman_table = va_create_buffer(va, context, VAHuffmanTableBufferType,
+                                           sizeof(params->huffman_table), &params->huffman_table);
+    test->slice_param = va_create_buffer(va, context, VASliceParameterBufferType,
+                                         sizeof(params->slice_param), &params->slice_param);
 
     test->slice_data =
-        va_create_buffer(va, test->context, VASliceDataBufferType, file->scan_size, file->scan);
+        va_create_buffer(va, context, VASliceDataBufferType, file->scan_size, file->scan);
+}
+
+static void
+jpegdec_test_destroy_buffers(struct jpegdec_test *test)
+{
+    struct va *va = &test->va;
+
+    va_destroy_buffer(va, test->pic_param);
+    va_destroy_buffer(va, test->iq_matrix);
+    va_destroy_buffer(va, test->huffman_table);
+    va_destroy_buffer(va, test->slice_param);
+    va_destroy_buffer(va, test->slice_data);
+}
+
+static void
+jpegdec_test_prepare(struct jpegdec_test *test)
+{
+    const struct jpegdec_test_file *file = &test->file;
+    struct va *va = &test->va;
+
+    struct jpegdec_test_params params;
+    jpegdec_test_init_params(file, &params);
+
+    test->config = va_create_config(va, test->profile, test->entrypoint, params.rt_format);
+    test->surface =
+        va_create_surface(va, params.rt_format, file->sof0.X, file->sof0.Y, params.pix_format);
+    test->context = va_create_context(va, test->config, file->sof0.X, file->sof0.Y,
+                                      VA_PROGRESSIVE, test->surface);
+
+    jpegdec_test_create_buffers(test, test->context, file, &params);
 }
 
 static void
-jpegdec_test_parse_file_dri(struct jpegdec_test *test)
+jpegdec_test_parse_file_dri(struct jpegdec_test_file *file)
 {
-    struct jpegdec_test_file *file = &test->file;
     if (!file->dri.segment)
         return;
 
@@ -266,9 +377,8 @@ jpegdec_test_parse_file_dri(struct jpegdec_test *test)
 }
 
 static void
-jpegdec_test_parse_file_sos(struct jpegdec_test *test)
+jpegdec_test_parse_file_sos(struct jpegdec_test_file *file)
 {
-    struct jpegdec_test_file *file = &test->file;
     const unsigned char *stream = file->sos.segment + 4;
 
     file->sos.Ns = stream[0];
@@ -288,9 +398,8 @@ jpegdec_test_parse_file_sos(struct jpegdec_test *test)
 }
 
 static void
-jpegdec_test_parse_file_dht(struct jpegdec_test *test)
+jpegdec_test_parse_file_dht(struct jpegdec_test_file *file)
 {
-    struct jpegdec_test_file *file = &test->file;
     unsigned int count = 0;
 
     for (unsigned int i = 0; i < ARRAY_SIZE(file->dht.segments); i++) {
@@ -338,9 +447,8 @@ jpegdec_test_parse_file_dht(struct jpegdec_test *test)
 }
 
 static void
-jpegdec_test_parse_file_sof0(struct jpegdec_test *test)
+jpegdec_test_parse_file_sof0(struct jpegdec_test_file *file)
 {
-    struct jpegdec_test_file *file = &test->file;
     const unsigned char *stream = file->sof0.segment + 4;
 
     file->sof0.P = stream[0];
@@ -364,9 +472,8 @@ jpegdec_test_parse_file_sof0(struct jpegdec_test *test)
 }
 
 static void
-jpegdec_test_parse_file_dqt(struct jpegdec_test *test)
+jpegdec_test_parse_file_dqt(struct jpegdec_test_file *file)
 {
-    struct jpegdec_test_file *file = &test->file;
     unsigned int count = 0;
 
     for (unsigned int i = 0; i < ARRAY_SIZE(file->dqt.segments); i++) {
@@ -399,11 +506,130 @@ jpegdec_test_parse_file_dqt(struct jpegdec_test *test)
     }
 }
 
-static void
-jpegdec_test_parse_file_segments(struct jpegdec_test *test)
+typedef const unsigned char *(*jpegdec_test_find_ff_func)(const unsigned char *ptr,
+                                                          const unsigned char *end);
+
+/* returns the first 0xff in [ptr, end), or end */
+static const unsigned char *
+jpegdec_test_find_ff(const unsigned char *ptr, const unsigned char *end)
+{
+    while (ptr < end && *ptr != 0xff)
+        ptr++;
+    return ptr;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+static __attribute__((target("sse4.1"))) const unsigned char *
+jpegdec_test_find_ff_sse41(const unsigned char *ptr, const unsigned char *end)
+{
+    const __m128i ff = _mm_set1_epi8((char)0xff);
+    for (; end - ptr >= 16; ptr += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)ptr);
+        const unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, ff));
+        if (mask)
+            return ptr + __builtin_ctz(mask);
+    }
+
+    return jpegdec_test_find_ff(ptr, end);
+}
+
+static __attribute__((target("avx2"))) const unsigned char *
+jpegdec_test_find_ff_avx2(const unsigned char *ptr, const unsigned char *end)
+{
+    const __m256i ff = _mm256_set1_epi8((char)0xff);
+    for (; end - ptr >= 32; ptr += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)ptr);
+        const unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, ff));
+        if (mask)
+            return ptr + __builtin_ctz(mask);
+    }
+
+    return jpegdec_test_find_ff(ptr, end);
+}
+
+#elif defined(__aarch64__)
+
+static const unsigned char *
+jpegdec_test_find_ff_neon(const unsigned char *ptr, const unsigned char *end)
+{
+    const uint8x16_t ff = vdupq_n_u8(0xff);
+    for (; end - ptr >= 16; ptr += 16) {
+        const uint8x16_t eq = vceqq_u8(vld1q_u8(ptr), ff);
+
+        /* narrow to 4 bits per byte to get a scalar mask */
+        const uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+        const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+        if (mask)
+            return ptr + __builtin_ctzll(mask) / 4;
+    }
+
+    return jpegdec_test_find_ff(ptr, end);
+}
+
+#endif
+
+static jpegdec_test_find_ff_func
+jpegdec_test_get_find_ff(enum u_simd_level level)
 {
-    struct jpegdec_test_file *file = &test->file;
+    if (!u_simd_level_supported(level))
+        va_die("unsupported simd level %s", u_simd_level_to_str(level));
+
+    switch (level) {
+#if defined(__x86_64__) || defined(__i386__)
+    case U_SIMD_LEVEL_SSE41:
+        return jpegdec_test_find_ff_sse41;
+    case U_SIMD_LEVEL_AVX2:
+        return jpegdec_test_find_ff_avx2;
+#elif defined(__aarch64__)
+    case U_SIMD_LEVEL_NEON:
+        return jpegdec_test_find_ff_neon;
+#endif
+    default:
+        return jpegdec_test_find_ff;
+    }
+}
 
+/* returns the marker that ends the entropy-coded data at scan */
+static const unsigned char *
+jpegdec_test_skip_scan(struct jpegdec_test_file *file,
+                       const unsigned char *scan,
+                       const unsigned char *end,
+                       enum u_simd_level level)
+{
+    const jpegdec_test_find_ff_func find_ff = jpegdec_test_get_find_ff(level);
+
+    /* 0xff00 is a stuffed 0xff and RSTn markers are part of the scan */
+    const unsigned char *last = end - 2;
+    const unsigned char *stream = scan;
+    while (stream < last) {
+        stream = find_ff(stream, last);
+        if (stream == last)
+            break;
+
+        const unsigned char next = stream[1];
+        if (next >= 0xd0 && next <= 0xd7) {
+            if (!file->dri.segment)
+                va_die("restart marker without DRI");
+            if ((next & 0x7) != (file->rst.count & 0x7))
+                va_die("unexpected restart marker 0x%02x", next);
+
+            if (file->rst.count < (int)ARRAY_SIZE(file->rst.offsets))
+                file->rst.offsets[file->rst.count] = stream - scan;
+            file->rst.count++;
+        } else if (next) {
+            break;
+        }
+
+        stream += 2;
+    }
+
+    return stream;
+}
+
+static void
+jpegdec_test_parse_file_segments(struct jpegdec_test_file *file, enum u_simd_level level)
+{
     const unsigned char *stream = file->ptr;
     if (file->size < 2 || stream[0] != 0xff || stream[1] != 0xd8)
         va_die("expect jpeg magic");
@@ -481,10 +707,7 @@ jpegdec_test_parse_file_segments(struct jpegdec_test *test)
         if (dst == &file->sos.segment) {
             file->scan = stream;
 
-            /* skip scan data */
-            while (stream + 2 < end && (stream[0] != 0xff || stream[1] == 0x00))
-                stream++;
-
+            stream = jpegdec_test_skip_scan(file, stream, end, level);
             file->scan_size = (const void *)stream - file->scan;
         }
     }
@@ -495,15 +718,15 @@ jpegdec_test_parse_file_segments(struct jpegdec_test *test)
 }
 
 static void
-jpegdec_test_parse_file(struct jpegdec_test *test)
+jpegdec_test_parse_file(struct jpegdec_test_file *file, enum u_simd_level level)
 {
-    jpegdec_test_parse_file_segments(test);
+    jpegdec_test_parse_file_segments(file, level);
 
-    jpegdec_test_parse_file_dqt(test);
-    jpegdec_test_parse_file_sof0(test);
-    jpegdec_test_parse_file_dht(test);
-    jpegdec_test_parse_file_sos(test);
-    jpegdec_test_parse_file_dri(test);
+    jpegdec_test_parse_file_dqt(file);
+    jpegdec_test_parse_file_sof0(file);
+    jpegdec_test_parse_file_dht(file);
+    jpegdec_test_parse_file_sos(file);
+    jpegdec_test_parse_file_dri(file);
 }
 
 static void
@@ -512,18 +735,14 @@ jpegdec_test_decode_file(struct jpegdec_test *test, const char *filename)
     struct va *va = &test->va;
 
     test->file.ptr = u_map_file(filename, &test->file.size);
-    jpegdec_test_parse_file(test);
+    jpegdec_test_parse_file(&test->file, test->simd_level);
 
     jpegdec_test_prepare(test);
     jpegdec_test_decode(test);
 
     jpegdec_test_dump(test, "decoded.ppm");
 
-    va_destroy_buffer(va, test->pic_param);
-    va_destroy_buffer(va, test->iq_matrix);
-    va_destroy_buffer(va, test->huffman_table);
-    va_destroy_buffer(va, test->slice_param);
-    va_destroy_buffer(va, test->slice_data);
+    jpegdec_test_destroy_buffers(test);
 
     va_destroy_config(va, test->config);
     va_destroy_surface(va, test->surface);
@@ -533,6 +752,409 @@ jpegdec_test_decode_file(struct jpegdec_test *test, const char *filename)
     memset(&test->file, 0, sizeof(test->file));
 }
 
+static int
+jpegdec_test_compare_filenames(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void
+jpegdec_test_add_filename(struct jpegdec_test_batch *batch, const char *filename)
+{
+    if (!(batch->file_count & (batch->file_count - 1))) {
+        const int max = batch->file_count ? batch->file_count * 2 : 64;
+        batch->filenames = realloc(batch->filenames, sizeof(*batch->filenames) * max);
+        if (!batch->filenames)
+            va_die("failed to alloc filenames");
+    }
+
+    batch->filenames[batch->file_count] = strdup(filename);
+    if (!batch->filenames[batch->file_count])
+        va_die("failed to alloc filename");
+    batch->file_count++;
+}
+
+/* expands directories to their .jpg/.jpeg files in name order */
+static void
+jpegdec_test_collect_files(struct jpegdec_test *test, int count, char **paths)
+{
+    struct jpegdec_test_batch *batch = &test->batch_state;
+
+    for (int i = 0; i < count; i++) {
+        struct stat st;
+        if (stat(paths[i], &st))
+            va_die("failed to stat %s", paths[i]);
+
+        if (!S_ISDIR(st.st_mode)) {
+            jpegdec_test_add_filename(batch, paths[i]);
+            continue;
+        }
+
+        DIR *dir = opendir(paths[i]);
+        if (!dir)
+            va_die("failed to open %s", paths[i]);
+
+        const int first = batch->file_count;
+        const struct dirent *ent;
+        while ((ent = readdir(dir))) {
+            const char *ext = strrchr(ent->d_name, '.');
+            if (!ext || (strcasecmp(ext, ".jpg") && strcasecmp(ext, ".jpeg")))
+                continue;
+
+            char path[PATH_MAX];
+            if (snprintf(path, sizeof(path), "%s/%s", paths[i], ent->d_name) >=
+                (int)sizeof(path))
+                va_die("path too long");
+            jpegdec_test_add_filename(batch, path);
+        }
+        closedir(dir);
+
+        qsort(batch->filenames + first, batch->file_count - first, sizeof(*batch->filenames),
+              jpegdec_test_compare_filenames);
+    }
+
+    if (!batch->file_count)
+        va_die("no jpeg files");
+}
+
+static uint64_t *
+jpegdec_test_alloc_samples(int count)
+{
+    uint64_t *samples = (uint64_t *)calloc(count, sizeof(*samples));
+    if (!samples)
+        va_die("failed to alloc samples");
+    return samples;
+}
+
+static void
+jpegdec_test_report(struct jpegdec_test *test, const char *stage, uint64_t *samples)
+{
+    struct jpegdec_test_batch *batch = &test->batch_state;
+
+    struct u_bench_stats stats;
+    u_bench_calc_stats(samples, batch->file_count, &stats);
+    free(samples);
+
+    char str[256];
+    va_log("%s latency: %s", stage, u_bench_stats_to_str(&stats, str, sizeof(str)));
+
+    u_result_clear_params(&test->result);
+    u_result_set_param(&test->result, "mode", "%s", "batch");
+    u_result_set_param(&test->result, "stage", "%s", stage);
+    u_result_add_bench_stats(&test->result, "latency", &stats);
+}
+
+static int
+jpegdec_test_batch_parse_thread(void *arg)
+{
+    struct jpegdec_test *test = arg;
+    struct jpegdec_test_batch *batch = &test->batch_state;
+
+    for (int i = 0; i < batch->file_count; i++) {
+        mtx_lock(&batch->mutex);
+        while (i - batch->submitted_count >= JPEGDEC_TEST_BATCH_DEPTH)
+            cnd_wait(&batch->cond, &batch->mutex);
+        mtx_unlock(&batch->mutex);
+
+        struct jpegdec_test_job *job = &batch->jobs[i % JPEGDEC_TEST_BATCH_DEPTH];
+        const uint64_t begin = u_now();
+
+        memset(job, 0, sizeof(*job));
+        job->file.ptr = u_map_file(batch->filenames[i], &job->file.size);
+        jpegdec_test_parse_file(&job->file, test->simd_level);
+        jpegdec_test_init_params(&job->file, &job->params);
+
+        const uint64_t dur = u_now() - begin;
+
+        mtx_lock(&batch->mutex);
+        batch->parse_samples[i] = dur;
+        batch->parsed_count++;
+        cnd_broadcast(&batch->cond);
+        mtx_unlock(&batch->mutex);
+    }
+
+    return 0;
+}
+
+/* timestamps decode completion as it happens rather than when the surface is reused */
+static int
+jpegdec_test_batch_sync_thread(void *arg)
+{
+    struct jpegdec_test *test = arg;
+    struct jpegdec_test_batch *batch = &test->batch_state;
+    struct va *va = &test->va;
+
+    for (int i = 0; i < batch->file_count; i++) {
+        mtx_lock(&batch->mutex);
+        while (batch->submitted_count == i)
+            cnd_wait(&batch->cond, &batch->mutex);
+        const int slot = i % JPEGDEC_TEST_SURFACE_COUNT;
+        const VASurfaceID surface = batch->surfaces[slot];
+        const uint64_t submit_ns = batch->submit_ns[slot];
+        mtx_unlock(&batch->mutex);
+
+        va_sync_surface(va, surface);
+        const uint64_t dur = u_now() - submit_ns;
+
+        mtx_lock(&batch->mutex);
+        batch->decode_samples[i] = dur;
+        batch->synced_count++;
+        cnd_broadcast(&batch->cond);
+        mtx_unlock(&batch->mutex);
+    }
+
+    return 0;
+}
+
+/* waits until the first count images have decoded */
+static void
+jpegdec_test_batch_wait_synced(struct jpegdec_test *test, int count)
+{
+    struct jpegdec_test_batch *batch = &test->batch_state;
+
+    mtx_lock(&batch->mutex);
+    while (batch->synced_count < count)
+        cnd_wait(&batch->cond, &batch->mutex);
+    mtx_unlock(&batch->mutex);
+}
+
+static void
+jpegdec_test_batch_destroy_pool(struct jpegdec_test *test)
+{
+    struct jpegdec_test_batch *batch = &test->batch_state;
+    struct va *va = &test->va;
+
+    if (!batch->width)
+        return;
+
+    jpegdec_test_batch_wait_synced(test, batch->submitted_count);
+
+    va_destroy_context(va, batch->context);
+    va_destroy_surfaces(va, batch->surfaces, JPEGDEC_TEST_SURFACE_COUNT);
+    va_destroy_config(va, batch->config);
+    batch->width = 0;
+}
+
+static void
+jpegdec_test_batch_init_pool(struct jpegdec_test *test, const struct jpegdec_test_job *job)
+{
+    struct jpegdec_test_batch *batch = &test->batch_state;
+    struct va *va = &test->va;
+
+    const int width = job->file.sof0.X;
+    const int height = job->file.sof0.Y;
+    if (batch->rt_format == job->params.rt_format &&
+        batch->pix_format == job->params.pix_format && batch->width == width &&
+        batch->height == height)
+        return;
+
+    if (batch->width)
+        batch->reconfig_count++;
+    jpegdec_test_batch_destroy_pool(test);
+
+    batch->rt_format = job->params.rt_format;
+    batch->pix_format = job->params.pix_format;
+    batch->width = width;
+    batch->height = height;
+
+    batch->config = va_create_config(va, test->profile, test->entrypoint, batch->rt_format);
+    va_create_surfaces(va, batch->rt_format, width, height, batch->pix_format, batch->surfaces,
+                       JPEGDEC_TEST_SURFACE_COUNT);
+    batch->context = va_create_context_for_surfaces(va, batch->config, width, height,
+                                                    VA_PROGRESSIVE, batch->surfaces,
+                                                    JPEGDEC_TEST_SURFACE_COUNT);
+}
+
+/* parses on a thread while earlier images decode on up to JPEGDEC_TEST_SURFACE_COUNT surfaces */
+static void
+jpegdec_test_batch_decode(struct jpegdec_test *test)
+{
+    struct jpegdec_test_batch *batch = &test->batch_state;
+
+    if (mtx_init(&batch->mutex, mtx_plain) != thrd_success ||
+        cnd_init(&batch->cond) != thrd_success)
+        va_die("failed to init batch sync");
+
+    batch->parse_samples = jpegdec_test_alloc_samples(batch->file_count);
+    batch->submit_samples = jpegdec_test_alloc_samples(batch->file_count);
+    batch->decode_samples = jpegdec_test_alloc_samples(batch->file_count);
+
+    const uint64_t begin = u_now();
+
+    thrd_t thrd;
+    if (thrd_create(&thrd, jpegdec_test_batch_parse_thread, test) != thrd_success)
+        va_die("failed to create parse thread");
+    thrd_t sync_thrd;
+    if (thrd_create(&sync_thrd, jpegdec_test_batch_sync_thread, test) != thrd_success)
+        va_die("failed to create sync thread");
+
+    uint64_t pixel_count = 0;
+    for (int i = 0; i < batch->file_count; i++) {
+        mtx_lock(&batch->mutex);
+        while (batch->parsed_count == i)
+            cnd_wait(&batch->cond, &batch->mutex);
+        mtx_unlock(&batch->mutex);
+
+        struct jpegdec_test_job *job = &batch->jobs[i % JPEGDEC_TEST_BATCH_DEPTH];
+        jpegdec_test_batch_init_pool(test, job);
+
+        /* the surface is free once the image that used it last has decoded */
+        const int slot = i % JPEGDEC_TEST_SURFACE_COUNT;
+        jpegdec_test_batch_wait_synced(test, i - JPEGDEC_TEST_SURFACE_COUNT + 1);
+
+        const uint64_t submit_begin = u_now();
+        jpegdec_test_create_buffers(test, batch->context, &job->file, &job->params);
+        jpegdec_test_submit(test, batch->context, batch->surfaces[slot]);
+        jpegdec_test_destroy_buffers(test);
+        const uint64_t submit_end = u_now();
+        batch->submit_samples[i] = submit_end - submit_begin;
+
+        /* the slice data has been copied to the buffer */
+        pixel_count += (uint64_t)job->file.sof0.X * job->file.sof0.Y;
+        u_unmap_file(job->file.ptr, job->file.size);
+
+        mtx_lock(&batch->mutex);
+        batch->submit_ns[slot] = submit_end;
+        batch->submitted_count++;
+        cnd_broadcast(&batch->cond);
+        mtx_unlock(&batch->mutex);
+    }
+
+    jpegdec_test_batch_wait_synced(test, batch->file_count);
+
+    const uint64_t dur = u_now() - begin;
+
+    thrd_join(thrd, NULL);
+    thrd_join(sync_thrd, NULL);
+    jpegdec_test_batch_destroy_pool(test);
+    cnd_destroy(&batch->cond);
+    mtx_destroy(&batch->mutex);
+
+    const double images_per_sec = batch->file_count * 1000000000.0 / (double)dur;
+    const double mpix_per_sec = (double)pixel_count * 1000.0 / (double)dur;
+    va_log("batch: %d images in %.1fms: %.1f images/s, %.1f MPix/s, %d reconfigs",
+           batch->file_count, dur / 1000000.0, images_per_sec, mpix_per_sec,
+           batch->reconfig_count);
+
+    u_result_clear_params(&test->result);
+    u_result_set_param(&test->result, "mode", "%s", "batch");
+    u_result_set_param(&test->result, "images", "%d", batch->file_count);
+    u_result_add(&test->result, "images_per_sec", images_per_sec, "1/s");
+    u_result_add(&test->result, "throughput", mpix_per_sec, "MPix/s");
+
+    jpegdec_test_report(test, "parse", batch->parse_samples);
+    jpegdec_test_report(test, "submit", batch->submit_samples);
+    jpegdec_test_report(test, "decode", batch->decode_samples);
+}
+
+static void
+jpegdec_test_reset_file(struct jpegdec_test_file *file)
+{
+    const struct jpegdec_test_file mapped = {
+        .ptr = file->ptr,
+        .size = file->size,
+    };
+    *file = mapped;
+}
+
+static void
+jpegdec_test_batch_parse_level(struct jpegdec_test *test,
+                               struct jpegdec_test_file *files,
+                               const struct jpegdec_test_file *refs,
+                               size_t total_size,
+                               enum u_simd_level level)
+{
+    struct jpegdec_test_batch *batch = &test->batch_state;
+
+    struct u_bench bench;
+    struct u_bench_stats stats;
+    u_bench_init(&bench, NULL);
+    while (u_bench_next(&bench)) {
+        const uint64_t begin = u_now();
+        for (int i = 0; i < batch->file_count; i++) {
+            struct jpegdec_test_file *file = &files[i];
+            jpegdec_test_reset_file(file);
+
+            struct jpegdec_test_params params;
+            jpegdec_test_parse_file(file, level);
+            jpegdec_test_init_params(file, &params);
+        }
+        u_bench_add(&bench, u_now() - begin);
+    }
+    u_bench_finish(&bench, &stats);
+
+    for (int i = 0; i < batch->file_count; i++) {
+        if (files[i].scan_size != refs[i].scan_size ||
+            memcmp(&files[i].rst, &refs[i].rst, sizeof(files[i].rst)))
+            va_die("%s: %s scan differs from scalar", batch->filenames[i],
+                   u_simd_level_to_str(level));
+    }
+
+    const double images_per_sec = batch->file_count * 1000000000.0 / (double)stats.median;
+    const double mb_per_sec = (double)total_size * 1000.0 / (double)stats.median;
+
+    char str[256];
+    va_log("parse %s: %.1f images/s, %.1f MB/s (%s)", u_simd_level_to_str(level),
+           images_per_sec, mb_per_sec, u_bench_stats_to_str(&stats, str, sizeof(str)));
+
+    u_result_clear_params(&test->result);
+    u_result_set_param(&test->result, "mode", "%s", "parse");
+    u_result_set_param(&test->result, "simd", "%s", u_simd_level_to_str(level));
+    u_result_set_param(&test->result, "images", "%d", batch->file_count);
+    u_result_add(&test->result, "images_per_sec", images_per_sec, "1/s");
+    u_result_add(&test->result, "throughput", mb_per_sec, "MB/s");
+    u_result_add_bench_stats(&test->result, "time", &stats);
+}
+
+/* benchmarks the cpu parse stage alone over already mapped files, at each simd level */
+static void
+jpegdec_test_batch_parse(struct jpegdec_test *test)
+{
+    struct jpegdec_test_batch *batch = &test->batch_state;
+
+    struct jpegdec_test_file *files = calloc(batch->file_count * 2, sizeof(*files));
+    if (!files)
+        va_die("failed to alloc files");
+    struct jpegdec_test_file *refs = files + batch->file_count;
+
+    size_t total_size = 0;
+    int restart_count = 0;
+    for (int i = 0; i < batch->file_count; i++) {
+        files[i].ptr = u_map_file(batch->filenames[i], &files[i].size);
+        total_size += files[i].size;
+
+        /* the scalar scan is the reference */
+        refs[i] = files[i];
+        jpegdec_test_parse_file(&refs[i], U_SIMD_LEVEL_NONE);
+        restart_count += refs[i].rst.count;
+    }
+
+    va_log("parse: %d images, %zu bytes, %d restart markers", batch->file_count, total_size,
+           restart_count);
+
+    for (int i = 0; i < U_SIMD_LEVEL_COUNT; i++) {
+        const enum u_simd_level level = (enum u_simd_level)i;
+        if (!u_simd_level_supported(level))
+            continue;
+
+        jpegdec_test_batch_parse_level(test, files, refs, total_size, level);
+    }
+
+    for (int i = 0; i < batch->file_count; i++)
+        u_unmap_file(files[i].ptr, files[i].size);
+    free(files);
+}
+
+static void
+jpegdec_test_cleanup_batch(struct jpegdec_test *test)
+{
+    struct jpegdec_test_batch *batch = &test->batch_state;
+
+    for (int i = 0; i < batch->file_count; i++)
+        free(batch->filenames[i]);
+    free(batch->filenames);
+}
+
 static void
 jpegdec_test_cleanup(struct jpegdec_test *test)
 {
@@ -551,14 +1173,41 @@ main(int argc, char **argv)
     struct jpegdec_test test = {
         .profile = VAProfileJPEGBaseline,
         .entrypoint = VAEntrypointVLD,
+        .simd_level = u_simd_level_get(),
     };
 
-    jpegdec_test_init(&test);
+    int first = 1;
+    if (argc > 1 && !strcmp(argv[1], "-b")) {
+        test.batch = true;
+        first++;
+    } else if (argc > 1 && !strcmp(argv[1], "-p")) {
+        test.parse_only = true;
+        first++;
+    }
+    if (first >= argc)
+        va_die("usage: %s [-b|-p] <jpeg-or-dir>...", argv[0]);
+
+    if (!test.batch && !test.parse_only) {
+        jpegdec_test_init(&test);
+        for (int i = first; i < argc; i++)
+            jpegdec_test_decode_file(&test, argv[i]);
+        jpegdec_test_cleanup(&test);
+        return 0;
+    }
+
+    jpegdec_test_collect_files(&test, argc - first, argv + first);
+    u_result_init(&test.result, "jpegdec", NULL);
 
-    for (int i = 1; i < argc; i++)
-        jpegdec_test_decode_file(&test, argv[i]);
+    if (test.parse_only) {
+        jpegdec_test_batch_parse(&test);
+    } else {
+        jpegdec_test_init(&test);
+        jpegdec_test_batch_decode(&test);
+        jpegdec_test_cleanup(&test);
+    }
 
-    jpegdec_test_cleanup(&test);
+    u_result_cleanup(&test.result);
+    jpegdec_test_cleanup_batch(&test);
 
     return 0;
 }
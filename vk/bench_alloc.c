@@ -0,0 +1,248 @@
+/*
+ * Copyright 2025 Google LLC
+ * SPDX-License-Identifier: MIT
+ */
+
+/* This test measures the cpu cost of buffer and image churn, with and without sub-allocation. */
+
+#include "vkutil.h"
+
+enum bench_alloc_test_mix {
+    BENCH_ALLOC_TEST_MIX_BUFFER,
+    BENCH_ALLOC_TEST_MIX_IMAGE,
+    BENCH_ALLOC_TEST_MIX_MIXED,
+};
+
+struct bench_alloc_test_res {
+    struct vk_buffer *buf;
+    struct vk_image *img;
+};
+
+struct bench_alloc_test {
+    uint32_t live_count;
+    uint32_t churn_count;
+    VkDeviceSize min_buf_size;
+    uint32_t buf_size_orders;
+    uint32_t min_img_size;
+    uint32_t img_size_orders;
+
+    struct u_bench_params bench_params;
+
+    struct vk vk;
+    struct u_result result;
+
+    uint32_t rand_state;
+    struct bench_alloc_test_res *res;
+};
+
+static const char *
+bench_alloc_test_mix_to_str(enum bench_alloc_test_mix mix)
+{
+    switch (mix) {
+    case BENCH_ALLOC_TEST_MIX_BUFFER:
+        return "buffer";
+    case BENCH_ALLOC_TEST_MIX_IMAGE:
+        return "image";
+    case BENCH_ALLOC_TEST_MIX_MIXED:
+        return "mixed";
+    default:
+        vk_die("unknown mix");
+    }
+}
+
+static uint32_t
+bench_alloc_test_rand(struct bench_alloc_test *test)
+{
+    /* xorshift32 */
+    uint32_t x = test->rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    test->rand_state = x;
+    return x;
+}
+
+static void
+bench_alloc_test_init(struct bench_alloc_test *test)
+{
+    struct vk *vk = &test->vk;
+
+    const struct vk_init_params params = {
+        .suballoc = true,
+    };
+    vk_init(vk, &params);
+    vk_init_result(vk, &test->result, "bench_alloc");
+
+    test->res = (struct bench_alloc_test_res *)calloc(test->live_count, sizeof(*test->res));
+    if (!test->res)
+        vk_die("failed to alloc res");
+}
+
+static void
+bench_alloc_test_cleanup(struct bench_alloc_test *test)
+{
+    struct vk *vk = &test->vk;
+
+    free(test->res);
+
+    u_result_cleanup(&test->result);
+    vk_cleanup(vk);
+}
+
+static void
+bench_alloc_test_create_res(struct bench_alloc_test *test,
+                            struct bench_alloc_test_res *res,
+                            enum bench_alloc_test_mix mix)
+{
+    struct vk *vk = &test->vk;
+
+    const uint32_t r = bench_alloc_test_rand(test);
+    const bool is_img = mix == BENCH_ALLOC_TEST_MIX_IMAGE ||
+                        (mix == BENCH_ALLOC_TEST_MIX_MIXED && (r & 1));
+
+    /* log-uniform sizes */
+    if (is_img) {
+        const uint32_t size = test->min_img_size << (r % test->img_size_orders);
+        res->img = vk_create_image(vk, VK_FORMAT_R8G8B8A8_UNORM, size, size,
+                                   VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_TILING_OPTIMAL,
+                                   VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+    } else {
+        const VkDeviceSize base = test->min_buf_size << (r % test->buf_size_orders);
+        const VkDeviceSize size = base + bench_alloc_test_rand(test) % base;
+        res->buf = vk_create_buffer(vk, 0, size,
+                                    VK_BUFFER_USAGE_2_STORAGE_BUFFER_BIT |
+                                        VK_BUFFER_USAGE_2_TRANSFER_DST_BIT);
+    }
+}
+
+static void
+bench_alloc_test_destroy_res(struct bench_alloc_test *test, struct bench_alloc_test_res *res)
+{
+    struct vk *vk = &test->vk;
+
+    if (res->img)
+        vk_destroy_image(vk, res->img);
+    if (res->buf)
+        vk_destroy_buffer(vk, res->buf);
+    res->img = NULL;
+    res->buf = NULL;
+}
+
+static uint32_t
+bench_alloc_test_count_memories(struct bench_alloc_test *test)
+{
+    struct vk *vk = &test->vk;
+
+    /* spare empty blocks left over from earlier runs back no resource */
+    uint32_t count = vk->suballoc.dedicated_count;
+    for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++) {
+        for (uint32_t j = 0; j < ARRAY_SIZE(vk->suballoc.pools[i]); j++) {
+            for (const struct vk_mem_block *block = vk->suballoc.pools[i][j]; block;
+                 block = block->next)
+                count += block->alloc_count > 0;
+        }
+    }
+
+    return count;
+}
+
+/* replaces random live resources with new ones of random sizes */
+static void
+bench_alloc_test_churn(struct bench_alloc_test *test, enum bench_alloc_test_mix mix)
+{
+    for (uint32_t i = 0; i < test->churn_count; i++) {
+        struct bench_alloc_test_res *res =
+            &test->res[bench_alloc_test_rand(test) % test->live_count];
+        bench_alloc_test_destroy_res(test, res);
+        bench_alloc_test_create_res(test, res, mix);
+    }
+}
+
+static void
+bench_alloc_test_run(struct bench_alloc_test *test, enum bench_alloc_test_mix mix, bool dedicated)
+{
+    struct vk *vk = &test->vk;
+
+    vk->params.suballoc = !dedicated;
+    test->rand_state = 0x12345678;
+
+    for (uint32_t i = 0; i < test->live_count; i++)
+        bench_alloc_test_create_res(test, &test->res[i], mix);
+
+    struct u_bench bench;
+    struct u_bench_stats stats;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        const uint64_t begin = u_now();
+        bench_alloc_test_churn(test, mix);
+        const uint64_t end = u_now();
+
+        u_bench_add(&bench, end - begin);
+    }
+    u_bench_finish(&bench, &stats);
+
+    const char *mode = dedicated ? "dedicated" : "suballoc";
+    const char *mix_str = bench_alloc_test_mix_to_str(mix);
+    const double replaces_per_sec = test->churn_count * 1000000000.0 / (double)stats.median;
+    const uint32_t mem_count = bench_alloc_test_count_memories(test);
+
+    char str[128];
+    vk_log("%s %s: %.0f replaces/s, %u memory objects for %u resources (%s)", mode, mix_str,
+           replaces_per_sec, mem_count, test->live_count,
+           u_bench_stats_to_str(&stats, str, sizeof(str)));
+    if (!dedicated)
+        vk_log_suballoc_stats(vk);
+
+    struct u_result *res = &test->result;
+    u_result_clear_params(res);
+    u_result_set_param(res, "mode", "%s", mode);
+    u_result_set_param(res, "mix", "%s", mix_str);
+    u_result_set_param(res, "live_count", "%u", test->live_count);
+    u_result_set_param(res, "churn_count", "%u", test->churn_count);
+    u_result_add(res, "replaces_per_sec", replaces_per_sec, "1/s");
+    u_result_add(res, "memory_objects", mem_count, "");
+    u_result_add_bench_stats(res, "time", &stats);
+
+    for (uint32_t i = 0; i < test->live_count; i++)
+        bench_alloc_test_destroy_res(test, &test->res[i]);
+}
+
+static void
+bench_alloc_test_all(struct bench_alloc_test *test)
+{
+    static const enum bench_alloc_test_mix mixes[] = {
+        BENCH_ALLOC_TEST_MIX_BUFFER,
+        BENCH_ALLOC_TEST_MIX_IMAGE,
+        BENCH_ALLOC_TEST_MIX_MIXED,
+    };
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(mixes); i++) {
+        bench_alloc_test_run(test, mixes[i], true);
+        bench_alloc_test_run(test, mixes[i], false);
+    }
+}
+
+int
+main(void)
+{
+    struct bench_alloc_test test = {
+        .live_count = 256,
+        .churn_count = 1024,
+        .min_buf_size = 4 * 1024,
+        .buf_size_orders = 8,
+        .min_img_size = 16,
+        .img_size_orders = 6,
+        .bench_params = {
+            .warmup = 1,
+            .min_repeat = 5,
+            .max_repeat = 20,
+            .max_cv = 0.05f,
+        },
+    };
+
+    bench_alloc_test_init(&test);
+    bench_alloc_test_all(&test);
+    bench_alloc_test_cleanup(&test);
+
+    return 0;
+}
@@ -5,10 +5,56 @@
 
 #include "vkutil.h"
 
+#include <sched.h>
+#include <stdatomic.h>
+#include <threads.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define BENCH_BUFFER_TEST_MAX_CPUS 64
+
 static const uint32_t bench_buffer_test_cs[] = {
 #include "bench_buffer_test.comp.inc"
 };
 
+enum bench_buffer_test_host_op {
+    BENCH_BUFFER_TEST_HOST_OP_MEMSET,
+    BENCH_BUFFER_TEST_HOST_OP_MEMSET_NT,
+    BENCH_BUFFER_TEST_HOST_OP_MEMCPY,
+    BENCH_BUFFER_TEST_HOST_OP_MEMCPY_NT,
+};
+
+struct bench_buffer_test_host_job {
+    enum bench_buffer_test_host_op op;
+    uint32_t loop;
+
+    atomic_uint ready;
+    atomic_bool go;
+};
+
+struct bench_buffer_test_host_thread {
+    struct bench_buffer_test_host_job *job;
+    int cpu;
+    void *dst;
+    const void *src;
+    size_t size;
+
+    thrd_t thrd;
+    uint64_t begin;
+    uint64_t end;
+};
+
+struct bench_buffer_test_curve {
+    char desc[64];
+    char op[32];
+    uint32_t elem_size;
+    uint32_t cs_local_size;
+
+    uint32_t mb[32];
+};
+
 struct bench_buffer_test {
     uint32_t elem_size;
     VkDeviceSize size;
@@ -16,8 +62,27 @@ struct bench_buffer_test {
 
     uint32_t cs_local_size;
 
+    /* sweep sizes from sweep_min_size to sweep_max_size in powers of 2 */
+    bool sweep;
+    VkDeviceSize sweep_min_size;
+    VkDeviceSize sweep_max_size;
+    /* pick the loop count such that each sample moves about this many bytes */
+    VkDeviceSize sweep_bytes;
+    uint32_t sweep_max_loop;
+
+    /* run host ops on pinned threads; 0 means one run per cpu cluster */
+    bool threads;
+    uint32_t thread_count;
+
+    struct u_bench_params bench_params;
+
     struct vk vk;
     struct vk_stopwatch *stopwatch;
+    struct u_result result;
+
+    uint32_t sweep_idx;
+    struct bench_buffer_test_curve *curves;
+    uint32_t curve_count;
 };
 
 static void
@@ -26,6 +91,7 @@ bench_buffer_test_init(struct bench_buffer_test *test)
     struct vk *vk = &test->vk;
 
     vk_init(vk, NULL);
+    vk_init_result(vk, &test->result, "bench_buffer");
 
     test->stopwatch = vk_create_stopwatch(vk, 2);
 }
@@ -35,6 +101,9 @@ bench_buffer_test_cleanup(struct bench_buffer_test *test)
 {
     struct vk *vk = &test->vk;
 
+    free(test->curves);
+
+    u_result_cleanup(&test->result);
     vk_destroy_stopwatch(vk, test->stopwatch);
     vk_cleanup(vk);
 }
@@ -69,31 +138,137 @@ bench_buffer_test_calc_throughput_mb(struct bench_buffer_test *test, uint64_t du
     return bench_buffer_test_calc_throughput(test, dur) / 1024 / 1024;
 }
 
-static uint64_t
-bench_buffer_test_memset(struct bench_buffer_test *test, void *buf)
+static const char *
+bench_buffer_test_describe_size(VkDeviceSize size, char desc[static 32])
 {
-    memset(buf, 0x7f, test->size);
+    const char *units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+    uint32_t unit = 0;
+    while (unit < ARRAY_SIZE(units) - 1 && size >= 1024 && !(size % 1024)) {
+        size /= 1024;
+        unit++;
+    }
 
-    const uint64_t begin = u_now();
-    for (uint32_t i = 0; i < test->loop; i++)
-        memset(buf, 0x7f, test->size);
-    const uint64_t end = u_now();
+    snprintf(desc, 32, "%" PRIu64 " %s", (uint64_t)size, units[unit]);
 
-    return end - begin;
+    return desc;
 }
 
-static uint64_t
-bench_buffer_test_memcpy(struct bench_buffer_test *test, void *dst, void *src)
+static void
+bench_buffer_test_add_curve_point(struct bench_buffer_test *test,
+                                  const char *desc,
+                                  const char *op,
+                                  uint32_t mb)
+{
+    const bool compute = !strcmp(op, "compute");
+    const uint32_t elem_size = compute ? test->elem_size : 0;
+    const uint32_t cs_local_size = compute ? test->cs_local_size : 0;
+
+    struct bench_buffer_test_curve *curve = NULL;
+    for (uint32_t i = 0; i < test->curve_count; i++) {
+        struct bench_buffer_test_curve *c = &test->curves[i];
+        if (!strcmp(c->desc, desc) && !strcmp(c->op, op) && c->elem_size == elem_size &&
+            c->cs_local_size == cs_local_size) {
+            curve = c;
+            break;
+        }
+    }
+
+    if (!curve) {
+        test->curves = realloc(test->curves, sizeof(*test->curves) * (test->curve_count + 1));
+        if (!test->curves)
+            vk_die("failed to alloc curves");
+
+        curve = &test->curves[test->curve_count++];
+        memset(curve, 0, sizeof(*curve));
+        snprintf(curve->desc, sizeof(curve->desc), "%s", desc);
+        snprintf(curve->op, sizeof(curve->op), "%s", op);
+        curve->elem_size = elem_size;
+        curve->cs_local_size = cs_local_size;
+    }
+
+    assert(test->sweep_idx < ARRAY_SIZE(curve->mb));
+    curve->mb[test->sweep_idx] = mb;
+}
+
+static void
+bench_buffer_test_report(struct bench_buffer_test *test,
+                         const char *desc,
+                         const char *op,
+                         const struct u_bench_stats *stats)
+{
+    const bool compute = !strcmp(op, "compute");
+    const uint32_t mb = bench_buffer_test_calc_throughput_mb(test, stats->median);
+
+    char str[128];
+    if (test->sweep) {
+        char size_desc[32];
+        bench_buffer_test_describe_size(test->size, size_desc);
+        if (compute) {
+            vk_log("%s: %s (local size %ux%u, elem size %u): %s x %u: %d MB/s (%s)", desc, op,
+                   test->cs_local_size, test->cs_local_size, test->elem_size, size_desc,
+                   test->loop, mb, u_bench_stats_to_str(stats, str, sizeof(str)));
+        } else {
+            vk_log("%s: %s: %s x %u: %d MB/s (%s)", desc, op, size_desc, test->loop, mb,
+                   u_bench_stats_to_str(stats, str, sizeof(str)));
+        }
+
+        bench_buffer_test_add_curve_point(test, desc, op, mb);
+    } else {
+        vk_log("%s: %s: %d MB/s (%s)", desc, op, mb,
+               u_bench_stats_to_str(stats, str, sizeof(str)));
+    }
+
+    struct u_result *res = &test->result;
+    u_result_clear_params(res);
+    u_result_set_param(res, "op", "%s", op);
+    u_result_set_param(res, "memory", "%s", desc);
+    u_result_set_param(res, "size", "%" PRIu64, (uint64_t)test->size);
+    u_result_set_param(res, "loop", "%u", test->loop);
+    if (compute) {
+        u_result_set_param(res, "elem_size", "%u", test->elem_size);
+        u_result_set_param(res, "local_size", "%u", test->cs_local_size);
+    }
+    u_result_add(res, "throughput", mb, "MB/s");
+    u_result_add_bench_stats(res, "time", stats);
+}
+
+static void
+bench_buffer_test_memset(struct bench_buffer_test *test,
+                         void *buf,
+                         struct u_bench_stats *stats)
+{
+    struct u_bench bench;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        const uint64_t begin = u_now();
+        for (uint32_t i = 0; i < test->loop; i++)
+            memset(buf, 0x7f, test->size);
+        const uint64_t end = u_now();
+
+        u_bench_add(&bench, end - begin);
+    }
+    u_bench_finish(&bench, stats);
+}
+
+static void
+bench_buffer_test_memcpy(struct bench_buffer_test *test,
+                         void *dst,
+                         void *src,
+                         struct u_bench_stats *stats)
 {
     memset(src, 0x7f, test->size);
-    memcpy(dst, src, test->size);
 
-    const uint64_t begin = u_now();
-    for (uint32_t i = 0; i < test->loop; i++)
-        memcpy(dst, src, test->size);
-    const uint64_t end = u_now();
+    struct u_bench bench;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        const uint64_t begin = u_now();
+        for (uint32_t i = 0; i < test->loop; i++)
+            memcpy(dst, src, test->size);
+        const uint64_t end = u_now();
 
-    return end - begin;
+        u_bench_add(&bench, end - begin);
+    }
+    u_bench_finish(&bench, stats);
 }
 
 static void
@@ -123,8 +298,11 @@ bench_buffer_test_barrier(struct bench_buffer_test *test,
     vk->CmdPipelineBarrier2(cmd, &dep_info);
 }
 
-static uint64_t
-bench_buffer_test_fill_buffer(struct bench_buffer_test *test, struct vk_buffer *buf, uint32_t val)
+static void
+bench_buffer_test_fill_buffer(struct bench_buffer_test *test,
+                              struct vk_buffer *buf,
+                              uint32_t val,
+                              struct u_bench_stats *stats)
 {
     struct vk *vk = &test->vk;
 
@@ -133,36 +311,40 @@ bench_buffer_test_fill_buffer(struct bench_buffer_test *test, struct vk_buffer *
     vk_end_cmd(vk);
     vk_wait(vk);
 
-    cmd = vk_begin_cmd(vk, false);
-    vk_write_stopwatch(vk, test->stopwatch, cmd);
-    for (uint32_t i = 0; i < test->loop; i++)
-        vk->CmdFillBuffer(cmd, buf->buf, 0, test->size, val);
-    vk_write_stopwatch(vk, test->stopwatch, cmd);
-    bench_buffer_test_barrier(test, cmd, buf, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
-                              VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_HOST_BIT,
-                              VK_ACCESS_2_HOST_READ_BIT);
-    vk_end_cmd(vk);
-    vk_wait(vk);
-
-    const uint64_t dur = vk_read_stopwatch(vk, test->stopwatch, 0);
-    vk_reset_stopwatch(vk, test->stopwatch);
+    struct u_bench bench;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        cmd = vk_begin_cmd(vk, false);
+        vk_write_stopwatch(vk, test->stopwatch, cmd);
+        for (uint32_t i = 0; i < test->loop; i++)
+            vk->CmdFillBuffer(cmd, buf->buf, 0, test->size, val);
+        vk_write_stopwatch(vk, test->stopwatch, cmd);
+        bench_buffer_test_barrier(test, cmd, buf, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                                  VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_HOST_BIT,
+                                  VK_ACCESS_2_HOST_READ_BIT);
+        vk_end_cmd(vk);
+        vk_wait(vk);
+
+        u_bench_add(&bench, vk_read_stopwatch(vk, test->stopwatch, 0));
+        vk_reset_stopwatch(vk, test->stopwatch);
+    }
+    u_bench_finish(&bench, stats);
 
     if (buf->is_coherent) {
-        uint32_t(*ptr)[4] = buf->mem_ptr;
-        for (uint32_t i = 0; i < test->size / test->elem_size; i++) {
-            if (ptr[i][0] != val || ptr[i][1] != val || ptr[i][2] != val || ptr[i][3] != val)
-                vk_die("bad element %d", i);
+        const uint32_t *ptr = buf->mem_ptr;
+        for (VkDeviceSize i = 0; i < test->size / sizeof(*ptr); i++) {
+            if (ptr[i] != val)
+                vk_die("bad element %" PRIu64, (uint64_t)i);
         }
     }
-
-    return dur;
 }
 
-static uint64_t
+static void
 bench_buffer_test_copy_buffer(struct bench_buffer_test *test,
                               struct vk_buffer *dst,
                               struct vk_buffer *src,
-                              uint32_t val)
+                              uint32_t val,
+                              struct u_bench_stats *stats)
 {
     struct vk *vk = &test->vk;
 
@@ -187,36 +369,40 @@ bench_buffer_test_copy_buffer(struct bench_buffer_test *test,
     vk_end_cmd(vk);
     vk_wait(vk);
 
-    cmd = vk_begin_cmd(vk, false);
-    vk_write_stopwatch(vk, test->stopwatch, cmd);
-    for (uint32_t i = 0; i < test->loop; i++)
-        vk->CmdCopyBuffer2(cmd, &copy_info);
-    vk_write_stopwatch(vk, test->stopwatch, cmd);
-    bench_buffer_test_barrier(test, cmd, dst, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
-                              VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_HOST_BIT,
-                              VK_ACCESS_2_HOST_READ_BIT);
-    vk_end_cmd(vk);
-    vk_wait(vk);
-
-    const uint64_t dur = vk_read_stopwatch(vk, test->stopwatch, 0);
-    vk_reset_stopwatch(vk, test->stopwatch);
+    struct u_bench bench;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        cmd = vk_begin_cmd(vk, false);
+        vk_write_stopwatch(vk, test->stopwatch, cmd);
+        for (uint32_t i = 0; i < test->loop; i++)
+            vk->CmdCopyBuffer2(cmd, &copy_info);
+        vk_write_stopwatch(vk, test->stopwatch, cmd);
+        bench_buffer_test_barrier(test, cmd, dst, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                                  VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_HOST_BIT,
+                                  VK_ACCESS_2_HOST_READ_BIT);
+        vk_end_cmd(vk);
+        vk_wait(vk);
+
+        u_bench_add(&bench, vk_read_stopwatch(vk, test->stopwatch, 0));
+        vk_reset_stopwatch(vk, test->stopwatch);
+    }
+    u_bench_finish(&bench, stats);
 
     if (dst->is_coherent) {
-        uint32_t(*ptr)[4] = dst->mem_ptr;
-        for (uint32_t i = 0; i < test->size / test->elem_size; i++) {
-            if (ptr[i][0] != val || ptr[i][1] != val || ptr[i][2] != val || ptr[i][3] != val)
-                vk_die("bad element %d", i);
+        const uint32_t *ptr = dst->mem_ptr;
+        for (VkDeviceSize i = 0; i < test->size / sizeof(*ptr); i++) {
+            if (ptr[i] != val)
+                vk_die("bad element %" PRIu64, (uint64_t)i);
         }
     }
-
-    return dur;
 }
 
-static uint64_t
+static void
 bench_buffer_test_dispatch(struct bench_buffer_test *test,
                            struct vk_buffer *dst,
                            struct vk_buffer *src,
-                           uint32_t val)
+                           uint32_t val,
+                           struct u_bench_stats *stats)
 {
     struct vk *vk = &test->vk;
     struct vk_pipeline *pipeline;
@@ -227,6 +413,12 @@ bench_buffer_test_dispatch(struct bench_buffer_test *test,
 
         vk_add_pipeline_shader(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, bench_buffer_test_cs,
                                sizeof(bench_buffer_test_cs));
+        vk_set_pipeline_spec_constant(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                      test->cs_local_size);
+        vk_set_pipeline_spec_constant(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, 1,
+                                      test->cs_local_size);
+        vk_set_pipeline_spec_constant(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, 2,
+                                      test->elem_size);
 
         const VkDescriptorSetLayoutBinding bindings[] = {
             [0] = {
@@ -282,10 +474,15 @@ bench_buffer_test_dispatch(struct bench_buffer_test *test,
         vk->UpdateDescriptorSets(vk->dev, ARRAY_SIZE(write_infos), write_infos, 0, NULL);
     }
 
-    const uint64_t grid_size = (uint64_t)sqrt(test->size / test->elem_size);
-    const uint32_t group_count = grid_size / test->cs_local_size;
-    assert(grid_size * grid_size * test->elem_size == test->size);
-    assert(group_count * test->cs_local_size == grid_size);
+    /* the shader skips out-of-bound invocations */
+    const uint64_t elem_count = test->size / test->elem_size;
+    const uint64_t group_total =
+        DIV_ROUND_UP(elem_count, test->cs_local_size * test->cs_local_size);
+    const uint32_t max_group_count = vk->props.properties.limits.maxComputeWorkGroupCount[0];
+    const uint32_t group_count_x =
+        group_total < max_group_count ? (uint32_t)group_total : max_group_count;
+    const uint32_t group_count_y = DIV_ROUND_UP(group_total, group_count_x);
+    assert(test->size % test->elem_size == 0);
 
     const VkBindDescriptorSetsInfo bind_info = {
         .sType = VK_STRUCTURE_TYPE_BIND_DESCRIPTOR_SETS_INFO,
@@ -302,53 +499,83 @@ bench_buffer_test_dispatch(struct bench_buffer_test *test,
         VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT);
     vk_bind_pipeline(vk, pipeline, cmd);
     vk->CmdBindDescriptorSets2(cmd, &bind_info);
-    vk->CmdDispatch(cmd, group_count, group_count, 1);
+    vk->CmdDispatch(cmd, group_count_x, group_count_y, 1);
     vk_end_cmd(vk);
     vk_wait(vk);
 
-    cmd = vk_begin_cmd(vk, false);
-    vk_bind_pipeline(vk, pipeline, cmd);
-    vk->CmdBindDescriptorSets2(cmd, &bind_info);
-    vk_write_stopwatch(vk, test->stopwatch, cmd);
-    for (uint32_t i = 0; i < test->loop; i++)
-        vk->CmdDispatch(cmd, group_count, group_count, 1);
-    vk_write_stopwatch(vk, test->stopwatch, cmd);
-    bench_buffer_test_barrier(test, cmd, dst, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-                              VK_ACCESS_2_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_2_HOST_BIT,
-                              VK_ACCESS_2_HOST_READ_BIT);
-    vk_end_cmd(vk);
-    vk_wait(vk);
+    struct u_bench bench;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        cmd = vk_begin_cmd(vk, false);
+        vk_bind_pipeline(vk, pipeline, cmd);
+        vk->CmdBindDescriptorSets2(cmd, &bind_info);
+        vk_write_stopwatch(vk, test->stopwatch, cmd);
+        for (uint32_t i = 0; i < test->loop; i++)
+            vk->CmdDispatch(cmd, group_count_x, group_count_y, 1);
+        vk_write_stopwatch(vk, test->stopwatch, cmd);
+        bench_buffer_test_barrier(test, cmd, dst, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                  VK_ACCESS_2_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_2_HOST_BIT,
+                                  VK_ACCESS_2_HOST_READ_BIT);
+        vk_end_cmd(vk);
+        vk_wait(vk);
+
+        u_bench_add(&bench, vk_read_stopwatch(vk, test->stopwatch, 0));
+        vk_reset_stopwatch(vk, test->stopwatch);
+    }
+    u_bench_finish(&bench, stats);
 
     vk_destroy_pipeline(vk, pipeline);
     vk_destroy_descriptor_set(vk, set);
 
-    const uint64_t dur = vk_read_stopwatch(vk, test->stopwatch, 0);
-    vk_reset_stopwatch(vk, test->stopwatch);
-
     if (dst->is_coherent) {
-        uint32_t(*ptr)[4] = dst->mem_ptr;
-        for (uint32_t i = 0; i < test->size / test->elem_size; i++) {
-            if (ptr[i][0] != val || ptr[i][1] != val || ptr[i][2] != val || ptr[i][3] != val)
-                vk_die("bad element %d", i);
+        const uint32_t *ptr = dst->mem_ptr;
+        for (VkDeviceSize i = 0; i < test->size / sizeof(*ptr); i++) {
+            if (ptr[i] != val)
+                vk_die("bad element %" PRIu64, (uint64_t)i);
         }
     }
+}
+
+static bool
+bench_buffer_test_fits_malloc(struct bench_buffer_test *test)
+{
+    const uint64_t sys_size = (uint64_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
 
-    return dur;
+    /* we need two buffers and leave at least half of the memory alone */
+    return test->size * 2 <= sys_size / 2;
+}
+
+static bool
+bench_buffer_test_fits_mt(struct bench_buffer_test *test, uint32_t mt_idx)
+{
+    struct vk *vk = &test->vk;
+    const VkMemoryType *mt = &vk->mem_props.memoryTypes[mt_idx];
+    const VkMemoryHeap *heap = &vk->mem_props.memoryHeaps[mt->heapIndex];
+
+    if (test->size > vk->vulkan_11_props.maxMemoryAllocationSize)
+        return false;
+
+    /* we need two buffers and leave at least half of the heap alone */
+    return test->size * 2 <= heap->size / 2;
 }
 
 static void
 bench_buffer_test_draw_malloc(struct bench_buffer_test *test)
 {
+    if (!bench_buffer_test_fits_malloc(test))
+        return;
+
     {
         void *mem = malloc(test->size);
         if (!mem)
             vk_die("failed to malloc");
 
-        uint64_t dur = bench_buffer_test_memset(test, mem);
+        struct u_bench_stats stats;
+        bench_buffer_test_memset(test, mem, &stats);
 
         free(mem);
 
-        vk_log("malloc: memset: %d MB/s", bench_buffer_test_calc_throughput_mb(test, dur));
+        bench_buffer_test_report(test, "malloc", "memset", &stats);
     }
 
     {
@@ -357,12 +584,13 @@ bench_buffer_test_draw_malloc(struct bench_buffer_test *test)
         if (!dst || !src)
             vk_die("failed to malloc");
 
-        uint64_t dur = bench_buffer_test_memcpy(test, dst, src);
+        struct u_bench_stats stats;
+        bench_buffer_test_memcpy(test, dst, src, &stats);
 
         free(dst);
         free(src);
 
-        vk_log("malloc: memcpy: %d MB/s", bench_buffer_test_calc_throughput_mb(test, dur));
+        bench_buffer_test_report(test, "malloc", "memcpy", &stats);
     }
 }
 
@@ -372,7 +600,8 @@ bench_buffer_test_draw_mt(struct bench_buffer_test *test, uint32_t mt_idx)
     struct vk *vk = &test->vk;
 
     const VkMemoryType *mt = &vk->mem_props.memoryTypes[mt_idx];
-    if (!(mt->propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+    if (!(mt->propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) ||
+        !bench_buffer_test_fits_mt(test, mt_idx))
         return;
 
     char desc[64];
@@ -390,11 +619,12 @@ bench_buffer_test_draw_mt(struct bench_buffer_test *test, uint32_t mt_idx)
         vk->result = vk->MapMemory2(vk->dev, &map_info, &mem_ptr);
         vk_check(vk, "failed to map memory");
 
-        uint64_t dur = bench_buffer_test_memset(test, mem_ptr);
+        struct u_bench_stats stats;
+        bench_buffer_test_memset(test, mem_ptr, &stats);
 
         vk->FreeMemory(vk->dev, mem, NULL);
 
-        vk_log("%s: memset: %d MB/s", desc, bench_buffer_test_calc_throughput_mb(test, dur));
+        bench_buffer_test_report(test, desc, "memset", &stats);
     }
 
     {
@@ -418,12 +648,13 @@ bench_buffer_test_draw_mt(struct bench_buffer_test *test, uint32_t mt_idx)
         vk->result = vk->MapMemory2(vk->dev, &src_map_info, &src_ptr);
         vk_check(vk, "failed to map memory");
 
-        uint64_t dur = bench_buffer_test_memcpy(test, dst_ptr, src_ptr);
+        struct u_bench_stats stats;
+        bench_buffer_test_memcpy(test, dst_ptr, src_ptr, &stats);
 
         vk->FreeMemory(vk->dev, dst, NULL);
         vk->FreeMemory(vk->dev, src, NULL);
 
-        vk_log("%s: memcpy: %d MB/s", desc, bench_buffer_test_calc_throughput_mb(test, dur));
+        bench_buffer_test_report(test, desc, "memcpy", &stats);
     }
 }
 
@@ -438,60 +669,509 @@ bench_buffer_test_draw_xfer(struct bench_buffer_test *test)
     const uint32_t mt_mask = vk_get_buffer_mt_mask(vk, 0, test->size, usage);
 
     for (uint32_t i = 0; i < vk->mem_props.memoryTypeCount; i++) {
-        if (!(mt_mask & (1 << i)))
+        if (!(mt_mask & (1 << i)) || !bench_buffer_test_fits_mt(test, i))
             continue;
 
         struct vk_buffer *buf = vk_create_buffer_with_mt_mask(vk, 0, test->size, usage, 1 << i);
 
-        const uint64_t dur = bench_buffer_test_fill_buffer(test, buf, 0x7f7f7f7f);
+        struct u_bench_stats stats;
+        bench_buffer_test_fill_buffer(test, buf, 0x7f7f7f7f, &stats);
 
         vk_destroy_buffer(vk, buf);
 
-        vk_log("%s: vkCmdFillBuffer: %d MB/s", bench_buffer_test_describe_mt(test, i, desc),
-               bench_buffer_test_calc_throughput_mb(test, dur));
+        bench_buffer_test_report(test, bench_buffer_test_describe_mt(test, i, desc),
+                                 "vkCmdFillBuffer", &stats);
     }
 
     for (uint32_t i = 0; i < vk->mem_props.memoryTypeCount; i++) {
-        if (!(mt_mask & (1 << i)))
+        if (!(mt_mask & (1 << i)) || !bench_buffer_test_fits_mt(test, i))
             continue;
 
         struct vk_buffer *dst = vk_create_buffer_with_mt_mask(vk, 0, test->size, usage, 1 << i);
         struct vk_buffer *src = vk_create_buffer_with_mt_mask(vk, 0, test->size, usage, 1 << i);
 
-        const uint64_t dur = bench_buffer_test_copy_buffer(test, dst, src, 0x7f7f7f7f);
+        struct u_bench_stats stats;
+        bench_buffer_test_copy_buffer(test, dst, src, 0x7f7f7f7f, &stats);
 
         vk_destroy_buffer(vk, dst);
         vk_destroy_buffer(vk, src);
 
-        vk_log("%s: vkCmdCopyBuffer2: %d MB/s", bench_buffer_test_describe_mt(test, i, desc),
-               bench_buffer_test_calc_throughput_mb(test, dur));
+        bench_buffer_test_report(test, bench_buffer_test_describe_mt(test, i, desc),
+                                 "vkCmdCopyBuffer2", &stats);
     }
 }
 
+static bool
+bench_buffer_test_fits_local_size(struct bench_buffer_test *test, uint32_t local_size)
+{
+    const VkPhysicalDeviceLimits *limits = &test->vk.props.properties.limits;
+
+    /* the workgroup is local_size x local_size */
+    return local_size <= limits->maxComputeWorkGroupSize[0] &&
+           local_size <= limits->maxComputeWorkGroupSize[1] &&
+           local_size * local_size <= limits->maxComputeWorkGroupInvocations;
+}
+
 static void
 bench_buffer_test_draw_compute(struct bench_buffer_test *test)
 {
+    /* local size and element size variations for sweeps */
+    static const struct {
+        uint32_t cs_local_size;
+        uint32_t elem_size;
+    } sweep_variants[] = {
+        { 4, 16 },
+        { 8, 16 },
+        { 16, 16 },
+        { 8, 4 },
+        { 8, 8 },
+    };
     struct vk *vk = &test->vk;
     char desc[64];
 
+    if (test->size > vk->props.properties.limits.maxStorageBufferRange)
+        return;
+
     const VkBufferUsageFlags2 usage =
         VK_BUFFER_USAGE_2_TRANSFER_DST_BIT | VK_BUFFER_USAGE_2_STORAGE_BUFFER_BIT;
     const uint32_t mt_mask = vk_get_buffer_mt_mask(vk, 0, test->size, usage);
 
+    const uint32_t cs_local_size = test->cs_local_size;
+    const uint32_t elem_size = test->elem_size;
+    const uint32_t variant_count = test->sweep ? ARRAY_SIZE(sweep_variants) : 1;
+
     for (uint32_t i = 0; i < vk->mem_props.memoryTypeCount; i++) {
-        if (!(mt_mask & (1 << i)))
+        if (!(mt_mask & (1 << i)) || !bench_buffer_test_fits_mt(test, i))
             continue;
 
         struct vk_buffer *dst = vk_create_buffer_with_mt_mask(vk, 0, test->size, usage, 1 << i);
         struct vk_buffer *src = vk_create_buffer_with_mt_mask(vk, 0, test->size, usage, 1 << i);
 
-        const uint64_t dur = bench_buffer_test_dispatch(test, dst, src, 0x7f7f7f7f);
+        for (uint32_t j = 0; j < variant_count; j++) {
+            if (test->sweep) {
+                test->cs_local_size = sweep_variants[j].cs_local_size;
+                test->elem_size = sweep_variants[j].elem_size;
+            }
+            if (!bench_buffer_test_fits_local_size(test, test->cs_local_size)) {
+                vk_log("skipping compute with local size %ux%u", test->cs_local_size,
+                       test->cs_local_size);
+                continue;
+            }
+
+            struct u_bench_stats stats;
+            bench_buffer_test_dispatch(test, dst, src, 0x7f7f7f7f, &stats);
+
+            bench_buffer_test_report(test, bench_buffer_test_describe_mt(test, i, desc),
+                                     "compute", &stats);
+        }
 
         vk_destroy_buffer(vk, dst);
         vk_destroy_buffer(vk, src);
+    }
+
+    test->cs_local_size = cs_local_size;
+    test->elem_size = elem_size;
+}
+
+/* non-temporal stores bypass the cache hierarchy */
+static void
+bench_buffer_test_memset_nt(void *dst, int val, size_t size)
+{
+#if defined(__SSE2__)
+    const __m128i v = _mm_set1_epi8((char)val);
+    __m128i *d = dst;
+    const size_t count = size / sizeof(*d);
+    for (size_t i = 0; i < count; i++)
+        _mm_stream_si128(&d[i], v);
+    _mm_sfence();
+    memset((char *)dst + count * sizeof(*d), val, size % sizeof(*d));
+#elif defined(__aarch64__)
+    const uint64_t v = 0x0101010101010101ull * (uint8_t)val;
+    uint64_t *d = dst;
+    const size_t count = size / sizeof(uint64_t[2]);
+    for (size_t i = 0; i < count; i++, d += 2)
+        __asm__ volatile("stnp %x0, %x1, [%2]" : : "r"(v), "r"(v), "r"(d) : "memory");
+    memset((char *)dst + count * sizeof(uint64_t[2]), val, size % sizeof(uint64_t[2]));
+#else
+    memset(dst, val, size);
+#endif
+}
+
+static void
+bench_buffer_test_memcpy_nt(void *dst, const void *src, size_t size)
+{
+#if defined(__SSE2__)
+    __m128i *d = dst;
+    const __m128i *s = src;
+    const size_t count = size / sizeof(*d);
+    for (size_t i = 0; i < count; i++)
+        _mm_stream_si128(&d[i], _mm_load_si128(&s[i]));
+    _mm_sfence();
+    memcpy((char *)dst + count * sizeof(*d), (const char *)src + count * sizeof(*d),
+           size % sizeof(*d));
+#elif defined(__aarch64__)
+    const size_t chunk = 32;
+    const size_t count = size / chunk;
+    for (size_t i = 0; i < count; i++) {
+        __asm__ volatile("ldp q0, q1, [%1]\n"
+                         "stnp q0, q1, [%0]\n"
+                         :
+                         : "r"((char *)dst + chunk * i), "r"((const char *)src + chunk * i)
+                         : "v0", "v1", "memory");
+    }
+    memcpy((char *)dst + count * chunk, (const char *)src + count * chunk, size % chunk);
+#else
+    memcpy(dst, src, size);
+#endif
+}
+
+static bool
+bench_buffer_test_has_nt(void)
+{
+#if defined(__SSE2__) || defined(__aarch64__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+static const char *const bench_buffer_test_host_op_names[] = {
+    [BENCH_BUFFER_TEST_HOST_OP_MEMSET] = "memset",
+    [BENCH_BUFFER_TEST_HOST_OP_MEMSET_NT] = "memset-nt",
+    [BENCH_BUFFER_TEST_HOST_OP_MEMCPY] = "memcpy",
+    [BENCH_BUFFER_TEST_HOST_OP_MEMCPY_NT] = "memcpy-nt",
+};
+
+static int
+bench_buffer_test_host_thread(void *arg)
+{
+    struct bench_buffer_test_host_thread *thread = arg;
+    struct bench_buffer_test_host_job *job = thread->job;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(thread->cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set))
+        vk_die("failed to pin thread to cpu %d", thread->cpu);
+
+    atomic_fetch_add(&job->ready, 1);
+    while (!atomic_load(&job->go))
+        ;
+
+    const uint64_t begin = u_now();
+    for (uint32_t i = 0; i < job->loop; i++) {
+        switch (job->op) {
+        case BENCH_BUFFER_TEST_HOST_OP_MEMSET:
+            memset(thread->dst, 0x7f, thread->size);
+            break;
+        case BENCH_BUFFER_TEST_HOST_OP_MEMSET_NT:
+            bench_buffer_test_memset_nt(thread->dst, 0x7f, thread->size);
+            break;
+        case BENCH_BUFFER_TEST_HOST_OP_MEMCPY:
+            memcpy(thread->dst, thread->src, thread->size);
+            break;
+        case BENCH_BUFFER_TEST_HOST_OP_MEMCPY_NT:
+            bench_buffer_test_memcpy_nt(thread->dst, thread->src, thread->size);
+            break;
+        }
+    }
+    const uint64_t end = u_now();
+
+    thread->begin = begin;
+    thread->end = end;
+
+    return 0;
+}
+
+static size_t
+bench_buffer_test_get_host_slice(struct bench_buffer_test *test,
+                                 uint32_t cpu_count,
+                                 uint32_t idx,
+                                 size_t *offset)
+{
+    /* keep slices cacheline-aligned */
+    const size_t slice = ALIGN(DIV_ROUND_UP(test->size, cpu_count), 64);
+
+    *offset = slice * idx;
+    if (*offset >= test->size)
+        return 0;
+
+    return test->size - *offset < slice ? test->size - *offset : slice;
+}
+
+/* splits [dst, dst + size) and [src, src + size) across the cpus and runs op on all of them
+ * concurrently
+ */
+static void
+bench_buffer_test_host_op(struct bench_buffer_test *test,
+                          enum bench_buffer_test_host_op op,
+                          void *dst,
+                          const void *src,
+                          const int *cpus,
+                          uint32_t cpu_count,
+                          struct u_bench_stats *stats,
+                          uint64_t *thread_ns)
+{
+    struct bench_buffer_test_host_job job = {
+        .op = op,
+        .loop = test->loop,
+    };
+    struct bench_buffer_test_host_thread threads[BENCH_BUFFER_TEST_MAX_CPUS];
+
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        size_t offset;
+        const size_t size = bench_buffer_test_get_host_slice(test, cpu_count, i, &offset);
+
+        threads[i] = (struct bench_buffer_test_host_thread){
+            .job = &job,
+            .cpu = cpus[i],
+            .dst = (char *)dst + offset,
+            .src = src ? (const char *)src + offset : NULL,
+            .size = size,
+        };
+        thread_ns[i] = 0;
+    }
+
+    struct u_bench bench;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        atomic_init(&job.ready, 0);
+        atomic_init(&job.go, false);
+
+        for (uint32_t i = 0; i < cpu_count; i++) {
+            if (thrd_create(&threads[i].thrd, bench_buffer_test_host_thread, &threads[i]) !=
+                thrd_success)
+                vk_die("failed to create thread");
+        }
+
+        /* release all threads at once after they are pinned */
+        while (atomic_load(&job.ready) < cpu_count)
+            ;
+        atomic_store(&job.go, true);
+
+        uint64_t begin = UINT64_MAX;
+        uint64_t end = 0;
+        for (uint32_t i = 0; i < cpu_count; i++) {
+            thrd_join(threads[i].thrd, NULL);
+
+            if (begin > threads[i].begin)
+                begin = threads[i].begin;
+            if (end < threads[i].end)
+                end = threads[i].end;
+
+            thread_ns[i] += threads[i].end - threads[i].begin;
+        }
+
+        u_bench_add(&bench, end - begin);
+    }
+    u_bench_finish(&bench, stats);
+
+    /* average per-thread time over all iterations, warmups included */
+    for (uint32_t i = 0; i < cpu_count; i++)
+        thread_ns[i] /= bench.iter;
+}
 
-        vk_log("%s: compute: %d MB/s", bench_buffer_test_describe_mt(test, i, desc),
-               bench_buffer_test_calc_throughput_mb(test, dur));
+static void
+bench_buffer_test_report_host_op(struct bench_buffer_test *test,
+                                 const char *desc,
+                                 enum bench_buffer_test_host_op op,
+                                 const char *cpu_desc,
+                                 const int *cpus,
+                                 uint32_t cpu_count,
+                                 const struct u_bench_stats *stats,
+                                 const uint64_t *thread_ns)
+{
+    const char *op_name = bench_buffer_test_host_op_names[op];
+    const uint32_t mb = bench_buffer_test_calc_throughput_mb(test, stats->median);
+
+    char str[128];
+    vk_log("%s: %s: %s: %u threads: %d MB/s (%s)", desc, op_name, cpu_desc, cpu_count, mb,
+           u_bench_stats_to_str(stats, str, sizeof(str)));
+
+    const uint64_t ns_per_s = 1000000000;
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        size_t offset;
+        const size_t size = bench_buffer_test_get_host_slice(test, cpu_count, i, &offset);
+        if (!thread_ns[i])
+            continue;
+
+        const uint64_t bytes = (uint64_t)size * test->loop;
+        const uint32_t mb = bytes * ns_per_s / thread_ns[i] / 1024 / 1024;
+        vk_log("  cpu %d: %d MB/s", cpus[i], mb);
+    }
+
+    struct u_result *res = &test->result;
+    u_result_clear_params(res);
+    u_result_set_param(res, "op", "%s", op_name);
+    u_result_set_param(res, "memory", "%s", desc);
+    u_result_set_param(res, "size", "%" PRIu64, (uint64_t)test->size);
+    u_result_set_param(res, "loop", "%u", test->loop);
+    u_result_set_param(res, "cpus", "%s", cpu_desc);
+    u_result_set_param(res, "threads", "%u", cpu_count);
+    u_result_add(res, "throughput", mb, "MB/s");
+    u_result_add_bench_stats(res, "time", stats);
+}
+
+static void
+bench_buffer_test_draw_host_ops(struct bench_buffer_test *test,
+                                const char *desc,
+                                void *dst,
+                                void *src,
+                                const int *cpus,
+                                uint32_t cpu_count,
+                                const char *cpu_desc)
+{
+    memset(src, 0x7f, test->size);
+
+    for (uint32_t op = 0; op < ARRAY_SIZE(bench_buffer_test_host_op_names); op++) {
+        const bool nt = op == BENCH_BUFFER_TEST_HOST_OP_MEMSET_NT ||
+                        op == BENCH_BUFFER_TEST_HOST_OP_MEMCPY_NT;
+        const bool copy =
+            op == BENCH_BUFFER_TEST_HOST_OP_MEMCPY || op == BENCH_BUFFER_TEST_HOST_OP_MEMCPY_NT;
+        if (nt && !bench_buffer_test_has_nt())
+            continue;
+
+        struct u_bench_stats stats;
+        uint64_t thread_ns[BENCH_BUFFER_TEST_MAX_CPUS];
+        bench_buffer_test_host_op(test, op, dst, copy ? src : NULL, cpus, cpu_count, &stats,
+                                  thread_ns);
+        bench_buffer_test_report_host_op(test, desc, op, cpu_desc, cpus, cpu_count, &stats,
+                                         thread_ns);
+    }
+}
+
+static void
+bench_buffer_test_draw_host_cpus(struct bench_buffer_test *test,
+                                 const int *cpus,
+                                 uint32_t cpu_count,
+                                 const char *cpu_desc)
+{
+    struct vk *vk = &test->vk;
+    char desc[64];
+
+    if (bench_buffer_test_fits_malloc(test)) {
+        void *dst = malloc(test->size);
+        void *src = malloc(test->size);
+        if (!dst || !src)
+            vk_die("failed to malloc");
+
+        bench_buffer_test_draw_host_ops(test, "malloc", dst, src, cpus, cpu_count, cpu_desc);
+
+        free(dst);
+        free(src);
+    }
+
+    for (uint32_t i = 0; i < vk->mem_props.memoryTypeCount; i++) {
+        const VkMemoryType *mt = &vk->mem_props.memoryTypes[i];
+        if (!(mt->propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) ||
+            !bench_buffer_test_fits_mt(test, i))
+            continue;
+
+        VkDeviceMemory mems[2];
+        void *ptrs[2];
+        for (uint32_t j = 0; j < ARRAY_SIZE(mems); j++) {
+            mems[j] = vk_alloc_memory(vk, test->size, i);
+
+            const VkMemoryMapInfo map_info = {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_MAP_INFO,
+                .memory = mems[j],
+                .size = test->size,
+            };
+            vk->result = vk->MapMemory2(vk->dev, &map_info, &ptrs[j]);
+            vk_check(vk, "failed to map memory");
+        }
+
+        bench_buffer_test_draw_host_ops(test, bench_buffer_test_describe_mt(test, i, desc),
+                                        ptrs[0], ptrs[1], cpus, cpu_count, cpu_desc);
+
+        for (uint32_t j = 0; j < ARRAY_SIZE(mems); j++)
+            vk->FreeMemory(vk->dev, mems[j], NULL);
+    }
+}
+
+static uint32_t
+bench_buffer_test_get_cpu_max_freq(int cpu)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return 0;
+
+    unsigned int khz = 0;
+    if (fscanf(fp, "%u", &khz) != 1)
+        khz = 0;
+    fclose(fp);
+
+    return khz;
+}
+
+static void
+bench_buffer_test_threads(struct bench_buffer_test *test)
+{
+    int cpus[BENCH_BUFFER_TEST_MAX_CPUS];
+    uint32_t freqs[BENCH_BUFFER_TEST_MAX_CPUS];
+    uint32_t cpu_count = 0;
+
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set))
+        vk_die("failed to get cpu affinity");
+    for (int cpu = 0; cpu < CPU_SETSIZE && cpu_count < ARRAY_SIZE(cpus); cpu++) {
+        if (!CPU_ISSET(cpu, &set))
+            continue;
+        cpus[cpu_count] = cpu;
+        freqs[cpu_count] = bench_buffer_test_get_cpu_max_freq(cpu);
+        cpu_count++;
+    }
+
+    /* sort by max freq, fastest first; cpus with the same max freq form a cluster */
+    for (uint32_t i = 1; i < cpu_count; i++) {
+        for (uint32_t j = i; j > 0 && freqs[j - 1] < freqs[j]; j--) {
+            const int cpu = cpus[j];
+            const uint32_t freq = freqs[j];
+            cpus[j] = cpus[j - 1];
+            freqs[j] = freqs[j - 1];
+            cpus[j - 1] = cpu;
+            freqs[j - 1] = freq;
+        }
+    }
+
+    char cpu_desc[64];
+    if (test->thread_count) {
+        if (test->thread_count > cpu_count)
+            vk_die("only %u cpus are available", cpu_count);
+
+        snprintf(cpu_desc, sizeof(cpu_desc), "fastest %u cpus", test->thread_count);
+        bench_buffer_test_draw_host_cpus(test, cpus, test->thread_count, cpu_desc);
+        return;
+    }
+
+    /* one thread on the fastest cpu as the baseline */
+    snprintf(cpu_desc, sizeof(cpu_desc), "cpu %d", cpus[0]);
+    bench_buffer_test_draw_host_cpus(test, cpus, 1, cpu_desc);
+
+    uint32_t cluster_count = 0;
+    for (uint32_t begin = 0; begin < cpu_count;) {
+        uint32_t end = begin + 1;
+        while (end < cpu_count && freqs[end] == freqs[begin])
+            end++;
+
+        if (freqs[begin]) {
+            snprintf(cpu_desc, sizeof(cpu_desc), "cluster %u (%u MHz)", cluster_count,
+                     freqs[begin] / 1000);
+        } else {
+            snprintf(cpu_desc, sizeof(cpu_desc), "cluster %u", cluster_count);
+        }
+        bench_buffer_test_draw_host_cpus(test, &cpus[begin], end - begin, cpu_desc);
+
+        cluster_count++;
+        begin = end;
+    }
+
+    if (cluster_count > 1) {
+        snprintf(cpu_desc, sizeof(cpu_desc), "all cpus");
+        bench_buffer_test_draw_host_cpus(test, cpus, cpu_count, cpu_desc);
     }
 }
 
@@ -509,6 +1189,66 @@ bench_buffer_test_draw(struct bench_buffer_test *test)
     bench_buffer_test_draw_compute(test);
 }
 
+static void
+bench_buffer_test_log_curves(struct bench_buffer_test *test, uint32_t point_count)
+{
+    /* flag drops of this much or more between adjacent sizes */
+    const float cliff_ratio = 0.75f;
+
+    for (uint32_t i = 0; i < test->curve_count; i++) {
+        const struct bench_buffer_test_curve *curve = &test->curves[i];
+
+        if (curve->elem_size) {
+            vk_log("%s: %s (local size %ux%u, elem size %u):", curve->desc, curve->op,
+                   curve->cs_local_size, curve->cs_local_size, curve->elem_size);
+        } else {
+            vk_log("%s: %s:", curve->desc, curve->op);
+        }
+
+        VkDeviceSize size = test->sweep_min_size;
+        uint32_t prev_mb = 0;
+        for (uint32_t j = 0; j < point_count; j++, size *= 2) {
+            const uint32_t mb = curve->mb[j];
+            if (!mb)
+                continue;
+
+            char size_desc[32];
+            const bool cliff = prev_mb && (float)mb < (float)prev_mb * cliff_ratio;
+            vk_log("  %10s: %8d MB/s%s", bench_buffer_test_describe_size(size, size_desc), mb,
+                   cliff ? "  <- cliff" : "");
+
+            prev_mb = mb;
+        }
+    }
+}
+
+static void
+bench_buffer_test_sweep(struct bench_buffer_test *test)
+{
+    const VkDeviceSize size = test->size;
+    const uint32_t loop = test->loop;
+
+    test->sweep_idx = 0;
+    for (VkDeviceSize sz = test->sweep_min_size; sz <= test->sweep_max_size; sz *= 2) {
+        VkDeviceSize sz_loop = test->sweep_bytes / sz;
+        if (sz_loop < 1)
+            sz_loop = 1;
+        else if (sz_loop > test->sweep_max_loop)
+            sz_loop = test->sweep_max_loop;
+
+        test->size = sz;
+        test->loop = (uint32_t)sz_loop;
+        bench_buffer_test_draw(test);
+
+        test->sweep_idx++;
+    }
+
+    bench_buffer_test_log_curves(test, test->sweep_idx);
+
+    test->size = size;
+    test->loop = loop;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -518,10 +1258,56 @@ main(int argc, char **argv)
         .loop = 32,
 
         .cs_local_size = 8,
+
+        .sweep_min_size = 4 * 1024,
+        .sweep_max_size = 4ull * 1024 * 1024 * 1024,
+        .sweep_bytes = 256 * 1024 * 1024,
+        .sweep_max_loop = 1024,
+
+        .bench_params = {
+            .warmup = 1,
+            .min_repeat = 5,
+            .max_repeat = 30,
+            .max_cv = 0.02f,
+        },
     };
 
+    if (argc > 1 && !strcmp(argv[1], "threads")) {
+        if (argc > 3)
+            vk_die("usage: %s threads [<thread-count>]", argv[0]);
+
+        test.threads = true;
+        if (argc == 3)
+            test.thread_count = atoi(argv[2]);
+    } else if (argc > 1) {
+        if (strcmp(argv[1], "sweep") || (argc != 2 && argc != 4))
+            vk_die("usage: %s [sweep [<min-size> <max-size>] | threads [<thread-count>]]",
+                   argv[0]);
+
+        test.sweep = true;
+        if (argc == 4) {
+            test.sweep_min_size = strtoull(argv[2], NULL, 0);
+            test.sweep_max_size = strtoull(argv[3], NULL, 0);
+        }
+
+        if (!test.sweep_min_size || test.sweep_min_size % test.elem_size ||
+            test.sweep_min_size > test.sweep_max_size)
+            vk_die("bad sweep sizes");
+
+        uint32_t point_count = 0;
+        for (VkDeviceSize sz = test.sweep_min_size; sz <= test.sweep_max_size; sz *= 2)
+            point_count++;
+        if (point_count > ARRAY_SIZE(test.curves->mb))
+            vk_die("too many sweep sizes");
+    }
+
     bench_buffer_test_init(&test);
-    bench_buffer_test_draw(&test);
+    if (test.sweep)
+        bench_buffer_test_sweep(&test);
+    else if (test.threads)
+        bench_buffer_test_threads(&test);
+    else
+        bench_buffer_test_draw(&test);
     bench_buffer_test_cleanup(&test);
 
     return 0;
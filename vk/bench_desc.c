@@ -0,0 +1,425 @@
+/*
+ * Copyright 2025 Google LLC
+ * SPDX-License-Identifier: MIT
+ */
+
+/* This test measures the cpu cost of descriptor updates through the different update paths, and
+ * of allocating sets from growable per-thread descriptor allocators.
+ */
+
+#include "vkutil.h"
+
+#define BENCH_DESC_TEST_BINDING_COUNT 8
+
+enum bench_desc_test_mode {
+    /* one UpdateDescriptorSets per descriptor */
+    BENCH_DESC_TEST_MODE_WRITE,
+    /* one UpdateDescriptorSets per set, as desc_buf does */
+    BENCH_DESC_TEST_MODE_BATCH,
+    BENCH_DESC_TEST_MODE_TEMPLATE,
+    BENCH_DESC_TEST_MODE_PUSH,
+    BENCH_DESC_TEST_MODE_PUSH_TEMPLATE,
+    BENCH_DESC_TEST_MODE_COUNT,
+};
+
+struct bench_desc_test_thread {
+    struct bench_desc_test *test;
+    struct vk_descriptor_allocator alloc;
+};
+
+struct bench_desc_test {
+    uint32_t set_count;
+    uint32_t pool_max_sets;
+
+    struct u_bench_params bench_params;
+
+    struct vk vk;
+    struct u_result result;
+
+    struct vk_buffer *buf;
+    VkDescriptorBufferInfo buf_infos[BENCH_DESC_TEST_BINDING_COUNT];
+    VkWriteDescriptorSet writes[BENCH_DESC_TEST_BINDING_COUNT];
+
+    VkDescriptorSetLayout set_layout;
+    VkDescriptorSetLayout push_set_layout;
+    VkPipelineLayout pipeline_layout;
+    VkDescriptorUpdateTemplate update_template;
+    VkDescriptorUpdateTemplate push_update_template;
+
+    struct vk_descriptor_allocator alloc;
+    VkDescriptorSet *sets;
+
+    uint32_t thread_count;
+    struct bench_desc_test_thread *threads;
+};
+
+static const char *
+bench_desc_test_mode_to_str(enum bench_desc_test_mode mode)
+{
+    switch (mode) {
+    case BENCH_DESC_TEST_MODE_WRITE:
+        return "write";
+    case BENCH_DESC_TEST_MODE_BATCH:
+        return "batch";
+    case BENCH_DESC_TEST_MODE_TEMPLATE:
+        return "template";
+    case BENCH_DESC_TEST_MODE_PUSH:
+        return "push";
+    case BENCH_DESC_TEST_MODE_PUSH_TEMPLATE:
+        return "push-template";
+    default:
+        vk_die("unknown mode");
+    }
+}
+
+static VkDescriptorType
+bench_desc_test_get_type(uint32_t binding)
+{
+    return binding % 2 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+}
+
+static void
+bench_desc_test_init_buffer(struct bench_desc_test *test)
+{
+    struct vk *vk = &test->vk;
+    const VkPhysicalDeviceLimits *limits = &vk->props.properties.limits;
+
+    const VkDeviceSize range = 256;
+    VkDeviceSize size = 0;
+    for (uint32_t i = 0; i < BENCH_DESC_TEST_BINDING_COUNT; i++) {
+        const bool ubo = bench_desc_test_get_type(i) == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        const VkDeviceSize align = ubo ? limits->minUniformBufferOffsetAlignment
+                                       : limits->minStorageBufferOffsetAlignment;
+        size = ALIGN(size, align);
+        test->buf_infos[i] = (VkDescriptorBufferInfo){
+            .offset = size,
+            .range = range,
+        };
+        size += range;
+    }
+
+    test->buf = vk_create_buffer(vk, 0, size,
+                                 VK_BUFFER_USAGE_2_UNIFORM_BUFFER_BIT |
+                                     VK_BUFFER_USAGE_2_STORAGE_BUFFER_BIT);
+    for (uint32_t i = 0; i < BENCH_DESC_TEST_BINDING_COUNT; i++) {
+        test->buf_infos[i].buffer = test->buf->buf;
+        test->writes[i] = (VkWriteDescriptorSet){
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstBinding = i,
+            .descriptorCount = 1,
+            .descriptorType = bench_desc_test_get_type(i),
+            .pBufferInfo = &test->buf_infos[i],
+        };
+    }
+}
+
+static void
+bench_desc_test_init_layouts(struct bench_desc_test *test)
+{
+    struct vk *vk = &test->vk;
+
+    VkDescriptorSetLayoutBinding bindings[BENCH_DESC_TEST_BINDING_COUNT];
+    VkDescriptorUpdateTemplateEntry entries[BENCH_DESC_TEST_BINDING_COUNT];
+    for (uint32_t i = 0; i < BENCH_DESC_TEST_BINDING_COUNT; i++) {
+        bindings[i] = (VkDescriptorSetLayoutBinding){
+            .binding = i,
+            .descriptorType = bench_desc_test_get_type(i),
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        };
+        entries[i] = (VkDescriptorUpdateTemplateEntry){
+            .dstBinding = i,
+            .descriptorCount = 1,
+            .descriptorType = bench_desc_test_get_type(i),
+            .offset = sizeof(test->buf_infos[0]) * i,
+            .stride = sizeof(test->buf_infos[0]),
+        };
+    }
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = ARRAY_SIZE(bindings),
+        .pBindings = bindings,
+    };
+    vk->result =
+        vk->CreateDescriptorSetLayout(vk->dev, &set_layout_info, NULL, &test->set_layout);
+    vk_check(vk, "failed to create descriptor set layout");
+
+    set_layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT;
+    vk->result =
+        vk->CreateDescriptorSetLayout(vk->dev, &set_layout_info, NULL, &test->push_set_layout);
+    vk_check(vk, "failed to create push descriptor set layout");
+
+    const VkPipelineLayoutCreateInfo pipeline_layout_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &test->push_set_layout,
+    };
+    vk->result =
+        vk->CreatePipelineLayout(vk->dev, &pipeline_layout_info, NULL, &test->pipeline_layout);
+    vk_check(vk, "failed to create pipeline layout");
+
+    VkDescriptorUpdateTemplateCreateInfo template_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO,
+        .descriptorUpdateEntryCount = ARRAY_SIZE(entries),
+        .pDescriptorUpdateEntries = entries,
+        .templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET,
+        .descriptorSetLayout = test->set_layout,
+    };
+    vk->result = vk->CreateDescriptorUpdateTemplate(vk->dev, &template_info, NULL,
+                                                    &test->update_template);
+    vk_check(vk, "failed to create descriptor update template");
+
+    template_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS;
+    template_info.descriptorSetLayout = VK_NULL_HANDLE;
+    template_info.pipelineBindPoint = VK_PIPELINE_BIND_POINT_COMPUTE;
+    template_info.pipelineLayout = test->pipeline_layout;
+    template_info.set = 0;
+    vk->result = vk->CreateDescriptorUpdateTemplate(vk->dev, &template_info, NULL,
+                                                    &test->push_update_template);
+    vk_check(vk, "failed to create push descriptor update template");
+}
+
+static void
+bench_desc_test_init(struct bench_desc_test *test)
+{
+    struct vk *vk = &test->vk;
+
+    vk_init(vk, NULL);
+    vk_init_result(vk, &test->result, "bench_desc");
+
+    if (!vk->vulkan_14_features.pushDescriptor)
+        vk_die("no push descriptor");
+
+    bench_desc_test_init_buffer(test);
+    bench_desc_test_init_layouts(test);
+
+    /* small pools such that the allocator has to chain them */
+    const uint32_t desc_count = test->pool_max_sets * BENCH_DESC_TEST_BINDING_COUNT;
+    vk_init_descriptor_allocator(vk, &test->alloc, test->pool_max_sets, desc_count);
+
+    test->sets = malloc(sizeof(*test->sets) * test->set_count);
+    if (!test->sets)
+        vk_die("failed to alloc sets");
+    for (uint32_t i = 0; i < test->set_count; i++)
+        test->sets[i] = vk_alloc_descriptor_set(vk, &test->alloc, test->set_layout);
+
+    test->thread_count = u_parallel_get_thread_count();
+    test->threads = calloc(test->thread_count, sizeof(*test->threads));
+    if (!test->threads)
+        vk_die("failed to alloc threads");
+    for (uint32_t i = 0; i < test->thread_count; i++) {
+        struct bench_desc_test_thread *thread = &test->threads[i];
+        thread->test = test;
+        vk_init_descriptor_allocator(vk, &thread->alloc, test->pool_max_sets, desc_count);
+    }
+}
+
+static void
+bench_desc_test_cleanup(struct bench_desc_test *test)
+{
+    struct vk *vk = &test->vk;
+
+    for (uint32_t i = 0; i < test->thread_count; i++)
+        vk_cleanup_descriptor_allocator(vk, &test->threads[i].alloc);
+    free(test->threads);
+
+    free(test->sets);
+    vk_cleanup_descriptor_allocator(vk, &test->alloc);
+
+    vk->DestroyDescriptorUpdateTemplate(vk->dev, test->push_update_template, NULL);
+    vk->DestroyDescriptorUpdateTemplate(vk->dev, test->update_template, NULL);
+    vk->DestroyPipelineLayout(vk->dev, test->pipeline_layout, NULL);
+    vk->DestroyDescriptorSetLayout(vk->dev, test->push_set_layout, NULL);
+    vk->DestroyDescriptorSetLayout(vk->dev, test->set_layout, NULL);
+
+    vk_destroy_buffer(vk, test->buf);
+
+    u_result_cleanup(&test->result);
+    vk_cleanup(vk);
+}
+
+static void
+bench_desc_test_update(struct bench_desc_test *test,
+                       enum bench_desc_test_mode mode,
+                       VkCommandBuffer cmd)
+{
+    struct vk *vk = &test->vk;
+
+    VkWriteDescriptorSet writes[BENCH_DESC_TEST_BINDING_COUNT];
+    memcpy(writes, test->writes, sizeof(writes));
+
+    for (uint32_t i = 0; i < test->set_count; i++) {
+        const VkDescriptorSet set = test->sets[i];
+
+        switch (mode) {
+        case BENCH_DESC_TEST_MODE_WRITE:
+            for (uint32_t j = 0; j < ARRAY_SIZE(writes); j++) {
+                writes[j].dstSet = set;
+                vk->UpdateDescriptorSets(vk->dev, 1, &writes[j], 0, NULL);
+            }
+            break;
+        case BENCH_DESC_TEST_MODE_BATCH:
+            for (uint32_t j = 0; j < ARRAY_SIZE(writes); j++)
+                writes[j].dstSet = set;
+            vk->UpdateDescriptorSets(vk->dev, ARRAY_SIZE(writes), writes, 0, NULL);
+            break;
+        case BENCH_DESC_TEST_MODE_TEMPLATE:
+            vk->UpdateDescriptorSetWithTemplate(vk->dev, set, test->update_template,
+                                                test->buf_infos);
+            break;
+        case BENCH_DESC_TEST_MODE_PUSH: {
+            const VkPushDescriptorSetInfo push_info = {
+                .sType = VK_STRUCTURE_TYPE_PUSH_DESCRIPTOR_SET_INFO,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                .layout = test->pipeline_layout,
+                .set = 0,
+                .descriptorWriteCount = ARRAY_SIZE(test->writes),
+                .pDescriptorWrites = test->writes,
+            };
+            vk->CmdPushDescriptorSet2(cmd, &push_info);
+            break;
+        }
+        case BENCH_DESC_TEST_MODE_PUSH_TEMPLATE: {
+            const VkPushDescriptorSetWithTemplateInfo push_info = {
+                .sType = VK_STRUCTURE_TYPE_PUSH_DESCRIPTOR_SET_WITH_TEMPLATE_INFO,
+                .descriptorUpdateTemplate = test->push_update_template,
+                .layout = test->pipeline_layout,
+                .set = 0,
+                .pData = test->buf_infos,
+            };
+            vk->CmdPushDescriptorSetWithTemplate2(cmd, &push_info);
+            break;
+        }
+        default:
+            vk_die("unknown mode");
+        }
+    }
+}
+
+static void
+bench_desc_test_report(struct bench_desc_test *test,
+                       const char *mode,
+                       uint32_t thread_count,
+                       uint64_t desc_count,
+                       const struct u_bench_stats *stats)
+{
+    const double descs_per_sec = desc_count * 1000000000.0 / (double)stats->median;
+
+    char str[128];
+    vk_log("%s, %u threads: %.2f M descriptors/s (%s)", mode, thread_count,
+           descs_per_sec / 1000000.0, u_bench_stats_to_str(stats, str, sizeof(str)));
+
+    struct u_result *res = &test->result;
+    u_result_clear_params(res);
+    u_result_set_param(res, "mode", "%s", mode);
+    u_result_set_param(res, "threads", "%u", thread_count);
+    u_result_set_param(res, "set_count", "%u", test->set_count);
+    u_result_add(res, "descs_per_sec", descs_per_sec, "1/s");
+    u_result_add_bench_stats(res, "time", stats);
+}
+
+static void
+bench_desc_test_update_mode(struct bench_desc_test *test, enum bench_desc_test_mode mode)
+{
+    struct vk *vk = &test->vk;
+    const bool push =
+        mode == BENCH_DESC_TEST_MODE_PUSH || mode == BENCH_DESC_TEST_MODE_PUSH_TEMPLATE;
+
+    struct u_bench bench;
+    struct u_bench_stats stats;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        VkCommandBuffer cmd = push ? vk_begin_cmd(vk, false) : VK_NULL_HANDLE;
+
+        const uint64_t begin = u_now();
+        bench_desc_test_update(test, mode, cmd);
+        const uint64_t end = u_now();
+
+        if (push) {
+            vk_end_cmd(vk);
+            vk_wait(vk);
+        }
+
+        u_bench_add(&bench, end - begin);
+    }
+    u_bench_finish(&bench, &stats);
+
+    const uint64_t desc_count = (uint64_t)test->set_count * BENCH_DESC_TEST_BINDING_COUNT;
+    bench_desc_test_report(test, bench_desc_test_mode_to_str(mode), 1, desc_count, &stats);
+}
+
+/* allocates and updates sets from a per-thread allocator, and then resets it as a frame would */
+static void
+bench_desc_test_alloc_threads(void *data, uint32_t begin, uint32_t end)
+{
+    struct bench_desc_test *test = data;
+    struct vk *vk = &test->vk;
+
+    for (uint32_t i = begin; i < end; i++) {
+        struct bench_desc_test_thread *thread = &test->threads[i];
+
+        for (uint32_t j = 0; j < test->set_count; j++) {
+            const VkDescriptorSet set =
+                vk_alloc_descriptor_set(vk, &thread->alloc, test->set_layout);
+            vk->UpdateDescriptorSetWithTemplate(vk->dev, set, test->update_template,
+                                                test->buf_infos);
+        }
+
+        vk_reset_descriptor_allocator(vk, &thread->alloc);
+    }
+}
+
+static void
+bench_desc_test_alloc(struct bench_desc_test *test, uint32_t thread_count)
+{
+    struct u_bench bench;
+    struct u_bench_stats stats;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        const uint64_t begin = u_now();
+        u_parallel_for(thread_count, 1, thread_count, bench_desc_test_alloc_threads, test);
+        const uint64_t end = u_now();
+
+        u_bench_add(&bench, end - begin);
+    }
+    u_bench_finish(&bench, &stats);
+
+    const uint64_t desc_count =
+        (uint64_t)test->set_count * BENCH_DESC_TEST_BINDING_COUNT * thread_count;
+    bench_desc_test_report(test, "alloc-template", thread_count, desc_count, &stats);
+    vk_log("  %u pools of %u sets per thread", test->threads[0].alloc.pool_count,
+           test->pool_max_sets);
+}
+
+static void
+bench_desc_test_all(struct bench_desc_test *test)
+{
+    for (uint32_t i = 0; i < BENCH_DESC_TEST_MODE_COUNT; i++)
+        bench_desc_test_update_mode(test, i);
+
+    bench_desc_test_alloc(test, 1);
+    if (test->thread_count > 1)
+        bench_desc_test_alloc(test, test->thread_count);
+}
+
+int
+main(void)
+{
+    struct bench_desc_test test = {
+        .set_count = 1024,
+        .pool_max_sets = 256,
+        .bench_params = {
+            .warmup = 1,
+            .min_repeat = 5,
+            .max_repeat = 20,
+            .max_cv = 0.05f,
+        },
+    };
+
+    bench_desc_test_init(&test);
+    bench_desc_test_all(&test);
+    bench_desc_test_cleanup(&test);
+
+    return 0;
+}
@@ -26,8 +26,11 @@ struct bench_image_test {
 
     uint32_t cs_local_size;
 
+    struct u_bench_params bench_params;
+
     struct vk vk;
     struct vk_stopwatch *stopwatch;
+    struct u_result result;
 };
 
 static void
@@ -36,6 +39,7 @@ bench_image_test_init(struct bench_image_test *test)
     struct vk *vk = &test->vk;
 
     vk_init(vk, NULL);
+    vk_init_result(vk, &test->result, "bench_image");
 
     test->stopwatch = vk_create_stopwatch(vk, 2);
 }
@@ -45,6 +49,7 @@ bench_image_test_cleanup(struct bench_image_test *test)
 {
     struct vk *vk = &test->vk;
 
+    u_result_cleanup(&test->result);
     vk_destroy_stopwatch(vk, test->stopwatch);
     vk_cleanup(vk);
 }
@@ -82,6 +87,29 @@ bench_image_test_calc_throughput_mb(struct bench_image_test *test, uint64_t dur)
     return bench_image_test_calc_throughput(test, dur) / 1024 / 1024;
 }
 
+static void
+bench_image_test_report(struct bench_image_test *test,
+                        const char *desc,
+                        const char *op,
+                        const struct u_bench_stats *stats)
+{
+    const uint32_t mb = bench_image_test_calc_throughput_mb(test, stats->median);
+
+    char str[128];
+    vk_log("%s: %s: %d MB/s (%s)", desc, op, mb, u_bench_stats_to_str(stats, str, sizeof(str)));
+
+    struct u_result *res = &test->result;
+    u_result_clear_params(res);
+    u_result_set_param(res, "op", "%s", op);
+    u_result_set_param(res, "memory", "%s", desc);
+    u_result_set_param(res, "format", "%d", test->format);
+    u_result_set_param(res, "width", "%u", test->width);
+    u_result_set_param(res, "height", "%u", test->height);
+    u_result_set_param(res, "loop", "%u", test->loop);
+    u_result_add(res, "throughput", mb, "MB/s");
+    u_result_add_bench_stats(res, "time", stats);
+}
+
 static const void *
 bench_image_test_get_image_ptr(struct bench_image_test *test,
                                struct vk_image *img,
@@ -148,8 +176,10 @@ bench_image_test_barrier(struct bench_image_test *test,
     vk->CmdPipelineBarrier2(cmd, &dep_info1);
 }
 
-static uint64_t
-bench_image_test_clear(struct bench_image_test *test, struct vk_image *img)
+static void
+bench_image_test_clear(struct bench_image_test *test,
+                       struct vk_image *img,
+                       struct u_bench_stats *stats)
 {
     struct vk *vk = &test->vk;
 
@@ -171,13 +201,25 @@ bench_image_test_clear(struct bench_image_test *test, struct vk_image *img)
     vk_end_cmd(vk);
     vk_wait(vk);
 
-    cmd = vk_begin_cmd(vk, false);
-    vk_write_stopwatch(vk, test->stopwatch, cmd);
-    for (uint32_t i = 0; i < test->loop; i++) {
-        vk->CmdClearColorImage(cmd, img->img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear_val, 1,
-                               &subres_range);
+    struct u_bench bench;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        cmd = vk_begin_cmd(vk, false);
+        vk_write_stopwatch(vk, test->stopwatch, cmd);
+        for (uint32_t i = 0; i < test->loop; i++) {
+            vk->CmdClearColorImage(cmd, img->img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                   &clear_val, 1, &subres_range);
+        }
+        vk_write_stopwatch(vk, test->stopwatch, cmd);
+        vk_end_cmd(vk);
+        vk_wait(vk);
+
+        u_bench_add(&bench, vk_read_stopwatch(vk, test->stopwatch, 0));
+        vk_reset_stopwatch(vk, test->stopwatch);
     }
-    vk_write_stopwatch(vk, test->stopwatch, cmd);
+    u_bench_finish(&bench, stats);
+
+    cmd = vk_begin_cmd(vk, false);
     bench_image_test_barrier(test, cmd, img, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
                              VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                              VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_HOST_BIT,
@@ -185,9 +227,6 @@ bench_image_test_clear(struct bench_image_test *test, struct vk_image *img)
     vk_end_cmd(vk);
     vk_wait(vk);
 
-    const uint64_t dur = vk_read_stopwatch(vk, test->stopwatch, 0);
-    vk_reset_stopwatch(vk, test->stopwatch);
-
     VkDeviceSize stride;
     const void *ptr = bench_image_test_get_image_ptr(test, img, &stride);
     if (ptr) {
@@ -199,12 +238,13 @@ bench_image_test_clear(struct bench_image_test *test, struct vk_image *img)
             }
         }
     }
-
-    return dur;
 }
 
-static uint64_t
-bench_image_test_copy(struct bench_image_test *test, struct vk_image *dst, struct vk_image *src)
+static void
+bench_image_test_copy(struct bench_image_test *test,
+                      struct vk_image *dst,
+                      struct vk_image *src,
+                      struct u_bench_stats *stats)
 {
     struct vk *vk = &test->vk;
 
@@ -257,12 +297,24 @@ bench_image_test_copy(struct bench_image_test *test, struct vk_image *dst, struc
     vk_end_cmd(vk);
     vk_wait(vk);
 
-    cmd = vk_begin_cmd(vk, false);
-    vk_write_stopwatch(vk, test->stopwatch, cmd);
-    for (uint32_t i = 0; i < test->loop; i++) {
-        vk->CmdCopyImage2(cmd, &copy_info);
+    struct u_bench bench;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        cmd = vk_begin_cmd(vk, false);
+        vk_write_stopwatch(vk, test->stopwatch, cmd);
+        for (uint32_t i = 0; i < test->loop; i++) {
+            vk->CmdCopyImage2(cmd, &copy_info);
+        }
+        vk_write_stopwatch(vk, test->stopwatch, cmd);
+        vk_end_cmd(vk);
+        vk_wait(vk);
+
+        u_bench_add(&bench, vk_read_stopwatch(vk, test->stopwatch, 0));
+        vk_reset_stopwatch(vk, test->stopwatch);
     }
-    vk_write_stopwatch(vk, test->stopwatch, cmd);
+    u_bench_finish(&bench, stats);
+
+    cmd = vk_begin_cmd(vk, false);
     bench_image_test_barrier(test, cmd, dst, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
                              VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                              VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_HOST_BIT,
@@ -270,9 +322,6 @@ bench_image_test_copy(struct bench_image_test *test, struct vk_image *dst, struc
     vk_end_cmd(vk);
     vk_wait(vk);
 
-    const uint64_t dur = vk_read_stopwatch(vk, test->stopwatch, 0);
-    vk_reset_stopwatch(vk, test->stopwatch);
-
     VkDeviceSize stride;
     const void *ptr = bench_image_test_get_image_ptr(test, dst, &stride);
     if (ptr) {
@@ -284,14 +333,13 @@ bench_image_test_copy(struct bench_image_test *test, struct vk_image *dst, struc
             }
         }
     }
-
-    return dur;
 }
 
-static uint64_t
+static void
 bench_image_test_copy_buffer(struct bench_image_test *test,
                              struct vk_image *dst,
-                             struct vk_buffer *src)
+                             struct vk_buffer *src,
+                             struct u_bench_stats *stats)
 {
     struct vk *vk = &test->vk;
 
@@ -345,12 +393,24 @@ bench_image_test_copy_buffer(struct bench_image_test *test,
     vk_end_cmd(vk);
     vk_wait(vk);
 
-    cmd = vk_begin_cmd(vk, false);
-    vk_write_stopwatch(vk, test->stopwatch, cmd);
-    for (uint32_t i = 0; i < test->loop; i++) {
-        vk->CmdCopyBufferToImage2(cmd, &copy_info);
+    struct u_bench bench;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        cmd = vk_begin_cmd(vk, false);
+        vk_write_stopwatch(vk, test->stopwatch, cmd);
+        for (uint32_t i = 0; i < test->loop; i++) {
+            vk->CmdCopyBufferToImage2(cmd, &copy_info);
+        }
+        vk_write_stopwatch(vk, test->stopwatch, cmd);
+        vk_end_cmd(vk);
+        vk_wait(vk);
+
+        u_bench_add(&bench, vk_read_stopwatch(vk, test->stopwatch, 0));
+        vk_reset_stopwatch(vk, test->stopwatch);
     }
-    vk_write_stopwatch(vk, test->stopwatch, cmd);
+    u_bench_finish(&bench, stats);
+
+    cmd = vk_begin_cmd(vk, false);
     bench_image_test_barrier(test, cmd, dst, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
                              VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                              VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_HOST_BIT,
@@ -358,9 +418,6 @@ bench_image_test_copy_buffer(struct bench_image_test *test,
     vk_end_cmd(vk);
     vk_wait(vk);
 
-    const uint64_t dur = vk_read_stopwatch(vk, test->stopwatch, 0);
-    vk_reset_stopwatch(vk, test->stopwatch);
-
     VkDeviceSize stride;
     const void *ptr = bench_image_test_get_image_ptr(test, dst, &stride);
     if (ptr) {
@@ -372,14 +429,13 @@ bench_image_test_copy_buffer(struct bench_image_test *test,
             }
         }
     }
-
-    return dur;
 }
 
-static uint64_t
+static void
 bench_image_test_dispatch(struct bench_image_test *test,
                           struct vk_image *dst,
-                          struct vk_image *src)
+                          struct vk_image *src,
+                          struct u_bench_stats *stats)
 {
     struct vk *vk = &test->vk;
     struct vk_pipeline *pipeline;
@@ -486,13 +542,25 @@ bench_image_test_dispatch(struct bench_image_test *test,
     vk_end_cmd(vk);
     vk_wait(vk);
 
+    struct u_bench bench;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        cmd = vk_begin_cmd(vk, false);
+        vk_bind_pipeline(vk, pipeline, cmd);
+        vk->CmdBindDescriptorSets2(cmd, &comp_bind_info);
+        vk_write_stopwatch(vk, test->stopwatch, cmd);
+        for (uint32_t i = 0; i < test->loop; i++)
+            vk->CmdDispatch(cmd, group_count_x, group_count_y, 1);
+        vk_write_stopwatch(vk, test->stopwatch, cmd);
+        vk_end_cmd(vk);
+        vk_wait(vk);
+
+        u_bench_add(&bench, vk_read_stopwatch(vk, test->stopwatch, 0));
+        vk_reset_stopwatch(vk, test->stopwatch);
+    }
+    u_bench_finish(&bench, stats);
+
     cmd = vk_begin_cmd(vk, false);
-    vk_bind_pipeline(vk, pipeline, cmd);
-    vk->CmdBindDescriptorSets2(cmd, &comp_bind_info);
-    vk_write_stopwatch(vk, test->stopwatch, cmd);
-    for (uint32_t i = 0; i < test->loop; i++)
-        vk->CmdDispatch(cmd, group_count_x, group_count_y, 1);
-    vk_write_stopwatch(vk, test->stopwatch, cmd);
     bench_image_test_barrier(test, cmd, dst, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
                              VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL,
                              VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_HOST_BIT,
@@ -503,9 +571,6 @@ bench_image_test_dispatch(struct bench_image_test *test,
     vk_destroy_pipeline(vk, pipeline);
     vk_destroy_descriptor_set(vk, set);
 
-    const uint64_t dur = vk_read_stopwatch(vk, test->stopwatch, 0);
-    vk_reset_stopwatch(vk, test->stopwatch);
-
     VkDeviceSize stride;
     const void *ptr = bench_image_test_get_image_ptr(test, dst, &stride);
     if (ptr) {
@@ -517,14 +582,13 @@ bench_image_test_dispatch(struct bench_image_test *test,
             }
         }
     }
-
-    return dur;
 }
 
-static uint64_t
+static void
 bench_image_test_render_pass(struct bench_image_test *test,
                              struct vk_image *dst,
-                             struct vk_image *src)
+                             struct vk_image *src,
+                             struct u_bench_stats *stats)
 {
     struct vk *vk = &test->vk;
     struct vk_pipeline *pipeline;
@@ -623,15 +687,27 @@ bench_image_test_render_pass(struct bench_image_test *test,
     vk_end_cmd(vk);
     vk_wait(vk);
 
+    struct u_bench bench;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        cmd = vk_begin_cmd(vk, false);
+        vk_bind_pipeline(vk, pipeline, cmd);
+        vk->CmdBindDescriptorSets2(cmd, &gfx_bind_info);
+        vk_write_stopwatch(vk, test->stopwatch, cmd);
+        vk->CmdBeginRendering(cmd, &rendering_info);
+        for (uint32_t i = 0; i < test->loop; i++)
+            vk->CmdDraw(cmd, 4, 1, 0, 0);
+        vk->CmdEndRendering(cmd);
+        vk_write_stopwatch(vk, test->stopwatch, cmd);
+        vk_end_cmd(vk);
+        vk_wait(vk);
+
+        u_bench_add(&bench, vk_read_stopwatch(vk, test->stopwatch, 0));
+        vk_reset_stopwatch(vk, test->stopwatch);
+    }
+    u_bench_finish(&bench, stats);
+
     cmd = vk_begin_cmd(vk, false);
-    vk_bind_pipeline(vk, pipeline, cmd);
-    vk->CmdBindDescriptorSets2(cmd, &gfx_bind_info);
-    vk_write_stopwatch(vk, test->stopwatch, cmd);
-    vk->CmdBeginRendering(cmd, &rendering_info);
-    for (uint32_t i = 0; i < test->loop; i++)
-        vk->CmdDraw(cmd, 4, 1, 0, 0);
-    vk->CmdEndRendering(cmd);
-    vk_write_stopwatch(vk, test->stopwatch, cmd);
     bench_image_test_barrier(test, cmd, dst, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
                              VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
                              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL,
@@ -642,9 +718,6 @@ bench_image_test_render_pass(struct bench_image_test *test,
     vk_destroy_pipeline(vk, pipeline);
     vk_destroy_descriptor_set(vk, set);
 
-    const uint64_t dur = vk_read_stopwatch(vk, test->stopwatch, 0);
-    vk_reset_stopwatch(vk, test->stopwatch);
-
     VkDeviceSize stride;
     const void *ptr = bench_image_test_get_image_ptr(test, dst, &stride);
     if (ptr) {
@@ -656,8 +729,6 @@ bench_image_test_render_pass(struct bench_image_test *test,
             }
         }
     }
-
-    return dur;
 }
 
 static void
@@ -702,13 +773,13 @@ bench_image_test_draw_clear(struct bench_image_test *test, VkImageTiling tiling)
 
         struct vk_image *img = vk_create_image_with_mt_mask(vk, &info, 1 << i);
 
-        const uint64_t dur = bench_image_test_clear(test, img);
+        struct u_bench_stats stats;
+        bench_image_test_clear(test, img, &stats);
 
         vk_destroy_image(vk, img);
 
-        vk_log("%s: vkCmdClearColorImage: %d MB/s",
-               bench_image_test_describe_mt(test, tiling, i, desc),
-               bench_image_test_calc_throughput_mb(test, dur));
+        bench_image_test_report(test, bench_image_test_describe_mt(test, tiling, i, desc),
+                                "vkCmdClearColorImage", &stats);
     }
 }
 
@@ -732,14 +803,14 @@ bench_image_test_draw_copy(struct bench_image_test *test, VkImageTiling tiling)
         struct vk_image *dst = vk_create_image_with_mt_mask(vk, &info, 1 << i);
         struct vk_image *src = vk_create_image_with_mt_mask(vk, &info, 1 << i);
 
-        const uint64_t dur = bench_image_test_copy(test, dst, src);
+        struct u_bench_stats stats;
+        bench_image_test_copy(test, dst, src, &stats);
 
         vk_destroy_image(vk, dst);
         vk_destroy_image(vk, src);
 
-        vk_log("%s: vkCmdCopyImage2: %d MB/s",
-               bench_image_test_describe_mt(test, tiling, i, desc),
-               bench_image_test_calc_throughput_mb(test, dur));
+        bench_image_test_report(test, bench_image_test_describe_mt(test, tiling, i, desc),
+                                "vkCmdCopyImage2", &stats);
     }
 }
 
@@ -766,14 +837,14 @@ bench_image_test_draw_copy_buffer(struct bench_image_test *test, VkImageTiling t
         struct vk_image *dst = vk_create_image_with_mt_mask(vk, &dst_info, 1 << i);
         struct vk_buffer *src = vk_create_buffer_with_mt_mask(vk, 0, src_size, src_usage, 1 << i);
 
-        const uint64_t dur = bench_image_test_copy_buffer(test, dst, src);
+        struct u_bench_stats stats;
+        bench_image_test_copy_buffer(test, dst, src, &stats);
 
         vk_destroy_image(vk, dst);
         vk_destroy_buffer(vk, src);
 
-        vk_log("%s: vkCmdCopyBufferToImage2: %d MB/s",
-               bench_image_test_describe_mt(test, tiling, i, desc),
-               bench_image_test_calc_throughput_mb(test, dur));
+        bench_image_test_report(test, bench_image_test_describe_mt(test, tiling, i, desc),
+                                "vkCmdCopyBufferToImage2", &stats);
     }
 }
 
@@ -798,13 +869,14 @@ bench_image_test_draw_compute(struct bench_image_test *test, VkImageTiling tilin
         vk_create_image_render_view(vk, dst, VK_IMAGE_ASPECT_COLOR_BIT);
         vk_create_image_render_view(vk, src, VK_IMAGE_ASPECT_COLOR_BIT);
 
-        const uint64_t dur = bench_image_test_dispatch(test, dst, src);
+        struct u_bench_stats stats;
+        bench_image_test_dispatch(test, dst, src, &stats);
 
         vk_destroy_image(vk, dst);
         vk_destroy_image(vk, src);
 
-        vk_log("%s: compute: %d MB/s", bench_image_test_describe_mt(test, tiling, i, desc),
-               bench_image_test_calc_throughput_mb(test, dur));
+        bench_image_test_report(test, bench_image_test_describe_mt(test, tiling, i, desc),
+                                "compute", &stats);
     }
 }
 
@@ -836,13 +908,14 @@ bench_image_test_draw_quad(struct bench_image_test *test, VkImageTiling tiling)
         vk_create_image_render_view(vk, dst, VK_IMAGE_ASPECT_COLOR_BIT);
         vk_create_image_sample_view(vk, src, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
 
-        const uint64_t dur = bench_image_test_render_pass(test, dst, src);
+        struct u_bench_stats stats;
+        bench_image_test_render_pass(test, dst, src, &stats);
 
         vk_destroy_image(vk, dst);
         vk_destroy_image(vk, src);
 
-        vk_log("%s: quad: %d MB/s", bench_image_test_describe_mt(test, tiling, i, desc),
-               bench_image_test_calc_throughput_mb(test, dur));
+        bench_image_test_report(test, bench_image_test_describe_mt(test, tiling, i, desc),
+                                "quad", &stats);
     }
 }
 
@@ -876,6 +949,13 @@ main(int argc, char **argv)
         .loop = 32,
 
         .cs_local_size = 8,
+
+        .bench_params = {
+            .warmup = 1,
+            .min_repeat = 5,
+            .max_repeat = 30,
+            .max_cv = 0.02f,
+        },
     };
 
     bench_image_test_init(&test);
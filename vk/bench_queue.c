@@ -0,0 +1,405 @@
+/*
+ * Copyright 2024 Google LLC
+ * SPDX-License-Identifier: MIT
+ */
+
+/* This test measures how well copies on a transfer queue overlap with dispatches on a compute
+ * queue, compared to serializing both on the primary queue.
+ */
+
+#include "vkutil.h"
+
+static const uint32_t bench_queue_test_cs[] = {
+#include "bench_queue_test.comp.inc"
+};
+
+struct bench_queue_test_push_consts {
+    uint32_t repeat;
+};
+
+struct bench_queue_test {
+    VkDeviceSize copy_size;
+    uint32_t compute_size;
+    uint32_t local_size;
+    uint32_t repeat;
+
+    struct u_bench_params bench_params;
+
+    struct vk vk;
+    struct u_result result;
+
+    struct vk_queue *copy_queue;
+    struct vk_queue *compute_queue;
+
+    struct vk_buffer *copy_src;
+    struct vk_buffer *copy_dst;
+
+    struct vk_pipeline *pipeline;
+    struct vk_buffer *compute_dst;
+    struct vk_descriptor_set *set;
+};
+
+static const char *
+bench_queue_test_describe_queue(struct bench_queue_test *test,
+                                const struct vk_queue *queue,
+                                char desc[static 64])
+{
+    snprintf(desc, 64, "family %u queue %u (%s%s%s)", queue->family_index, queue->index,
+             queue->flags & VK_QUEUE_GRAPHICS_BIT ? "G" : ".",
+             queue->flags & VK_QUEUE_COMPUTE_BIT ? "C" : ".",
+             queue->flags & VK_QUEUE_TRANSFER_BIT ? "T" : ".");
+    return desc;
+}
+
+static void
+bench_queue_test_init_queues(struct bench_queue_test *test)
+{
+    struct vk *vk = &test->vk;
+
+    for (uint32_t i = 0; i < vk->queue_count; i++) {
+        char desc[64];
+        vk_log("%s", bench_queue_test_describe_queue(test, &vk->queues[i], desc));
+    }
+
+    /* prefer a dedicated transfer queue, then a dedicated compute queue */
+    test->copy_queue =
+        vk_find_queue(vk, VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+    if (!test->copy_queue)
+        test->copy_queue = vk_find_queue(vk, VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT);
+    if (!test->copy_queue && vk->queue_count > 1)
+        test->copy_queue = &vk->queues[1];
+    if (!test->copy_queue)
+        test->copy_queue = &vk->queues[0];
+
+    /* prefer a dedicated compute queue that is not used for copies */
+    test->compute_queue = vk_find_queue(vk, VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT);
+    if (!test->compute_queue || test->compute_queue == test->copy_queue)
+        test->compute_queue = &vk->queues[0];
+
+    char desc[64];
+    vk_log("copy queue: %s", bench_queue_test_describe_queue(test, test->copy_queue, desc));
+    vk_log("compute queue: %s",
+           bench_queue_test_describe_queue(test, test->compute_queue, desc));
+    if (test->copy_queue == test->compute_queue)
+        vk_log("no second queue; concurrent runs are serialized");
+}
+
+static void
+bench_queue_test_init_pipeline(struct bench_queue_test *test)
+{
+    struct vk *vk = &test->vk;
+
+    test->pipeline = vk_create_pipeline(vk);
+
+    vk_add_pipeline_shader(vk, test->pipeline, VK_SHADER_STAGE_COMPUTE_BIT, bench_queue_test_cs,
+                           sizeof(bench_queue_test_cs));
+
+    vk_add_pipeline_set_layout(vk, test->pipeline, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                               VK_SHADER_STAGE_COMPUTE_BIT, NULL);
+
+    test->pipeline->push_const = (VkPushConstantRange){
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .size = sizeof(struct bench_queue_test_push_consts),
+    };
+
+    vk_compile_pipeline(vk, test->pipeline);
+}
+
+static void
+bench_queue_test_init_buffers(struct bench_queue_test *test)
+{
+    struct vk *vk = &test->vk;
+
+    /* The buffers are used on different queue families without ownership transfers.  That is
+     * fine because their contents are never read back.
+     */
+    test->copy_src =
+        vk_create_buffer(vk, 0, test->copy_size, VK_BUFFER_USAGE_2_TRANSFER_SRC_BIT);
+    test->copy_dst =
+        vk_create_buffer(vk, 0, test->copy_size, VK_BUFFER_USAGE_2_TRANSFER_DST_BIT);
+
+    test->compute_dst = vk_create_buffer(vk, 0, test->compute_size * sizeof(float),
+                                         VK_BUFFER_USAGE_2_STORAGE_BUFFER_BIT);
+
+    test->set = vk_create_descriptor_set(vk, test->pipeline->set_layouts[0]);
+    vk_write_descriptor_set_buffer(vk, test->set, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                   test->compute_dst, VK_WHOLE_SIZE);
+}
+
+static void
+bench_queue_test_init(struct bench_queue_test *test)
+{
+    struct vk *vk = &test->vk;
+
+    const struct vk_init_params params = {
+        .queues_per_family = 1,
+    };
+    vk_init(vk, &params);
+    vk_init_result(vk, &test->result, "bench_queue");
+
+    bench_queue_test_init_queues(test);
+    bench_queue_test_init_pipeline(test);
+    bench_queue_test_init_buffers(test);
+}
+
+static void
+bench_queue_test_cleanup(struct bench_queue_test *test)
+{
+    struct vk *vk = &test->vk;
+
+    vk_destroy_descriptor_set(vk, test->set);
+    vk_destroy_buffer(vk, test->compute_dst);
+    vk_destroy_buffer(vk, test->copy_dst);
+    vk_destroy_buffer(vk, test->copy_src);
+    vk_destroy_pipeline(vk, test->pipeline);
+
+    u_result_cleanup(&test->result);
+    vk_cleanup(vk);
+}
+
+static void
+bench_queue_test_record_copy(struct bench_queue_test *test, VkCommandBuffer cmd)
+{
+    struct vk *vk = &test->vk;
+
+    const VkBufferCopy2 region = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_COPY_2,
+        .size = test->copy_size,
+    };
+    const VkCopyBufferInfo2 copy_info = {
+        .sType = VK_STRUCTURE_TYPE_COPY_BUFFER_INFO_2,
+        .srcBuffer = test->copy_src->buf,
+        .dstBuffer = test->copy_dst->buf,
+        .regionCount = 1,
+        .pRegions = &region,
+    };
+    vk->CmdCopyBuffer2(cmd, &copy_info);
+}
+
+static void
+bench_queue_test_record_compute(struct bench_queue_test *test, VkCommandBuffer cmd)
+{
+    struct vk *vk = &test->vk;
+
+    vk_bind_pipeline(vk, test->pipeline, cmd);
+    const VkBindDescriptorSetsInfo bind_info = {
+        .sType = VK_STRUCTURE_TYPE_BIND_DESCRIPTOR_SETS_INFO,
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .layout = test->pipeline->layout,
+        .descriptorSetCount = 1,
+        .pDescriptorSets = &test->set->set,
+    };
+    vk->CmdBindDescriptorSets2(cmd, &bind_info);
+
+    const struct bench_queue_test_push_consts consts = {
+        .repeat = test->repeat,
+    };
+    const VkPushConstantsInfo push_info = {
+        .sType = VK_STRUCTURE_TYPE_PUSH_CONSTANTS_INFO,
+        .layout = test->pipeline->layout,
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .size = sizeof(consts),
+        .pValues = &consts,
+    };
+    vk->CmdPushConstants2(cmd, &push_info);
+
+    vk->CmdDispatch(cmd, test->compute_size / test->local_size, 1, 1);
+}
+
+enum bench_queue_test_mode {
+    BENCH_QUEUE_TEST_MODE_COPY,
+    BENCH_QUEUE_TEST_MODE_COMPUTE,
+    BENCH_QUEUE_TEST_MODE_SERIALIZED,
+    BENCH_QUEUE_TEST_MODE_CONCURRENT,
+};
+
+static const char *
+bench_queue_test_mode_to_str(enum bench_queue_test_mode mode)
+{
+    switch (mode) {
+    case BENCH_QUEUE_TEST_MODE_COPY:
+        return "copy";
+    case BENCH_QUEUE_TEST_MODE_COMPUTE:
+        return "compute";
+    case BENCH_QUEUE_TEST_MODE_SERIALIZED:
+        return "serialized";
+    case BENCH_QUEUE_TEST_MODE_CONCURRENT:
+        return "concurrent";
+    default:
+        vk_die("unknown mode");
+    }
+}
+
+static void
+bench_queue_test_submit(struct bench_queue_test *test, enum bench_queue_test_mode mode)
+{
+    struct vk *vk = &test->vk;
+    VkCommandBuffer cmd;
+
+    switch (mode) {
+    case BENCH_QUEUE_TEST_MODE_COPY:
+        cmd = vk_queue_begin_cmd(vk, test->copy_queue, false);
+        bench_queue_test_record_copy(test, cmd);
+        vk_queue_end_cmd(vk, test->copy_queue);
+        vk_queue_wait(vk, test->copy_queue);
+        break;
+    case BENCH_QUEUE_TEST_MODE_COMPUTE:
+        cmd = vk_queue_begin_cmd(vk, test->compute_queue, false);
+        bench_queue_test_record_compute(test, cmd);
+        vk_queue_end_cmd(vk, test->compute_queue);
+        vk_queue_wait(vk, test->compute_queue);
+        break;
+    case BENCH_QUEUE_TEST_MODE_SERIALIZED: {
+        cmd = vk_begin_cmd(vk, false);
+        bench_queue_test_record_copy(test, cmd);
+
+        /* the copy and the dispatch are independent; serialize them explicitly */
+        const VkMemoryBarrier2 barrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+        };
+        const VkDependencyInfo dep_info = {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = &barrier,
+        };
+        vk->CmdPipelineBarrier2(cmd, &dep_info);
+
+        bench_queue_test_record_compute(test, cmd);
+        vk_end_cmd(vk);
+        vk_wait(vk);
+        break;
+    }
+    case BENCH_QUEUE_TEST_MODE_CONCURRENT:
+        cmd = vk_queue_begin_cmd(vk, test->copy_queue, false);
+        bench_queue_test_record_copy(test, cmd);
+        vk_queue_end_cmd(vk, test->copy_queue);
+
+        cmd = vk_queue_begin_cmd(vk, test->compute_queue, false);
+        bench_queue_test_record_compute(test, cmd);
+        vk_queue_end_cmd(vk, test->compute_queue);
+
+        vk_queue_wait(vk, test->copy_queue);
+        vk_queue_wait(vk, test->compute_queue);
+        break;
+    }
+}
+
+static void
+bench_queue_test_run(struct bench_queue_test *test,
+                     enum bench_queue_test_mode mode,
+                     struct u_bench_stats *stats)
+{
+    struct u_bench bench;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        const uint64_t begin = u_now();
+        bench_queue_test_submit(test, mode);
+        const uint64_t end = u_now();
+        u_bench_add(&bench, end - begin);
+    }
+    u_bench_finish(&bench, stats);
+}
+
+static void
+bench_queue_test_report(struct bench_queue_test *test,
+                        enum bench_queue_test_mode mode,
+                        const struct u_bench_stats *stats)
+{
+    const char *op = bench_queue_test_mode_to_str(mode);
+
+    char str[128];
+    vk_log("%s: %.3f ms (%s)", op, (double)stats->median / 1000000.0,
+           u_bench_stats_to_str(stats, str, sizeof(str)));
+
+    struct u_result *res = &test->result;
+    u_result_clear_params(res);
+    u_result_set_param(res, "op", "%s", op);
+    u_result_set_param(res, "copy_size", "%" PRIu64, (uint64_t)test->copy_size);
+    u_result_set_param(res, "compute_size", "%u", test->compute_size);
+    u_result_set_param(res, "repeat", "%u", test->repeat);
+    u_result_add_bench_stats(res, "time", stats);
+}
+
+static void
+bench_queue_test_calibrate(struct bench_queue_test *test)
+{
+    struct u_bench_stats copy_stats;
+    struct u_bench_stats compute_stats;
+    bench_queue_test_run(test, BENCH_QUEUE_TEST_MODE_COPY, &copy_stats);
+    bench_queue_test_run(test, BENCH_QUEUE_TEST_MODE_COMPUTE, &compute_stats);
+
+    /* overlap is easiest to see when both take about the same time */
+    const double scale = (double)copy_stats.median / (double)compute_stats.median;
+    double repeat = test->repeat * scale;
+    if (repeat < 1.0)
+        repeat = 1.0;
+    else if (repeat > 1000000.0)
+        repeat = 1000000.0;
+    test->repeat = (uint32_t)repeat;
+
+    vk_log("calibrated compute repeat to %u", test->repeat);
+}
+
+static void
+bench_queue_test_all(struct bench_queue_test *test)
+{
+    bench_queue_test_calibrate(test);
+
+    struct u_bench_stats stats[4];
+    for (uint32_t i = 0; i < ARRAY_SIZE(stats); i++) {
+        const enum bench_queue_test_mode mode = (enum bench_queue_test_mode)i;
+        bench_queue_test_run(test, mode, &stats[i]);
+        bench_queue_test_report(test, mode, &stats[i]);
+    }
+
+    const double copy_mb = (double)test->copy_size / 1024.0 / 1024.0;
+    const double copy_ms = (double)stats[BENCH_QUEUE_TEST_MODE_COPY].median / 1000000.0;
+    const double compute_ms = (double)stats[BENCH_QUEUE_TEST_MODE_COMPUTE].median / 1000000.0;
+    const double serialized_ms =
+        (double)stats[BENCH_QUEUE_TEST_MODE_SERIALIZED].median / 1000000.0;
+    const double concurrent_ms =
+        (double)stats[BENCH_QUEUE_TEST_MODE_CONCURRENT].median / 1000000.0;
+
+    /* 100% means the shorter of copy and compute was completely hidden */
+    const double hidden_ms = copy_ms + compute_ms - concurrent_ms;
+    const double overlap = hidden_ms / (copy_ms < compute_ms ? copy_ms : compute_ms);
+    const double speedup = serialized_ms / concurrent_ms;
+
+    vk_log("copy throughput: alone %.1f MB/s, serialized %.1f MB/s, concurrent %.1f MB/s",
+           copy_mb * 1000.0 / copy_ms, copy_mb * 1000.0 / serialized_ms,
+           copy_mb * 1000.0 / concurrent_ms);
+    vk_log("overlap: %.1f%%, speedup over serialized: %.2fx", overlap * 100.0, speedup);
+
+    struct u_result *res = &test->result;
+    u_result_clear_params(res);
+    u_result_set_param(res, "copy_size", "%" PRIu64, (uint64_t)test->copy_size);
+    u_result_set_param(res, "compute_size", "%u", test->compute_size);
+    u_result_set_param(res, "repeat", "%u", test->repeat);
+    u_result_add(res, "overlap", overlap * 100.0, "%");
+    u_result_add(res, "speedup", speedup, "x");
+}
+
+int
+main(void)
+{
+    struct bench_queue_test test = {
+        .copy_size = 256 * 1024 * 1024,
+        .compute_size = 1024 * 1024,
+        .local_size = 64,
+        .repeat = 256,
+        .bench_params = {
+            .warmup = 1,
+            .min_repeat = 5,
+            .max_repeat = 30,
+            .max_cv = 0.02f,
+        },
+    };
+
+    bench_queue_test_init(&test);
+    bench_queue_test_all(&test);
+    bench_queue_test_cleanup(&test);
+
+    return 0;
+}
@@ -0,0 +1,457 @@
+/*
+ * Copyright 2024 Google LLC
+ * SPDX-License-Identifier: MIT
+ */
+
+/* This test measures the cpu overhead of submitting empty command buffers. */
+
+#include "vkutil.h"
+
+#define BENCH_SUBMIT_TEST_MAX_BATCH 64
+/* in command buffers, matching the submit ring depth */
+#define BENCH_SUBMIT_TEST_MAX_PENDING (BENCH_SUBMIT_TEST_MAX_BATCH * 2)
+
+/* allocated command buffers that are freed once sem_val is reached */
+struct bench_submit_test_batch {
+    VkCommandBuffer cmds[BENCH_SUBMIT_TEST_MAX_BATCH];
+    uint32_t count;
+    uint64_t sem_val;
+};
+
+struct bench_submit_test {
+    uint32_t cmd_count;
+
+    struct u_bench_params bench_params;
+    struct u_bench_params wait_bench_params;
+
+    struct vk vk;
+    struct u_result result;
+
+    /* in submission order */
+    struct bench_submit_test_batch pending[BENCH_SUBMIT_TEST_MAX_PENDING];
+    uint32_t pending_first;
+    uint32_t pending_count;
+    uint32_t pending_cmd_count;
+
+    VkCommandBuffer empty_cmd;
+    VkSemaphore sem;
+    uint64_t sem_val;
+    VkFence fence;
+};
+
+enum bench_submit_test_wait {
+    BENCH_SUBMIT_TEST_WAIT_TIMELINE,
+    BENCH_SUBMIT_TEST_WAIT_FENCE,
+    BENCH_SUBMIT_TEST_WAIT_IDLE,
+};
+
+static const char *
+bench_submit_test_wait_to_str(enum bench_submit_test_wait wait)
+{
+    switch (wait) {
+    case BENCH_SUBMIT_TEST_WAIT_TIMELINE:
+        return "timeline";
+    case BENCH_SUBMIT_TEST_WAIT_FENCE:
+        return "fence";
+    case BENCH_SUBMIT_TEST_WAIT_IDLE:
+        return "idle";
+    default:
+        vk_die("unknown wait");
+    }
+}
+
+static uint64_t
+bench_submit_test_cpu_now(void)
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts))
+        return 0;
+
+    const uint64_t ns = 1000000000ull;
+    return ns * ts.tv_sec + ts.tv_nsec;
+}
+
+static void
+bench_submit_test_init_sync(struct bench_submit_test *test)
+{
+    struct vk *vk = &test->vk;
+
+    const VkSemaphoreTypeCreateInfo sem_type_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = 0,
+    };
+    const VkSemaphoreCreateInfo sem_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &sem_type_info,
+    };
+    vk->result = vk->CreateSemaphore(vk->dev, &sem_info, NULL, &test->sem);
+    vk_check(vk, "failed to create semaphore");
+
+    const VkFenceCreateInfo fence_info = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+    };
+    vk->result = vk->CreateFence(vk->dev, &fence_info, NULL, &test->fence);
+    vk_check(vk, "failed to create fence");
+}
+
+static void
+bench_submit_test_init_empty_cmd(struct bench_submit_test *test)
+{
+    struct vk *vk = &test->vk;
+
+    const VkCommandBufferAllocateInfo alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = vk->cmd_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+    vk->result = vk->AllocateCommandBuffers(vk->dev, &alloc_info, &test->empty_cmd);
+    vk_check(vk, "failed to allocate command buffer");
+
+    const VkCommandBufferBeginInfo begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    };
+    vk->result = vk->BeginCommandBuffer(test->empty_cmd, &begin_info);
+    vk_check(vk, "failed to begin command buffer");
+    vk->result = vk->EndCommandBuffer(test->empty_cmd);
+    vk_check(vk, "failed to end command buffer");
+}
+
+static void
+bench_submit_test_init(struct bench_submit_test *test)
+{
+    struct vk *vk = &test->vk;
+
+    /* deep enough to never stall on the largest batch */
+    const struct vk_init_params params = {
+        .submit_ring_depth = BENCH_SUBMIT_TEST_MAX_PENDING,
+    };
+    vk_init(vk, &params);
+    vk_init_result(vk, &test->result, "bench_submit");
+
+    bench_submit_test_init_sync(test);
+    bench_submit_test_init_empty_cmd(test);
+}
+
+static void
+bench_submit_test_cleanup(struct bench_submit_test *test)
+{
+    struct vk *vk = &test->vk;
+
+    vk->FreeCommandBuffers(vk->dev, vk->cmd_pool, 1, &test->empty_cmd);
+    vk->DestroyFence(vk->dev, test->fence, NULL);
+    vk->DestroySemaphore(vk->dev, test->sem, NULL);
+
+    u_result_cleanup(&test->result);
+    vk_cleanup(vk);
+}
+
+/* records and submits test->cmd_count command buffers through the submit ring */
+static void
+bench_submit_test_submit_reuse(struct bench_submit_test *test, uint32_t batch)
+{
+    struct vk *vk = &test->vk;
+
+    uint64_t sem_val = 0;
+    for (uint32_t i = 0; i < test->cmd_count; i++) {
+        vk_begin_cmd(vk, false);
+        sem_val = vk_end_cmd_batched(vk);
+        if ((i + 1) % batch == 0)
+            vk_submit_batch(vk);
+    }
+
+    vk_wait_value(vk, sem_val);
+}
+
+/* frees completed batches, after waiting for the oldest one if wait is set */
+static void
+bench_submit_test_reclaim(struct bench_submit_test *test, bool wait)
+{
+    struct vk *vk = &test->vk;
+
+    if (!test->pending_count)
+        return;
+
+    uint64_t completed;
+    if (wait) {
+        completed = test->pending[test->pending_first].sem_val;
+        const VkSemaphoreWaitInfo wait_info = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .semaphoreCount = 1,
+            .pSemaphores = &test->sem,
+            .pValues = &completed,
+        };
+        vk->result = vk->WaitSemaphores(vk->dev, &wait_info, UINT64_MAX);
+        vk_check(vk, "failed to wait semaphore");
+    } else {
+        vk->result = vk->GetSemaphoreCounterValue(vk->dev, test->sem, &completed);
+        vk_check(vk, "failed to get semaphore value");
+    }
+
+    while (test->pending_count) {
+        struct bench_submit_test_batch *pending = &test->pending[test->pending_first];
+        if (pending->sem_val > completed)
+            break;
+
+        vk->FreeCommandBuffers(vk->dev, vk->cmd_pool, pending->count, pending->cmds);
+        test->pending_cmd_count -= pending->count;
+        test->pending_first = (test->pending_first + 1) % BENCH_SUBMIT_TEST_MAX_PENDING;
+        test->pending_count--;
+    }
+}
+
+/* Allocates, records, submits, and frees test->cmd_count command buffers.  Like the submit
+ * ring, up to BENCH_SUBMIT_TEST_MAX_PENDING command buffers can be pending.
+ */
+static void
+bench_submit_test_submit_realloc(struct bench_submit_test *test, uint32_t batch)
+{
+    struct vk *vk = &test->vk;
+
+    VkCommandBufferSubmitInfo cmd_infos[BENCH_SUBMIT_TEST_MAX_BATCH];
+    for (uint32_t i = 0; i < test->cmd_count; i += batch) {
+        const uint32_t count = test->cmd_count - i < batch ? test->cmd_count - i : batch;
+
+        /* command buffers cannot be freed while pending */
+        if (test->pending_cmd_count + count > BENCH_SUBMIT_TEST_MAX_PENDING) {
+            bench_submit_test_reclaim(test, false);
+            while (test->pending_cmd_count + count > BENCH_SUBMIT_TEST_MAX_PENDING)
+                bench_submit_test_reclaim(test, true);
+        }
+
+        struct bench_submit_test_batch *pending =
+            &test->pending[(test->pending_first + test->pending_count) %
+                           BENCH_SUBMIT_TEST_MAX_PENDING];
+        pending->count = count;
+
+        const VkCommandBufferAllocateInfo alloc_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = vk->cmd_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = count,
+        };
+        vk->result = vk->AllocateCommandBuffers(vk->dev, &alloc_info, pending->cmds);
+        vk_check(vk, "failed to allocate command buffers");
+
+        for (uint32_t j = 0; j < count; j++) {
+            const VkCommandBufferBeginInfo begin_info = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            };
+            vk->result = vk->BeginCommandBuffer(pending->cmds[j], &begin_info);
+            vk_check(vk, "failed to begin command buffer");
+            vk->result = vk->EndCommandBuffer(pending->cmds[j]);
+            vk_check(vk, "failed to end command buffer");
+
+            cmd_infos[j] = (VkCommandBufferSubmitInfo){
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+                .commandBuffer = pending->cmds[j],
+            };
+        }
+
+        const VkSemaphoreSubmitInfo signal_info = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+            .semaphore = test->sem,
+            .value = ++test->sem_val,
+            .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+        };
+        const VkSubmitInfo2 submit_info = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+            .commandBufferInfoCount = count,
+            .pCommandBufferInfos = cmd_infos,
+            .signalSemaphoreInfoCount = 1,
+            .pSignalSemaphoreInfos = &signal_info,
+        };
+        vk->result = vk->QueueSubmit2(vk->queue, 1, &submit_info, VK_NULL_HANDLE);
+        vk_check(vk, "failed to submit command buffers");
+
+        pending->sem_val = test->sem_val;
+        test->pending_count++;
+        test->pending_cmd_count += count;
+    }
+
+    while (test->pending_count)
+        bench_submit_test_reclaim(test, true);
+}
+
+static void
+bench_submit_test_throughput(struct bench_submit_test *test, uint32_t batch, bool realloc)
+{
+    struct u_bench bench;
+    struct u_bench_stats stats;
+    uint64_t cpu_total = 0;
+
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        const uint64_t cpu_begin = bench_submit_test_cpu_now();
+        const uint64_t begin = u_now();
+        if (realloc)
+            bench_submit_test_submit_realloc(test, batch);
+        else
+            bench_submit_test_submit_reuse(test, batch);
+        const uint64_t end = u_now();
+
+        /* warmup iterations are not counted in stats.count */
+        const uint64_t cpu_end = bench_submit_test_cpu_now();
+        if (bench.iter >= bench.params.warmup)
+            cpu_total += cpu_end - cpu_begin;
+        u_bench_add(&bench, end - begin);
+    }
+    u_bench_finish(&bench, &stats);
+
+    const char *cmd_mode = realloc ? "realloc" : "reuse";
+    const uint32_t submit_count = DIV_ROUND_UP(test->cmd_count, batch);
+    const double submits_per_sec = submit_count * 1000000000.0 / (double)stats.median;
+    const double cmds_per_sec = test->cmd_count * 1000000000.0 / (double)stats.median;
+    const double cpu_per_cmd = (double)cpu_total / stats.count / test->cmd_count;
+
+    char str[128];
+    vk_log("%s, batch %u: %.0f submits/s, %.0f cmds/s, cpu %.0f ns/cmd (%s)", cmd_mode, batch,
+           submits_per_sec, cmds_per_sec, cpu_per_cmd,
+           u_bench_stats_to_str(&stats, str, sizeof(str)));
+
+    struct u_result *res = &test->result;
+    u_result_clear_params(res);
+    u_result_set_param(res, "cmd", "%s", cmd_mode);
+    u_result_set_param(res, "batch", "%u", batch);
+    u_result_set_param(res, "cmd_count", "%u", test->cmd_count);
+    u_result_add(res, "submits_per_sec", submits_per_sec, "1/s");
+    u_result_add(res, "cmds_per_sec", cmds_per_sec, "1/s");
+    u_result_add(res, "cpu_per_cmd", cpu_per_cmd, "ns");
+    u_result_add_bench_stats(res, "time", &stats);
+}
+
+static void
+bench_submit_test_submit_and_wait(struct bench_submit_test *test, enum bench_submit_test_wait wait)
+{
+    struct vk *vk = &test->vk;
+
+    const bool timeline = wait == BENCH_SUBMIT_TEST_WAIT_TIMELINE;
+    if (timeline)
+        test->sem_val++;
+
+    const VkCommandBufferSubmitInfo cmd_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+        .commandBuffer = test->empty_cmd,
+    };
+    const VkSemaphoreSubmitInfo signal_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+        .semaphore = test->sem,
+        .value = test->sem_val,
+        .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+    };
+    const VkSubmitInfo2 submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+        .commandBufferInfoCount = 1,
+        .pCommandBufferInfos = &cmd_info,
+        .signalSemaphoreInfoCount = timeline ? 1u : 0u,
+        .pSignalSemaphoreInfos = timeline ? &signal_info : NULL,
+    };
+
+    const VkFence fence = wait == BENCH_SUBMIT_TEST_WAIT_FENCE ? test->fence : VK_NULL_HANDLE;
+    vk->result = vk->QueueSubmit2(vk->queue, 1, &submit_info, fence);
+    vk_check(vk, "failed to submit command buffer");
+
+    switch (wait) {
+    case BENCH_SUBMIT_TEST_WAIT_TIMELINE: {
+        const VkSemaphoreWaitInfo wait_info = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .semaphoreCount = 1,
+            .pSemaphores = &test->sem,
+            .pValues = &test->sem_val,
+        };
+        vk->result = vk->WaitSemaphores(vk->dev, &wait_info, UINT64_MAX);
+        vk_check(vk, "failed to wait semaphore");
+        break;
+    }
+    case BENCH_SUBMIT_TEST_WAIT_FENCE:
+        vk->result = vk->WaitForFences(vk->dev, 1, &test->fence, VK_TRUE, UINT64_MAX);
+        vk_check(vk, "failed to wait fence");
+        vk->result = vk->ResetFences(vk->dev, 1, &test->fence);
+        vk_check(vk, "failed to reset fence");
+        break;
+    case BENCH_SUBMIT_TEST_WAIT_IDLE:
+        vk->result = vk->QueueWaitIdle(vk->queue);
+        vk_check(vk, "failed to wait queue");
+        break;
+    }
+}
+
+static void
+bench_submit_test_latency(struct bench_submit_test *test, enum bench_submit_test_wait wait)
+{
+    struct u_bench bench;
+    struct u_bench_stats stats;
+    uint64_t cpu_total = 0;
+
+    u_bench_init(&bench, &test->wait_bench_params);
+    while (u_bench_next(&bench)) {
+        const uint64_t cpu_begin = bench_submit_test_cpu_now();
+        const uint64_t begin = u_now();
+        bench_submit_test_submit_and_wait(test, wait);
+        const uint64_t end = u_now();
+
+        /* warmup iterations are not counted in stats.count */
+        const uint64_t cpu_end = bench_submit_test_cpu_now();
+        if (bench.iter >= bench.params.warmup)
+            cpu_total += cpu_end - cpu_begin;
+        u_bench_add(&bench, end - begin);
+    }
+    u_bench_finish(&bench, &stats);
+
+    const char *wait_mode = bench_submit_test_wait_to_str(wait);
+    const double cpu_per_submit = (double)cpu_total / stats.count;
+
+    char str[128];
+    vk_log("%s wait: %.1f us round trip, cpu %.0f ns/submit (%s)", wait_mode,
+           (double)stats.median / 1000.0, cpu_per_submit,
+           u_bench_stats_to_str(&stats, str, sizeof(str)));
+
+    struct u_result *res = &test->result;
+    u_result_clear_params(res);
+    u_result_set_param(res, "wait", "%s", wait_mode);
+    u_result_add(res, "cpu_per_submit", cpu_per_submit, "ns");
+    u_result_add_bench_stats(res, "latency", &stats);
+}
+
+static void
+bench_submit_test_all(struct bench_submit_test *test)
+{
+    static const uint32_t batches[] = { 1, 4, 16, BENCH_SUBMIT_TEST_MAX_BATCH };
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(batches); i++)
+        bench_submit_test_throughput(test, batches[i], false);
+    for (uint32_t i = 0; i < ARRAY_SIZE(batches); i++)
+        bench_submit_test_throughput(test, batches[i], true);
+
+    bench_submit_test_latency(test, BENCH_SUBMIT_TEST_WAIT_TIMELINE);
+    bench_submit_test_latency(test, BENCH_SUBMIT_TEST_WAIT_FENCE);
+    bench_submit_test_latency(test, BENCH_SUBMIT_TEST_WAIT_IDLE);
+}
+
+int
+main(void)
+{
+    struct bench_submit_test test = {
+        .cmd_count = 1024,
+        .bench_params = {
+            .warmup = 1,
+            .min_repeat = 5,
+            .max_repeat = 20,
+            .max_cv = 0.05f,
+        },
+        .wait_bench_params = {
+            .warmup = 10,
+            .min_repeat = 100,
+            .max_repeat = 1000,
+            .max_cv = 0.05f,
+        },
+    };
+
+    bench_submit_test_init(&test);
+    bench_submit_test_all(&test);
+    bench_submit_test_cleanup(&test);
+
+    return 0;
+}
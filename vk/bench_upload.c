@@ -0,0 +1,371 @@
+/*
+ * Copyright 2025 Google LLC
+ * SPDX-License-Identifier: MIT
+ */
+
+/* This test measures buffer and image upload throughput through a throwaway staging buffer
+ * sized to the upload, as ktx does, and through a reusable staging ring.
+ */
+
+#include "vkutil.h"
+
+enum bench_upload_test_target {
+    BENCH_UPLOAD_TEST_TARGET_BUFFER,
+    BENCH_UPLOAD_TEST_TARGET_IMAGE,
+};
+
+struct bench_upload_test {
+    VkFormat format;
+    uint32_t texel_size;
+    uint32_t min_image_size;
+    uint32_t image_size_orders;
+
+    VkDeviceSize ring_size;
+    VkDeviceSize chunk_size;
+
+    struct u_bench_params bench_params;
+
+    struct vk vk;
+    struct u_result result;
+
+    uint8_t *src;
+    VkDeviceSize src_size;
+    uint32_t dst_mt_mask;
+};
+
+static const char *
+bench_upload_test_target_to_str(enum bench_upload_test_target target)
+{
+    switch (target) {
+    case BENCH_UPLOAD_TEST_TARGET_BUFFER:
+        return "buffer";
+    case BENCH_UPLOAD_TEST_TARGET_IMAGE:
+        return "image";
+    default:
+        vk_die("unknown target");
+    }
+}
+
+static void
+bench_upload_test_init(struct bench_upload_test *test)
+{
+    struct vk *vk = &test->vk;
+
+    vk_init(vk, NULL);
+    vk_init_result(vk, &test->result, "bench_upload");
+
+    const uint32_t max_image_size = test->min_image_size << (test->image_size_orders - 1);
+    test->src_size = (VkDeviceSize)max_image_size * max_image_size * test->texel_size;
+    test->src = (uint8_t *)malloc(test->src_size);
+    if (!test->src)
+        vk_die("failed to alloc src");
+
+    for (VkDeviceSize i = 0; i < test->src_size; i++)
+        test->src[i] = (uint8_t)(i * 7);
+
+    /* upload to device-local memory that is not mappable, as ktx does on dgpus */
+    uint32_t local_mask = 0;
+    uint32_t visible_mask = 0;
+    for (uint32_t i = 0; i < vk->mem_props.memoryTypeCount; i++) {
+        const VkMemoryType *mt = &vk->mem_props.memoryTypes[i];
+        if (mt->propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+            local_mask |= 1u << i;
+        if (mt->propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+            visible_mask |= 1u << i;
+    }
+    test->dst_mt_mask = local_mask & ~visible_mask;
+    if (!test->dst_mt_mask)
+        test->dst_mt_mask = local_mask;
+    if (!test->dst_mt_mask)
+        vk_die("no device-local memory type");
+}
+
+static void
+bench_upload_test_cleanup(struct bench_upload_test *test)
+{
+    struct vk *vk = &test->vk;
+
+    free(test->src);
+
+    u_result_cleanup(&test->result);
+    vk_cleanup(vk);
+}
+
+static uint64_t
+bench_upload_test_upload(struct bench_upload_test *test,
+                         struct vk_staging_ring *ring,
+                         struct vk_buffer *buf,
+                         struct vk_image *img,
+                         VkDeviceSize size)
+{
+    struct vk *vk = &test->vk;
+
+    if (img) {
+        return vk_staging_ring_upload_image(vk, ring, img, test->src, test->texel_size,
+                                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    } else {
+        return vk_staging_ring_upload_buffer(vk, ring, buf, 0, test->src, size);
+    }
+}
+
+/* copy the target back to a mappable buffer and compare against src */
+static void
+bench_upload_test_verify(struct bench_upload_test *test,
+                         struct vk_buffer *buf,
+                         struct vk_image *img,
+                         VkDeviceSize size)
+{
+    struct vk *vk = &test->vk;
+
+    struct vk_buffer *readback =
+        vk_create_buffer(vk, 0, size, VK_BUFFER_USAGE_2_TRANSFER_DST_BIT);
+
+    VkCommandBuffer cmd = vk_begin_cmd(vk, false);
+
+    if (img) {
+        const VkImageMemoryBarrier2 img_barrier = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+            .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+            .dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            .image = img->img,
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .levelCount = 1,
+                .layerCount = 1,
+            },
+        };
+        const VkDependencyInfo dep_info = {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .imageMemoryBarrierCount = 1,
+            .pImageMemoryBarriers = &img_barrier,
+        };
+        vk->CmdPipelineBarrier2(cmd, &dep_info);
+
+        const VkBufferImageCopy2 region = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2,
+            .imageSubresource = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .layerCount = 1,
+            },
+            .imageExtent = img->info.extent,
+        };
+        const VkCopyImageToBufferInfo2 copy_info = {
+            .sType = VK_STRUCTURE_TYPE_COPY_IMAGE_TO_BUFFER_INFO_2,
+            .srcImage = img->img,
+            .srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            .dstBuffer = readback->buf,
+            .regionCount = 1,
+            .pRegions = &region,
+        };
+        vk->CmdCopyImageToBuffer2(cmd, &copy_info);
+    } else {
+        const VkBufferMemoryBarrier2 buf_barrier = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+            .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+            .dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT,
+            .buffer = buf->buf,
+            .size = VK_WHOLE_SIZE,
+        };
+        const VkDependencyInfo dep_info = {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .bufferMemoryBarrierCount = 1,
+            .pBufferMemoryBarriers = &buf_barrier,
+        };
+        vk->CmdPipelineBarrier2(cmd, &dep_info);
+
+        const VkBufferCopy2 region = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_COPY_2,
+            .size = size,
+        };
+        const VkCopyBufferInfo2 copy_info = {
+            .sType = VK_STRUCTURE_TYPE_COPY_BUFFER_INFO_2,
+            .srcBuffer = buf->buf,
+            .dstBuffer = readback->buf,
+            .regionCount = 1,
+            .pRegions = &region,
+        };
+        vk->CmdCopyBuffer2(cmd, &copy_info);
+    }
+
+    const VkBufferMemoryBarrier2 host_barrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+        .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+        .dstAccessMask = VK_ACCESS_2_HOST_READ_BIT,
+        .buffer = readback->buf,
+        .size = VK_WHOLE_SIZE,
+    };
+    const VkDependencyInfo dep_info = {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .bufferMemoryBarrierCount = 1,
+        .pBufferMemoryBarriers = &host_barrier,
+    };
+    vk->CmdPipelineBarrier2(cmd, &dep_info);
+
+    vk_end_cmd(vk);
+    vk_wait(vk);
+
+    if (memcmp(readback->mem_ptr, test->src, size))
+        vk_die("%s upload mismatch", img ? "image" : "buffer");
+
+    vk_destroy_buffer(vk, readback);
+}
+
+/* a one-shot upload is a ring sized to the upload and destroyed afterwards */
+static void
+bench_upload_test_run(struct bench_upload_test *test,
+                      enum bench_upload_test_target target,
+                      uint32_t image_size,
+                      bool oneshot)
+{
+    struct vk *vk = &test->vk;
+
+    const VkDeviceSize size = (VkDeviceSize)image_size * image_size * test->texel_size;
+    struct vk_buffer *buf = NULL;
+    struct vk_image *img = NULL;
+    if (target == BENCH_UPLOAD_TEST_TARGET_IMAGE) {
+        const VkImageCreateInfo info = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = test->format,
+            .extent = {
+                .width = image_size,
+                .height = image_size,
+                .depth = 1,
+            },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                     VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        };
+        img = vk_create_image_with_mt_mask(vk, &info, test->dst_mt_mask);
+    } else {
+        buf = vk_create_buffer_with_mt_mask(
+            vk, 0, size, VK_BUFFER_USAGE_2_TRANSFER_DST_BIT | VK_BUFFER_USAGE_2_TRANSFER_SRC_BIT,
+            test->dst_mt_mask);
+    }
+
+    struct vk_staging_ring ring;
+    if (!oneshot)
+        vk_init_staging_ring(vk, &ring, &vk->queues[0], test->ring_size, test->chunk_size);
+
+    VkDeviceSize peak_size = 0;
+    uint32_t stall_count = 0;
+
+    struct u_bench bench;
+    struct u_bench_stats stats;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench)) {
+        const uint64_t begin = u_now();
+
+        if (oneshot)
+            vk_init_staging_ring(vk, &ring, &vk->queues[0], size, size);
+
+        const uint64_t sem_val = bench_upload_test_upload(test, &ring, buf, img, size);
+        vk_wait_value(vk, sem_val);
+
+        if (peak_size < ring.peak_size)
+            peak_size = ring.peak_size;
+        if (oneshot) {
+            stall_count += ring.stall_count;
+            vk_cleanup_staging_ring(vk, &ring);
+        }
+
+        const uint64_t end = u_now();
+
+        u_bench_add(&bench, end - begin);
+    }
+    u_bench_finish(&bench, &stats);
+
+    /* the whole staging buffer is resident, however much of it is in use */
+    VkDeviceSize staging_size = size;
+    if (!oneshot) {
+        stall_count = ring.stall_count;
+        staging_size = ring.size;
+        vk_cleanup_staging_ring(vk, &ring);
+    }
+
+    bench_upload_test_verify(test, buf, img, size);
+
+    const char *mode = oneshot ? "oneshot" : "ring";
+    const char *target_str = bench_upload_test_target_to_str(target);
+    const double gbps = (double)size / (double)stats.median;
+
+    char str[128];
+    vk_log("%s %s %ux%u: %.2f GB/s, %zu KiB staging (%zu KiB peak), %u stalls (%s)", mode,
+           target_str, image_size, image_size, gbps, (size_t)(staging_size / 1024),
+           (size_t)(peak_size / 1024), stall_count,
+           u_bench_stats_to_str(&stats, str, sizeof(str)));
+
+    struct u_result *res = &test->result;
+    u_result_clear_params(res);
+    u_result_set_param(res, "mode", "%s", mode);
+    u_result_set_param(res, "target", "%s", target_str);
+    u_result_set_param(res, "size", "%zu", (size_t)size);
+    u_result_add(res, "throughput", gbps, "GB/s");
+    u_result_add(res, "staging_size", (double)staging_size, "B");
+    u_result_add(res, "staging_peak", (double)peak_size, "B");
+    u_result_add_bench_stats(res, "time", &stats);
+
+    if (img)
+        vk_destroy_image(vk, img);
+    if (buf)
+        vk_destroy_buffer(vk, buf);
+}
+
+static void
+bench_upload_test_all(struct bench_upload_test *test)
+{
+    static const enum bench_upload_test_target targets[] = {
+        BENCH_UPLOAD_TEST_TARGET_BUFFER,
+        BENCH_UPLOAD_TEST_TARGET_IMAGE,
+    };
+
+    vk_log("ring: %zu KiB in %zu KiB chunks", (size_t)(test->ring_size / 1024),
+           (size_t)(test->chunk_size / 1024));
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(targets); i++) {
+        for (uint32_t j = 0; j < test->image_size_orders; j++) {
+            const uint32_t image_size = test->min_image_size << j;
+            bench_upload_test_run(test, targets[i], image_size, true);
+            bench_upload_test_run(test, targets[i], image_size, false);
+        }
+    }
+}
+
+int
+main(void)
+{
+    struct bench_upload_test test = {
+        .format = VK_FORMAT_R8G8B8A8_UNORM,
+        .texel_size = 4,
+        .min_image_size = 1024,
+        .image_size_orders = 4,
+
+        .ring_size = 32 * 1024 * 1024,
+        .chunk_size = 4 * 1024 * 1024,
+
+        .bench_params = {
+            .warmup = 1,
+            .min_repeat = 5,
+            .max_repeat = 20,
+            .max_cv = 0.05f,
+        },
+    };
+
+    bench_upload_test_init(&test);
+    bench_upload_test_all(&test);
+    bench_upload_test_cleanup(&test);
+
+    return 0;
+}
@@ -31,9 +31,13 @@ struct conv2d_test {
 
     uint32_t local_size;
 
+    struct u_bench_params bench_params;
+
     struct vk vk;
 
     struct vk_pipeline *pipeline;
+    /* width, slice, and kernel size are specialization constants rather than push constants */
+    struct vk_pipeline *spec_pipeline;
 
     struct vk_buffer *src;
     struct vk_buffer *dst;
@@ -84,15 +88,24 @@ conv2d_test_init_descriptor_set(struct conv2d_test *test)
     vk->UpdateDescriptorSets(vk->dev, ARRAY_SIZE(write_infos), write_infos, 0, NULL);
 }
 
-static void
-conv2d_test_init_pipeline(struct conv2d_test *test)
+static struct vk_pipeline *
+conv2d_test_create_pipeline(struct conv2d_test *test, bool spec)
 {
     struct vk *vk = &test->vk;
 
-    test->pipeline = vk_create_pipeline(vk);
+    struct vk_pipeline *pipeline = vk_create_pipeline(vk);
 
-    vk_add_pipeline_shader(vk, test->pipeline, VK_SHADER_STAGE_COMPUTE_BIT, conv2d_test_cs,
+    vk_add_pipeline_shader(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, conv2d_test_cs,
                            sizeof(conv2d_test_cs));
+    vk_set_pipeline_spec_constant(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, 0, test->local_size);
+    if (spec) {
+        vk_set_pipeline_spec_constant(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, 1, test->width);
+        vk_set_pipeline_spec_constant(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, 2, test->slice);
+        vk_set_pipeline_spec_constant(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, 3,
+                                      test->kernel_width);
+        vk_set_pipeline_spec_constant(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, 4,
+                                      test->kernel_height);
+    }
 
     const VkDescriptorSetLayoutBinding bindings[] = {
         [0] = {
@@ -119,14 +132,16 @@ conv2d_test_init_pipeline(struct conv2d_test *test)
         .bindingCount = ARRAY_SIZE(bindings),
         .pBindings = bindings,
     };
-    vk_add_pipeline_set_layout_from_info(vk, test->pipeline, &set_layout_info);
+    vk_add_pipeline_set_layout_from_info(vk, pipeline, &set_layout_info);
 
-    test->pipeline->push_const = (VkPushConstantRange){
+    pipeline->push_const = (VkPushConstantRange){
         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
         .size = sizeof(struct conv2d_test_push_consts),
     };
 
-    vk_compile_pipeline(vk, test->pipeline);
+    vk_compile_pipeline(vk, pipeline);
+
+    return pipeline;
 }
 
 static void
@@ -167,7 +182,8 @@ conv2d_test_init(struct conv2d_test *test)
 
     vk_init(vk, NULL);
 
-    conv2d_test_init_pipeline(test);
+    test->pipeline = conv2d_test_create_pipeline(test, false);
+    test->spec_pipeline = conv2d_test_create_pipeline(test, true);
     conv2d_test_init_buffers(test);
     conv2d_test_init_descriptor_set(test);
 }
@@ -182,24 +198,26 @@ conv2d_test_cleanup(struct conv2d_test *test)
     vk_destroy_buffer(vk, test->weight);
     vk_destroy_buffer(vk, test->dst);
     vk_destroy_buffer(vk, test->src);
+    vk_destroy_pipeline(vk, test->spec_pipeline);
     vk_destroy_pipeline(vk, test->pipeline);
 
     vk_cleanup(vk);
 }
 
-static void
-conv2d_test_dispatch(struct conv2d_test *test, bool warmup)
+/* returns the gpu time in ns */
+static uint64_t
+conv2d_test_dispatch(struct conv2d_test *test, struct vk_pipeline *pipeline)
 {
     struct vk *vk = &test->vk;
-    struct vk_stopwatch *stopwatch = warmup ? NULL : vk_create_stopwatch(vk, 2);
+    struct vk_stopwatch *stopwatch = vk_create_stopwatch(vk, 2);
 
     VkCommandBuffer cmd = vk_begin_cmd(vk, false);
 
-    vk_bind_pipeline(vk, test->pipeline, cmd);
+    vk_bind_pipeline(vk, pipeline, cmd);
     const VkBindDescriptorSetsInfo bind_info = {
         .sType = VK_STRUCTURE_TYPE_BIND_DESCRIPTOR_SETS_INFO,
         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-        .layout = test->pipeline->layout,
+        .layout = pipeline->layout,
         .descriptorSetCount = 1,
         .pDescriptorSets = &test->set->set,
     };
@@ -213,28 +231,42 @@ conv2d_test_dispatch(struct conv2d_test *test, bool warmup)
     };
     const VkPushConstantsInfo push_info = {
         .sType = VK_STRUCTURE_TYPE_PUSH_CONSTANTS_INFO,
-        .layout = test->pipeline->layout,
+        .layout = pipeline->layout,
         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
         .size = sizeof(consts),
         .pValues = &consts,
     };
     vk->CmdPushConstants2(cmd, &push_info);
 
-    if (stopwatch)
-        vk_write_stopwatch(vk, stopwatch, cmd);
+    vk_write_stopwatch(vk, stopwatch, cmd);
     vk->CmdDispatch(cmd, test->width / test->local_size, test->height, 1);
-    if (stopwatch)
-        vk_write_stopwatch(vk, stopwatch, cmd);
+    vk_write_stopwatch(vk, stopwatch, cmd);
 
     vk_end_cmd(vk);
     vk_wait(vk);
 
-    if (stopwatch) {
-        const float ns_per_ms = 1000000.0f;
-        const float gpu_ms = (float)vk_read_stopwatch(vk, stopwatch, 0) / ns_per_ms;
-        vk_log("gpu %.1fms", gpu_ms);
-        vk_destroy_stopwatch(vk, stopwatch);
-    }
+    const uint64_t gpu_ns = vk_read_stopwatch(vk, stopwatch, 0);
+    vk_destroy_stopwatch(vk, stopwatch);
+
+    return gpu_ns;
+}
+
+/* returns the median gpu time in ns */
+static uint64_t
+conv2d_test_bench(struct conv2d_test *test, struct vk_pipeline *pipeline)
+{
+    struct u_bench bench;
+    struct u_bench_stats stats;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench))
+        u_bench_add(&bench, conv2d_test_dispatch(test, pipeline));
+    u_bench_finish(&bench, &stats);
+
+    char str[128];
+    vk_log("%s: %s", pipeline == test->spec_pipeline ? "spec" : "push",
+           u_bench_stats_to_str(&stats, str, sizeof(str)));
+
+    return stats.median;
 }
 
 int
@@ -253,14 +285,24 @@ main(void)
         .kernel_height = 3,
 
         .local_size = 64,
+
+        .bench_params = {
+            .warmup = 1,
+            .min_repeat = 5,
+            .max_repeat = 20,
+            .max_cv = 0.05f,
+        },
     };
 
     if (test.width % test.local_size)
         vk_die("bad width / local size");
 
     conv2d_test_init(&test);
-    conv2d_test_dispatch(&test, true);
-    conv2d_test_dispatch(&test, false);
+
+    const uint64_t push_ns = conv2d_test_bench(&test, test.pipeline);
+    const uint64_t spec_ns = conv2d_test_bench(&test, test.spec_pipeline);
+    vk_log("specialization speedup: %.2fx", (double)push_ns / (double)spec_ns);
+
     conv2d_test_cleanup(&test);
 
     return 0;
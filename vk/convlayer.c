@@ -29,9 +29,13 @@ struct convlayer_test {
     uint32_t local_size[3];
     uint32_t block_size[3];
 
+    struct u_bench_params bench_params;
+
     struct vk vk;
 
     struct vk_pipeline *pipeline;
+    /* slice counts and grid size are specialization constants rather than ubo values */
+    struct vk_pipeline *spec_pipeline;
 
     struct vk_buffer *ssbo;
     struct vk_buffer *ubo;
@@ -96,15 +100,29 @@ convlayer_test_init_descriptor_set(struct convlayer_test *test)
     vk->UpdateDescriptorSets(vk->dev, ARRAY_SIZE(write_infos), write_infos, 0, NULL);
 }
 
-static void
-convlayer_test_init_pipeline(struct convlayer_test *test)
+static struct vk_pipeline *
+convlayer_test_create_pipeline(struct convlayer_test *test, bool spec)
 {
     struct vk *vk = &test->vk;
 
-    test->pipeline = vk_create_pipeline(vk);
+    struct vk_pipeline *pipeline = vk_create_pipeline(vk);
 
-    vk_add_pipeline_shader(vk, test->pipeline, VK_SHADER_STAGE_COMPUTE_BIT, convlayer_test_cs,
+    vk_add_pipeline_shader(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, convlayer_test_cs,
                            sizeof(convlayer_test_cs));
+    for (uint32_t i = 0; i < ARRAY_SIZE(test->local_size); i++) {
+        vk_set_pipeline_spec_constant(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, i,
+                                      test->local_size[i]);
+    }
+    if (spec) {
+        vk_set_pipeline_spec_constant(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, 3,
+                                      test->src_slice_count);
+        vk_set_pipeline_spec_constant(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, 4,
+                                      test->dst_slice_count);
+        vk_set_pipeline_spec_constant(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, 5,
+                                      test->grid_width);
+        vk_set_pipeline_spec_constant(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, 6,
+                                      test->grid_height);
+    }
 
     const VkDescriptorSetLayoutBinding bindings[] = {
         [0] = {
@@ -137,15 +155,17 @@ convlayer_test_init_pipeline(struct convlayer_test *test)
         .bindingCount = ARRAY_SIZE(bindings),
         .pBindings = bindings,
     };
-    vk_add_pipeline_set_layout_from_info(vk, test->pipeline, &set_layout_info);
+    vk_add_pipeline_set_layout_from_info(vk, pipeline, &set_layout_info);
 
     /* unused */
-    test->pipeline->push_const = (VkPushConstantRange){
+    pipeline->push_const = (VkPushConstantRange){
         .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
         .size = 8,
     };
 
-    vk_compile_pipeline(vk, test->pipeline);
+    vk_compile_pipeline(vk, pipeline);
+
+    return pipeline;
 }
 
 static void
@@ -199,7 +219,8 @@ convlayer_test_init(struct convlayer_test *test)
 
     vk_init(vk, NULL);
 
-    convlayer_test_init_pipeline(test);
+    test->pipeline = convlayer_test_create_pipeline(test, false);
+    test->spec_pipeline = convlayer_test_create_pipeline(test, true);
     convlayer_test_init_buffers(test);
     convlayer_test_init_images(test);
     convlayer_test_init_descriptor_set(test);
@@ -215,16 +236,18 @@ convlayer_test_cleanup(struct convlayer_test *test)
     vk_destroy_image(vk, test->dst);
     vk_destroy_buffer(vk, test->ssbo);
     vk_destroy_buffer(vk, test->ubo);
+    vk_destroy_pipeline(vk, test->spec_pipeline);
     vk_destroy_pipeline(vk, test->pipeline);
 
     vk_cleanup(vk);
 }
 
-static void
-convlayer_test_dispatch(struct convlayer_test *test, bool warmup)
+/* returns the gpu time in ns */
+static uint64_t
+convlayer_test_dispatch(struct convlayer_test *test, struct vk_pipeline *pipeline)
 {
     struct vk *vk = &test->vk;
-    struct vk_stopwatch *stopwatch = warmup ? NULL : vk_create_stopwatch(vk, 2);
+    struct vk_stopwatch *stopwatch = vk_create_stopwatch(vk, 2);
 
     VkCommandBuffer cmd = vk_begin_cmd(vk, false);
 
@@ -267,11 +290,11 @@ convlayer_test_dispatch(struct convlayer_test *test, bool warmup)
     };
     vk->CmdPipelineBarrier2(cmd, &dep_info);
 
-    vk_bind_pipeline(vk, test->pipeline, cmd);
+    vk_bind_pipeline(vk, pipeline, cmd);
     const VkBindDescriptorSetsInfo bind_info = {
         .sType = VK_STRUCTURE_TYPE_BIND_DESCRIPTOR_SETS_INFO,
         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-        .layout = test->pipeline->layout,
+        .layout = pipeline->layout,
         .descriptorSetCount = 1,
         .pDescriptorSets = &test->set->set,
     };
@@ -284,21 +307,35 @@ convlayer_test_dispatch(struct convlayer_test *test, bool warmup)
     const uint32_t dispatch_depth =
         DIV_ROUND_UP(test->dst_slice_count, test->local_size[2] * test->block_size[2]);
 
-    if (stopwatch)
-        vk_write_stopwatch(vk, stopwatch, cmd);
+    vk_write_stopwatch(vk, stopwatch, cmd);
     vk->CmdDispatch(cmd, dispatch_width, dispatch_height, dispatch_depth);
-    if (stopwatch)
-        vk_write_stopwatch(vk, stopwatch, cmd);
+    vk_write_stopwatch(vk, stopwatch, cmd);
 
     vk_end_cmd(vk);
     vk_wait(vk);
 
-    if (stopwatch) {
-        const float ns_per_ms = 1000000.0f;
-        const float gpu_ms = (float)vk_read_stopwatch(vk, stopwatch, 0) / ns_per_ms;
-        vk_log("gpu %.1fms", gpu_ms);
-        vk_destroy_stopwatch(vk, stopwatch);
-    }
+    const uint64_t gpu_ns = vk_read_stopwatch(vk, stopwatch, 0);
+    vk_destroy_stopwatch(vk, stopwatch);
+
+    return gpu_ns;
+}
+
+/* returns the median gpu time in ns */
+static uint64_t
+convlayer_test_bench(struct convlayer_test *test, struct vk_pipeline *pipeline)
+{
+    struct u_bench bench;
+    struct u_bench_stats stats;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench))
+        u_bench_add(&bench, convlayer_test_dispatch(test, pipeline));
+    u_bench_finish(&bench, &stats);
+
+    char str[128];
+    vk_log("%s: %s", pipeline == test->spec_pipeline ? "spec" : "push",
+           u_bench_stats_to_str(&stats, str, sizeof(str)));
+
+    return stats.median;
 }
 
 int
@@ -316,11 +353,21 @@ main(void)
 
         .local_size = { 16, 1, 16 },
         .block_size = { 4, 1, 4 },
+
+        .bench_params = {
+            .warmup = 1,
+            .min_repeat = 5,
+            .max_repeat = 20,
+            .max_cv = 0.05f,
+        },
     };
 
     convlayer_test_init(&test);
-    convlayer_test_dispatch(&test, true);
-    convlayer_test_dispatch(&test, false);
+
+    const uint64_t push_ns = convlayer_test_bench(&test, test.pipeline);
+    const uint64_t spec_ns = convlayer_test_bench(&test, test.spec_pipeline);
+    vk_log("specialization speedup: %.2fx", (double)push_ns / (double)spec_ns);
+
     convlayer_test_cleanup(&test);
 
     return 0;
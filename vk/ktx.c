@@ -12,6 +12,10 @@
 #include <ktxvulkan.h>
 #endif
 
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 static const uint32_t ktx_test_vs[] = {
 #include "ktx_test.vert.inc"
 };
@@ -25,11 +29,48 @@ struct ktx_test_push_const {
     float slice;
 };
 
+#define KTX_TEST_MAX_LEVELS 32
+
+/* KTX2 supercompressionScheme values */
+#define KTX_TEST_SS_NONE 0
+#define KTX_TEST_SS_ZSTD 2
+
+struct ktx_test_stream_level {
+    uint64_t file_offset;
+    uint64_t file_size;
+    uint64_t size;
+    uint64_t staging_offset;
+
+    uint64_t ready_ns;
+};
+
+/* streams mip levels from the mmapped file into the mapped staging buffer */
+struct ktx_test_stream {
+    const uint8_t *file_ptr;
+    size_t file_size;
+    uint32_t supercompression;
+
+    struct ktx_test_stream_level levels[KTX_TEST_MAX_LEVELS];
+    uint32_t level_count;
+    uint64_t staging_size;
+    uint8_t *staging_ptr;
+
+    uint64_t begin_ns;
+    mtx_t mutex;
+    cnd_t cond;
+    uint32_t next_job;
+    uint32_t ready_levels[KTX_TEST_MAX_LEVELS];
+    uint32_t ready_count;
+};
+
 struct ktx_test {
     VkFormat rt_format;
     const char *filename;
     int slice;
+    bool stream;
     ktxTexture *tex;
+    struct ktx_test_stream stream_state;
+    uint64_t load_ns;
 
     struct vk vk;
 
@@ -127,23 +168,174 @@ ktx_test_dump_info(struct ktx_test *test, ktxTexture *tex)
 static void
 ktx_test_load_file(struct ktx_test *test)
 {
+    const uint64_t begin = u_now();
+
+    /* the stream path reads image data from the file itself */
+    const uint32_t flags = test->stream ? 0 : KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT;
     ktxTexture *tex;
-    KTX_error_code result = ktxTexture_CreateFromNamedFile(
-        test->filename, KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &tex);
+    KTX_error_code result = ktxTexture_CreateFromNamedFile(test->filename, flags, &tex);
     if (result != KTX_SUCCESS)
         vk_die("failed to load %s: %s", test->filename, ktxErrorString(result));
 
+    test->load_ns += u_now() - begin;
+
     ktx_test_dump_info(test, tex);
 
     /* only KTX 2.0 guarantees tight packing */
     if (tex->classId != ktxTexture2_c)
         vk_die("only KTX 2.0 is supported");
-    if (((ktxTexture2 *)tex)->supercompressionScheme != KTX_SS_NONE)
+    if (!test->stream && ((ktxTexture2 *)tex)->supercompressionScheme != KTX_SS_NONE)
         vk_die("data is super-compressed");
 
     test->tex = tex;
 }
 
+static uint32_t
+ktx_test_read_u32(const uint8_t *ptr)
+{
+    uint32_t val;
+    memcpy(&val, ptr, sizeof(val));
+    return val;
+}
+
+static uint64_t
+ktx_test_read_u64(const uint8_t *ptr)
+{
+    uint64_t val;
+    memcpy(&val, ptr, sizeof(val));
+    return val;
+}
+
+static void
+ktx_test_init_stream(struct ktx_test *test)
+{
+    static const uint8_t ktx2_id[12] = {
+        0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n',
+    };
+    /* identifier, 9 header words, and the dfd/kvd/sgd index */
+    const size_t level_index_offset = sizeof(ktx2_id) + 4 * 9 + 4 * 4 + 8 * 2;
+    const size_t level_index_entry_size = 8 * 3;
+
+    struct ktx_test_stream *stream = &test->stream_state;
+    ktxTexture *tex = test->tex;
+
+    stream->file_ptr = u_map_file(test->filename, &stream->file_size);
+    if (stream->file_size < level_index_offset ||
+        memcmp(stream->file_ptr, ktx2_id, sizeof(ktx2_id)))
+        vk_die("%s is not a KTX 2.0 file", test->filename);
+
+    const uint8_t *hdr = stream->file_ptr + sizeof(ktx2_id);
+    const uint32_t level_count = ktx_test_read_u32(hdr + 4 * 7);
+    stream->supercompression = ktx_test_read_u32(hdr + 4 * 8);
+    stream->level_count = level_count ? level_count : 1;
+    if (stream->level_count != tex->numLevels || stream->level_count > KTX_TEST_MAX_LEVELS)
+        vk_die("bad level count %u", stream->level_count);
+
+    switch (stream->supercompression) {
+    case KTX_TEST_SS_NONE:
+        break;
+    case KTX_TEST_SS_ZSTD:
+#ifndef HAVE_ZSTD
+        vk_die("no zstd support");
+#endif
+        break;
+    default:
+        vk_die("unsupported supercompression scheme %u", stream->supercompression);
+    }
+
+    if (stream->file_size < level_index_offset + level_index_entry_size * stream->level_count)
+        vk_die("truncated level index");
+
+    /* levels are copied to the staging buffer at texel block and 4-byte aligned offsets */
+    const uint32_t elem_size = ktxTexture_GetElementSize(tex);
+    uint32_t align = elem_size;
+    while (align % 4)
+        align += elem_size;
+
+    for (uint32_t i = 0; i < stream->level_count; i++) {
+        struct ktx_test_stream_level *level = &stream->levels[i];
+        const uint8_t *entry = stream->file_ptr + level_index_offset + level_index_entry_size * i;
+
+        level->file_offset = ktx_test_read_u64(entry);
+        level->file_size = ktx_test_read_u64(entry + 8);
+        level->size = ktx_test_read_u64(entry + 16);
+        if (level->file_offset > stream->file_size ||
+            level->file_size > stream->file_size - level->file_offset)
+            vk_die("level %u is out of bounds", i);
+        if (stream->supercompression == KTX_TEST_SS_NONE && level->size != level->file_size)
+            vk_die("level %u has bad size", i);
+
+        level->staging_offset = DIV_ROUND_UP(stream->staging_size, align) * align;
+        stream->staging_size = level->staging_offset + level->size;
+    }
+
+    if (mtx_init(&stream->mutex, mtx_plain) != thrd_success ||
+        cnd_init(&stream->cond) != thrd_success)
+        vk_die("failed to init stream sync");
+}
+
+static void
+ktx_test_cleanup_stream(struct ktx_test *test)
+{
+    struct ktx_test_stream *stream = &test->stream_state;
+
+    cnd_destroy(&stream->cond);
+    mtx_destroy(&stream->mutex);
+    u_unmap_file(stream->file_ptr, stream->file_size);
+}
+
+static void
+ktx_test_decode_level(struct ktx_test_stream *stream, uint32_t idx)
+{
+    const struct ktx_test_stream_level *level = &stream->levels[idx];
+    const uint8_t *src = stream->file_ptr + level->file_offset;
+    uint8_t *dst = stream->staging_ptr + level->staging_offset;
+
+    switch (stream->supercompression) {
+    case KTX_TEST_SS_NONE:
+        memcpy(dst, src, level->size);
+        break;
+#ifdef HAVE_ZSTD
+    case KTX_TEST_SS_ZSTD: {
+        const size_t size = ZSTD_decompress(dst, level->size, src, level->file_size);
+        if (ZSTD_isError(size) || size != level->size)
+            vk_die("failed to decode level %u", idx);
+        break;
+    }
+#endif
+    default:
+        vk_die("unsupported supercompression scheme %u", stream->supercompression);
+    }
+}
+
+static int
+ktx_test_stream_worker(void *arg)
+{
+    struct ktx_test_stream *stream = arg;
+
+    while (true) {
+        mtx_lock(&stream->mutex);
+        const uint32_t job = stream->next_job;
+        if (job < stream->level_count)
+            stream->next_job++;
+        mtx_unlock(&stream->mutex);
+        if (job >= stream->level_count)
+            break;
+
+        /* smallest levels first so that uploads start early */
+        const uint32_t idx = stream->level_count - 1 - job;
+        ktx_test_decode_level(stream, idx);
+
+        mtx_lock(&stream->mutex);
+        stream->levels[idx].ready_ns = u_now();
+        stream->ready_levels[stream->ready_count++] = idx;
+        cnd_signal(&stream->cond);
+        mtx_unlock(&stream->mutex);
+    }
+
+    return 0;
+}
+
 static void
 ktx_test_init_descriptor_set(struct ktx_test *test)
 {
@@ -286,9 +478,23 @@ ktx_test_init_staging_buffer(struct ktx_test *test)
     struct vk *vk = &test->vk;
     ktxTexture *tex = test->tex;
 
+    if (test->stream) {
+        struct ktx_test_stream *stream = &test->stream_state;
+
+        /* filled by ktx_test_draw_stream_texture */
+        test->staging_buf =
+            vk_create_buffer(vk, 0, stream->staging_size, VK_BUFFER_USAGE_2_TRANSFER_SRC_BIT);
+        stream->staging_ptr = test->staging_buf->mem_ptr;
+        return;
+    }
+
+    const uint64_t begin = u_now();
+
     test->staging_buf =
         vk_create_buffer(vk, 0, tex->dataSize, VK_BUFFER_USAGE_2_TRANSFER_SRC_BIT);
     memcpy(test->staging_buf->mem_ptr, tex->pData, tex->dataSize);
+
+    test->load_ns += u_now() - begin;
 }
 
 static void
@@ -297,6 +503,8 @@ ktx_test_init(struct ktx_test *test)
     struct vk *vk = &test->vk;
 
     ktx_test_load_file(test);
+    if (test->stream)
+        ktx_test_init_stream(test);
 
     vk_init(vk, NULL);
 
@@ -319,6 +527,8 @@ ktx_test_cleanup(struct ktx_test *test)
     vk_destroy_image(vk, test->rt_img);
     vk_cleanup(vk);
 
+    if (test->stream)
+        ktx_test_cleanup_stream(test);
     ktxTexture_Destroy(test->tex);
 }
 
@@ -480,16 +690,141 @@ ktx_test_draw_prep_texture(struct ktx_test *test, VkCommandBuffer cmd)
 }
 
 static void
-ktx_test_draw(struct ktx_test *test)
+ktx_test_draw_upload_level(struct ktx_test *test, uint32_t idx)
 {
     struct vk *vk = &test->vk;
+    ktxTexture *tex = test->tex;
+    const struct ktx_test_stream_level *level = &test->stream_state.levels[idx];
+
+    const VkImageSubresourceRange subres_range = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = idx,
+        .levelCount = 1,
+        .layerCount = tex->numLayers * tex->numFaces,
+    };
+    const VkImageMemoryBarrier2 barrier1 = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_NONE,
+        .srcAccessMask = VK_ACCESS_2_NONE,
+        .dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+        .dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .image = test->tex_img->img,
+        .subresourceRange = subres_range,
+    };
+    const VkImageMemoryBarrier2 barrier2 = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+        .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+        .dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        .image = test->tex_img->img,
+        .subresourceRange = subres_range,
+    };
+    const VkBufferImageCopy2 copy = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2,
+        .bufferOffset = level->staging_offset,
+        .imageSubresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = idx,
+            .layerCount = tex->numLayers * tex->numFaces,
+        },
+        .imageExtent = {
+            .width = u_minify(tex->baseWidth, idx),
+            .height = u_minify(tex->baseHeight, idx),
+            .depth = u_minify(tex->baseDepth, idx),
+        },
+    };
 
     VkCommandBuffer cmd = vk_begin_cmd(vk, false);
-    ktx_test_draw_prep_texture(test, cmd);
+
+    const VkDependencyInfo dep_info1 = {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .imageMemoryBarrierCount = 1,
+        .pImageMemoryBarriers = &barrier1,
+    };
+    vk->CmdPipelineBarrier2(cmd, &dep_info1);
+    const VkCopyBufferToImageInfo2 copy_info = {
+        .sType = VK_STRUCTURE_TYPE_COPY_BUFFER_TO_IMAGE_INFO_2,
+        .srcBuffer = test->staging_buf->buf,
+        .dstImage = test->tex_img->img,
+        .dstImageLayout = barrier1.newLayout,
+        .regionCount = 1,
+        .pRegions = &copy,
+    };
+    vk->CmdCopyBufferToImage2(cmd, &copy_info);
+    const VkDependencyInfo dep_info2 = {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .imageMemoryBarrierCount = 1,
+        .pImageMemoryBarriers = &barrier2,
+    };
+    vk->CmdPipelineBarrier2(cmd, &dep_info2);
+
+    vk_end_cmd(vk);
+}
+
+/* decodes levels on worker threads and submits each level's upload as soon as it is ready */
+static void
+ktx_test_draw_stream_texture(struct ktx_test *test)
+{
+    struct ktx_test_stream *stream = &test->stream_state;
+
+    stream->begin_ns = u_now();
+
+    uint32_t thread_count = u_parallel_get_thread_count();
+    if (thread_count > stream->level_count)
+        thread_count = stream->level_count;
+
+    thrd_t thrds[U_PARALLEL_MAX_THREADS];
+    for (uint32_t i = 0; i < thread_count; i++) {
+        if (thrd_create(&thrds[i], ktx_test_stream_worker, stream) != thrd_success)
+            vk_die("failed to create stream worker");
+    }
+
+    for (uint32_t i = 0; i < stream->level_count; i++) {
+        mtx_lock(&stream->mutex);
+        while (stream->ready_count == i)
+            cnd_wait(&stream->cond, &stream->mutex);
+        const uint32_t idx = stream->ready_levels[i];
+        mtx_unlock(&stream->mutex);
+
+        ktx_test_draw_upload_level(test, idx);
+
+        const struct ktx_test_stream_level *level = &stream->levels[idx];
+        vk_log("level %u: %" PRIu64 " -> %" PRIu64 " bytes, ready at %.3fms", idx,
+               level->file_size, level->size, (level->ready_ns - stream->begin_ns) / 1000000.0);
+    }
+
+    for (uint32_t i = 0; i < thread_count; i++)
+        thrd_join(thrds[i], NULL);
+}
+
+static void
+ktx_test_draw(struct ktx_test *test)
+{
+    struct vk *vk = &test->vk;
+
+    const uint64_t begin = u_now();
+
+    VkCommandBuffer cmd;
+    if (test->stream) {
+        ktx_test_draw_stream_texture(test);
+        cmd = vk_begin_cmd(vk, false);
+    } else {
+        cmd = vk_begin_cmd(vk, false);
+        ktx_test_draw_prep_texture(test, cmd);
+    }
     ktx_test_draw_quad(test, cmd);
     vk_end_cmd(vk);
     vk_wait(vk);
 
+    test->load_ns += u_now() - begin;
+    vk_log("load-to-sample latency (%s): %.3fms", test->stream ? "stream" : "load all",
+           test->load_ns / 1000000.0);
+
     vk_dump_image(vk, test->rt_img, VK_IMAGE_ASPECT_COLOR_BIT, "rt.ppm");
 }
 
@@ -501,12 +836,17 @@ main(int argc, char **argv)
     };
 
     if (argc < 2) {
-        vk_log("Usage: %s <filename.ktx> [slice]", argv[0]);
+        vk_log("Usage: %s <filename.ktx> [slice] [stream]", argv[0]);
         return -1;
     }
 
     test.filename = argv[1];
     test.slice = argc > 2 ? atoi(argv[2]) : 0;
+    test.stream = argc > 3 ? atoi(argv[3]) : true;
+#ifdef FAKEKTX
+    /* fakektx generates its data and ignores the file */
+    test.stream = false;
+#endif
 
     ktx_test_init(&test);
     ktx_test_draw(&test);
@@ -17,10 +17,15 @@ struct loop_test {
     uint32_t buf_width;
     uint32_t type_size;
     uint32_t local_size;
+    uint32_t repeat;
+
+    struct u_bench_params bench_params;
 
     struct vk vk;
 
     struct vk_pipeline *pipeline;
+    /* repeat is a specialization constant rather than a push constant */
+    struct vk_pipeline *spec_pipeline;
 
     struct vk_buffer *src;
     struct vk_buffer *dst;
@@ -39,25 +44,30 @@ loop_test_init_descriptor_set(struct loop_test *test)
                                    VK_WHOLE_SIZE);
 }
 
-static void
-loop_test_init_pipeline(struct loop_test *test)
+static struct vk_pipeline *
+loop_test_create_pipeline(struct loop_test *test, bool spec)
 {
     struct vk *vk = &test->vk;
 
-    test->pipeline = vk_create_pipeline(vk);
+    struct vk_pipeline *pipeline = vk_create_pipeline(vk);
 
-    vk_add_pipeline_shader(vk, test->pipeline, VK_SHADER_STAGE_COMPUTE_BIT, loop_test_cs,
+    vk_add_pipeline_shader(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, loop_test_cs,
                            sizeof(loop_test_cs));
+    vk_set_pipeline_spec_constant(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, 0, test->local_size);
+    if (spec)
+        vk_set_pipeline_spec_constant(vk, pipeline, VK_SHADER_STAGE_COMPUTE_BIT, 1, test->repeat);
 
-    vk_add_pipeline_set_layout(vk, test->pipeline, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+    vk_add_pipeline_set_layout(vk, pipeline, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
                                VK_SHADER_STAGE_COMPUTE_BIT, NULL);
 
-    test->pipeline->push_const = (VkPushConstantRange){
+    pipeline->push_const = (VkPushConstantRange){
         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
         .size = sizeof(struct loop_test_push_consts),
     };
 
-    vk_compile_pipeline(vk, test->pipeline);
+    vk_compile_pipeline(vk, pipeline);
+
+    return pipeline;
 }
 
 static void
@@ -76,7 +86,8 @@ loop_test_init(struct loop_test *test)
 
     vk_init(vk, NULL);
 
-    loop_test_init_pipeline(test);
+    test->pipeline = loop_test_create_pipeline(test, false);
+    test->spec_pipeline = loop_test_create_pipeline(test, true);
     loop_test_init_buffer(test);
     loop_test_init_descriptor_set(test);
 }
@@ -88,44 +99,72 @@ loop_test_cleanup(struct loop_test *test)
 
     vk_destroy_descriptor_set(vk, test->set);
     vk_destroy_buffer(vk, test->dst);
+    vk_destroy_pipeline(vk, test->spec_pipeline);
     vk_destroy_pipeline(vk, test->pipeline);
 
     vk_cleanup(vk);
 }
 
-static void
-loop_test_dispatch(struct loop_test *test)
+/* returns the gpu time in ns */
+static uint64_t
+loop_test_dispatch(struct loop_test *test, struct vk_pipeline *pipeline)
 {
     struct vk *vk = &test->vk;
+    struct vk_stopwatch *stopwatch = vk_create_stopwatch(vk, 2);
 
     VkCommandBuffer cmd = vk_begin_cmd(vk, false);
 
-    vk_bind_pipeline(vk, test->pipeline, cmd);
+    vk_bind_pipeline(vk, pipeline, cmd);
     const VkBindDescriptorSetsInfo bind_info = {
         .sType = VK_STRUCTURE_TYPE_BIND_DESCRIPTOR_SETS_INFO,
         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-        .layout = test->pipeline->layout,
+        .layout = pipeline->layout,
         .descriptorSetCount = 1,
         .pDescriptorSets = &test->set->set,
     };
     vk->CmdBindDescriptorSets2(cmd, &bind_info);
 
     const struct loop_test_push_consts consts = {
-        .repeat = 100,
+        .repeat = test->repeat,
     };
     const VkPushConstantsInfo push_info = {
         .sType = VK_STRUCTURE_TYPE_PUSH_CONSTANTS_INFO,
-        .layout = test->pipeline->layout,
+        .layout = pipeline->layout,
         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
         .size = sizeof(consts),
         .pValues = &consts,
     };
     vk->CmdPushConstants2(cmd, &push_info);
 
+    vk_write_stopwatch(vk, stopwatch, cmd);
     vk->CmdDispatch(cmd, test->buf_width / test->local_size, 1, 1);
+    vk_write_stopwatch(vk, stopwatch, cmd);
 
     vk_end_cmd(vk);
     vk_wait(vk);
+
+    const uint64_t gpu_ns = vk_read_stopwatch(vk, stopwatch, 0);
+    vk_destroy_stopwatch(vk, stopwatch);
+
+    return gpu_ns;
+}
+
+/* returns the median gpu time in ns */
+static uint64_t
+loop_test_bench(struct loop_test *test, struct vk_pipeline *pipeline)
+{
+    struct u_bench bench;
+    struct u_bench_stats stats;
+    u_bench_init(&bench, &test->bench_params);
+    while (u_bench_next(&bench))
+        u_bench_add(&bench, loop_test_dispatch(test, pipeline));
+    u_bench_finish(&bench, &stats);
+
+    char str[128];
+    vk_log("%s: %s", pipeline == test->spec_pipeline ? "spec" : "push",
+           u_bench_stats_to_str(&stats, str, sizeof(str)));
+
+    return stats.median;
 }
 
 int
@@ -135,10 +174,22 @@ main(void)
         .buf_width = 64 * 64,
         .type_size = 2 * 1,
         .local_size = 64,
+        .repeat = 100,
+
+        .bench_params = {
+            .warmup = 1,
+            .min_repeat = 5,
+            .max_repeat = 20,
+            .max_cv = 0.05f,
+        },
     };
 
     loop_test_init(&test);
-    loop_test_dispatch(&test);
+
+    const uint64_t push_ns = loop_test_bench(&test, test.pipeline);
+    const uint64_t spec_ns = loop_test_bench(&test, test.spec_pipeline);
+    vk_log("specialization speedup: %.2fx", (double)push_ns / (double)spec_ns);
+
     loop_test_cleanup(&test);
 
     return 0;
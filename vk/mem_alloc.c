@@ -3,28 +3,168 @@
  * SPDX-License-Identifier: MIT
  */
 
+/* This test measures the VkDeviceMemory allocation paths of the driver.  It first allocates and
+ * frees a fixed sequence of sizes, and then stresses the allocator with randomized sizes,
+ * interleaved allocs/frees, concurrent threads, and optional map/unmap per allocation.
+ */
+
 #include "vkutil.h"
 
+#include <sys/resource.h>
+
+enum mem_alloc_test_dist {
+    MEM_ALLOC_TEST_DIST_LOGNORMAL,
+    MEM_ALLOC_TEST_DIST_BIMODAL,
+};
+
+enum mem_alloc_test_call {
+    MEM_ALLOC_TEST_CALL_ALLOC,
+    MEM_ALLOC_TEST_CALL_FREE,
+    /* map, touch, and unmap */
+    MEM_ALLOC_TEST_CALL_MAP,
+    MEM_ALLOC_TEST_CALL_COUNT,
+};
+
+struct mem_alloc_test_thread {
+    struct mem_alloc_test *test;
+    uint32_t mt;
+    enum mem_alloc_test_dist dist;
+    bool map;
+
+    uint32_t rand_state;
+    VkDeviceMemory *mems;
+
+    /* per-call latencies */
+    struct {
+        uint64_t *ns;
+        uint32_t count;
+    } samples[MEM_ALLOC_TEST_CALL_COUNT];
+
+    VkDeviceSize peak_heap_usage;
+};
+
 struct mem_alloc_test {
     VkDeviceSize base_size;
     uint32_t order;
     uint32_t loop;
     uint32_t mt;
 
+    /* lognormal distribution */
+    VkDeviceSize median_size;
+    float sigma;
+    /* bimodal distribution */
+    VkDeviceSize small_size;
+    VkDeviceSize large_size;
+    float large_ratio;
+    VkDeviceSize max_size;
+
+    /* allocations kept alive per thread */
+    uint32_t live_count;
+    /* interleaved free/alloc pairs per thread */
+    uint32_t op_count;
+    uint32_t thread_count;
+
     struct vk vk;
+    struct u_result result;
+    bool has_memory_budget;
+
     VkDeviceMemory *mems;
+    struct mem_alloc_test_thread *threads;
 };
 
+static const char *
+mem_alloc_test_call_to_str(enum mem_alloc_test_call call)
+{
+    switch (call) {
+    case MEM_ALLOC_TEST_CALL_ALLOC:
+        return "alloc";
+    case MEM_ALLOC_TEST_CALL_FREE:
+        return "free";
+    case MEM_ALLOC_TEST_CALL_MAP:
+        return "map";
+    default:
+        vk_die("unknown call");
+    }
+}
+
+static const char *
+mem_alloc_test_dist_to_str(enum mem_alloc_test_dist dist)
+{
+    switch (dist) {
+    case MEM_ALLOC_TEST_DIST_LOGNORMAL:
+        return "lognormal";
+    case MEM_ALLOC_TEST_DIST_BIMODAL:
+        return "bimodal";
+    default:
+        vk_die("unknown dist");
+    }
+}
+
+static bool
+mem_alloc_test_has_dev_ext(struct mem_alloc_test *test, const char *name)
+{
+    struct vk *vk = &test->vk;
+
+    uint32_t ext_count;
+    vk->EnumerateDeviceExtensionProperties(vk->physical_dev, NULL, &ext_count, NULL);
+    VkExtensionProperties *exts = malloc(sizeof(*exts) * ext_count);
+    if (!exts)
+        vk_die("failed to alloc exts");
+    vk->EnumerateDeviceExtensionProperties(vk->physical_dev, NULL, &ext_count, exts);
+
+    bool found = false;
+    for (uint32_t i = 0; i < ext_count; i++) {
+        if (!strcmp(exts[i].extensionName, name)) {
+            found = true;
+            break;
+        }
+    }
+    free(exts);
+
+    return found;
+}
+
 static void
 mem_alloc_test_init(struct mem_alloc_test *test)
 {
     struct vk *vk = &test->vk;
 
     vk_init(vk, NULL);
+    vk_init_result(vk, &test->result, "mem_alloc");
+
+    /* budget queries only need the extension to be supported */
+    test->has_memory_budget =
+        mem_alloc_test_has_dev_ext(test, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+    if (!test->thread_count)
+        test->thread_count = u_parallel_get_thread_count();
+    if (test->thread_count > U_PARALLEL_MAX_THREADS)
+        test->thread_count = U_PARALLEL_MAX_THREADS;
+
+    const uint32_t max_count = vk->props.properties.limits.maxMemoryAllocationCount;
+    if (test->live_count * test->thread_count > max_count / 2)
+        vk_die("%u live allocs on %u threads exceed half of maxMemoryAllocationCount %u",
+               test->live_count, test->thread_count, max_count);
 
     test->mems = malloc(sizeof(*test->mems) * test->order);
-    if (!test->mems)
+    test->threads = calloc(test->thread_count, sizeof(*test->threads));
+    if (!test->mems || !test->threads)
         vk_die("failed to alloc mems");
+
+    const uint32_t alloc_max = test->live_count + test->op_count;
+    for (uint32_t i = 0; i < test->thread_count; i++) {
+        struct mem_alloc_test_thread *thread = &test->threads[i];
+        thread->test = test;
+        thread->mems = malloc(sizeof(*thread->mems) * test->live_count);
+        if (!thread->mems)
+            vk_die("failed to alloc thread mems");
+
+        for (uint32_t j = 0; j < MEM_ALLOC_TEST_CALL_COUNT; j++) {
+            thread->samples[j].ns = malloc(sizeof(*thread->samples[j].ns) * alloc_max);
+            if (!thread->samples[j].ns)
+                vk_die("failed to alloc thread samples");
+        }
+    }
 }
 
 static void
@@ -32,7 +172,16 @@ mem_alloc_test_cleanup(struct mem_alloc_test *test)
 {
     struct vk *vk = &test->vk;
 
+    for (uint32_t i = 0; i < test->thread_count; i++) {
+        struct mem_alloc_test_thread *thread = &test->threads[i];
+        free(thread->mems);
+        for (uint32_t j = 0; j < MEM_ALLOC_TEST_CALL_COUNT; j++)
+            free(thread->samples[j].ns);
+    }
+    free(test->threads);
     free(test->mems);
+
+    u_result_cleanup(&test->result);
     vk_cleanup(vk);
 }
 
@@ -67,6 +216,349 @@ mem_alloc_test_loop(struct mem_alloc_test *test)
            (unsigned)(total_size / 1024 / 1024), us / 1000.0f);
 }
 
+static uint32_t
+mem_alloc_test_rand(struct mem_alloc_test_thread *thread)
+{
+    /* xorshift32 */
+    uint32_t x = thread->rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    thread->rand_state = x;
+    return x;
+}
+
+/* in (0, 1] */
+static double
+mem_alloc_test_rand_unorm(struct mem_alloc_test_thread *thread)
+{
+    return ((double)mem_alloc_test_rand(thread) + 1.0) / 4294967296.0;
+}
+
+static VkDeviceSize
+mem_alloc_test_rand_size(struct mem_alloc_test_thread *thread)
+{
+    const struct mem_alloc_test *test = thread->test;
+
+    double size;
+    switch (thread->dist) {
+    case MEM_ALLOC_TEST_DIST_LOGNORMAL: {
+        /* box-muller */
+        const double u1 = mem_alloc_test_rand_unorm(thread);
+        const double u2 = mem_alloc_test_rand_unorm(thread);
+        const double n = sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+        size = (double)test->median_size * exp(test->sigma * n);
+        break;
+    }
+    case MEM_ALLOC_TEST_DIST_BIMODAL: {
+        const bool large = mem_alloc_test_rand_unorm(thread) <= test->large_ratio;
+        const VkDeviceSize mode = large ? test->large_size : test->small_size;
+        /* within +-50% of the mode */
+        size = (double)mode * (0.5 + mem_alloc_test_rand_unorm(thread));
+        break;
+    }
+    default:
+        vk_die("unknown dist");
+    }
+
+    if (size > (double)test->max_size)
+        size = (double)test->max_size;
+
+    return ALIGN((VkDeviceSize)size + 1, 4096);
+}
+
+/* returns the usage and sets the budget of the heap of the memory type */
+static VkDeviceSize
+mem_alloc_test_get_heap_usage(struct mem_alloc_test *test, uint32_t mt, VkDeviceSize *budget)
+{
+    struct vk *vk = &test->vk;
+
+    if (!test->has_memory_budget) {
+        if (budget)
+            *budget = 0;
+        return 0;
+    }
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_props = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+    };
+    VkPhysicalDeviceMemoryProperties2 props2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+        .pNext = &budget_props,
+    };
+    vk->GetPhysicalDeviceMemoryProperties2(vk->physical_dev, &props2);
+
+    const uint32_t heap = vk->mem_props.memoryTypes[mt].heapIndex;
+    if (budget)
+        *budget = budget_props.heapBudget[heap];
+    return budget_props.heapUsage[heap];
+}
+
+/* resets the peak rss, when the kernel allows */
+static void
+mem_alloc_test_reset_peak_rss(void)
+{
+    FILE *fp = fopen("/proc/self/clear_refs", "w");
+    if (!fp)
+        return;
+    fputs("5", fp);
+    fclose(fp);
+}
+
+/* in KiB */
+static uint64_t
+mem_alloc_test_get_peak_rss(void)
+{
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (fp) {
+        char line[256];
+        uint64_t kib = 0;
+        while (fgets(line, sizeof(line), fp)) {
+            if (sscanf(line, "VmHWM: %" SCNu64, &kib) == 1)
+                break;
+        }
+        fclose(fp);
+
+        if (kib)
+            return kib;
+    }
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage))
+        return 0;
+    return (uint64_t)usage.ru_maxrss;
+}
+
+static void
+mem_alloc_test_add_sample(struct mem_alloc_test_thread *thread,
+                          enum mem_alloc_test_call call,
+                          uint64_t ns)
+{
+    thread->samples[call].ns[thread->samples[call].count++] = ns;
+}
+
+static void
+mem_alloc_test_alloc_one(struct mem_alloc_test_thread *thread, uint32_t slot)
+{
+    struct mem_alloc_test *test = thread->test;
+    struct vk *vk = &test->vk;
+
+    const VkDeviceSize size = mem_alloc_test_rand_size(thread);
+    const VkMemoryAllocateInfo alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = size,
+        .memoryTypeIndex = thread->mt,
+    };
+
+    const uint64_t begin = u_now();
+    const VkResult result = vk->AllocateMemory(vk->dev, &alloc_info, NULL, &thread->mems[slot]);
+    const uint64_t end = u_now();
+    if (result != VK_SUCCESS)
+        vk_die("failed to allocate memory of size %zu: %d", (size_t)size, result);
+
+    mem_alloc_test_add_sample(thread, MEM_ALLOC_TEST_CALL_ALLOC, end - begin);
+
+    if (thread->map) {
+        const VkMemoryMapInfo map_info = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_MAP_INFO,
+            .memory = thread->mems[slot],
+            .size = VK_WHOLE_SIZE,
+        };
+        const VkMemoryUnmapInfo unmap_info = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_UNMAP_INFO,
+            .memory = thread->mems[slot],
+        };
+
+        void *ptr;
+        const uint64_t map_begin = u_now();
+        const VkResult map_result = vk->MapMemory2(vk->dev, &map_info, &ptr);
+        /* fault in the first page */
+        if (map_result == VK_SUCCESS)
+            *(volatile uint32_t *)ptr = 0;
+        vk->UnmapMemory2(vk->dev, &unmap_info);
+        const uint64_t map_end = u_now();
+        if (map_result != VK_SUCCESS)
+            vk_die("failed to map memory: %d", map_result);
+
+        mem_alloc_test_add_sample(thread, MEM_ALLOC_TEST_CALL_MAP, map_end - map_begin);
+    }
+}
+
+static void
+mem_alloc_test_free_one(struct mem_alloc_test_thread *thread, uint32_t slot)
+{
+    struct mem_alloc_test *test = thread->test;
+    struct vk *vk = &test->vk;
+
+    const uint64_t begin = u_now();
+    vk->FreeMemory(vk->dev, thread->mems[slot], NULL);
+    const uint64_t end = u_now();
+
+    mem_alloc_test_add_sample(thread, MEM_ALLOC_TEST_CALL_FREE, end - begin);
+    thread->mems[slot] = VK_NULL_HANDLE;
+}
+
+static void
+mem_alloc_test_stress_thread(struct mem_alloc_test_thread *thread)
+{
+    struct mem_alloc_test *test = thread->test;
+
+    for (uint32_t i = 0; i < MEM_ALLOC_TEST_CALL_COUNT; i++)
+        thread->samples[i].count = 0;
+    thread->peak_heap_usage = 0;
+
+    for (uint32_t i = 0; i < test->live_count; i++)
+        mem_alloc_test_alloc_one(thread, i);
+
+    for (uint32_t i = 0; i < test->op_count; i++) {
+        const uint32_t slot = mem_alloc_test_rand(thread) % test->live_count;
+        mem_alloc_test_free_one(thread, slot);
+        mem_alloc_test_alloc_one(thread, slot);
+
+        /* heap usage is global and any thread can sample its peak */
+        if (i % 64 == 0) {
+            const VkDeviceSize usage = mem_alloc_test_get_heap_usage(test, thread->mt, NULL);
+            if (thread->peak_heap_usage < usage)
+                thread->peak_heap_usage = usage;
+        }
+    }
+
+    for (uint32_t i = 0; i < test->live_count; i++)
+        mem_alloc_test_free_one(thread, i);
+}
+
+static void
+mem_alloc_test_stress_threads(void *data, uint32_t begin, uint32_t end)
+{
+    struct mem_alloc_test *test = data;
+
+    for (uint32_t i = begin; i < end; i++)
+        mem_alloc_test_stress_thread(&test->threads[i]);
+}
+
+static void
+mem_alloc_test_calc_stats(struct mem_alloc_test *test,
+                          uint32_t thread_count,
+                          enum mem_alloc_test_call call,
+                          struct u_bench_stats *stats)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < thread_count; i++)
+        count += test->threads[i].samples[call].count;
+
+    uint64_t *samples = malloc(sizeof(*samples) * count);
+    if (!samples)
+        vk_die("failed to alloc samples");
+
+    count = 0;
+    for (uint32_t i = 0; i < thread_count; i++) {
+        const struct mem_alloc_test_thread *thread = &test->threads[i];
+        memcpy(samples + count, thread->samples[call].ns,
+               sizeof(*samples) * thread->samples[call].count);
+        count += thread->samples[call].count;
+    }
+
+    u_bench_calc_stats(samples, count, stats);
+    free(samples);
+}
+
+static void
+mem_alloc_test_stress(struct mem_alloc_test *test,
+                      enum mem_alloc_test_dist dist,
+                      uint32_t thread_count,
+                      bool map)
+{
+    struct vk *vk = &test->vk;
+
+    /* mapping needs a host-visible type */
+    const uint32_t mt = map ? (uint32_t)(ffs(vk->buf_mt_mask) - 1) : test->mt;
+    if (map && !vk->buf_mt_mask)
+        vk_die("no host-visible memory type");
+
+    for (uint32_t i = 0; i < thread_count; i++) {
+        struct mem_alloc_test_thread *thread = &test->threads[i];
+        thread->mt = mt;
+        thread->dist = dist;
+        thread->map = map;
+        thread->rand_state = 0x9e3779b9u * (i + 1);
+    }
+
+    const VkDeviceSize base_usage = mem_alloc_test_get_heap_usage(test, mt, NULL);
+    mem_alloc_test_reset_peak_rss();
+
+    const uint64_t begin = u_now();
+    u_parallel_for(thread_count, 1, thread_count, mem_alloc_test_stress_threads, test);
+    const uint64_t end = u_now();
+
+    const uint64_t peak_rss = mem_alloc_test_get_peak_rss();
+    VkDeviceSize budget;
+    mem_alloc_test_get_heap_usage(test, mt, &budget);
+
+    VkDeviceSize peak_usage = 0;
+    uint32_t alloc_count = 0;
+    for (uint32_t i = 0; i < thread_count; i++) {
+        const struct mem_alloc_test_thread *thread = &test->threads[i];
+        if (peak_usage < thread->peak_heap_usage)
+            peak_usage = thread->peak_heap_usage;
+        alloc_count += thread->samples[MEM_ALLOC_TEST_CALL_ALLOC].count;
+    }
+    peak_usage = peak_usage > base_usage ? peak_usage - base_usage : 0;
+
+    const char *dist_str = mem_alloc_test_dist_to_str(dist);
+    const double allocs_per_sec = alloc_count * 1000000000.0 / (double)(end - begin);
+
+    vk_log("%s, %u threads, mt %u%s: %.0f allocs/s, peak rss %.1f MiB", dist_str, thread_count,
+           mt, map ? ", map" : "", allocs_per_sec, peak_rss / 1024.0);
+    if (test->has_memory_budget) {
+        vk_log("  heap: peak usage %.1f MiB of budget %.1f MiB", peak_usage / 1024.0 / 1024.0,
+               budget / 1024.0 / 1024.0);
+    }
+
+    struct u_result *res = &test->result;
+    u_result_clear_params(res);
+    u_result_set_param(res, "dist", "%s", dist_str);
+    u_result_set_param(res, "threads", "%u", thread_count);
+    u_result_set_param(res, "mt", "%u", mt);
+    u_result_set_param(res, "map", "%d", map);
+    u_result_set_param(res, "live_count", "%u", test->live_count);
+    u_result_add(res, "allocs_per_sec", allocs_per_sec, "1/s");
+    u_result_add(res, "peak_rss", (double)peak_rss, "KiB");
+    if (test->has_memory_budget)
+        u_result_add(res, "peak_heap_usage", (double)peak_usage, "B");
+
+    const uint32_t call_count = map ? MEM_ALLOC_TEST_CALL_COUNT : MEM_ALLOC_TEST_CALL_MAP;
+    for (uint32_t i = 0; i < call_count; i++) {
+        const char *call_str = mem_alloc_test_call_to_str(i);
+
+        struct u_bench_stats stats;
+        mem_alloc_test_calc_stats(test, thread_count, i, &stats);
+
+        char str[128];
+        vk_log("  %s: %s", call_str, u_bench_stats_to_str(&stats, str, sizeof(str)));
+
+        char metric[32];
+        snprintf(metric, sizeof(metric), "%s_latency", call_str);
+        u_result_add_bench_stats(res, metric, &stats);
+    }
+}
+
+static void
+mem_alloc_test_stress_all(struct mem_alloc_test *test)
+{
+    static const enum mem_alloc_test_dist dists[] = {
+        MEM_ALLOC_TEST_DIST_LOGNORMAL,
+        MEM_ALLOC_TEST_DIST_BIMODAL,
+    };
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(dists); i++) {
+        for (uint32_t map = 0; map < 2; map++) {
+            mem_alloc_test_stress(test, dists[i], 1, map);
+            if (test->thread_count > 1)
+                mem_alloc_test_stress(test, dists[i], test->thread_count, map);
+        }
+    }
+}
+
 int
 main(int argc, char **argv)
 {
@@ -75,10 +567,30 @@ main(int argc, char **argv)
         .order = 10,
         .loop = 8,
         .mt = 0,
+
+        .median_size = 64 * 1024,
+        .sigma = 1.5f,
+        .small_size = 16 * 1024,
+        .large_size = 2 * 1024 * 1024,
+        .large_ratio = 0.1f,
+        .max_size = 64 * 1024 * 1024,
+
+        .live_count = 128,
+        .op_count = 2048,
     };
 
+    if (argc > 3)
+        vk_die("usage: %s [<live-count> [<thread-count>]]", argv[0]);
+    if (argc > 1)
+        test.live_count = atoi(argv[1]);
+    if (argc > 2)
+        test.thread_count = atoi(argv[2]);
+    if (!test.live_count)
+        vk_die("bad live count");
+
     mem_alloc_test_init(&test);
     mem_alloc_test_loop(&test);
+    mem_alloc_test_stress_all(&test);
     mem_alloc_test_cleanup(&test);
 
     return 0;
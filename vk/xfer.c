@@ -18,6 +18,8 @@ struct xfer_test {
     uint32_t buf_count;
     struct vk_image *imgs[4];
     uint32_t img_count;
+
+    struct u_result result;
 };
 
 struct xfer_test_format {
@@ -117,6 +119,7 @@ xfer_test_init(struct xfer_test *test)
     struct vk *vk = &test->vk;
 
     vk_init(vk, NULL);
+    vk_init_result(vk, &test->result, "xfer");
     xfer_test_init_formats(test);
 }
 
@@ -125,9 +128,29 @@ xfer_test_cleanup(struct xfer_test *test)
 {
     struct vk *vk = &test->vk;
 
+    u_result_cleanup(&test->result);
     vk_cleanup(vk);
 }
 
+static void
+xfer_test_set_result_params(struct xfer_test *test,
+                            const char *op,
+                            const struct xfer_test_format *fmt,
+                            VkImageTiling tiling)
+{
+    struct u_result *res = &test->result;
+
+    u_result_clear_params(res);
+    u_result_set_param(res, "op", "%s", op);
+    u_result_set_param(res, "buf_size", "%" PRIu64, (uint64_t)test->buf_size);
+    if (fmt) {
+        u_result_set_param(res, "format", "%s", fmt->name);
+        u_result_set_param(res, "tiling", "%s", tiling ? "linear" : "optimal");
+        u_result_set_param(res, "width", "%u", test->img_width);
+        u_result_set_param(res, "height", "%u", test->img_height);
+    }
+}
+
 static VkCommandBuffer
 xfer_test_begin_cmd(struct xfer_test *test)
 {
@@ -210,8 +233,12 @@ xfer_test_end_all(struct xfer_test *test)
 {
     struct vk *vk = &test->vk;
 
+    const uint64_t begin = u_now();
     vk_end_cmd(vk);
     vk_wait(vk);
+    const uint64_t end = u_now();
+
+    u_result_add(&test->result, "submit_time", (double)(end - begin), "ns");
 
     test->cmd = NULL;
 
@@ -229,6 +256,8 @@ xfer_test_draw_fill_buffer(struct xfer_test *test)
 {
     struct vk *vk = &test->vk;
 
+    xfer_test_set_result_params(test, "vkCmdFillBuffer", NULL, VK_IMAGE_TILING_OPTIMAL);
+
     VkCommandBuffer cmd = xfer_test_begin_cmd(test);
     struct vk_buffer *buf = xfer_test_begin_buffer(test, VK_BUFFER_USAGE_2_TRANSFER_DST_BIT);
 
@@ -243,6 +272,8 @@ xfer_test_draw_update_buffer(struct xfer_test *test)
     struct vk *vk = &test->vk;
     const uint32_t data[] = { 0x37, 0x38, 0x39, 0x40 };
 
+    xfer_test_set_result_params(test, "vkCmdUpdateBuffer", NULL, VK_IMAGE_TILING_OPTIMAL);
+
     VkCommandBuffer cmd = xfer_test_begin_cmd(test);
     struct vk_buffer *buf = xfer_test_begin_buffer(test, VK_BUFFER_USAGE_2_TRANSFER_DST_BIT);
 
@@ -256,6 +287,8 @@ xfer_test_draw_copy_buffer(struct xfer_test *test)
 {
     struct vk *vk = &test->vk;
 
+    xfer_test_set_result_params(test, "vkCmdCopyBuffer2", NULL, VK_IMAGE_TILING_OPTIMAL);
+
     VkCommandBuffer cmd = xfer_test_begin_cmd(test);
     struct vk_buffer *buf = xfer_test_begin_buffer(
         test, VK_BUFFER_USAGE_2_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_2_TRANSFER_DST_BIT);
@@ -435,6 +468,8 @@ xfer_test_draw_copy_image_to_buffer(struct xfer_test *test,
     if (test->verbose)
         vk_log("  copy %s image to buffer", tiling ? "linear" : "optimal");
 
+    xfer_test_set_result_params(test, "vkCmdCopyImageToBuffer2", fmt, tiling);
+
     VkBufferImageCopy2 regions[4];
     const uint32_t region_count = xfer_test_get_buffer_image_copy(test, fmt, regions);
 
@@ -467,6 +502,8 @@ xfer_test_draw_copy_buffer_to_image(struct xfer_test *test,
     if (test->verbose)
         vk_log("  copy buffer to %s image", tiling ? "linear" : "optimal");
 
+    xfer_test_set_result_params(test, "vkCmdCopyBufferToImage2", fmt, tiling);
+
     VkBufferImageCopy2 regions[4];
     const uint32_t region_count = xfer_test_get_buffer_image_copy(test, fmt, regions);
 
@@ -509,6 +546,8 @@ xfer_test_draw_clear_color_image(struct xfer_test *test,
     if (test->verbose)
         vk_log("  clear %s color image", tiling ? "linear" : "optimal");
 
+    xfer_test_set_result_params(test, "vkCmdClearColorImage", fmt, tiling);
+
     /* VUID-vkCmdClearColorImage-aspectMask-02498
      * The VkImageSubresourceRange::aspectMask members of the elements of the
      * pRanges array must each only include VK_IMAGE_ASPECT_COLOR_BIT
@@ -548,6 +587,8 @@ xfer_test_draw_clear_depth_stencil_image(struct xfer_test *test,
     if (test->verbose)
         vk_log("  clear %s depth/stencil image", tiling ? "linear" : "optimal");
 
+    xfer_test_set_result_params(test, "vkCmdClearDepthStencilImage", fmt, tiling);
+
     /* VUID-vkCmdClearDepthStencilImage-image-02825
      * If the image’s format does not have a stencil component, then the
      * VkImageSubresourceRange::aspectMask member of each element of the
@@ -716,6 +757,10 @@ xfer_test_draw_copy_image(struct xfer_test *test,
                dst_tiling ? "linear" : "optimal");
     }
 
+    xfer_test_set_result_params(test, "vkCmdCopyImage2", src_fmt, src_tiling);
+    u_result_set_param(&test->result, "dst_format", "%s", dst_fmt->name);
+    u_result_set_param(&test->result, "dst_tiling", "%s", dst_tiling ? "linear" : "optimal");
+
     VkCommandBuffer cmd = xfer_test_begin_cmd(test);
     struct vk_image *src_img = xfer_test_begin_image(test, src_fmt, VK_SAMPLE_COUNT_1_BIT,
                                                      src_tiling, VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
@@ -869,6 +914,10 @@ xfer_test_draw_blit_image(struct xfer_test *test,
                dst_tiling ? "linear" : "optimal");
     }
 
+    xfer_test_set_result_params(test, "vkCmdBlitImage2", src_fmt, src_tiling);
+    u_result_set_param(&test->result, "dst_format", "%s", dst_fmt->name);
+    u_result_set_param(&test->result, "dst_tiling", "%s", dst_tiling ? "linear" : "optimal");
+
     /* VUID-vkCmdBlitImage-srcImage-00232
      * If srcImage was created with a depth/stencil format, filter must be
      * VK_FILTER_NEAREST
@@ -929,6 +978,8 @@ xfer_test_draw_resolve_image(struct xfer_test *test,
     if (test->verbose)
         vk_log("  resolve %s image", tiling ? "linear" : "optimal");
 
+    xfer_test_set_result_params(test, "vkCmdResolveImage2", fmt, tiling);
+
     VkCommandBuffer cmd = xfer_test_begin_cmd(test);
     struct vk_image *src_img =
         xfer_test_begin_image(test, fmt, samples, tiling, VK_IMAGE_USAGE_TRANSFER_SRC_BIT,